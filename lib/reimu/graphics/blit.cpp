@@ -0,0 +1,680 @@
+#include "blit.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REIMU_BLIT_X86
+#include <immintrin.h>
+#endif
+
+namespace reimu::graphics::blit {
+
+namespace {
+
+// Divides 'x' (at most 255 * 255) by 255, rounding to nearest
+inline uint32_t div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// 'a' * (255 - 'weight') + 'b' * 'weight' per channel, divided by 255
+inline uint32_t lerp_pixel(uint32_t a, uint32_t b, uint32_t weight) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t ca = (a >> shift) & 0xff;
+        uint32_t cb = (b >> shift) & 0xff;
+
+        result |= div255(ca * (255 - weight) + cb * weight) << shift;
+    }
+
+    return result;
+}
+
+// Each channel of 'pixel' times 'weight' divided by 255, two channels at a time in 16-bit lanes
+inline uint32_t scale_pixel(uint32_t pixel, uint32_t weight) {
+    uint32_t rb = (pixel & 0x00ff00ff) * weight + 0x00800080;
+    uint32_t ag = ((pixel >> 8) & 0x00ff00ff) * weight + 0x00800080;
+
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+
+    return rb | ag;
+}
+
+// Add each channel, saturating at 255
+inline uint32_t add_pixel_saturate(uint32_t a, uint32_t b) {
+    uint32_t rb = (a & 0x00ff00ff) + (b & 0x00ff00ff);
+    uint32_t ag = ((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff);
+
+    // Carries out of a channel set all of its bits
+    uint32_t rb_carry = rb & 0x01000100;
+    uint32_t ag_carry = ag & 0x01000100;
+    rb = (rb | (rb_carry - (rb_carry >> 8))) & 0x00ff00ff;
+    ag = (ag | (ag_carry - (ag_carry >> 8))) & 0x00ff00ff;
+
+    return rb | ag << 8;
+}
+
+// Premultiplied source over, saturating each channel like the SIMD versions
+inline uint32_t over_pixel(uint32_t dest, uint32_t color) {
+    return add_pixel_saturate(scale_pixel(dest, 255 - (color >> 24)), color);
+}
+
+inline uint32_t gradient_weight(float t) {
+    float f = t * 255.f;
+
+    // Written so that NaN gives 0, the same as the SIMD versions
+    f = f > 0.f ? f : 0.f;
+    f = f < 255.f ? f : 255.f;
+
+    return (uint32_t)f;
+}
+
+void fill_span_scalar(uint32_t *dest, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; i++) {
+        dest[i] = color;
+    }
+}
+
+void blend_span_scalar(uint32_t *dest, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+
+    for (size_t i = 0; i < count; i++) {
+        dest[i] = lerp_pixel(dest[i], color, alpha);
+    }
+}
+
+void gradient_span_scalar(uint32_t *dest, size_t count, uint32_t c1, uint32_t c2,
+        float t, float dt, int x) {
+    for (size_t i = 0; i < count; i++) {
+        float pixel_t = (float)(x + (int)i) * dt + t;
+        dest[i] = lerp_pixel(c1, c2, gradient_weight(pixel_t));
+    }
+}
+
+void over_span_scalar(uint32_t *dest, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; i++) {
+        dest[i] = over_pixel(dest[i], color);
+    }
+}
+
+void multiply_span_scalar(uint32_t *dest, size_t count, uint32_t color) {
+    uint32_t src_alpha = color >> 24;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t pixel = dest[i];
+        uint32_t dest_alpha = pixel >> 24;
+
+        uint32_t result = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            uint32_t c = (color >> shift) & 0xff;
+            uint32_t d = (pixel >> shift) & 0xff;
+
+            // c * d + c * (1 - da) + d * (1 - sa)
+            result |= div255(d * (c + 255 - src_alpha) + c * (255 - dest_alpha)) << shift;
+        }
+
+        dest[i] = result;
+    }
+}
+
+void coverage_span_scalar(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color) {
+    bool is_opaque = (color >> 24) == 0xff;
+
+    for (size_t i = 0; i < count; i++) {
+        if (coverage[i] == 0xff && is_opaque) {
+            dest[i] = color;
+        } else if (coverage[i]) {
+            dest[i] = over_pixel(dest[i], scale_pixel(color, coverage[i]));
+        }
+    }
+}
+
+void composite_span_scalar(uint32_t *dest, const uint32_t *src, size_t count, uint32_t opacity) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t color = opacity == 0xff ? src[i] : scale_pixel(src[i], opacity);
+        dest[i] = over_pixel(dest[i], color);
+    }
+}
+
+using FillSpanFn = void (*)(uint32_t *dest, size_t count, uint32_t color);
+using CoverageSpanFn = void (*)(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color);
+using GradientSpanFn = void (*)(uint32_t *dest, size_t count, uint32_t c1, uint32_t c2,
+    float t, float dt, int x);
+using CompositeSpanFn = void (*)(uint32_t *dest, const uint32_t *src, size_t count, uint32_t opacity);
+
+struct Kernels {
+    FillSpanFn fill;
+    FillSpanFn blend;
+    GradientSpanFn gradient;
+    FillSpanFn over;
+    FillSpanFn multiply;
+    CoverageSpanFn coverage;
+    CompositeSpanFn composite;
+};
+
+#ifdef REIMU_BLIT_X86
+
+__attribute__((target("sse2")))
+inline __m128i div255_epi16(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+inline __m256i div255_epi16(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+void fill_span_sse2(uint32_t *dest, size_t count, uint32_t color) {
+    __m128i value = _mm_set1_epi32(color);
+
+    // Align to 16 bytes so the main loop uses aligned stores
+    size_t i = 0;
+    while (i < count && ((uintptr_t)(dest + i) & 15)) {
+        dest[i++] = color;
+    }
+
+    for (; i + 8 <= count; i += 8) {
+        _mm_store_si128((__m128i *)(dest + i), value);
+        _mm_store_si128((__m128i *)(dest + i + 4), value);
+    }
+
+    for (; i + 4 <= count; i += 4) {
+        _mm_store_si128((__m128i *)(dest + i), value);
+    }
+
+    fill_span_scalar(dest + i, count - i, color);
+}
+
+__attribute__((target("sse2")))
+void blend_span_sse2(uint32_t *dest, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inv_alpha = _mm_set1_epi16(255 - alpha);
+    const __m128i src = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32(color), zero),
+        _mm_set1_epi16(alpha));
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(dest + i));
+
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+        lo = div255_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, inv_alpha), src));
+        hi = div255_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, inv_alpha), src));
+
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+    }
+
+    blend_span_scalar(dest + i, count - i, color);
+}
+
+__attribute__((target("sse2")))
+void gradient_span_sse2(uint32_t *dest, size_t count, uint32_t c1, uint32_t c2,
+        float t, float dt, int x) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max_weight = _mm_set1_epi16(255);
+
+    const __m128i color1 = _mm_unpacklo_epi8(_mm_set1_epi32(c1), zero);
+    const __m128i color2 = _mm_unpacklo_epi8(_mm_set1_epi32(c2), zero);
+
+    const __m128 t_start = _mm_set1_ps(t);
+    const __m128 t_step = _mm_set1_ps(dt);
+
+    __m128i index = _mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3));
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 pixel_t = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(index), t_step), t_start);
+        index = _mm_add_epi32(index, _mm_set1_epi32(4));
+
+        __m128 f = _mm_mul_ps(pixel_t, _mm_set1_ps(255.f));
+        f = _mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), _mm_set1_ps(255.f));
+
+        // Spread each pixel's weight across its four 16-bit channels
+        __m128i weight = _mm_cvttps_epi32(f);
+        weight = _mm_or_si128(weight, _mm_slli_epi32(weight, 16));
+
+        __m128i weight_lo = _mm_unpacklo_epi32(weight, weight);
+        __m128i weight_hi = _mm_unpackhi_epi32(weight, weight);
+
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(color1, _mm_sub_epi16(max_weight, weight_lo)),
+            _mm_mullo_epi16(color2, weight_lo));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(color1, _mm_sub_epi16(max_weight, weight_hi)),
+            _mm_mullo_epi16(color2, weight_hi));
+
+        _mm_storeu_si128((__m128i *)(dest + i),
+            _mm_packus_epi16(div255_epi16(lo), div255_epi16(hi)));
+    }
+
+    gradient_span_scalar(dest + i, count - i, c1, c2, t, dt, x + (int)i);
+}
+
+__attribute__((target("sse2")))
+void over_span_sse2(uint32_t *dest, size_t count, uint32_t color) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inv_alpha = _mm_set1_epi16(255 - (color >> 24));
+    const __m128i src = _mm_set1_epi32(color);
+
+    // The color is already scaled by its alpha, so only the destination is multiplied
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(dest + i));
+
+        __m128i lo = div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), inv_alpha));
+        __m128i hi = div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), inv_alpha));
+
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_adds_epu8(_mm_packus_epi16(lo, hi), src));
+    }
+
+    over_span_scalar(dest + i, count - i, color);
+}
+
+__attribute__((target("sse2")))
+void multiply_span_sse2(uint32_t *dest, size_t count, uint32_t color) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max_alpha = _mm_set1_epi16(255);
+
+    const __m128i src = _mm_unpacklo_epi8(_mm_set1_epi32(color), zero);
+    const __m128i dest_factor = _mm_add_epi16(src, _mm_set1_epi16(255 - (color >> 24)));
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(dest + i));
+
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+        // Each pixel's alpha in all four of its channels
+        __m128i alpha_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+        __m128i alpha_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, dest_factor),
+            _mm_mullo_epi16(src, _mm_sub_epi16(max_alpha, alpha_lo)));
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, dest_factor),
+            _mm_mullo_epi16(src, _mm_sub_epi16(max_alpha, alpha_hi)));
+
+        _mm_storeu_si128((__m128i *)(dest + i),
+            _mm_packus_epi16(div255_epi16(lo), div255_epi16(hi)));
+    }
+
+    multiply_span_scalar(dest + i, count - i, color);
+}
+
+__attribute__((target("sse2")))
+void coverage_span_sse2(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max_alpha = _mm_set1_epi16(255);
+    const __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32(color), zero);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t coverage4;
+        memcpy(&coverage4, coverage + i, 4);
+
+        // Glyph bitmaps are mostly empty
+        if (coverage4 == 0) {
+            continue;
+        }
+
+        // Each pixel's coverage in all four of its channels
+        __m128i c = _mm_cvtsi32_si128(coverage4);
+        c = _mm_unpacklo_epi8(c, c);
+        c = _mm_unpacklo_epi16(c, c);
+
+        __m128i src_lo = div255_epi16(_mm_mullo_epi16(color16, _mm_unpacklo_epi8(c, zero)));
+        __m128i src_hi = div255_epi16(_mm_mullo_epi16(color16, _mm_unpackhi_epi8(c, zero)));
+
+        __m128i inv_lo = _mm_sub_epi16(max_alpha, _mm_shufflehi_epi16(_mm_shufflelo_epi16(src_lo, 0xff), 0xff));
+        __m128i inv_hi = _mm_sub_epi16(max_alpha, _mm_shufflehi_epi16(_mm_shufflelo_epi16(src_hi, 0xff), 0xff));
+
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(dest + i));
+
+        __m128i lo = _mm_add_epi16(div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), inv_lo)), src_lo);
+        __m128i hi = _mm_add_epi16(div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), inv_hi)), src_hi);
+
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+    }
+
+    coverage_span_scalar(dest + i, coverage + i, count - i, color);
+}
+
+// Source over for 16-bit channels of two pixels, with each source alpha in its own lanes
+__attribute__((target("sse2")))
+inline __m128i over_epi16(__m128i dest, __m128i src, __m128i opacity, bool has_opacity) {
+    if (has_opacity) {
+        src = div255_epi16(_mm_mullo_epi16(src, opacity));
+    }
+
+    __m128i inv_alpha = _mm_sub_epi16(_mm_set1_epi16(255),
+        _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xff), 0xff));
+
+    return _mm_add_epi16(div255_epi16(_mm_mullo_epi16(dest, inv_alpha)), src);
+}
+
+__attribute__((target("sse2")))
+void composite_span_sse2(uint32_t *dest, const uint32_t *src, size_t count, uint32_t opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opacity16 = _mm_set1_epi16(opacity);
+    bool has_opacity = opacity != 0xff;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(dest + i));
+        __m128i colors = _mm_loadu_si128((const __m128i *)(src + i));
+
+        __m128i lo = over_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_unpacklo_epi8(colors, zero),
+            opacity16, has_opacity);
+        __m128i hi = over_epi16(_mm_unpackhi_epi8(pixels, zero), _mm_unpackhi_epi8(colors, zero),
+            opacity16, has_opacity);
+
+        // Packing saturates, like the scalar version
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+    }
+
+    composite_span_scalar(dest + i, src + i, count - i, opacity);
+}
+
+__attribute__((target("avx2")))
+void fill_span_avx2(uint32_t *dest, size_t count, uint32_t color) {
+    __m256i value = _mm256_set1_epi32(color);
+
+    size_t i = 0;
+    while (i < count && ((uintptr_t)(dest + i) & 31)) {
+        dest[i++] = color;
+    }
+
+    for (; i + 16 <= count; i += 16) {
+        _mm256_store_si256((__m256i *)(dest + i), value);
+        _mm256_store_si256((__m256i *)(dest + i + 8), value);
+    }
+
+    for (; i + 8 <= count; i += 8) {
+        _mm256_store_si256((__m256i *)(dest + i), value);
+    }
+
+    fill_span_scalar(dest + i, count - i, color);
+}
+
+__attribute__((target("avx2")))
+void blend_span_avx2(uint32_t *dest, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i inv_alpha = _mm256_set1_epi16(255 - alpha);
+    const __m256i src = _mm256_mullo_epi16(_mm256_unpacklo_epi8(_mm256_set1_epi32(color), zero),
+        _mm256_set1_epi16(alpha));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(dest + i));
+
+        // Unpacking and packing both work within 128-bit lanes, so pixel order is kept
+        __m256i lo = _mm256_unpacklo_epi8(pixels, zero);
+        __m256i hi = _mm256_unpackhi_epi8(pixels, zero);
+
+        lo = div255_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, inv_alpha), src));
+        hi = div255_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, inv_alpha), src));
+
+        _mm256_storeu_si256((__m256i *)(dest + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    // GCC doesn't clear the upper halves before tail calls, which makes the SSE2 tail slow
+    _mm256_zeroupper();
+    blend_span_sse2(dest + i, count - i, color);
+}
+
+__attribute__((target("avx2")))
+void gradient_span_avx2(uint32_t *dest, size_t count, uint32_t c1, uint32_t c2,
+        float t, float dt, int x) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_weight = _mm256_set1_epi16(255);
+
+    const __m256i color1 = _mm256_unpacklo_epi8(_mm256_set1_epi32(c1), zero);
+    const __m256i color2 = _mm256_unpacklo_epi8(_mm256_set1_epi32(c2), zero);
+
+    const __m256 t_start = _mm256_set1_ps(t);
+    const __m256 t_step = _mm256_set1_ps(dt);
+
+    __m256i index = _mm256_add_epi32(_mm256_set1_epi32(x), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 pixel_t = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(index), t_step), t_start);
+        index = _mm256_add_epi32(index, _mm256_set1_epi32(8));
+
+        __m256 f = _mm256_mul_ps(pixel_t, _mm256_set1_ps(255.f));
+        f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), _mm256_set1_ps(255.f));
+
+        __m256i weight = _mm256_cvttps_epi32(f);
+        weight = _mm256_or_si256(weight, _mm256_slli_epi32(weight, 16));
+
+        // Pixels 0, 1, 4, 5 in lo and 2, 3, 6, 7 in hi, packing puts them back in order
+        __m256i weight_lo = _mm256_unpacklo_epi32(weight, weight);
+        __m256i weight_hi = _mm256_unpackhi_epi32(weight, weight);
+
+        __m256i lo = _mm256_add_epi16(
+            _mm256_mullo_epi16(color1, _mm256_sub_epi16(max_weight, weight_lo)),
+            _mm256_mullo_epi16(color2, weight_lo));
+        __m256i hi = _mm256_add_epi16(
+            _mm256_mullo_epi16(color1, _mm256_sub_epi16(max_weight, weight_hi)),
+            _mm256_mullo_epi16(color2, weight_hi));
+
+        _mm256_storeu_si256((__m256i *)(dest + i),
+            _mm256_packus_epi16(div255_epi16(lo), div255_epi16(hi)));
+    }
+
+    _mm256_zeroupper();
+    gradient_span_scalar(dest + i, count - i, c1, c2, t, dt, x + (int)i);
+}
+
+__attribute__((target("avx2")))
+void over_span_avx2(uint32_t *dest, size_t count, uint32_t color) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i inv_alpha = _mm256_set1_epi16(255 - (color >> 24));
+    const __m256i src = _mm256_set1_epi32(color);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(dest + i));
+
+        __m256i lo = div255_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(pixels, zero), inv_alpha));
+        __m256i hi = div255_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(pixels, zero), inv_alpha));
+
+        _mm256_storeu_si256((__m256i *)(dest + i), _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), src));
+    }
+
+    _mm256_zeroupper();
+    over_span_sse2(dest + i, count - i, color);
+}
+
+__attribute__((target("avx2")))
+void multiply_span_avx2(uint32_t *dest, size_t count, uint32_t color) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_alpha = _mm256_set1_epi16(255);
+
+    const __m256i src = _mm256_unpacklo_epi8(_mm256_set1_epi32(color), zero);
+    const __m256i dest_factor = _mm256_add_epi16(src, _mm256_set1_epi16(255 - (color >> 24)));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(dest + i));
+
+        __m256i lo = _mm256_unpacklo_epi8(pixels, zero);
+        __m256i hi = _mm256_unpackhi_epi8(pixels, zero);
+
+        __m256i alpha_lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, 0xff), 0xff);
+        __m256i alpha_hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, 0xff), 0xff);
+
+        lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, dest_factor),
+            _mm256_mullo_epi16(src, _mm256_sub_epi16(max_alpha, alpha_lo)));
+        hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, dest_factor),
+            _mm256_mullo_epi16(src, _mm256_sub_epi16(max_alpha, alpha_hi)));
+
+        _mm256_storeu_si256((__m256i *)(dest + i),
+            _mm256_packus_epi16(div255_epi16(lo), div255_epi16(hi)));
+    }
+
+    _mm256_zeroupper();
+    multiply_span_sse2(dest + i, count - i, color);
+}
+
+__attribute__((target("avx2")))
+inline __m256i over_epi16(__m256i dest, __m256i src, __m256i opacity, bool has_opacity) {
+    if (has_opacity) {
+        src = div255_epi16(_mm256_mullo_epi16(src, opacity));
+    }
+
+    __m256i inv_alpha = _mm256_sub_epi16(_mm256_set1_epi16(255),
+        _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, 0xff), 0xff));
+
+    return _mm256_add_epi16(div255_epi16(_mm256_mullo_epi16(dest, inv_alpha)), src);
+}
+
+__attribute__((target("avx2")))
+void composite_span_avx2(uint32_t *dest, const uint32_t *src, size_t count, uint32_t opacity) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i opacity16 = _mm256_set1_epi16(opacity);
+    bool has_opacity = opacity != 0xff;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(dest + i));
+        __m256i colors = _mm256_loadu_si256((const __m256i *)(src + i));
+
+        __m256i lo = over_epi16(_mm256_unpacklo_epi8(pixels, zero), _mm256_unpacklo_epi8(colors, zero),
+            opacity16, has_opacity);
+        __m256i hi = over_epi16(_mm256_unpackhi_epi8(pixels, zero), _mm256_unpackhi_epi8(colors, zero),
+            opacity16, has_opacity);
+
+        _mm256_storeu_si256((__m256i *)(dest + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    _mm256_zeroupper();
+    composite_span_sse2(dest + i, src + i, count - i, opacity);
+}
+
+Kernels select_kernels() {
+    if (__builtin_cpu_supports("avx2")) {
+        // Glyph rows are too short for AVX2 to help coverage
+        return { fill_span_avx2, blend_span_avx2, gradient_span_avx2, over_span_avx2, multiply_span_avx2,
+            coverage_span_sse2, composite_span_avx2 };
+    }
+
+    return { fill_span_sse2, blend_span_sse2, gradient_span_sse2, over_span_sse2, multiply_span_sse2,
+        coverage_span_sse2, composite_span_sse2 };
+}
+
+#else
+
+Kernels select_kernels() {
+    return { fill_span_scalar, blend_span_scalar, gradient_span_scalar, over_span_scalar,
+        multiply_span_scalar, coverage_span_scalar, composite_span_scalar };
+}
+
+#endif
+
+const Kernels &kernels() {
+    static const Kernels k = select_kernels();
+    return k;
+}
+
+}
+
+void fill_span(uint32_t *dest, size_t count, uint32_t color) {
+    // Spans this short are all alignment and tail, so the vector kernels only add overhead
+    if (count <= 16) {
+        // Two pixels per store
+        uint64_t pair = (uint64_t)color << 32 | color;
+
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            memcpy(dest + i, &pair, sizeof(pair));
+        }
+
+        if (i < count) {
+            dest[i] = color;
+        }
+
+        return;
+    }
+
+    kernels().fill(dest, count, color);
+}
+
+void blend_span(uint32_t *dest, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 0xff) {
+        fill_span(dest, count, color);
+        return;
+    } else if (alpha == 0) {
+        return;
+    }
+
+    kernels().blend(dest, count, color);
+}
+
+void gradient_span(uint32_t *dest, size_t count, uint32_t c1, uint32_t c2, float t, float dt, int x) {
+    kernels().gradient(dest, count, c1, c2, t, dt, x);
+}
+
+void over_span(uint32_t *dest, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 0xff) {
+        fill_span(dest, count, color);
+        return;
+    } else if (color == 0) {
+        return;
+    }
+
+    kernels().over(dest, count, color);
+}
+
+void multiply_span(uint32_t *dest, size_t count, uint32_t color) {
+    kernels().multiply(dest, count, color);
+}
+
+void coverage_span(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color) {
+    kernels().coverage(dest, coverage, count, color);
+}
+
+void composite_span(uint32_t *dest, const uint32_t *src, size_t count, uint32_t opacity) {
+    if (opacity == 0) {
+        return;
+    }
+
+    kernels().composite(dest, src, count, opacity);
+}
+
+void premultiply_span(uint32_t *dest, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t alpha = dest[i] >> 24;
+        dest[i] = (scale_pixel(dest[i], alpha) & 0x00ffffff) | alpha << 24;
+    }
+}
+
+void unpremultiply_span(uint32_t *dest, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t alpha = dest[i] >> 24;
+        if (alpha == 0 || alpha == 0xff) {
+            continue;
+        }
+
+        uint32_t result = alpha << 24;
+        for (int shift = 0; shift < 24; shift += 8) {
+            uint32_t c = (dest[i] >> shift) & 0xff;
+            result |= std::min((c * 255 + alpha / 2) / alpha, 255u) << shift;
+        }
+
+        dest[i] = result;
+    }
+}
+
+}
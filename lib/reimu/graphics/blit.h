@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace reimu::graphics::blit {
+
+// Span kernels for 32-bit pixels. The SSE2 or AVX2 version is picked on first use,
+// with a scalar version for other CPUs. Every version gives identical results.
+
+// Set 'count' pixels to 'color'
+void fill_span(uint32_t *dest, size_t count, uint32_t color);
+
+// Blend straight alpha 'color' over 'count' straight alpha pixels by its alpha
+void blend_span(uint32_t *dest, size_t count, uint32_t color);
+
+// Operators on premultiplied colors and pixels. Results are only defined when
+// no channel is greater than the alpha, which holds for anything these produce.
+
+// Composite 'color' over 'count' pixels (Porter-Duff source over)
+void over_span(uint32_t *dest, size_t count, uint32_t color);
+
+// Multiply 'count' pixels by 'color', keeping the parts of each outside the other
+void multiply_span(uint32_t *dest, size_t count, uint32_t color);
+
+// Composite 'color' over 'count' pixels, scaled by a coverage value for each pixel
+void coverage_span(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color);
+
+// Composite 'count' pixels of 'src' over 'dest', with 'src' scaled by 'opacity' out of 255
+void composite_span(uint32_t *dest, const uint32_t *src, size_t count, uint32_t opacity);
+
+// Convert 'count' pixels between straight and premultiplied alpha
+void premultiply_span(uint32_t *dest, size_t count);
+void unpremultiply_span(uint32_t *dest, size_t count);
+
+// Set 'count' pixels to a blend of 'c1' and 'c2', where pixel i takes
+// '(x + i) * dt + t' of 'c2', clamped to [0, 1]. Each pixel only depends
+// on its x, so a span split into parts gives the same pixels.
+void gradient_span(uint32_t *dest, size_t count, uint32_t c1, uint32_t c2, float t, float dt, int x);
+
+}
@@ -0,0 +1,827 @@
+#include <reimu/graphics/display_list.h>
+
+#include <reimu/graphics/font.h>
+#include <reimu/graphics/image.h>
+#include <reimu/graphics/surface.h>
+
+#include "blit.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+namespace reimu::graphics {
+
+// Tiles are wide so each row of a tile is a long span for the kernels
+static constexpr int tile_width = 256;
+static constexpr int tile_height = 64;
+
+void DisplayList::fill_rect(const Recti &rect, const Color &color) {
+    if (rect.is_empty()) {
+        return;
+    }
+
+    m_commands.push_back({ .type = CommandType::Fill, .rect = rect, .color = color });
+}
+
+void DisplayList::blend_rect(const Recti &rect, const Color &color, BlendMode mode) {
+    if (rect.is_empty() || (mode == BlendMode::SourceOver && color.a == 0)) {
+        return;
+    }
+
+    m_commands.push_back({ .type = CommandType::Blend, .rect = rect, .color = color, .blend_mode = mode });
+}
+
+void DisplayList::gradient_rect(const Recti &rect, const Color &c1, const Color &c2,
+        const Vector2f &p1, const Vector2f &p2) {
+    if (rect.is_empty()) {
+        return;
+    }
+
+    Vector2f direction = p2 - p1;
+    float length_squared = direction.x * direction.x + direction.y * direction.y;
+    if (length_squared == 0) {
+        fill_rect(rect, c2);
+        return;
+    }
+
+    // Blend factor is the projection of the pixel onto p1 -> p2, 0 at p1 and 1 at p2
+    m_commands.push_back({
+        .type = CommandType::Gradient,
+        .rect = rect,
+        .color = c1,
+        .color2 = c2,
+        .origin = p1,
+        .dx = direction.x / length_squared,
+        .dy = direction.y / length_squared,
+    });
+}
+
+void DisplayList::draw_glyphs(std::span<const PositionedGlyph> glyphs, const Color &color, const Recti &clip) {
+    Recti bounds = { INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+    for (const auto &g : glyphs) {
+        bounds = bounds.union_with(Recti::from_size(g.pos, { g.glyph->width, g.glyph->rows }));
+    }
+
+    bounds = bounds.intersect(clip);
+    if (bounds.is_empty()) {
+        return;
+    }
+
+    m_commands.push_back({
+        .type = CommandType::Glyphs,
+        .rect = bounds,
+        .color = color,
+        .first_glyph = (uint32_t)m_glyphs.size(),
+        .glyph_count = (uint32_t)glyphs.size(),
+    });
+
+    m_glyphs.insert(m_glyphs.end(), glyphs.begin(), glyphs.end());
+}
+
+// Clip the segment a -> b to 'rect' (Liang-Barsky), returning false if none of it is inside
+static bool clip_segment(Vector2f &a, Vector2f &b, const Rectf &rect) {
+    float t0 = 0;
+    float t1 = 1;
+
+    Vector2f d = b - a;
+
+    float p[4] = { -d.x, d.x, -d.y, d.y };
+    float q[4] = { a.x - rect.x, rect.z - a.x, a.y - rect.y, rect.w - a.y };
+
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            // Parallel to this edge
+            if (q[i] < 0) {
+                return false;
+            }
+
+            continue;
+        }
+
+        float t = q[i] / p[i];
+        if (p[i] < 0) {
+            t0 = std::max(t0, t);
+        } else {
+            t1 = std::min(t1, t);
+        }
+    }
+
+    if (t0 > t1) {
+        return false;
+    }
+
+    b = a + d * t1;
+    a = a + d * t0;
+    return true;
+}
+
+void DisplayList::draw_line(const Vector2f &begin, const Vector2f &end, const Color &color, float width,
+        const Recti &clip, bool include_end) {
+    if (color.a == 0) {
+        return;
+    }
+
+    // Clip once here so the bounds only cover the visible part of the line,
+    // with room for the width and rounding to pixels
+    float margin = std::max(width, 1.f) / 2 + 1;
+    Rectf clip_rect = { clip.x - margin, clip.y - margin, clip.z + margin, clip.w + margin };
+
+    Vector2f a = begin;
+    Vector2f b = end;
+    if (!clip_segment(a, b, clip_rect)) {
+        return;
+    }
+
+    Recti bounds = {
+        (int)std::floor(std::min(a.x, b.x) - margin), (int)std::floor(std::min(a.y, b.y) - margin),
+        (int)std::ceil(std::max(a.x, b.x) + margin), (int)std::ceil(std::max(a.y, b.y) + margin)
+    };
+
+    bounds = bounds.intersect(clip);
+    if (bounds.is_empty()) {
+        return;
+    }
+
+    // Pixels are worked out from the whole line, so any part of it draws the same
+    m_commands.push_back({
+        .type = CommandType::Line,
+        .rect = bounds,
+        .color = color,
+        .origin = begin,
+        .end = end,
+        .width = width,
+        .include_end = include_end,
+    });
+}
+
+void DisplayList::copy_image(const Recti &rect, std::shared_ptr<const Surface> image, const Recti &source,
+        const Recti &clip) {
+    // Only the part of the buffer within the surface is read
+    Recti visible_source = source.intersect(Recti::from_size({0, 0}, image->size()));
+    const uint8_t *pixels = image->buffer();
+    size_t stride = image->stride();
+    AlphaMode alpha_mode = image->alpha_mode();
+
+    add_image(rect, { std::move(image), pixels, stride, alpha_mode }, visible_source, clip);
+}
+
+void DisplayList::copy_image(const Recti &rect, std::shared_ptr<const Image> image, const Recti &source,
+        const Recti &clip) {
+    Recti visible_source = source.intersect(Recti::from_size({0, 0}, image->size()));
+    const uint8_t *pixels = image->pixels();
+    size_t stride = image->stride();
+    AlphaMode alpha_mode = image->alpha_mode();
+
+    add_image(rect, { std::move(image), pixels, stride, alpha_mode }, visible_source, clip);
+}
+
+void DisplayList::add_image(const Recti &rect, ImageRef image, const Recti &source, const Recti &clip) {
+    Recti visible = rect.intersect(clip);
+    if (visible.is_empty() || source.is_empty()) {
+        return;
+    }
+
+    m_commands.push_back({
+        .type = CommandType::Image,
+        .rect = visible,
+        .color = {},
+        .image = (uint32_t)m_images.size(),
+        .source = source,
+        .image_origin = { rect.x, rect.y },
+    });
+
+    m_images.push_back(std::move(image));
+}
+
+void DisplayList::clear() {
+    m_commands.clear();
+    m_glyphs.clear();
+    m_images.clear();
+}
+
+void DisplayList::rasterize(Surface &surface) const {
+    for (const auto &command : m_commands) {
+        surface.add_damage(command.rect);
+        draw_command(surface.buffer(), surface.stride(), surface.alpha_mode(), command, command.rect);
+    }
+}
+
+void DisplayList::rasterize_tiled(Surface &surface, unsigned thread_count) {
+    if (m_commands.empty()) {
+        return;
+    }
+
+    for (const auto &command : m_commands) {
+        surface.add_damage(command.rect);
+    }
+
+    Recti whole_surface = Recti::from_size({0, 0}, surface.size());
+    draw_tiles(surface, { &whole_surface, 1 }, thread_count);
+}
+
+void DisplayList::rasterize(Surface &surface, std::span<const Recti> clip_rects) const {
+    // Clip rects don't overlap, so each pixel is still drawn by its commands once and in order
+    for (const auto &clip : clip_rects) {
+        surface.add_damage(clip);
+
+        for (const auto &command : m_commands) {
+            if (command.rect.intersect(clip).is_empty()) {
+                continue;
+            }
+
+            draw_command(surface.buffer(), surface.stride(), surface.alpha_mode(), command, clip);
+        }
+    }
+}
+
+void DisplayList::rasterize_tiled(Surface &surface, std::span<const Recti> clip_rects, unsigned thread_count) {
+    if (m_commands.empty() || clip_rects.empty()) {
+        return;
+    }
+
+    for (const auto &clip : clip_rects) {
+        surface.add_damage(clip);
+    }
+
+    draw_tiles(surface, clip_rects, thread_count);
+}
+
+// Largest part of 'rect' outside of 'hole'
+static Recti largest_outside(const Recti &rect, const Recti &hole) {
+    Recti overlap = rect.intersect(hole);
+    if (overlap.is_empty()) {
+        return rect;
+    }
+
+    Recti parts[] = {
+        { rect.x, rect.y, rect.z, overlap.y },
+        { rect.x, overlap.w, rect.z, rect.w },
+        { rect.x, rect.y, overlap.x, rect.w },
+        { overlap.z, rect.y, rect.z, rect.w },
+    };
+
+    Recti largest = {};
+    for (const auto &part : parts) {
+        if (!part.is_empty() && (largest.is_empty() || part.area() > largest.area())) {
+            largest = part;
+        }
+    }
+
+    return largest;
+}
+
+Recti DisplayList::opaque_rect(AlphaMode alpha_mode, const Recti &previous) const {
+    bool is_premultiplied = alpha_mode == AlphaMode::Premultiplied;
+    Recti opaque = previous;
+
+    for (const auto &command : m_commands) {
+        bool is_opaque = command.color.a == 0xff;
+
+        // Whether every pixel of the rect is opaque after the command
+        bool covers = false;
+        // Whether pixels which were opaque stay opaque
+        bool keeps = false;
+
+        switch (command.type) {
+        case CommandType::Fill:
+            covers = is_opaque;
+            break;
+        case CommandType::Blend:
+            switch (command.blend_mode) {
+            case BlendMode::SourceOver:
+                covers = is_opaque;
+                keeps = is_premultiplied;
+                break;
+            case BlendMode::Source:
+                covers = is_opaque;
+                break;
+            case BlendMode::Multiply:
+                keeps = true;
+                break;
+            case BlendMode::Clear:
+                break;
+            }
+            break;
+        case CommandType::Gradient:
+            covers = is_opaque && command.color2.a == 0xff;
+            break;
+        case CommandType::Glyphs:
+        case CommandType::Line:
+            // Partly covered pixels are blended like SourceOver
+            keeps = is_premultiplied;
+            break;
+        case CommandType::Image:
+            // Images may have transparent pixels
+            break;
+        }
+
+        if (covers) {
+            if (opaque.is_empty() || command.rect.area() >= opaque.area()) {
+                opaque = command.rect;
+            }
+        } else if (!keeps) {
+            opaque = largest_outside(opaque, command.rect);
+        }
+    }
+
+    return opaque;
+}
+
+// Merge 'rect' into a list of rects which don't overlap
+static void add_disjoint_rect(std::vector<Recti> &rects, Recti rect) {
+    // Past this many rects, drawing the bounding rect is cheaper than more passes over the list
+    static constexpr size_t max_rects = 16;
+
+    if (rect.is_empty()) {
+        return;
+    }
+
+    for (size_t i = 0; i < rects.size();) {
+        if (rects[i].intersect(rect).is_empty()) {
+            i++;
+            continue;
+        }
+
+        // The union may now overlap rects already checked, so start again
+        rect = rect.union_with(rects[i]);
+        rects.erase(rects.begin() + i);
+        i = 0;
+    }
+
+    if (rects.size() >= max_rects) {
+        for (const auto &r : rects) {
+            rect = rect.union_with(r);
+        }
+
+        rects.clear();
+    }
+
+    rects.push_back(rect);
+}
+
+void DisplayList::diff(const DisplayList &previous, std::vector<Recti> &damage) const {
+    // Where no command covering a pixel changed, the pixel is the same. Both rects
+    // of a changed command are damaged, as the old one needs drawing over too.
+    size_t common = std::min(m_commands.size(), previous.m_commands.size());
+    for (size_t i = 0; i < common; i++) {
+        const auto &command = m_commands[i];
+        const auto &previous_command = previous.m_commands[i];
+
+        if (!same_command(command, previous, previous_command)) {
+            add_disjoint_rect(damage, command.rect);
+            add_disjoint_rect(damage, previous_command.rect);
+        }
+    }
+
+    for (size_t i = common; i < m_commands.size(); i++) {
+        add_disjoint_rect(damage, m_commands[i].rect);
+    }
+
+    for (size_t i = common; i < previous.m_commands.size(); i++) {
+        add_disjoint_rect(damage, previous.m_commands[i].rect);
+    }
+}
+
+bool DisplayList::same_command(const Command &command, const DisplayList &other,
+        const Command &other_command) const {
+    const Command &a = command;
+    const Command &b = other_command;
+
+    if (a.type != b.type || a.color.value != b.color.value || a.rect.x != b.rect.x || a.rect.y != b.rect.y
+            || a.rect.z != b.rect.z || a.rect.w != b.rect.w) {
+        return false;
+    }
+
+    switch (a.type) {
+    case CommandType::Fill:
+        return true;
+    case CommandType::Blend:
+        return a.blend_mode == b.blend_mode;
+    case CommandType::Gradient:
+        return a.color2.value == b.color2.value && a.origin == b.origin && a.dx == b.dx && a.dy == b.dy;
+    case CommandType::Line:
+        return a.origin == b.origin && a.end == b.end && a.width == b.width && a.include_end == b.include_end;
+    case CommandType::Image:
+        return m_images[a.image].pixels == other.m_images[b.image].pixels && a.image_origin == b.image_origin
+            && a.source.x == b.source.x && a.source.y == b.source.y
+            && a.source.z == b.source.z && a.source.w == b.source.w;
+    case CommandType::Glyphs:
+        if (a.glyph_count != b.glyph_count) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < a.glyph_count; i++) {
+            const auto &g1 = m_glyphs[a.first_glyph + i];
+            const auto &g2 = other.m_glyphs[b.first_glyph + i];
+
+            if (g1.glyph != g2.glyph || g1.pos != g2.pos) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void DisplayList::draw_tiles(Surface &surface, std::span<const Recti> clip_rects, unsigned thread_count) {
+    Vector2i size = surface.size();
+    int tiles_x = (size.x + tile_width - 1) / tile_width;
+    int tiles_y = (size.y + tile_height - 1) / tile_height;
+
+    m_tile_commands.resize(tiles_x * tiles_y);
+    for (auto &tile : m_tile_commands) {
+        tile.clear();
+    }
+
+    // Bin the commands in order, so each tile draws its commands in the same order as rasterize
+    for (uint32_t i = 0; i < m_commands.size(); i++) {
+        const Recti &rect = m_commands[i].rect;
+
+        bool is_visible = false;
+        for (const auto &clip : clip_rects) {
+            if (!rect.intersect(clip).is_empty()) {
+                is_visible = true;
+                break;
+            }
+        }
+
+        if (!is_visible) {
+            continue;
+        }
+
+        int x_begin = std::max(rect.x, 0) / tile_width;
+        int x_end = std::min((rect.z - 1) / tile_width + 1, tiles_x);
+        int y_begin = std::max(rect.y, 0) / tile_height;
+        int y_end = std::min((rect.w - 1) / tile_height + 1, tiles_y);
+
+        for (int y = y_begin; y < y_end; y++) {
+            for (int x = x_begin; x < x_end; x++) {
+                m_tile_commands[y * tiles_x + x].push_back(i);
+            }
+        }
+    }
+
+    uint8_t *buffer = surface.buffer();
+    size_t stride = surface.stride();
+    AlphaMode alpha_mode = surface.alpha_mode();
+
+    WorkerPool::get().run(m_tile_commands.size(), thread_count, [&](size_t index) {
+        if (m_tile_commands[index].empty()) {
+            return;
+        }
+
+        int x = index % tiles_x;
+        int y = index / tiles_x;
+
+        Recti tile = Recti::from_size({ x * tile_width, y * tile_height }, { tile_width, tile_height })
+            .intersect(Recti::from_size({0, 0}, size));
+
+        for (const auto &clip : clip_rects) {
+            Recti piece = tile.intersect(clip);
+            if (piece.is_empty()) {
+                continue;
+            }
+
+            for (uint32_t command : m_tile_commands[index]) {
+                draw_command(buffer, stride, alpha_mode, m_commands[command], piece);
+            }
+        }
+    });
+}
+
+void DisplayList::draw_command(uint8_t *buffer, size_t stride, AlphaMode alpha_mode, const Command &command,
+        const Recti &clip) const {
+    Recti rect = command.rect.intersect(clip);
+    if (rect.is_empty()) {
+        return;
+    }
+
+    uint8_t *row = buffer + rect.y * stride + rect.x * 4;
+    size_t width = rect.width();
+
+    // Full width rows are contiguous, so spans over them are drawn as one
+    size_t rows = rect.height();
+    if (width * 4 == stride) {
+        width *= rows;
+        rows = 1;
+    }
+
+    bool is_premultiplied = alpha_mode == AlphaMode::Premultiplied;
+    Color color = is_premultiplied ? command.color.premultiplied() : command.color;
+
+    switch (command.type) {
+    case CommandType::Fill:
+        for (size_t y = 0; y < rows; y++, row += stride) {
+            blit::fill_span((uint32_t *)row, width, color.value);
+        }
+        break;
+    case CommandType::Blend:
+        for (size_t y = 0; y < rows; y++, row += stride) {
+            blend_span((uint32_t *)row, width, color, command.blend_mode, is_premultiplied);
+        }
+        break;
+    case CommandType::Gradient: {
+        // Interpolating premultiplied colors also keeps transparent ends from tinting the other color
+        Color color2 = is_premultiplied ? command.color2.premultiplied() : command.color2;
+
+        for (int y = rect.y; y < rect.w; y++, row += stride) {
+            float row_t = (y - command.origin.y) * command.dy - command.origin.x * command.dx;
+
+            blit::gradient_span((uint32_t *)row, rect.width(), color.value, color2.value,
+                row_t, command.dx, rect.x);
+        }
+        break;
+    }
+    case CommandType::Glyphs: {
+        uint32_t *pixels = (uint32_t *)buffer;
+        size_t pitch = stride / 4;
+
+        Color c = command.color;
+        for (uint32_t i = 0; i < command.glyph_count; i++) {
+            const auto &g = m_glyphs[command.first_glyph + i];
+            const Glyph &glyph = *g.glyph;
+
+            int x_min = std::max(rect.x, g.pos.x);
+            int x_max = std::min(rect.z, g.pos.x + glyph.width);
+            int y_min = std::max(rect.y, g.pos.y);
+            int y_max = std::min(rect.w, g.pos.y + glyph.rows);
+
+            for (int y = y_min; y < y_max; y++) {
+                const uint8_t *src = glyph.bitmap + (y - g.pos.y) * glyph.width - g.pos.x;
+                uint32_t *dst = pixels + y * pitch;
+
+                if (is_premultiplied) {
+                    if (x_min < x_max) {
+                        blit::coverage_span(dst + x_min, src + x_min, x_max - x_min, color.value);
+                    }
+                    continue;
+                }
+
+                for (int x = x_min; x < x_max; x++) {
+                    if (src[x] == 0xff) {
+                        dst[x] = c.value;
+                    } else if (src[x]) {
+                        c.a = src[x];
+                        dst[x] = (Color(dst[x]) * c).value;
+                        c.a = command.color.a;
+                    }
+                }
+            }
+        }
+        break;
+    }
+    case CommandType::Line:
+        if (command.width <= 1) {
+            draw_thin_line(buffer, stride, command, color, is_premultiplied, rect);
+        } else {
+            draw_wide_line(buffer, stride, command, color, is_premultiplied, rect);
+        }
+        break;
+    case CommandType::Image: {
+        const ImageRef &image = m_images[command.image];
+        bool needs_conversion = image.alpha_mode != alpha_mode;
+
+        int source_width = command.source.width();
+        int source_height = command.source.height();
+        int x_offset = (rect.x - command.image_origin.x) % source_width;
+
+        for (int y = rect.y; y < rect.w; y++, row += stride) {
+            int source_y = command.source.y + (y - command.image_origin.y) % source_height;
+            const uint32_t *src = (const uint32_t *)(image.pixels + source_y * image.stride)
+                + command.source.x;
+
+            copy_tiled((uint32_t *)row, rect.width(), src, source_width, x_offset);
+
+            if (needs_conversion && is_premultiplied) {
+                blit::premultiply_span((uint32_t *)row, rect.width());
+            } else if (needs_conversion) {
+                blit::unpremultiply_span((uint32_t *)row, rect.width());
+            }
+        }
+        break;
+    }
+    }
+}
+
+void DisplayList::copy_tiled(uint32_t *dest, size_t count, const uint32_t *src, size_t src_count,
+        size_t offset) {
+    // Edges of nine-slices are a single pixel across
+    if (src_count == 1) {
+        blit::fill_span(dest, count, src[0]);
+        return;
+    }
+
+    while (count > 0) {
+        size_t n = std::min(count, src_count - offset);
+        memcpy(dest, src + offset, n * 4);
+
+        dest += n;
+        count -= n;
+        offset = 0;
+    }
+}
+
+// Floor of a / b for b > 0
+static int64_t floor_div(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+void DisplayList::draw_thin_line(uint8_t *buffer, size_t stride, const Command &command, const Color &color,
+        bool is_premultiplied, const Recti &clip) {
+    int64_t x0 = std::lround(command.origin.x);
+    int64_t y0 = std::lround(command.origin.y);
+    int64_t x1 = std::lround(command.end.x);
+    int64_t y1 = std::lround(command.end.y);
+
+    bool is_x_major = std::abs(x1 - x0) >= std::abs(y1 - y0);
+
+    // Walk along the major axis, swapping x and y for steep lines
+    if (!is_x_major) {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+    }
+
+    // Walk in increasing order, remembering which end to leave out
+    bool exclude_first = false;
+    bool exclude_last = !command.include_end;
+    if (x1 < x0) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        std::swap(exclude_first, exclude_last);
+    }
+
+    int64_t dx = x1 - x0;
+    int64_t dy = y1 - y0;
+
+    int64_t major_min = is_x_major ? clip.x : clip.y;
+    int64_t major_max = is_x_major ? clip.z : clip.w;
+    int64_t minor_min = is_x_major ? clip.y : clip.x;
+    int64_t minor_max = is_x_major ? clip.w : clip.z;
+
+    int64_t first = std::max(x0 + exclude_first, major_min);
+    int64_t last = std::min(x1 - exclude_last, major_max - 1);
+    if (first > last) {
+        return;
+    }
+
+    auto plot_run = [&](int64_t run_start, int64_t run_end, int64_t minor) {
+        if (minor < minor_min || minor >= minor_max) {
+            return;
+        }
+
+        if (is_x_major) {
+            uint32_t *row = (uint32_t *)(buffer + minor * stride) + run_start;
+            blend_span(row, run_end - run_start, color, BlendMode::SourceOver, is_premultiplied);
+        } else {
+            // Steep lines have one pixel per row
+            for (int64_t y = run_start; y < run_end; y++) {
+                uint32_t *pixel = (uint32_t *)(buffer + y * stride) + minor;
+                blend_span(pixel, 1, color, BlendMode::SourceOver, is_premultiplied);
+            }
+        }
+    };
+
+    if (dx == 0) {
+        plot_run(first, last + 1, y0);
+        return;
+    }
+
+    // The minor coordinate is y0 + (x - x0) * dy / dx rounded, kept as a whole part and a
+    // remainder in [0, 2 * dx) so stepping needs no division. Starting from the first
+    // visible pixel gives the same pixels as walking from x0.
+    int64_t numerator = 2 * (first - x0) * dy + dx;
+    int64_t minor = y0 + floor_div(numerator, 2 * dx);
+    int64_t remainder = numerator - (minor - y0) * 2 * dx;
+
+    int64_t run_start = first;
+    for (int64_t x = first; x < last; x++) {
+        remainder += 2 * dy;
+
+        int64_t next_minor = minor;
+        if (remainder >= 2 * dx) {
+            remainder -= 2 * dx;
+            next_minor++;
+        } else if (remainder < 0) {
+            remainder += 2 * dx;
+            next_minor--;
+        }
+
+        // Shallow lines are drawn as runs of pixels on each row
+        if (next_minor != minor) {
+            plot_run(run_start, x + 1, minor);
+            run_start = x + 1;
+            minor = next_minor;
+        }
+    }
+
+    plot_run(run_start, last + 1, minor);
+}
+
+void DisplayList::draw_wide_line(uint8_t *buffer, size_t stride, const Command &command, const Color &color,
+        bool is_premultiplied, const Recti &clip) {
+    Vector2f a = command.origin;
+    Vector2f direction = command.end - command.origin;
+    float length_squared = direction.x * direction.x + direction.y * direction.y;
+
+    // Coverage falls from 1 to 0 over the pixel either side of the edge
+    float radius = command.width / 2 + 0.5f;
+
+    // Unit normal, for finding where each row crosses the line
+    float length = std::sqrt(length_squared);
+    Vector2f normal = length > 0 ? Vector2f{ -direction.y / length, direction.x / length } : Vector2f{ 0, 1 };
+
+    float line_x_min = std::min(a.x, command.end.x) - radius;
+    float line_x_max = std::max(a.x, command.end.x) + radius;
+
+    uint8_t coverage[256];
+
+    for (int y = clip.y; y < clip.w; y++) {
+        float py = y + 0.5f;
+
+        // Pixels within 'radius' of the infinite line on this row, and of the segment's ends
+        float x_min = line_x_min;
+        float x_max = line_x_max;
+        if (std::abs(normal.x) > 1e-4f) {
+            float c = normal.y * (py - a.y) - normal.x * a.x;
+            float x_a = (-radius - c) / normal.x;
+            float x_b = (radius - c) / normal.x;
+
+            x_min = std::max(x_min, std::min(x_a, x_b));
+            x_max = std::min(x_max, std::max(x_a, x_b));
+        } else if (std::abs(py - a.y) > radius) {
+            continue;
+        }
+
+        int x_begin = std::max((int)std::floor(x_min), clip.x);
+        int x_end = std::min((int)std::ceil(x_max) + 1, clip.z);
+
+        uint32_t *row = (uint32_t *)(buffer + y * stride);
+
+        for (int x = x_begin; x < x_end; x += sizeof(coverage)) {
+            int count = std::min<int>(x_end - x, sizeof(coverage));
+
+            for (int i = 0; i < count; i++) {
+                Vector2f p = { x + i + 0.5f - a.x, py - a.y };
+
+                // Distance to the nearest point on the segment, giving round caps
+                float t = length_squared > 0 ? (p.x * direction.x + p.y * direction.y) / length_squared : 0;
+                t = std::clamp(t, 0.f, 1.f);
+
+                float dx = p.x - direction.x * t;
+                float dy = p.y - direction.y * t;
+
+                float cover = std::clamp(radius - std::sqrt(dx * dx + dy * dy), 0.f, 1.f);
+                coverage[i] = (uint8_t)(cover * 255 + 0.5f);
+            }
+
+            if (is_premultiplied) {
+                blit::coverage_span(row + x, coverage, count, color.value);
+                continue;
+            }
+
+            Color c = color;
+            for (int i = 0; i < count; i++) {
+                if (coverage[i]) {
+                    c.a = (color.a * coverage[i] + 127) / 255;
+                    row[x + i] = (Color(row[x + i]) * c).value;
+                }
+            }
+        }
+    }
+}
+
+void DisplayList::blend_span(uint32_t *dest, size_t count, const Color &color, BlendMode mode,
+        bool is_premultiplied) {
+    switch (mode) {
+    case BlendMode::SourceOver:
+        if (is_premultiplied) {
+            blit::over_span(dest, count, color.value);
+        } else {
+            blit::blend_span(dest, count, color.value);
+        }
+        break;
+    case BlendMode::Source:
+        blit::fill_span(dest, count, color.value);
+        break;
+    case BlendMode::Multiply:
+        // Straight pixels are converted to use the premultiplied operator
+        if (is_premultiplied) {
+            blit::multiply_span(dest, count, color.value);
+        } else {
+            blit::premultiply_span(dest, count);
+            blit::multiply_span(dest, count, color.premultiplied().value);
+            blit::unpremultiply_span(dest, count);
+        }
+        break;
+    case BlendMode::Clear:
+        blit::fill_span(dest, count, 0);
+        break;
+    }
+}
+
+}
@@ -1,6 +1,13 @@
 #include <reimu/graphics/font.h>
 
+#include <reimu/core/hash.h>
 #include <reimu/core/resource_manager.h>
+#include <reimu/os/fs.h>
+
+#include <array>
+#include <unordered_map>
+
+#include <string.h>
 
 #define FIXED_FONT_PATH "font.ttf"
 
@@ -8,15 +15,365 @@
 
 namespace reimu::graphics {
 
+namespace {
+
+/**
+ * Two-level bitmap of the codepoints a face has glyphs for.
+ *
+ * The top level maps each 256 codepoint page to a bitmap, pages with no glyphs
+ * all share the empty bitmap at index 0.
+ */
+class CodepointCoverage {
+public:
+    CodepointCoverage() : m_page_index(page_count, 0), m_pages(1) {}
+
+    void build(FT_Face face) {
+        FT_UInt glyph_index;
+        FT_ULong codepoint = FT_Get_First_Char(face, &glyph_index);
+
+        while (glyph_index != 0) {
+            if (codepoint < max_codepoint) {
+                add(codepoint);
+            }
+
+            codepoint = FT_Get_Next_Char(face, codepoint, &glyph_index);
+        }
+    }
+
+    inline bool contains(uint32_t codepoint) const {
+        if (codepoint >= max_codepoint) {
+            return false;
+        }
+
+        const auto &page = m_pages[m_page_index[codepoint >> 8]];
+        return (page[(codepoint & 0xff) >> 6] >> (codepoint & 63)) & 1;
+    }
+
+private:
+    static constexpr uint32_t max_codepoint = 0x110000;
+    static constexpr uint32_t page_count = max_codepoint >> 8;
+
+    void add(uint32_t codepoint) {
+        auto &index = m_page_index[codepoint >> 8];
+        if (index == 0) {
+            index = m_pages.size();
+            m_pages.push_back({});
+        }
+
+        m_pages[index][(codepoint & 0xff) >> 6] |= 1ull << (codepoint & 63);
+    }
+
+    std::vector<uint16_t> m_page_index;
+    std::vector<std::array<uint64_t, 4>> m_pages;
+};
+
+struct CachedGlyph {
+    Glyph glyph;
+    std::vector<uint8_t> pixels;
+};
+
+inline uint64_t glyph_key(uint32_t codepoint, int pixel_size, bool smoothing) {
+    return (uint64_t)codepoint | ((uint64_t)(uint16_t)pixel_size << 21)
+        | ((uint64_t)smoothing << 37);
+}
+
+inline uint32_t glyph_key_codepoint(uint64_t key) {
+    return key & 0x1fffff;
+}
+
+inline uint64_t glyph_key_mode(uint64_t key) {
+    return key >> 21;
+}
+
+/**
+ * On-disk glyph cache, one file per font, pixel size and render mode.
+ *
+ * The header is followed by the glyph table and then the glyph bitmaps,
+ * all offsets are from the start of the file so glyphs can point
+ * straight into a mapping of it.
+ */
+struct DiskCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t font_hash;
+    int32_t pixel_size;
+    uint32_t smoothing;
+
+    int32_t ascender;
+    int32_t line_height;
+    uint32_t has_kerning;
+
+    uint32_t glyph_count;
+    uint64_t bitmap_offset;
+    uint64_t bitmap_size;
+
+    // Hash of everything after the header
+    uint64_t checksum;
+};
+
+struct DiskCacheGlyph {
+    uint32_t codepoint;
+    uint32_t index;
+    // Relative to the bitmap offset in the header
+    uint32_t bitmap_offset;
+    int16_t width;
+    int16_t rows;
+    int16_t left;
+    int16_t top;
+    int32_t advance;
+};
+
+static_assert(sizeof(DiskCacheHeader) == 64);
+static_assert(sizeof(DiskCacheGlyph) == 24);
+
+static constexpr uint32_t disk_cache_magic = 0x43475252; // 'RRGC'
+static constexpr uint32_t disk_cache_version = 1;
+
+struct DiskCacheState {
+    // Whether we have tried to load the cache file
+    bool loaded = false;
+    // Whether glyphs have been rasterized since
+    bool dirty = false;
+};
+
+}
+
 struct detail::FontData {
     FT_Face face;
     std::vector<uint8_t> data;
+
+    CodepointCoverage coverage;
+
+    // Pixel size currently set on the face
+    int pixel_size = 0;
+
+    std::unordered_map<uint64_t, CachedGlyph> glyphs;
+    std::unordered_map<int, FontMetrics> metrics;
+
+    // Empty when there is no disk cache
+    std::string cache_dir;
+    uint64_t font_hash = 0;
+
+    // Keyed by glyph_key_mode
+    std::unordered_map<uint64_t, DiskCacheState> disk_cache;
+    std::vector<std::unique_ptr<os::MappedFile>> mappings;
+
+    bool set_pixel_size(int size) {
+        if (pixel_size == size) {
+            return true;
+        }
+
+        if (FT_Set_Pixel_Sizes(face, 0, size)) {
+            logger::warn("Failed to set font size!");
+            return false;
+        }
+
+        pixel_size = size;
+        return true;
+    }
+
+    std::string disk_cache_path(int size, bool smoothing) const {
+        return std::format("{}/{:016x}-{}-{}.glyphs", cache_dir, font_hash, size,
+            smoothing ? "aa" : "mono");
+    }
+
+    FontMetrics rasterize_metrics(int size);
+
+    bool load_disk_cache(int size, bool smoothing);
+    void store_disk_cache(uint64_t mode);
 };
 
+FontMetrics detail::FontData::rasterize_metrics(int size) {
+    if (!set_pixel_size(size)) {
+        return {};
+    }
+
+    // In 64ths of a pixel so r shift by 6
+    return {
+        .ascender = (int)(face->size->metrics.ascender >> 6),
+        .line_height = (int)(face->size->metrics.height >> 6),
+        .has_kerning = FT_HAS_KERNING(face),
+    };
+}
+
+// Returns true if any glyphs were loaded from the cache
+bool detail::FontData::load_disk_cache(int size, bool smoothing) {
+    if (cache_dir.empty()) {
+        return false;
+    }
+
+    auto &state = disk_cache[glyph_key_mode(glyph_key(0, size, smoothing))];
+    if (state.loaded) {
+        return false;
+    }
+
+    state.loaded = true;
+
+    auto path = disk_cache_path(size, smoothing);
+
+    auto r = os::map_file(path);
+    if (r.is_err()) {
+        // No cache yet
+        return false;
+    }
+
+    auto mapping = r.move_val();
+    const uint8_t *base = mapping->data();
+    size_t file_size = mapping->size();
+
+    DiskCacheHeader header;
+    if (file_size < sizeof(header)) {
+        logger::warn("Glyph cache '{}' is truncated", path);
+        return false;
+    }
+
+    memcpy(&header, base, sizeof(header));
+
+    // Anything that does not match is stale rather than corrupt, just rebuild it
+    if (header.magic != disk_cache_magic || header.version != disk_cache_version
+            || header.font_hash != font_hash || header.pixel_size != size
+            || header.smoothing != (uint32_t)smoothing) {
+        return false;
+    }
+
+    uint64_t table_end = sizeof(header) + (uint64_t)header.glyph_count * sizeof(DiskCacheGlyph);
+    if (table_end > header.bitmap_offset || header.bitmap_offset > file_size
+            || header.bitmap_size != file_size - header.bitmap_offset) {
+        logger::warn("Glyph cache '{}' is corrupt", path);
+        return false;
+    }
+
+    if (data_hash(base + sizeof(header), file_size - sizeof(header)) != header.checksum) {
+        logger::warn("Glyph cache '{}' failed checksum", path);
+        return false;
+    }
+
+    // Validate every glyph before inserting any
+    auto *table = (const DiskCacheGlyph *)(base + sizeof(header));
+    for (uint32_t i = 0; i < header.glyph_count; i++) {
+        const auto &g = table[i];
+        if (g.width < 0 || g.rows < 0 || g.codepoint > 0x10ffff
+                || (uint64_t)g.bitmap_offset + g.width * g.rows > header.bitmap_size) {
+            logger::warn("Glyph cache '{}' is corrupt", path);
+            return false;
+        }
+    }
+
+    const uint8_t *bitmaps = base + header.bitmap_offset;
+    for (uint32_t i = 0; i < header.glyph_count; i++) {
+        const auto &g = table[i];
+
+        auto [it, inserted] = glyphs.try_emplace(glyph_key(g.codepoint, size, smoothing));
+        if (!inserted) {
+            continue;
+        }
+
+        it->second.glyph = {
+            .index = g.index,
+            .bitmap = bitmaps + g.bitmap_offset,
+            .width = g.width,
+            .rows = g.rows,
+            .left = g.left,
+            .top = g.top,
+            .advance = g.advance,
+        };
+    }
+
+    metrics.try_emplace(size, FontMetrics{
+        .ascender = header.ascender,
+        .line_height = header.line_height,
+        .has_kerning = header.has_kerning != 0,
+    });
+
+    // Glyphs point into the mapping so keep it around
+    mappings.push_back(std::move(mapping));
+
+    return header.glyph_count > 0;
+}
+
+void detail::FontData::store_disk_cache(uint64_t mode) {
+    int size = mode & 0xffff;
+    bool smoothing = mode >> 16;
+
+    std::vector<std::pair<uint32_t, const Glyph *>> entries;
+    uint64_t bitmap_size = 0;
+    for (const auto &[key, cached] : glyphs) {
+        if (glyph_key_mode(key) == mode) {
+            entries.push_back({ glyph_key_codepoint(key), &cached.glyph });
+            bitmap_size += cached.glyph.width * cached.glyph.rows;
+        }
+    }
+
+    if (bitmap_size > UINT32_MAX) {
+        return;
+    }
+
+    auto it = metrics.find(size);
+    FontMetrics font_metrics = it != metrics.end() ? it->second : rasterize_metrics(size);
+
+    size_t table_size = entries.size() * sizeof(DiskCacheGlyph);
+    size_t bitmap_offset = sizeof(DiskCacheHeader) + table_size;
+
+    std::vector<uint8_t> data(bitmap_offset + bitmap_size);
+
+    auto *table = (DiskCacheGlyph *)(data.data() + sizeof(DiskCacheHeader));
+    uint8_t *bitmaps = data.data() + bitmap_offset;
+
+    uint32_t offset = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        auto [codepoint, glyph] = entries[i];
+
+        table[i] = {
+            .codepoint = codepoint,
+            .index = glyph->index,
+            .bitmap_offset = offset,
+            .width = (int16_t)glyph->width,
+            .rows = (int16_t)glyph->rows,
+            .left = (int16_t)glyph->left,
+            .top = (int16_t)glyph->top,
+            .advance = glyph->advance,
+        };
+
+        size_t bitmap_len = glyph->width * glyph->rows;
+        if (bitmap_len) {
+            memcpy(bitmaps + offset, glyph->bitmap, bitmap_len);
+        }
+
+        offset += bitmap_len;
+    }
+
+    DiskCacheHeader header = {
+        .magic = disk_cache_magic,
+        .version = disk_cache_version,
+        .font_hash = font_hash,
+        .pixel_size = size,
+        .smoothing = smoothing,
+        .ascender = font_metrics.ascender,
+        .line_height = font_metrics.line_height,
+        .has_kerning = font_metrics.has_kerning,
+        .glyph_count = (uint32_t)entries.size(),
+        .bitmap_offset = bitmap_offset,
+        .bitmap_size = bitmap_size,
+        .checksum = data_hash(data.data() + sizeof(DiskCacheHeader), data.size() - sizeof(DiskCacheHeader)),
+    };
+
+    memcpy(data.data(), &header, sizeof(header));
+
+    if (auto r = os::make_path(cache_dir, 0755); r.is_err()) {
+        logger::warn("Failed to create cache directory '{}': {}", cache_dir, r.move_err().as_string());
+        return;
+    }
+
+    auto path = disk_cache_path(size, smoothing);
+    if (auto r = os::replace_file(path, data.data(), data.size()); r.is_err()) {
+        logger::warn("Failed to write glyph cache '{}': {}", path, r.move_err().as_string());
+    }
+}
+
 Result<Font *, ReimuError> Font::create(File &file) {
     std::vector<uint8_t> font_data = file.read(file.file_size()).ensure();
 
-    auto r = FreeType::instance().new_face(font_data, 0); 
+    auto r = FreeType::instance().new_face(font_data, 0);
     if (r.is_err()) {
         auto err = r.move_err();
         logger::debug("Failed to load font: {:x}", (err.error));
@@ -25,6 +382,7 @@ Result<Font *, ReimuError> Font::create(File &file) {
 
     auto font = new Font();
     font->m_data = std::make_unique<detail::FontData>(r.ensure(), std::move(font_data));
+    font->m_data->coverage.build(font->m_data->face);
 
     return OK(font);
 }
@@ -35,6 +393,8 @@ StringID Font::obj_type_id() const {
 
 Font::Font() {}
 Font::~Font() {
+    store_disk_cache();
+
     FreeType::instance().done_face(m_data->face);
 }
 
@@ -42,4 +402,123 @@ void *Font::get_handle() {
     return m_data->face;
 }
 
+bool Font::has_codepoint(uint32_t codepoint) const {
+    return m_data->coverage.contains(codepoint);
+}
+
+const Glyph *Font::get_glyph(uint32_t codepoint, int pixel_size, bool smoothing) {
+    std::unique_lock lock(m_lock);
+
+    auto key = glyph_key(codepoint, pixel_size, smoothing);
+
+    auto it = m_data->glyphs.find(key);
+    if (it == m_data->glyphs.end() && m_data->load_disk_cache(pixel_size, smoothing)) {
+        it = m_data->glyphs.find(key);
+    }
+
+    if (it != m_data->glyphs.end()) {
+        return &it->second.glyph;
+    }
+
+    auto &cached = m_data->glyphs[key];
+
+    if (!m_data->cache_dir.empty()) {
+        m_data->disk_cache[glyph_key_mode(key)].dirty = true;
+    }
+
+    FT_Face face = m_data->face;
+
+    // Glyphs that fail to load are cached as empty so we do not try again
+    cached.glyph = {};
+    cached.glyph.index = FT_Get_Char_Index(face, codepoint);
+
+    if (!m_data->set_pixel_size(pixel_size)) {
+        return &cached.glyph;
+    }
+
+    if (FT_Load_Glyph(face, cached.glyph.index,
+            smoothing ? FT_LOAD_NO_BITMAP : FT_LOAD_NO_HINTING | FT_LOAD_MONOCHROME)) {
+        return &cached.glyph;
+    }
+
+    if (FT_Render_Glyph(face->glyph, smoothing ? FT_RENDER_MODE_NORMAL : FT_RENDER_MODE_MONO)) {
+        return &cached.glyph;
+    }
+
+    FT_GlyphSlot slot = face->glyph;
+    const FT_Bitmap &bitmap = slot->bitmap;
+
+    int width = bitmap.width;
+    int rows = bitmap.rows;
+
+    // Store everything as 8-bit coverage, expanding monochrome bitmaps
+    cached.pixels.resize(width * rows);
+    for (int y = 0; y < rows; y++) {
+        const uint8_t *src = bitmap.buffer + y * bitmap.pitch;
+        uint8_t *dst = cached.pixels.data() + y * width;
+
+        if (bitmap.pixel_mode == FT_PIXEL_MODE_MONO) {
+            for (int x = 0; x < width; x++) {
+                dst[x] = (src[x >> 3] & (0x80 >> (x & 7))) ? 0xff : 0;
+            }
+        } else {
+            memcpy(dst, src, width);
+        }
+    }
+
+    cached.glyph.bitmap = cached.pixels.data();
+    cached.glyph.width = width;
+    cached.glyph.rows = rows;
+    cached.glyph.left = slot->bitmap_left;
+    cached.glyph.top = slot->bitmap_top;
+    cached.glyph.advance = slot->advance.x >> 6;
+
+    return &cached.glyph;
+}
+
+FontMetrics Font::get_metrics(int pixel_size) {
+    std::unique_lock lock(m_lock);
+
+    auto it = m_data->metrics.find(pixel_size);
+    if (it != m_data->metrics.end()) {
+        return it->second;
+    }
+
+    FontMetrics metrics = m_data->rasterize_metrics(pixel_size);
+    m_data->metrics.emplace(pixel_size, metrics);
+
+    return metrics;
+}
+
+int Font::get_kerning(uint32_t left, uint32_t right, int pixel_size) {
+    std::unique_lock lock(m_lock);
+
+    if (!m_data->set_pixel_size(pixel_size)) {
+        return 0;
+    }
+
+    FT_Vector kerning = { 0, 0 };
+    FT_Get_Kerning(m_data->face, left, right, FT_KERNING_DEFAULT, &kerning);
+
+    return kerning.x >> 6;
+}
+
+void Font::enable_disk_cache(std::string cache_dir) {
+    std::unique_lock lock(m_lock);
+
+    m_data->cache_dir = std::move(cache_dir);
+    m_data->font_hash = data_hash(m_data->data.data(), m_data->data.size());
+}
+
+void Font::store_disk_cache() {
+    std::unique_lock lock(m_lock);
+
+    for (auto &[mode, state] : m_data->disk_cache) {
+        if (state.dirty) {
+            m_data->store_disk_cache(mode);
+            state.dirty = false;
+        }
+    }
+}
+
 }
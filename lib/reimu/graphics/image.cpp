@@ -0,0 +1,377 @@
+#include <reimu/graphics/image.h>
+
+#include <reimu/core/hash.h>
+#include <reimu/core/logger.h>
+#include <reimu/graphics/color.h>
+#include <reimu/os/fs.h>
+
+#include "blit.h"
+
+#include <format>
+#include <vector>
+
+#include <string.h>
+
+namespace reimu::graphics {
+
+namespace {
+
+/**
+ * Decoded image cache, one file per source image.
+ *
+ * The header is followed by the premultiplied pixels as tightly packed rows,
+ * so images can point straight into a mapping of the file. Pixels are not
+ * checksummed, as that would read every pixel on load. Files are replaced
+ * in one go, so they are never seen partly written.
+ */
+struct ImageCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Hash of the path, size and modification time of the file the image was decoded from
+    uint64_t source_key;
+    int32_t width;
+    int32_t height;
+    uint64_t pixel_offset;
+    uint64_t pixel_size;
+
+    // Keeps the pixels 64 byte aligned
+    uint8_t reserved[24];
+};
+
+static_assert(sizeof(ImageCacheHeader) == 64);
+
+static constexpr uint32_t image_cache_magic = 0x43495252; // 'RRIC'
+static constexpr uint32_t image_cache_version = 2;
+
+// Largest width or height accepted, so sizes can't overflow
+static constexpr uint32_t max_image_dimension = 1 << 15;
+
+struct DecodedImage {
+    std::vector<uint8_t> pixels;
+    Vector2i size;
+};
+
+// Skips whitespace and comments, then reads a number of a PPM header
+bool read_ppm_number(const uint8_t *&p, const uint8_t *end, uint32_t &value) {
+    while (p < end) {
+        if (*p == '#') {
+            while (p < end && *p != '\n') {
+                p++;
+            }
+        } else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            p++;
+        } else {
+            break;
+        }
+    }
+
+    if (p == end || *p < '0' || *p > '9') {
+        return false;
+    }
+
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p++ - '0');
+        if (value > 0xffffff) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool decode_ppm(const uint8_t *data, size_t size, DecodedImage &image) {
+    const uint8_t *p = data + 2;
+    const uint8_t *end = data + size;
+
+    bool is_grey = data[1] == '5';
+
+    uint32_t width, height, max_value;
+    if (!read_ppm_number(p, end, width) || !read_ppm_number(p, end, height)
+            || !read_ppm_number(p, end, max_value) || p == end) {
+        return false;
+    }
+
+    // A single whitespace character separates the header from the samples
+    p++;
+
+    if (width == 0 || height == 0 || width > max_image_dimension || height > max_image_dimension
+            || max_value == 0 || max_value > 0xffff) {
+        return false;
+    }
+
+    size_t channels = is_grey ? 1 : 3;
+    size_t sample_size = max_value > 0xff ? 2 : 1;
+    if ((size_t)(end - p) < (size_t)width * height * channels * sample_size) {
+        return false;
+    }
+
+    image.size = { (int)width, (int)height };
+    image.pixels.resize((size_t)width * height * 4);
+
+    auto read_sample = [&]() -> uint8_t {
+        uint32_t value = *p++;
+        if (sample_size == 2) {
+            value = (value << 8) | *p++;
+        }
+
+        return (value * 255 + max_value / 2) / max_value;
+    };
+
+    // No alpha, so the pixels are already premultiplied
+    uint8_t *out = image.pixels.data();
+    for (size_t i = 0; i < (size_t)width * height; i++, out += 4) {
+        out[0] = read_sample();
+        out[1] = is_grey ? out[0] : read_sample();
+        out[2] = is_grey ? out[0] : read_sample();
+        out[3] = 0xff;
+    }
+
+    return true;
+}
+
+uint32_t read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+bool decode_qoi(const uint8_t *data, size_t size, DecodedImage &image) {
+    static constexpr size_t header_size = 14;
+    static constexpr size_t end_marker_size = 8;
+
+    if (size < header_size + end_marker_size) {
+        return false;
+    }
+
+    uint32_t width = read_be32(data + 4);
+    uint32_t height = read_be32(data + 8);
+    if (width == 0 || height == 0 || width > max_image_dimension || height > max_image_dimension) {
+        return false;
+    }
+
+    image.size = { (int)width, (int)height };
+    image.pixels.resize((size_t)width * height * 4);
+
+    Color index[64] = {};
+    Color pixel(0, 0, 0, 255);
+    int run = 0;
+
+    const uint8_t *p = data + header_size;
+    const uint8_t *end = data + size - end_marker_size;
+
+    uint32_t *out = (uint32_t *)image.pixels.data();
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        if (run > 0) {
+            run--;
+        } else if (p < end) {
+            uint8_t b1 = *p++;
+
+            if (b1 == 0xfe) {
+                if (end - p < 3) {
+                    return false;
+                }
+
+                pixel.r = p[0];
+                pixel.g = p[1];
+                pixel.b = p[2];
+                p += 3;
+            } else if (b1 == 0xff) {
+                if (end - p < 4) {
+                    return false;
+                }
+
+                pixel = Color(p[0], p[1], p[2], p[3]);
+                p += 4;
+            } else if ((b1 & 0xc0) == 0x00) {
+                pixel = index[b1];
+            } else if ((b1 & 0xc0) == 0x40) {
+                pixel.r += ((b1 >> 4) & 3) - 2;
+                pixel.g += ((b1 >> 2) & 3) - 2;
+                pixel.b += (b1 & 3) - 2;
+            } else if ((b1 & 0xc0) == 0x80) {
+                if (p == end) {
+                    return false;
+                }
+
+                uint8_t b2 = *p++;
+                int dg = (b1 & 0x3f) - 32;
+
+                pixel.r += dg - 8 + ((b2 >> 4) & 0x0f);
+                pixel.g += dg;
+                pixel.b += dg - 8 + (b2 & 0x0f);
+            } else {
+                run = b1 & 0x3f;
+            }
+
+            index[(pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64] = pixel;
+        } else {
+            return false;
+        }
+
+        out[i] = pixel.value;
+    }
+
+    blit::premultiply_span(out, (size_t)width * height);
+    return true;
+}
+
+bool decode(const uint8_t *data, size_t size, DecodedImage &image) {
+    if (size >= 4 && memcmp(data, "qoif", 4) == 0) {
+        return decode_qoi(data, size, image);
+    }
+
+    if (size >= 2 && data[0] == 'P' && (data[1] == '5' || data[1] == '6')) {
+        return decode_ppm(data, size, image);
+    }
+
+    return false;
+}
+
+// Returns the offset of the pixels if 'data' is a valid cache file, or 0
+size_t check_cache(const uint8_t *data, size_t size, ImageCacheHeader &header) {
+    if (size < sizeof(header)) {
+        return 0;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    uint64_t pixel_size = (uint64_t)header.width * header.height * 4;
+    if (header.magic != image_cache_magic || header.version != image_cache_version
+            || header.width <= 0 || header.height <= 0
+            || (uint32_t)header.width > max_image_dimension || (uint32_t)header.height > max_image_dimension
+            || header.pixel_size != pixel_size || header.pixel_offset < sizeof(header)
+            || header.pixel_offset % 4 != 0 || header.pixel_offset + pixel_size > size) {
+        return 0;
+    }
+
+    return header.pixel_offset;
+}
+
+std::string cache_path(const std::string &cache_dir, uint64_t source_key) {
+    return std::format("{}/{:016x}.image", cache_dir, source_key);
+}
+
+void store_cache(const Image &image, const std::string &cache_dir, uint64_t source_key) {
+    Vector2i size = image.size();
+
+    ImageCacheHeader header = {
+        .magic = image_cache_magic,
+        .version = image_cache_version,
+        .source_key = source_key,
+        .width = size.x,
+        .height = size.y,
+        .pixel_offset = sizeof(ImageCacheHeader),
+        .pixel_size = (uint64_t)size.x * size.y * 4,
+        .reserved = {},
+    };
+
+    std::vector<uint8_t> data(sizeof(header) + header.pixel_size);
+    memcpy(data.data(), &header, sizeof(header));
+
+    for (int y = 0; y < size.y; y++) {
+        memcpy(data.data() + sizeof(header) + (size_t)y * size.x * 4,
+            image.pixels() + y * image.stride(), size.x * 4);
+    }
+
+    if (auto r = os::make_path(cache_dir, 0755); r.is_err()) {
+        logger::warn("Failed to create cache directory '{}': {}", cache_dir, r.move_err().as_string());
+        return;
+    }
+
+    auto path = cache_path(cache_dir, source_key);
+    if (auto r = os::replace_file(path, data.data(), data.size()); r.is_err()) {
+        logger::warn("Failed to write image cache '{}': {}", path, r.move_err().as_string());
+    }
+}
+
+}
+
+Result<Image *, ReimuError> Image::create(File &file) {
+    return create(file, "");
+}
+
+Result<Image *, ReimuError> Image::create(File &file, const std::string &cache_dir) {
+    // Cached images are found by the path, size and modification time of the source,
+    // so loading from the cache never reads the source. Sources with no known
+    // modification time aren't cached, as changes to them couldn't be seen
+    uint64_t source_key = 0;
+    if (uint64_t modified_time = file.modified_time(); !cache_dir.empty() && modified_time) {
+        uint64_t file_size = file.file_size();
+
+        source_key = data_hash(file.path().data(), file.path().size());
+        source_key = data_hash(&file_size, sizeof(file_size), source_key);
+        source_key = data_hash(&modified_time, sizeof(modified_time), source_key);
+
+        auto path = cache_path(cache_dir, source_key);
+        if (auto r = os::map_file(path); !r.is_err()) {
+            std::shared_ptr<os::MappedFile> mapping = r.move_val();
+
+            ImageCacheHeader header;
+            size_t offset = check_cache(mapping->data(), mapping->size(), header);
+            if (offset && header.source_key == source_key) {
+                auto image = new Image();
+                image->m_pixels = mapping->data() + offset;
+                image->m_size = { header.width, header.height };
+                image->m_stride = header.width * 4;
+                image->m_storage = std::move(mapping);
+                image->m_is_mapped = true;
+
+                return OK(image);
+            }
+
+            logger::warn("Image cache '{}' is corrupt", path);
+        }
+    }
+
+    auto data = std::make_shared<std::vector<uint8_t>>(TRY(file.read(file.file_size())));
+
+    // Cache files can be loaded directly, pointing into the data read
+    ImageCacheHeader header;
+    if (size_t offset = check_cache(data->data(), data->size(), header)) {
+        auto image = new Image();
+        image->m_pixels = data->data() + offset;
+        image->m_size = { header.width, header.height };
+        image->m_stride = header.width * 4;
+        image->m_storage = std::move(data);
+
+        return OK(image);
+    }
+
+    auto decoded = std::make_shared<DecodedImage>();
+    if (!decode(data->data(), data->size(), *decoded)) {
+        return ERR(ReimuError::FailedToLoadImage);
+    }
+
+    auto image = new Image();
+    image->m_pixels = decoded->pixels.data();
+    image->m_size = decoded->size;
+    image->m_stride = decoded->size.x * 4;
+    image->m_storage = std::move(decoded);
+
+    if (source_key) {
+        store_cache(*image, cache_dir, source_key);
+    }
+
+    return OK(image);
+}
+
+StringID Image::obj_type_id() const {
+    return Image::type_id();
+}
+
+std::shared_ptr<Image> Image::sub_image(const Recti &region) const {
+    Recti visible = region.intersect(Recti::from_size({0, 0}, m_size));
+
+    auto image = std::shared_ptr<Image>{ new Image() };
+    image->m_storage = m_storage;
+    image->m_stride = m_stride;
+    image->m_is_mapped = m_is_mapped;
+
+    if (!visible.is_empty()) {
+        image->m_pixels = m_pixels + visible.y * m_stride + visible.x * 4;
+        image->m_size = { visible.width(), visible.height() };
+    }
+
+    return image;
+}
+
+}
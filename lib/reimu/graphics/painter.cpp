@@ -1,6 +1,11 @@
 #include <reimu/graphics/painter.h>
 
 #include <reimu/core/logger.h>
+#include <reimu/graphics/text.h>
+
+#include <algorithm>
+
+#include "blit.h"
 
 namespace reimu::graphics {
 
@@ -12,82 +17,201 @@ static Recti get_visible_rect(const Surface &surface, const Rectf &rect) {
         .intersect((Recti)vector_static_cast<int>((Vector4f)rect));
 }
 
-Painter::Painter(Surface &surface)
-    : m_surface(surface) {}
+Painter::Painter(Surface &surface, PaintMode mode)
+    : m_surface(surface), m_mode(mode) {}
 
-Painter &Painter::draw_rect(const Rectf &rect, const Color &color) {
-    Recti clipped_rect = get_visible_rect(m_surface, rect);
+Painter::Painter(Surface &surface, DisplayList &retained, PaintMode mode)
+    : m_surface(surface), m_mode(mode), m_retained(&retained) {}
 
-    if (clipped_rect.width() <= 0 || clipped_rect.height() <= 0) {
-        return *this;
+Painter::~Painter() {
+    if (m_retained) {
+        draw_retained();
+    } else {
+        flush();
     }
 
-    // TODO: Consider vectorising this
-    uint32_t stride = m_surface.stride();
-    uint8_t *buffer = m_surface.buffer() + clipped_rect.y * stride + clipped_rect.x * 4;
-    uint32_t pixel_value = color.value;
-    
-    size_t rows = clipped_rect.height();
-    size_t pixels_per_row = clipped_rect.width();
-
-    while (rows--) {
-        for (uint32_t i = 0; i < pixels_per_row; i++) {
-            reinterpret_cast<uint32_t*>(buffer)[i] = pixel_value;
-        }
+    m_surface.update();
+}
 
-        buffer += stride;
+Painter &Painter::draw_rect(const Rectf &rect, const Color &color) {
+    // Small opaque fills, such as terminal cells, cost less to draw than to record and rasterize
+    if (m_mode == PaintMode::Immediate && !m_retained && color.a == 0xff) {
+        Recti visible = get_visible_rect(m_surface, rect);
+        if (visible.area() <= max_direct_fill_area) {
+            fill_direct(visible, color);
+            return *this;
+        }
     }
 
-    return *this;
+    m_list.fill_rect(get_visible_rect(m_surface, rect), color);
+    return command_added();
+}
+
+Painter &Painter::blend_rect(const Rectf &rect, const Color &color, BlendMode mode) {
+    m_list.blend_rect(get_visible_rect(m_surface, rect), color, mode);
+    return command_added();
 }
 
 Painter &Painter::draw_rect_gradient(const Rectf &rect, const Color &c1, const Color &c2,
         const Vector2f &p1, const Vector2f &p2) {
-    Recti clipped_rect = get_visible_rect(m_surface, rect);
+    m_list.gradient_rect(get_visible_rect(m_surface, rect), c1, c2, p1, p2);
+    return command_added();
+}
+
+Painter &Painter::draw_text(Text &text, const Rectf &bounds) {
+    text.render(m_list, bounds, Recti::from_size({0, 0}, m_surface.size()));
+    return command_added();
+}
 
-    if (clipped_rect.width() <= 0 || clipped_rect.height() <= 0) {
+Painter &Painter::draw_rect_outline(const Rectf &rect, const Color &color, int thickness) {
+    if (thickness <= 0) {
         return *this;
     }
 
-    auto length = (p2 - p1).magnitude();
-    auto normalized = (p2 - p1).normalize();
+    float t = thickness;
+    if (t * 2 >= rect.width() || t * 2 >= rect.height()) {
+        return draw_rect(rect, color);
+    }
 
-    float dy = normalized.y / length;
-    float dx = normalized.x / length;
+    // Top and bottom span the full width and the sides fit between them, so no pixel is drawn twice
+    m_list.fill_rect(get_visible_rect(m_surface, { rect.x, rect.y, rect.z, rect.y + t }), color);
+    m_list.fill_rect(get_visible_rect(m_surface, { rect.x, rect.w - t, rect.z, rect.w }), color);
+    m_list.fill_rect(get_visible_rect(m_surface, { rect.x, rect.y + t, rect.x + t, rect.w - t }), color);
+    m_list.fill_rect(get_visible_rect(m_surface, { rect.z - t, rect.y + t, rect.z, rect.w - t }), color);
 
-    uint8_t *row = m_surface.buffer() + m_surface.stride() * clipped_rect.y;
+    return command_added();
+}
 
-    float y = clipped_rect.y / length;
-    uint32_t rows = clipped_rect.height();
-    while (rows--) {
-        uint32_t *pixel = ((uint32_t*)row) + clipped_rect.x;
+Painter &Painter::draw_line(const Vector2f &begin, const Vector2f &end, const Color &color, int thickness) {
+    m_list.draw_line(begin, end, color, thickness, Recti::from_size({0, 0}, m_surface.size()));
+    return command_added();
+}
+
+Painter &Painter::draw_lines(std::span<const Vector2f> points, const Color &color, int thickness) {
+    Recti clip = Recti::from_size({0, 0}, m_surface.size());
 
-        float blend = y + clipped_rect.x / length;
-        uint32_t cols = clipped_rect.width();
-        while (cols--) {
-            uint16_t blend_factor = std::min<uint16_t>(std::max<uint16_t>(static_cast<uint16_t>(blend * 255), 0), 255);
-            uint16_t one_minus = 255 - blend_factor;
+    for (size_t i = 1; i < points.size(); i++) {
+        // Each joint is drawn by the line after it
+        bool is_last = i + 1 == points.size();
+        m_list.draw_line(points[i - 1], points[i], color, thickness, clip, is_last);
+    }
+
+    return command_added();
+}
+
+Painter &Painter::draw_image(const Rectf &rect, std::shared_ptr<const Surface> image, const Recti &source) {
+    m_list.copy_image((Recti)vector_static_cast<int>((Vector4f)rect), std::move(image), source,
+        Recti::from_size({0, 0}, m_surface.size()));
+    return command_added();
+}
+
+Painter &Painter::draw_image(const Rectf &rect, std::shared_ptr<const Image> image, const Recti &source) {
+    m_list.copy_image((Recti)vector_static_cast<int>((Vector4f)rect), std::move(image), source,
+        Recti::from_size({0, 0}, m_surface.size()));
+    return command_added();
+}
 
-            // Split up red-blue, alpha-green
-            uint32_t rb = (c1.value & 0x00ff00ff) * one_minus + (c2.value & 0x00ff00ff) * blend_factor;
-            uint32_t ag = ((c1.value & 0xff00ff00) >> 8) * one_minus + ((c2.value & 0xff00ff00) >> 8) * blend_factor;
+Painter &Painter::draw_image(const Vector2f &pos, std::shared_ptr<const Image> image) {
+    Recti source = Recti::from_size({0, 0}, image->size());
+    Recti rect = Recti::from_size(vector_static_cast<int>(pos), image->size());
 
-            *(pixel++) = ((rb & 0xff00ff00) >> 8) | ((ag & 0xff00ff00));
-            blend += dx;
+    m_list.copy_image(rect, std::move(image), source, Recti::from_size({0, 0}, m_surface.size()));
+    return command_added();
+}
+
+Painter &Painter::draw_nine_slice(const Rectf &rect, const NineSlice &image) {
+    Recti dest = (Recti)vector_static_cast<int>((Vector4f)rect);
+    Vector2i size = image.shared_surface()->size();
+    const Recti &center = image.center();
+
+    // Left and top sides take priority when both don't fit
+    int left = std::clamp(center.x, 0, std::max(dest.width(), 0));
+    int right = std::clamp(size.x - center.z, 0, std::max(dest.width() - left, 0));
+    int top = std::clamp(center.y, 0, std::max(dest.height(), 0));
+    int bottom = std::clamp(size.y - center.w, 0, std::max(dest.height() - top, 0));
+
+    int dest_x[] = { dest.x, dest.x + left, dest.z - right, dest.z };
+    int dest_y[] = { dest.y, dest.y + top, dest.w - bottom, dest.w };
+    int source_x[] = { 0, left, center.x, center.z, size.x - right, size.x };
+    int source_y[] = { 0, top, center.y, center.w, size.y - bottom, size.y };
+
+    Recti clip = Recti::from_size({0, 0}, m_surface.size());
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 3; column++) {
+            if (row == 1 && column == 1 && !image.draws_center()) {
+                continue;
+            }
+
+            Recti part = { dest_x[column], dest_y[row], dest_x[column + 1], dest_y[row + 1] };
+            Recti source = {
+                source_x[column * 2], source_y[row * 2],
+                source_x[column * 2 + 1], source_y[row * 2 + 1]
+            };
+
+            m_list.copy_image(part, image.shared_surface(), source, clip);
         }
+    }
 
-        row += m_surface.stride();
-        y += dy;
+    return command_added();
+}
+
+void Painter::flush() {
+    if (m_retained || m_list.is_empty()) {
+        return;
     }
 
-    return *this;
+    if (m_mode == PaintMode::Tiled) {
+        m_list.rasterize_tiled(m_surface);
+    } else {
+        m_list.rasterize(m_surface);
+    }
+
+    m_surface.set_opaque_rect(m_list.opaque_rect(m_surface.alpha_mode(), m_surface.opaque_rect()));
+
+    m_list.clear();
 }
 
-Painter &Painter::draw_rect_outline(const Rectf &rect, const Color &color, int thickness) {
-    return *this;
+void Painter::draw_retained() {
+    std::vector<Recti> damage;
+    m_list.diff(*m_retained, damage);
+
+    if (m_mode == PaintMode::Tiled) {
+        m_list.rasterize_tiled(m_surface, damage);
+    } else {
+        m_list.rasterize(m_surface, damage);
+    }
+
+    std::swap(m_list, *m_retained);
+
+    // The surface holds everything in the retained list, not only what was drawn now
+    m_surface.set_opaque_rect(m_retained->opaque_rect(m_surface.alpha_mode()));
 }
 
-Painter &Painter::draw_line(const Vector2f &begin, const Vector2f &end, const Color &color, int thickness) {
+void Painter::fill_direct(const Recti &rect, const Color &color) {
+    if (rect.is_empty()) {
+        return;
+    }
+
+    m_surface.add_damage(rect);
+
+    // Opaque, so the same in either alpha mode
+    size_t stride = m_surface.stride();
+    uint8_t *row = m_surface.buffer() + rect.y * stride + rect.x * 4;
+    for (int y = rect.y; y < rect.w; y++, row += stride) {
+        blit::fill_span((uint32_t *)row, rect.width(), color.value);
+    }
+
+    // As DisplayList::opaque_rect does for an opaque fill
+    if (m_surface.opaque_rect().is_empty() || rect.area() >= m_surface.opaque_rect().area()) {
+        m_surface.set_opaque_rect(rect);
+    }
+}
+
+Painter &Painter::command_added() {
+    if (m_mode == PaintMode::Immediate && !m_retained) {
+        flush();
+    }
+
     return *this;
 }
 
@@ -1,10 +1,20 @@
 #include <reimu/graphics/renderer.h>
+#include <reimu/graphics/software_renderer.h>
+
+#include <string_view>
+
+#include <stdlib.h>
 
 #include "webgpu/renderer.h"
 
 namespace reimu::graphics {
 
 Result<Renderer *, ReimuError> create_attach_renderer(video::Window *window) {
+    // REIMU_RENDERER=software renders without a GPU
+    if (auto name = getenv("REIMU_RENDERER"); name && std::string_view{name} == "software") {
+        return OK(SoftwareRenderer::create(window));
+    }
+
     Renderer *r = WebGPURenderer::create(window);
     if (r) {
         return OK(r);
@@ -0,0 +1,136 @@
+#include "render_pass.h"
+
+#include <reimu/core/logger.h>
+#include <reimu/graphics/software_renderer.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <string.h>
+
+#include "../blit.h"
+#include "texture.h"
+
+namespace reimu::graphics {
+
+static Recti round_rect(const Vector4f &rect) {
+    return { (int)std::lround(rect.x), (int)std::lround(rect.y), (int)std::lround(rect.z), (int)std::lround(rect.w) };
+}
+
+SoftwareRenderPass::SoftwareRenderPass(SoftwareRenderer &renderer, AlphaMode alpha_mode)
+        : m_renderer(renderer), m_alpha_mode(alpha_mode) {}
+
+SoftwareRenderPass::~SoftwareRenderPass() {
+    m_renderer.on_destroy_render_pass(this);
+}
+
+void SoftwareRenderPass::render(uint32_t *framebuffer, const Vector2i &size) {
+    if (!strategy) {
+        return;
+    }
+
+    m_framebuffer = framebuffer;
+    m_framebuffer_size = size;
+
+    strategy->draw(m_renderer, *this);
+
+    m_framebuffer = nullptr;
+}
+
+void SoftwareRenderPass::draw(int num_vertices) {
+    draw_instanced(num_vertices, 1, 0);
+}
+
+void SoftwareRenderPass::draw_instanced(int num_vertices, int num_instances, int first_instance) {
+    // Every instance is a quad
+    if (num_vertices != 4 || !m_texture || !m_framebuffer) {
+        return;
+    }
+
+    size_t end = std::min(m_instances.size(), (size_t)first_instance + num_instances);
+    for (size_t i = first_instance; i < end; i++) {
+        draw_instance(m_instances[i]);
+    }
+}
+
+void SoftwareRenderPass::bind_texture(int, Texture *texture) {
+    // A null texture clears the binding, as on the GPU
+    m_texture = texture ? static_cast<SoftwareTexture *>(&texture->backing_texture()) : nullptr;
+}
+
+void SoftwareRenderPass::bind_uniform_buffer(int, const void *, size_t) {
+    // The only uniform of the default shader is the view transform, which maps regions to pixels
+}
+
+void SoftwareRenderPass::bind_storage_buffer(int, const void *data, size_t size) {
+    m_instances.resize(size / sizeof(Instance));
+    memcpy(m_instances.data(), data, m_instances.size() * sizeof(Instance));
+}
+
+void SoftwareRenderPass::draw_instance(const Instance &instance) {
+    Recti source = round_rect(instance.source);
+    Recti target = round_rect(instance.target);
+
+    uint32_t opacity = (uint32_t)std::clamp(std::lround(instance.opacity * 255), 0l, 255l);
+    if (source.is_empty() || target.is_empty() || opacity == 0) {
+        return;
+    }
+
+    Vector2i tex_size = m_texture->size();
+    const uint32_t *pixels = m_texture->pixels();
+
+    Recti visible = target.intersect(Recti::from_size({0, 0}, m_framebuffer_size));
+
+    bool is_scaled = source.size() != target.size();
+    if (!is_scaled) {
+        // Only draw where the source is within the texture
+        Vector2i offset = target.top_left() - source.top_left();
+        Recti readable = source.intersect(Recti::from_size({0, 0}, tex_size));
+
+        visible = visible.intersect(Recti::from_size(readable.top_left() + offset, readable.size()));
+    }
+
+    if (visible.is_empty()) {
+        return;
+    }
+
+    bool is_straight = m_alpha_mode == AlphaMode::Straight;
+    size_t width = visible.width();
+
+    for (int y = visible.y; y < visible.w; y++) {
+        uint32_t *dest = m_framebuffer + (size_t)y * m_framebuffer_size.x + visible.x;
+        const uint32_t *src;
+
+        if (!is_scaled) {
+            int source_y = source.y + (y - target.y);
+            src = pixels + (size_t)source_y * tex_size.x + source.x + (visible.x - target.x);
+        } else {
+            // Nearest pixel to the centre of each target pixel, like textureLoad of the interpolated position
+            int source_y = source.y + (int)((y + 0.5f - target.y) * source.height() / target.height());
+            source_y = std::clamp(source_y, 0, tex_size.y - 1);
+
+            m_row.resize(width);
+            for (size_t i = 0; i < width; i++) {
+                int source_x = source.x + (int)((visible.x + i + 0.5f - target.x) * source.width() / target.width());
+                source_x = std::clamp(source_x, 0, tex_size.x - 1);
+
+                m_row[i] = pixels[(size_t)source_y * tex_size.x + source_x];
+            }
+
+            src = m_row.data();
+        }
+
+        if (is_straight) {
+            if (src != m_row.data()) {
+                m_row.assign(src, src + width);
+            }
+
+            blit::premultiply_span(m_row.data(), width);
+            src = m_row.data();
+        }
+
+        blit::composite_span(dest, src, width, opacity);
+    }
+}
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <reimu/graphics/render_pass.h>
+#include <reimu/graphics/texture.h>
+#include <reimu/graphics/vector.h>
+
+#include <vector>
+
+namespace reimu::graphics {
+
+class SoftwareRenderer;
+class SoftwareTexture;
+
+/**
+ * @brief Pass drawing the default shader's instances into the framebuffer
+ *
+ * Instances copy a region of the texture bound to a region of the framebuffer,
+ * scaled by their opacity and composited over what is there. Regions are in
+ * pixels of the framebuffer, as the compositor's view transform maps them.
+ */
+class SoftwareRenderPass : public RenderPass {
+public:
+    SoftwareRenderPass(SoftwareRenderer &renderer, AlphaMode alpha_mode);
+    ~SoftwareRenderPass() override;
+
+    /**
+     * @brief Run the strategy, drawing over 'framebuffer'
+     */
+    void render(uint32_t *framebuffer, const Vector2i &size);
+
+    void draw(int num_vertices) override;
+    void draw_instanced(int num_vertices, int num_instances, int first_instance) override;
+    void bind_texture(int index, Texture *texture) override;
+    void bind_uniform_buffer(int index, const void *data, size_t size) override;
+    void bind_storage_buffer(int index, const void *data, size_t size) override;
+
+    inline void set_strategy(RenderStrategy *strategy) override {
+        this->strategy = strategy;
+    }
+
+    RenderStrategy *strategy = nullptr;
+
+private:
+    // Laid out like the Instance struct of the default shader
+    struct Instance {
+        Vector4f source;
+        Vector4f target;
+        float opacity;
+        float padding[3];
+    };
+
+    void draw_instance(const Instance &instance);
+
+    SoftwareRenderer &m_renderer;
+    AlphaMode m_alpha_mode;
+
+    SoftwareTexture *m_texture = nullptr;
+    std::vector<Instance> m_instances;
+
+    // Output while rendering
+    uint32_t *m_framebuffer = nullptr;
+    Vector2i m_framebuffer_size = {0, 0};
+
+    // Source pixels of a row, when they need converting first
+    std::vector<uint32_t> m_row;
+};
+
+}
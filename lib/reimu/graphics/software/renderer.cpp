@@ -0,0 +1,130 @@
+#include <reimu/graphics/software_renderer.h>
+
+#include <reimu/core/logger.h>
+#include <reimu/os/fs.h>
+#include <reimu/video/window.h>
+
+#include <format>
+
+#include <stdlib.h>
+
+#include "../blit.h"
+#include "render_pass.h"
+#include "texture.h"
+
+namespace reimu::graphics {
+
+SoftwareRenderer::SoftwareRenderer(const Vector2i &viewport_size) {
+    resize_viewport(viewport_size);
+}
+
+SoftwareRenderer::~SoftwareRenderer() {
+
+}
+
+SoftwareRenderer *SoftwareRenderer::create(video::Window *window) {
+    auto *renderer = new SoftwareRenderer(window->get_size());
+
+    if (auto dir = getenv("REIMU_FRAME_DUMP_DIR"); dir && *dir) {
+        renderer->set_frame_dump_dir(dir);
+    }
+
+    window->set_renderer(renderer);
+
+    return renderer;
+}
+
+bool SoftwareRenderer::render() {
+    m_frame_stats = {};
+
+    // Cleared to opaque black, like the first pass of the GPU renderer
+    blit::fill_span(m_framebuffer.data(), m_framebuffer.size(), 0xff000000);
+
+    for (auto *pass : m_render_passes) {
+        pass->render(m_framebuffer.data(), m_viewport_size);
+    }
+
+    if (!m_frame_dump_dir.empty()) {
+        auto path = std::format("{}/frame_{:05}.ppm", m_frame_dump_dir, m_frame_index);
+
+        if (write_ppm(path).is_err()) {
+            logger::warn("Failed to write frame to {}", path);
+        }
+    }
+
+    m_frame_index++;
+
+    // Frames stay in memory
+    return false;
+}
+
+Result<void, ReimuError> SoftwareRenderer::load_shader(const std::string &name, const char *) {
+    // Passes draw the default shader's instances in code
+    logger::warn("Software renderer can't load shader '{}'", name);
+
+    return ERR(ReimuError::RendererShaderCompilationFailed);
+}
+
+Result<RenderPass *, ReimuError> SoftwareRenderer::create_render_pass(const BindingDefinition *,
+        size_t, AlphaMode alpha_mode, const std::string &shader) {
+    if (shader != "default") {
+        logger::warn("Software renderer only draws the default shader, not '{}'", shader);
+
+        return ERR(ReimuError::RendererError);
+    }
+
+    auto *render_pass = new SoftwareRenderPass{*this, alpha_mode};
+
+    m_render_passes.push_back(render_pass);
+
+    return OK(render_pass);
+}
+
+Result<Texture *, ReimuError> SoftwareRenderer::create_texture(const Vector2i &size, ColorFormat format) {
+    return OK(new SoftwareTexture(format, size));
+}
+
+void SoftwareRenderer::resize_viewport(const Vector2i &size) {
+    m_viewport_size = size;
+
+    m_framebuffer.assign((size_t)size.x * size.y, 0xff000000);
+}
+
+void SoftwareRenderer::set_present_mode(PresentMode) {
+    // Frames are never presented, so rendering never waits
+}
+
+ColorFormat SoftwareRenderer::display_surface_color_format() const {
+    return ColorFormat::RGBA8;
+}
+
+void SoftwareRenderer::set_frame_dump_dir(std::string dir) {
+    m_frame_dump_dir = std::move(dir);
+}
+
+Result<void, ReimuError> SoftwareRenderer::write_ppm(const std::string &path) const {
+    std::string data = std::format("P6\n{} {}\n255\n", m_viewport_size.x, m_viewport_size.y);
+
+    // The frame is opaque, so premultiplied colors are the colors shown
+    size_t header_size = data.size();
+    data.resize(header_size + m_framebuffer.size() * 3);
+
+    char *out = data.data() + header_size;
+    for (uint32_t pixel : m_framebuffer) {
+        *out++ = pixel & 0xff;
+        *out++ = (pixel >> 8) & 0xff;
+        *out++ = (pixel >> 16) & 0xff;
+    }
+
+    if (os::replace_file(path, data.data(), data.size()).is_err()) {
+        return ERR(ReimuError::IOError);
+    }
+
+    return OK();
+}
+
+void SoftwareRenderer::on_destroy_render_pass(RenderPass *render_pass) {
+    std::erase(m_render_passes, (SoftwareRenderPass *)render_pass);
+}
+
+}
@@ -0,0 +1,49 @@
+#include "texture.h"
+
+#include <reimu/core/logger.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace reimu::graphics {
+
+SoftwareTexture::SoftwareTexture(ColorFormat fmt, const Vector2i &size) : Texture(fmt, size) {
+    replace(fmt, size);
+}
+
+void SoftwareTexture::replace(ColorFormat fmt, const Vector2i &size) {
+    // Pixels are composited as 32-bit words
+    if (get_color_format_info(fmt).bytes_per_pixel != 4) {
+        logger::fatal("Unsupported color format for software texture");
+    }
+
+    m_format = fmt;
+    m_size = size;
+
+    m_pixels.assign((size_t)size.x * size.y, 0);
+}
+
+void SoftwareTexture::update(const void *data, size_t size) {
+    memcpy(m_pixels.data(), data, std::min(size, m_pixels.size() * 4));
+}
+
+void SoftwareTexture::update_region(const void *data, size_t stride, const Recti &region) {
+    auto *region_data = (const uint8_t *)data + region.y * stride + region.x * 4;
+
+    write_region(region_data, stride, region);
+}
+
+void SoftwareTexture::write_region(const void *data, size_t stride, const Recti &region) {
+    Recti visible = region.intersect(Recti::from_size({0, 0}, m_size));
+    if (visible.is_empty()) {
+        return;
+    }
+
+    auto *src = (const uint8_t *)data + (visible.y - region.y) * stride + (visible.x - region.x) * 4;
+    for (int y = visible.y; y < visible.w; y++, src += stride) {
+        memcpy(m_pixels.data() + (size_t)y * m_size.x + visible.x, src, visible.width() * 4);
+    }
+}
+
+}
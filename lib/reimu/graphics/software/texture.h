@@ -0,0 +1,30 @@
+#pragma once
+
+#include <reimu/graphics/texture.h>
+
+#include <vector>
+
+namespace reimu::graphics {
+
+/**
+ * @brief Texture kept in memory, writes are copied straight into it
+ */
+class SoftwareTexture final : public Texture {
+public:
+    SoftwareTexture(ColorFormat fmt, const Vector2i &size);
+
+    void replace(ColorFormat fmt, const Vector2i &size) override;
+    void update(const void *data, size_t size) override;
+    void update_region(const void *data, size_t stride, const Recti &region) override;
+    void write_region(const void *data, size_t stride, const Recti &region) override;
+
+    // Rows are the width of the texture
+    inline const uint32_t *pixels() const {
+        return m_pixels.data();
+    }
+
+private:
+    std::vector<uint32_t> m_pixels;
+};
+
+}
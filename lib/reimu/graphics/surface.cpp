@@ -1,37 +1,160 @@
 #include <reimu/graphics/surface.h>
 
+#include <cstdint>
+
 namespace reimu::graphics {
 
+// Past this many rects, new damage is merged into the rect where it wastes the least area
+static constexpr size_t max_damage_rects = 16;
+
+static int64_t rect_area(const Recti &rect) {
+    return (int64_t)rect.width() * rect.height();
+}
+
+// Area the union of a and b covers which neither covers alone, negative when they overlap
+static int64_t merge_cost(const Recti &a, const Recti &b) {
+    Recti overlap = a.intersect(b);
+    int64_t overlap_area = overlap.is_empty() ? 0 : rect_area(overlap);
+
+    return rect_area(a.union_with(b)) - rect_area(a) - rect_area(b) + overlap_area;
+}
+
 Surface::Surface(Texture *tex) {
     m_color_format = tex->color_format();
     m_size = tex->size();
+    m_capacity = m_size;
 
     m_texture = std::unique_ptr<Texture>{tex};
 
     make_buffer();
 }
 
+Surface::Surface(const Vector2i &size, ColorFormat format)
+        : m_color_format(format), m_size(size), m_capacity(size) {
+    make_buffer();
+}
+
+Surface::Surface(SurfacePool &pool, const Vector2i &size, ColorFormat format)
+        : m_color_format(format), m_size(size), m_pool(&pool) {
+    auto storage = pool.acquire(size, format);
+
+    m_texture = std::move(storage.texture);
+    m_buffer = std::move(storage.buffer);
+    m_capacity = m_texture->size();
+
+    add_damage(Recti::from_size({0, 0}, m_size));
+}
+
 Surface::~Surface() {
+    if (m_pool) {
+        m_pool->release({ std::move(m_texture), std::move(m_buffer) });
+    }
+
     m_texture = nullptr;
 }
 
 void Surface::resize(const Vector2i &size) {
-    m_texture->replace(m_color_format, size);
+    m_opaque_rect = {};
+
+    if (!m_pool) {
+        if (m_texture) {
+            m_texture->replace(m_color_format, size);
+        }
+
+        m_size = size;
+        m_capacity = size;
+
+        make_buffer();
+        return;
+    }
+
+    // Swap storage with the pool only when changing size class,
+    // so resizing a little each frame doesn't allocate
+    if (SurfacePool::size_class(size) != m_capacity) {
+        m_pool->release({ std::move(m_texture), std::move(m_buffer) });
+
+        auto storage = m_pool->acquire(size, m_color_format);
+        m_texture = std::move(storage.texture);
+        m_buffer = std::move(storage.buffer);
+        m_capacity = m_texture->size();
+    }
+
     m_size = size;
 
-    make_buffer();
+    m_damage.clear();
+    add_damage(Recti::from_size({0, 0}, m_size));
+}
+
+void Surface::add_damage(const Recti &rect) {
+    Recti damage = Recti::from_size({0, 0}, m_size).intersect(rect);
+    if (damage.is_empty()) {
+        return;
+    }
+
+    // Repainting somewhere already damaged, common for small repeated draws
+    for (const auto &existing : m_damage) {
+        if (existing.x <= damage.x && existing.y <= damage.y && existing.z >= damage.z && existing.w >= damage.w) {
+            return;
+        }
+    }
+
+    // Absorb any rects which can be merged for free, which may let the result merge with others
+    for (size_t i = 0; i < m_damage.size();) {
+        if (merge_cost(m_damage[i], damage) <= 0) {
+            damage = damage.union_with(m_damage[i]);
+
+            m_damage[i] = m_damage.back();
+            m_damage.pop_back();
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (m_damage.size() < max_damage_rects) {
+        m_damage.push_back(damage);
+        return;
+    }
+
+    // Merge into the rect which wastes the least area, linear in the number of rects
+    // as painting many small rects adds damage for each one
+    size_t best = 0;
+    int64_t best_cost = INT64_MAX;
+
+    for (size_t i = 0; i < m_damage.size(); i++) {
+        int64_t cost = merge_cost(m_damage[i], damage);
+        if (cost < best_cost) {
+            best = i;
+            best_cost = cost;
+        }
+    }
+
+    m_damage[best] = m_damage[best].union_with(damage);
 }
 
 void Surface::update() {
-    m_texture->update(m_buffer.data(), m_buffer.size());
+    if (!m_texture) {
+        m_damage.clear();
+        return;
+    }
+
+    for (const auto &rect : m_damage) {
+        m_texture->update_region(m_buffer.data(), stride(), rect);
+    }
+
+    m_damage.clear();
 }
 
 void Surface::make_buffer() {
     size_t buffer_size = m_size.x * m_size.y;
-    
+
     buffer_size *= get_color_format_info(m_color_format).bytes_per_pixel;
 
     m_buffer.resize(buffer_size);
+
+    // The texture is new, so all of it needs uploading
+    m_damage.clear();
+    add_damage(Recti::from_size({0, 0}, m_size));
 }
 
 }
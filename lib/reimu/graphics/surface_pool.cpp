@@ -0,0 +1,62 @@
+#include <reimu/graphics/surface_pool.h>
+
+namespace reimu::graphics {
+
+// Small sizes round up to a power of two, larger ones to a multiple of this,
+// so large surfaces don't waste up to half their memory
+static constexpr int large_class_step = 128;
+
+static int round_dimension(int n) {
+    if (n > large_class_step) {
+        return (n + large_class_step - 1) / large_class_step * large_class_step;
+    }
+
+    int rounded = 16;
+    while (rounded < n) {
+        rounded *= 2;
+    }
+
+    return rounded;
+}
+
+SurfacePool::SurfacePool(CreateTextureFn create_texture, size_t max_free_bytes)
+    : m_create_texture(std::move(create_texture)), m_max_free_bytes(max_free_bytes) {}
+
+Vector2i SurfacePool::size_class(const Vector2i &size) {
+    return { round_dimension(size.x), round_dimension(size.y) };
+}
+
+SurfacePool::Storage SurfacePool::acquire(const Vector2i &size, ColorFormat format) {
+    Vector2i storage_size = size_class(size);
+
+    auto it = m_free.find(key(storage_size, format));
+    if (it != m_free.end() && !it->second.empty()) {
+        Storage storage = std::move(it->second.back());
+        it->second.pop_back();
+
+        m_free_bytes -= storage.buffer.size();
+        return storage;
+    }
+
+    Storage storage;
+    storage.texture = std::unique_ptr<Texture>{m_create_texture(storage_size, format)};
+    storage.buffer.resize((size_t)storage_size.x * storage_size.y
+        * get_color_format_info(format).bytes_per_pixel);
+
+    return storage;
+}
+
+void SurfacePool::release(Storage storage) {
+    if (m_free_bytes + storage.buffer.size() > m_max_free_bytes) {
+        return;
+    }
+
+    m_free_bytes += storage.buffer.size();
+    m_free[key(storage.texture->size(), storage.texture->color_format())].push_back(std::move(storage));
+}
+
+uint64_t SurfacePool::key(const Vector2i &size_class, ColorFormat format) {
+    return (uint64_t)size_class.x << 40 | (uint64_t)size_class.y << 8 | (uint64_t)format;
+}
+
+}
@@ -1,6 +1,8 @@
 #include <cstdint>
 #include <reimu/graphics/text.h>
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 
 #include "freetype.h"
@@ -42,138 +44,494 @@ reimu::Result<void, FreeTypeError> FreeType::done_face(FT_Face face) {
 
 namespace reimu::graphics {
 
-Text::Text() {}
+namespace {
 
-Text::Text(std::u32string text) : Text() { set_text(std::move(text)); }
+// TODO: settings to tweak whether to enable font smoothing
+constexpr bool font_smoothing = false;
+
+std::vector<std::u32string> split_paragraphs(std::u32string_view text) {
+    std::vector<std::u32string> paragraphs;
+
+    size_t start = 0;
+    while (true) {
+        size_t end = text.find(U'\n', start);
+        if (end == std::u32string_view::npos) {
+            paragraphs.emplace_back(text.substr(start));
+            break;
+        }
+
+        paragraphs.emplace_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+
+    return paragraphs;
+}
+
+// Lines can be broken after whitespace, which is allowed to hang past the wrap width
+inline bool is_break_opportunity(uint32_t codepoint) {
+    return codepoint == ' ' || codepoint == '\t';
+}
+
+}
+
+void Text::PrefixSums::build(const std::vector<size_t> &values) {
+    m_tree = values;
+
+    // Add each node into its parent
+    for (size_t i = 1; i <= m_tree.size(); i++) {
+        size_t parent = i + (i & -i);
+        if (parent <= m_tree.size()) {
+            m_tree[parent - 1] += m_tree[i - 1];
+        }
+    }
+}
+
+void Text::PrefixSums::add(size_t index, ptrdiff_t delta) {
+    for (size_t i = index + 1; i <= m_tree.size(); i += i & -i) {
+        m_tree[i - 1] += delta;
+    }
+}
+
+size_t Text::PrefixSums::prefix(size_t count) const {
+    size_t sum = 0;
+    for (size_t i = count; i > 0; i -= i & -i) {
+        sum += m_tree[i - 1];
+    }
+
+    return sum;
+}
+
+size_t Text::PrefixSums::find(size_t value) const {
+    size_t index = 0;
+    for (size_t step = std::bit_floor(m_tree.size()); step > 0; step >>= 1) {
+        if (index + step <= m_tree.size() && m_tree[index + step - 1] <= value) {
+            index += step;
+            value -= m_tree[index - 1];
+        }
+    }
+
+    return index;
+}
+
+Text::Text() {
+    m_paragraphs.emplace_back();
+    mark_stale(0, 1);
+}
+
+Text::Text(std::u32string text) : Text() { set_text(text); }
 
 void Text::render(Surface &dest, const Rectf &bounds) {
+    assert(dest.bytes_per_pixel() == 4);
+
+    m_render_list.clear();
+    render(m_render_list, bounds, Recti::from_size({0, 0}, dest.size()));
+    m_render_list.rasterize(dest);
+}
+
+void Text::render(DisplayList &list, const Rectf &bounds, const Recti &clip) {
     if (!m_font.get()) {
         return;
     }
 
-    Recti final_bounds = {
-        (int)bounds.x, (int)bounds.y, std::min((int)bounds.z, dest.size().x),
-        std::min((int)bounds.w, dest.size().y), 
+    Recti final_bounds = Recti{ (int)bounds.x, (int)bounds.y, (int)bounds.z, (int)bounds.w }.intersect(clip);
+    if (final_bounds.is_empty()) {
+        return;
+    }
+
+    update_layout();
+
+    auto add_glyph = [&](const Glyph &glyph, int pen_x, int baseline) {
+        if (glyph.width > 0 && glyph.rows > 0) {
+            m_line_glyphs.push_back({ &glyph, { pen_x + glyph.left, baseline - glyph.top } });
+        }
     };
 
-    if (final_bounds.z <= bounds.x || final_bounds.w <= bounds.y) {
-        return;
+    int line_height = m_metrics.line_height;
+
+    // Start at the paragraph with the first visible line
+    size_t first_line = final_bounds.y > bounds.y ? (final_bounds.y - (int)bounds.y) / line_height : 0;
+    size_t first = std::min(m_line_index.find(first_line), m_paragraphs.size() - 1);
+
+    int y = bounds.y + (int)m_line_index.prefix(first) * line_height;
+
+    // Only lay out glyphs for lines which are visible
+    for (size_t p = first; p < m_paragraphs.size(); p++) {
+        const auto &paragraph = m_paragraphs[p];
+        int line_count = paragraph.line_count();
+
+        std::u32string_view text = paragraph.text;
+        for (int i = 0; i < line_count && y < final_bounds.w; i++) {
+            if (y + line_height > final_bounds.y) {
+                size_t begin = i > 0 ? paragraph.line_breaks[i - 1] : 0;
+                size_t end = i < line_count - 1 ? paragraph.line_breaks[i] : text.size();
+
+                // Each line is its own run so tiles only look at the lines crossing them
+                m_line_glyphs.clear();
+                layout_line(text.substr(begin, end - begin), bounds.x, y + m_metrics.ascender,
+                    add_glyph);
+
+                list.draw_glyphs(m_line_glyphs, m_color, final_bounds);
+            }
+
+            y += line_height;
+        }
+
+        if (y >= final_bounds.w) {
+            break;
+        }
     }
+}
 
-    std::unique_lock fontLock(m_font->m_lock);
-    FT_Face face = reinterpret_cast<FT_Face>(m_font->get_handle());
+template<typename GlyphFn>
+int Text::layout_line(std::u32string_view line, int x, int baseline, GlyphFn glyph_fn) {
+    PenState pen;
 
-    if (FT_Set_Pixel_Sizes(face, 0, m_pixel_size)) {
-        reimu::logger::warn("Failed to set font size!");
-        return;
+    for (auto codepoint : line) {
+        // Ignore carriage returns
+        if (codepoint == '\r') {
+            continue;
+        }
+
+        int kerning;
+        const Glyph *glyph = next_glyph(codepoint, pen, kerning);
+
+        x += kerning;
+        glyph_fn(*glyph, x, baseline);
+
+        // Advance the x position
+        x += glyph->advance;
     }
 
-    bool use_kerning = FT_HAS_KERNING(face);
-    // In 64ths of a pixel so r shift by 6
-    unsigned int pixel_line_height = face->size->metrics.height >> 6;
+    return x;
+}
 
-    // Compose a vector of glyphs
-    std::vector<unsigned int> glyphs;
+const Glyph *Text::next_glyph(uint32_t codepoint, PenState &pen, int &kerning) {
+    Font *font;
+    const Glyph *glyph = resolve_glyph(codepoint, font);
 
-    for (int codepoint : m_text) {
-        if (codepoint == '\n') {
-            glyphs.push_back('\n');
-        } else if (codepoint != '\r') { // Ignore carriage returns
-            glyphs.push_back(FT_Get_Char_Index(face, codepoint));
-        }
+    kerning = 0;
+
+    // Only kern between glyphs from the main font
+    if (m_metrics.has_kerning && pen.prev_glyph && font == pen.prev_font && font == m_font.get()) {
+        kerning = font->get_kerning(pen.prev_glyph->index, glyph->index, m_pixel_size);
     }
 
-    if (glyphs.size() == 0) {
-        return;
+    pen.prev_glyph = glyph;
+    pen.prev_font = font;
+
+    return glyph;
+}
+
+const Glyph *Text::resolve_glyph(uint32_t codepoint, Font *&font) {
+    auto [it, inserted] = m_resolved_glyphs.try_emplace(codepoint);
+    auto &resolved = it->second;
+
+    if (inserted) {
+        resolved.font = m_font.get();
+
+        if (!resolved.font->has_codepoint(codepoint)) {
+            for (auto &fallback : m_fallback_fonts) {
+                if (fallback->has_codepoint(codepoint)) {
+                    resolved.font = fallback.get();
+                    break;
+                }
+            }
+        }
+
+        resolved.glyph = resolved.font->get_glyph(codepoint, m_pixel_size, font_smoothing);
     }
 
-    int x_pos = final_bounds.x;
-    int y_pos = final_bounds.y;
+    font = resolved.font;
+    return resolved.glyph;
+}
 
-    auto surface_size = dest.size();
-    uint32_t *surface_buffer = (uint32_t*)dest.buffer();
+void Text::layout_paragraph(size_t index) {
+    auto &paragraph = m_paragraphs[index];
+    std::u32string_view text = paragraph.text;
 
-    assert(dest.bytes_per_pixel() == 4);
-    
-    FT_Vector kerning = { 0, 0 };
-    int prev_glyph = 0;
-    for (unsigned int glyph : glyphs) {
-        if (glyph == '\n') {
-            y_pos += static_cast<int>(pixel_line_height);
-            x_pos = 0;
+    paragraph.line_breaks.clear();
+    paragraph.width = 0;
+
+    PenState pen;
+    int x = 0;
+    size_t line_start = 0;
+
+    // Last point the current line can be broken at
+    size_t break_pos = 0;
+    int break_x = 0;
+
+    for (size_t i = 0; i < text.size(); i++) {
+        uint32_t codepoint = text[i];
+        if (codepoint == '\r') {
             continue;
         }
 
-        if (use_kerning && prev_glyph) {
-            FT_Get_Kerning(face, prev_glyph, glyph, FT_KERNING_DEFAULT, &kerning);
-            x_pos += kerning.x >> 6; // Offset the x position for kerning
-        }
+        int kerning;
+        const Glyph *glyph = next_glyph(codepoint, pen, kerning);
 
-        // TODO: settings to tweak whether to enable font smoothing
-        constexpr bool font_smoothing = false;
+        x += kerning + glyph->advance;
 
-        if (FT_Load_Glyph(face, glyph, font_smoothing ? FT_LOAD_NO_BITMAP : FT_LOAD_NO_HINTING | FT_LOAD_MONOCHROME)) {
+        if (is_break_opportunity(codepoint)) {
+            break_pos = i + 1;
+            break_x = x;
             continue;
         }
 
-        if (FT_Render_Glyph(face->glyph, font_smoothing ? FT_RENDER_MODE_NORMAL : FT_RENDER_MODE_MONO)) {
+        if (m_wrap_width <= 0 || x <= m_wrap_width || i == line_start) {
             continue;
         }
 
-        FT_GlyphSlot slot = face->glyph;
+        // Wrap at the last word boundary
+        if (break_pos > line_start) {
+            paragraph.width = std::max(paragraph.width, break_x);
+            paragraph.line_breaks.push_back(break_pos);
 
-        // Start of the font blit
-        // Ascender is the difference between the baseline and the top of the glyph
-        int y_offset = y_pos + (face->size->metrics.ascender >> 6) - slot->bitmap_top;
-        assert(y_offset >= 0);
+            line_start = break_pos;
+            x -= break_x;
+        }
+
+        // Word is too long for a line by itself, break before this character
+        if (x > m_wrap_width && i > line_start) {
+            paragraph.width = std::max(paragraph.width, x - glyph->advance);
+            paragraph.line_breaks.push_back(i);
 
-        int x_off = 0;
-        if (!use_kerning) {
-            x_off += face->glyph->metrics.horiBearingX >> 6;
+            line_start = i;
+            x = glyph->advance;
         }
+    }
 
-        int x_min = std::max(0, final_bounds.x - x_pos);
-        int x_max = std::min((int)slot->bitmap.width, final_bounds.z - x_pos);
+    paragraph.width = std::max(paragraph.width, x);
+    paragraph.stale = false;
 
-        // Copy the glyph into the texture
-        for (unsigned y = 0; y < slot->bitmap.rows && y_offset < final_bounds.w; y++, y_offset++) {
-            if (y_offset + (int)y < 0) {
-                continue;
-            }
-            
-            auto *dst = surface_buffer + y_offset * surface_size.x + x_pos + x_off;
+    m_line_count += paragraph.line_count();
+    m_paragraph_widths[paragraph.width]++;
 
-            uint8_t *src = (uint8_t*)slot->bitmap.buffer + y * slot->bitmap.pitch;
+    if (!m_index_stale) {
+        m_line_index.add(index, paragraph.line_count());
+    }
+}
 
-            Color c = m_color;
-            for (int x = x_min; x < x_max; x++) {
-                if (font_smoothing && src[x]) {
-                    // Copy the pixel into the surface buffer
-                    c.a = src[x];
+void Text::invalidate_paragraph(size_t index) {
+    auto &paragraph = m_paragraphs[index];
 
-                    dst[x] = (Color(dst[x]) * c).value;
-                } else if (src[x >> 3] & (1 << (7 - (x & 7)))) {
-                    dst[x] = c.value;
-                }
-            }
+    if (!paragraph.stale) {
+        m_line_count -= paragraph.line_count();
+
+        if (!m_index_stale) {
+            m_line_index.add(index, -paragraph.line_count());
         }
 
-        // Advance the x position
-        x_pos += slot->advance.x >> 6;
-        prev_glyph = glyph;
+        auto it = m_paragraph_widths.find(paragraph.width);
+        if (--it->second == 0) {
+            m_paragraph_widths.erase(it);
+        }
+
+        paragraph.stale = true;
+    }
+
+    mark_stale(index, index + 1);
+}
+
+void Text::invalidate_layout() {
+    m_resolved_glyphs.clear();
+
+    for (size_t i = 0; i < m_paragraphs.size(); i++) {
+        invalidate_paragraph(i);
     }
 }
 
+void Text::update_layout() {
+    ensure_index();
+
+    if (m_stale_begin >= m_stale_end) {
+        return;
+    }
+
+    // Metrics only change along with the font or size, which invalidate every paragraph
+    m_metrics = m_font->get_metrics(m_pixel_size);
+
+    for (size_t i = m_stale_begin; i < m_stale_end; i++) {
+        if (m_paragraphs[i].stale) {
+            layout_paragraph(i);
+        }
+    }
+
+    m_stale_begin = m_stale_end = 0;
+}
+
+void Text::mark_stale(size_t begin, size_t end) {
+    if (begin >= end) {
+        return;
+    }
+
+    if (m_stale_begin >= m_stale_end) {
+        m_stale_begin = begin;
+        m_stale_end = end;
+    } else {
+        m_stale_begin = std::min(m_stale_begin, begin);
+        m_stale_end = std::max(m_stale_end, end);
+    }
+}
+
+void Text::ensure_index() {
+    if (!m_index_stale) {
+        return;
+    }
+
+    std::vector<size_t> offsets(m_paragraphs.size());
+    std::vector<size_t> lines(m_paragraphs.size());
+
+    for (size_t i = 0; i < m_paragraphs.size(); i++) {
+        offsets[i] = m_paragraphs[i].text.size() + 1;
+        lines[i] = m_paragraphs[i].stale ? 0 : m_paragraphs[i].line_count();
+    }
+
+    m_offset_index.build(offsets);
+    m_line_index.build(lines);
+
+    m_index_stale = false;
+}
+
+void Text::replace_paragraphs(size_t index, size_t count, std::vector<std::u32string> paragraphs) {
+    size_t new_count = paragraphs.size();
+
+    // Paragraphs are separated by newlines, so the length also changes by the paragraph count
+    for (size_t i = index; i < index + count; i++) {
+        invalidate_paragraph(i);
+        m_length -= m_paragraphs[i].text.size() + 1;
+    }
+
+    for (const auto &text : paragraphs) {
+        m_length += text.size() + 1;
+    }
+
+    // Reuse the existing paragraphs, then insert or remove the difference
+    size_t reused = std::min(count, new_count);
+    for (size_t i = 0; i < reused; i++) {
+        auto &paragraph = m_paragraphs[index + i];
+
+        if (!m_index_stale) {
+            m_offset_index.add(index + i, (ptrdiff_t)paragraphs[i].size() - (ptrdiff_t)paragraph.text.size());
+        }
+
+        paragraph.text = std::move(paragraphs[i]);
+    }
+
+    if (new_count != count) {
+        // Keep the stale range on the same paragraphs after they move
+        auto remap = [&](size_t p) {
+            return p >= index + count ? p - count + new_count : std::min(p, index + new_count);
+        };
+
+        if (m_stale_begin < m_stale_end) {
+            m_stale_begin = remap(m_stale_begin);
+            m_stale_end = remap(m_stale_end);
+        }
+
+        m_index_stale = true;
+    }
+
+    mark_stale(index, index + new_count);
+
+    if (new_count > count) {
+        std::vector<Paragraph> inserted(new_count - count);
+        for (size_t i = count; i < new_count; i++) {
+            inserted[i - count].text = std::move(paragraphs[i]);
+        }
+
+        m_paragraphs.insert(m_paragraphs.begin() + index + count,
+            std::make_move_iterator(inserted.begin()), std::make_move_iterator(inserted.end()));
+    } else if (count > new_count) {
+        m_paragraphs.erase(m_paragraphs.begin() + index + new_count, m_paragraphs.begin() + index + count);
+    }
+}
+
+void Text::set_text(std::u32string_view text) {
+    auto paragraphs = split_paragraphs(text);
+
+    size_t old_count = m_paragraphs.size();
+    size_t new_count = paragraphs.size();
+    size_t common = std::min(old_count, new_count);
+
+    // Only replace the paragraphs between the unchanged start and end
+    size_t prefix = 0;
+    while (prefix < common && m_paragraphs[prefix].text == paragraphs[prefix]) {
+        prefix++;
+    }
+
+    size_t suffix = 0;
+    while (suffix < common - prefix
+            && m_paragraphs[old_count - suffix - 1].text == paragraphs[new_count - suffix - 1]) {
+        suffix++;
+    }
+
+    if (prefix + suffix == old_count && old_count == new_count) {
+        return;
+    }
+
+    paragraphs.erase(paragraphs.end() - suffix, paragraphs.end());
+    paragraphs.erase(paragraphs.begin(), paragraphs.begin() + prefix);
+
+    replace_paragraphs(prefix, old_count - prefix - suffix, std::move(paragraphs));
+}
+
+void Text::replace(size_t pos, size_t len, std::u32string_view text) {
+    pos = std::min(pos, length());
+    len = std::min(len, length() - pos);
+
+    ensure_index();
+
+    // Find the paragraphs containing the start and end of the range
+    size_t first = m_offset_index.find(pos);
+    size_t first_offset = pos - m_offset_index.prefix(first);
+
+    size_t last = m_offset_index.find(pos + len);
+    size_t last_offset = pos + len - m_offset_index.prefix(last);
+
+    std::u32string joined = m_paragraphs[first].text.substr(0, first_offset);
+    joined += text;
+    joined += std::u32string_view{ m_paragraphs[last].text }.substr(last_offset);
+
+    replace_paragraphs(first, last - first + 1, split_paragraphs(joined));
+}
+
+void Text::append(std::u32string_view text) {
+    replace(length(), 0, text);
+}
+
+std::u32string Text::get_text() const {
+    std::u32string text;
+    text.reserve(length());
+
+    for (size_t i = 0; i < m_paragraphs.size(); i++) {
+        if (i > 0) {
+            text.push_back(U'\n');
+        }
+
+        text += m_paragraphs[i].text;
+    }
+
+    return text;
+}
+
 void Text::set_font(std::shared_ptr<Font> font) {
+    if (font == m_font) {
+        return;
+    }
+
     m_font = std::move(font);
 
-    m_stale_geometry = true;
+    invalidate_layout();
 }
 
-void Text::set_text(std::u32string text) {
-    m_text = std::move(text);
+void Text::set_fallback_fonts(std::vector<std::shared_ptr<Font>> fonts) {
+    if (fonts == m_fallback_fonts) {
+        return;
+    }
+
+    m_fallback_fonts = std::move(fonts);
 
-    m_stale_geometry = true;
+    invalidate_layout();
 }
 
 void Text::set_color(const Color& color) {
@@ -181,9 +539,29 @@ void Text::set_color(const Color& color) {
 }
 
 void Text::set_font_size_px(int size_px) {
+    if (size_px == m_pixel_size) {
+        return;
+    }
+
     m_pixel_size = size_px;
 
-    m_stale_geometry = true;
+    invalidate_layout();
+}
+
+void Text::set_wrap_width(int width) {
+    if (width == m_wrap_width) {
+        return;
+    }
+
+    m_wrap_width = width;
+
+    // Paragraphs which were not wrapped and still fit do not need laying out again
+    for (size_t i = 0; i < m_paragraphs.size(); i++) {
+        const auto &paragraph = m_paragraphs[i];
+        if (!paragraph.line_breaks.empty() || (width > 0 && paragraph.width > width)) {
+            invalidate_paragraph(i);
+        }
+    }
 }
 
 Vector2f Text::text_geometry() {
@@ -191,61 +569,86 @@ Vector2f Text::text_geometry() {
         return { 0, 0 };
     }
 
-    if (m_stale_geometry) {
-        std::unique_lock fontLock(m_font->m_lock);
-        FT_Face face = reinterpret_cast<FT_Face>(m_font->get_handle());
+    update_layout();
 
-        if (FT_Set_Pixel_Sizes(face, 0, m_pixel_size)) {
-            reimu::logger::warn("Failed to set font size!");
-            return {0, 0};
-        }
+    int width = m_paragraph_widths.empty() ? 0 : m_paragraph_widths.rbegin()->first;
+    return { (float)width, (float)(m_line_count * m_metrics.line_height) };
+}
 
-        bool use_kerning = FT_HAS_KERNING(face);
-        // In 64ths of a pixel so r shift by 6
-        unsigned int pixel_line_height = face->size->metrics.height >> 6;
+Vector2f Text::position_of(size_t pos) {
+    if (!m_font.get()) {
+        return { 0, 0 };
+    }
 
-        float y_pos = 0;
+    update_layout();
 
-        float x_pos = 0;
-        float x_max = 0;
+    pos = std::min(pos, length());
 
-        FT_Vector kerning = { 0, 0 };
-        int prev_glyph = 0;
+    size_t p = m_offset_index.find(pos);
+    const auto &paragraph = m_paragraphs[p];
+    pos -= m_offset_index.prefix(p);
 
-        for (auto codepoint : m_text) {
-            if (codepoint == '\n') {
-                y_pos += (float)pixel_line_height;
-                
-                x_max = std::max(x_max, x_pos);
-                x_pos = 0;
+    // A codepoint at a line break starts the next line
+    const auto &breaks = paragraph.line_breaks;
+    size_t line = std::upper_bound(breaks.begin(), breaks.end(), pos) - breaks.begin();
+    size_t begin = line > 0 ? breaks[line - 1] : 0;
 
-                prev_glyph = 0;
-            } else if (codepoint != '\r') { // Ignore carriage returns
-                auto glyph = FT_Get_Char_Index(face, codepoint);
+    int x = layout_line(std::u32string_view{ paragraph.text }.substr(begin, pos - begin), 0, 0,
+        [](const Glyph &, int, int) {});
 
-                if (use_kerning && prev_glyph) {
-                    x_pos += kerning.x >> 6; // Offset the x position for kerning
-                    
-                    FT_Get_Kerning(face, prev_glyph, glyph, FT_KERNING_DEFAULT, &kerning);
-                }
+    return { (float)x, (float)((m_line_index.prefix(p) + line) * m_metrics.line_height) };
+}
 
-                if (FT_Load_Glyph(face, glyph, FT_LOAD_ADVANCE_ONLY)) {
-                    continue;
-                }
+size_t Text::offset_at(const Vector2f &point) {
+    if (!m_font.get()) {
+        return 0;
+    }
 
-                // Advance the x position
-                x_pos += face->glyph->metrics.horiAdvance >> 6;
-                prev_glyph = glyph;
-            }
+    update_layout();
+
+    int line_height = m_metrics.line_height;
+
+    // Points above the text go to the first paragraph and points below it to the last
+    size_t text_line = point.y > 0 ? (size_t)(point.y / line_height) : 0;
+    size_t p = std::min(m_line_index.find(text_line), m_paragraphs.size() - 1);
+
+    const auto &paragraph = m_paragraphs[p];
+    size_t offset = m_offset_index.prefix(p);
+    size_t first_line = m_line_index.prefix(p);
+
+    int line_count = paragraph.line_count();
+    int line = (int)std::min(text_line - std::min(text_line, first_line), (size_t)line_count - 1);
+    bool is_wrapped = line < line_count - 1;
+
+    size_t begin = line > 0 ? paragraph.line_breaks[line - 1] : 0;
+    size_t end = is_wrapped ? paragraph.line_breaks[line] : paragraph.text.size();
+
+    PenState pen;
+    int x = 0;
+    for (size_t i = begin; i < end; i++) {
+        uint32_t codepoint = paragraph.text[i];
+        if (codepoint == '\r') {
+            continue;
+        }
+
+        int kerning;
+        const Glyph *glyph = next_glyph(codepoint, pen, kerning);
+
+        x += kerning;
+        // Doubled so half of an odd advance is not rounded down
+        if (2 * point.x < 2 * x + glyph->advance) {
+            return offset + i;
         }
 
-        x_max = std::max(x_max, x_pos);
-        m_text_size = { x_max, y_pos + pixel_line_height };
+        x += glyph->advance;
+    }
 
-        m_stale_geometry = false;
+    // Keep the position on this line rather than the start of the next
+    if (is_wrapped && end > begin) {
+        return offset + end - 1;
     }
 
-    return m_text_size;
+    return offset + end;
 }
 
 } // namespace Arclight
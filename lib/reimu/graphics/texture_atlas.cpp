@@ -0,0 +1,219 @@
+#include <reimu/graphics/texture_atlas.h>
+
+#include <algorithm>
+
+namespace reimu::graphics {
+
+// Shelf heights are rounded up to a multiple of this, so similar rects share shelves
+static constexpr int shelf_height_step = 16;
+
+ShelfPacker::ShelfPacker(const Vector2i &size) : m_size(size) {}
+
+int ShelfPacker::shelf_height(int height) {
+    return (height + shelf_height_step - 1) / shelf_height_step * shelf_height_step;
+}
+
+Optional<Recti> ShelfPacker::allocate(const Vector2i &size) {
+    if (size.x <= 0 || size.y <= 0 || size.x > m_size.x || size.y > m_size.y) {
+        return OPT_NONE;
+    }
+
+    int height = std::min(shelf_height(size.y), m_size.y);
+
+    for (auto &shelf : m_shelves) {
+        if (shelf.height == height) {
+            if (auto rect = allocate_in(shelf, size); rect.has_some()) {
+                return rect;
+            }
+        }
+    }
+
+    // Empty shelves can take any rect that fits, keeping their height
+    for (auto &shelf : m_shelves) {
+        bool is_empty = shelf.free_spans.size() == 1 && shelf.free_spans[0].width == m_size.x;
+
+        if (is_empty && shelf.height >= height) {
+            return allocate_in(shelf, size);
+        }
+    }
+
+    if (m_next_y + height > m_size.y) {
+        return OPT_NONE;
+    }
+
+    m_shelves.push_back(Shelf {
+        .y = m_next_y,
+        .height = height,
+        .free_spans = { Span{ 0, m_size.x } },
+    });
+    m_next_y += height;
+
+    return allocate_in(m_shelves.back(), size);
+}
+
+Optional<Recti> ShelfPacker::allocate_in(Shelf &shelf, const Vector2i &size) {
+    int width = size.x;
+
+    for (auto it = shelf.free_spans.begin(); it != shelf.free_spans.end(); it++) {
+        if (it->width < width) {
+            continue;
+        }
+
+        int x = it->x;
+
+        it->x += width;
+        it->width -= width;
+        if (it->width == 0) {
+            shelf.free_spans.erase(it);
+        }
+
+        m_used_area += (int64_t)width * shelf.height;
+
+        // The rect is only as high as asked for, free() finds its shelf by y
+        return OPT_SOME((Recti{ x, shelf.y, x + width, shelf.y + size.y }));
+    }
+
+    return OPT_NONE;
+}
+
+void ShelfPacker::free(const Recti &rect) {
+    auto shelf = std::lower_bound(m_shelves.begin(), m_shelves.end(), rect.y,
+        [](const Shelf &shelf, int y) { return shelf.y < y; });
+
+    if (shelf == m_shelves.end() || shelf->y != rect.y) {
+        return;
+    }
+
+    auto &spans = shelf->free_spans;
+    int width = rect.width();
+
+    m_used_area -= (int64_t)width * shelf->height;
+
+    // Insert the span, merging it with its neighbours
+    auto next = std::lower_bound(spans.begin(), spans.end(), rect.x,
+        [](const Span &span, int x) { return span.x < x; });
+
+    bool joins_prev = next != spans.begin() && std::prev(next)->x + std::prev(next)->width == rect.x;
+    bool joins_next = next != spans.end() && rect.x + width == next->x;
+
+    if (joins_prev && joins_next) {
+        std::prev(next)->width += width + next->width;
+        spans.erase(next);
+    } else if (joins_prev) {
+        std::prev(next)->width += width;
+    } else if (joins_next) {
+        next->x = rect.x;
+        next->width += width;
+    } else {
+        spans.insert(next, Span{ rect.x, width });
+    }
+
+    // Give empty shelves at the bottom back, so any height can use the space
+    while (!m_shelves.empty()) {
+        auto &last = m_shelves.back();
+        if (last.free_spans.size() != 1 || last.free_spans[0].width != m_size.x) {
+            break;
+        }
+
+        m_next_y = last.y;
+        m_shelves.pop_back();
+    }
+}
+
+/**
+ * Texture which is a region of a TextureAtlas, or a texture of its own if it
+ * doesn't fit in the atlas.
+ */
+class AtlasTexture final : public Texture {
+public:
+    AtlasTexture(TextureAtlas &atlas, ColorFormat fmt, const Vector2i &size)
+            : Texture(fmt, size), m_atlas(atlas) {
+        allocate();
+    }
+
+    ~AtlasTexture() override {
+        release();
+    }
+
+    void replace(ColorFormat fmt, const Vector2i &size) override {
+        release();
+
+        m_format = fmt;
+        m_size = size;
+
+        allocate();
+    }
+
+    void update(const void *data, size_t) override {
+        write_region(data, get_color_format_info(m_format).bytes_per_pixel * m_size.x,
+            Recti::from_size({0, 0}, m_size));
+    }
+
+    void update_region(const void *data, size_t stride, const Recti &region) override {
+        auto bytes_per_pixel = get_color_format_info(m_format).bytes_per_pixel;
+
+        write_region((const uint8_t *)data + region.y * stride + region.x * bytes_per_pixel, stride, region);
+    }
+
+    void write_region(const void *data, size_t stride, const Recti &region) override {
+        Vector2i origin = backing_origin();
+
+        backing_texture().write_region(data, stride, Recti::from_size(
+            origin + region.top_left(), region.size()));
+    }
+
+    Texture &backing_texture() override {
+        return m_texture ? *m_texture : m_atlas.texture();
+    }
+
+    Vector2i backing_origin() const override {
+        return m_texture ? Vector2i{0, 0} : m_region.top_left();
+    }
+
+private:
+    void allocate() {
+        // The atlas texture is only created once something goes in it
+        if (m_format == TextureAtlas::format
+                && m_size.x <= m_atlas.m_max_region_size && m_size.y <= m_atlas.m_max_region_size) {
+            if (auto region = m_atlas.m_packer.allocate(m_size); region.has_some()) {
+                m_region = region.ensure();
+                m_atlas.texture();
+
+                return;
+            }
+        }
+
+        m_texture = std::unique_ptr<Texture>{m_atlas.m_create_texture(m_size, m_format)};
+    }
+
+    void release() {
+        if (m_texture) {
+            m_texture = nullptr;
+        } else {
+            m_atlas.m_packer.free(m_region);
+        }
+    }
+
+    TextureAtlas &m_atlas;
+
+    // Region of the atlas, when not using a texture of its own
+    Recti m_region = {0, 0, 0, 0};
+    std::unique_ptr<Texture> m_texture;
+};
+
+TextureAtlas::TextureAtlas(CreateTextureFn create_texture, const Vector2i &size, int max_region_size)
+    : m_create_texture(std::move(create_texture)), m_packer(size), m_max_region_size(max_region_size) {}
+
+Texture *TextureAtlas::create_texture(const Vector2i &size, ColorFormat format) {
+    return new AtlasTexture(*this, format, size);
+}
+
+Texture &TextureAtlas::texture() {
+    if (!m_texture) {
+        m_texture = std::unique_ptr<Texture>{m_create_texture(m_packer.size(), format)};
+    }
+
+    return *m_texture;
+}
+
+}
@@ -0,0 +1,181 @@
+#include "context.h"
+
+#include <reimu/core/logger.h>
+
+#include <assert.h>
+
+namespace reimu::graphics {
+
+std::shared_ptr<WebGPUContext> WebGPUContext::get() {
+    static std::weak_ptr<WebGPUContext> shared;
+
+    if (auto context = shared.lock()) {
+        return context;
+    }
+
+    WGPUInstanceDescriptor desc = {};
+    desc.nextInChain = nullptr;
+
+    auto instance = wgpuCreateInstance(&desc);
+    if (!instance) {
+        logger::warn("Failed to create WebGPU instance");
+
+        return nullptr;
+    }
+
+    auto context = std::shared_ptr<WebGPUContext>{new WebGPUContext};
+    context->m_instance = instance;
+
+    shared = context;
+    return context;
+}
+
+WebGPUContext::~WebGPUContext() {
+    if (m_queue) {
+        wgpuQueueRelease(m_queue);
+    }
+
+    if (m_device) {
+        wgpuDeviceRelease(m_device);
+    }
+
+    if (m_adapter) {
+        wgpuAdapterRelease(m_adapter);
+    }
+
+    if (m_instance) {
+        wgpuInstanceRelease(m_instance);
+    }
+}
+
+Result<void, ReimuError> WebGPUContext::create_device(WGPUSurface surface) {
+    if (m_device) {
+        return OK();
+    }
+
+    // Use the first window's surface to request an adapter, later windows on
+    // the same display can present with it too
+    WGPURequestAdapterOptions adapter_options = {};
+    adapter_options.compatibleSurface = surface;
+
+    auto adapter = request_adapter(m_instance, adapter_options);
+    if (!adapter) {
+        logger::warn("Failed to create WebGPU adapter");
+
+        return ERR(ReimuError::RendererError);
+    }
+
+    WGPUSupportedFeatures adapter_features;
+
+    wgpuAdapterGetFeatures(adapter, &adapter_features);
+
+    for (size_t i = 0; i < adapter_features.featureCount; i++) {
+        logger::debug("Adapter feature: {:x}", (uint64_t)adapter_features.features[i]);
+    }
+
+    wgpuSupportedFeaturesFreeMembers(adapter_features);
+
+    WGPUDeviceDescriptor device_desc = {};
+    device_desc.label = webgpu::to_sv("reimu");
+    // Required features or limits can go here
+    device_desc.defaultQueue.label = webgpu::to_sv("queue");
+
+    WGPUDevice device = request_device(adapter, device_desc);
+    if (!device) {
+        logger::warn("Failed to create WebGPU device");
+
+        wgpuAdapterRelease(adapter);
+        return ERR(ReimuError::RendererError);
+    }
+
+    auto queue = wgpuDeviceGetQueue(device);
+    if (!queue) {
+        logger::warn("Failed to get WebGPU queue");
+
+        wgpuDeviceRelease(device);
+        wgpuAdapterRelease(adapter);
+        return ERR(ReimuError::RendererError);
+    }
+
+    WGPUQueueWorkDoneCallbackInfo info = {
+        .nextInChain = nullptr,
+        .mode = WGPUCallbackMode_WaitAnyOnly,
+        .callback = [](WGPUQueueWorkDoneStatus status, void*, void*) -> void {
+            logger::debug("Queue work done, status: {:x}", (uint32_t)status);
+        },
+        .userdata1 = NULL,
+        .userdata2 = NULL
+    };
+    wgpuQueueOnSubmittedWorkDone(queue, info);
+
+    m_adapter = adapter;
+    m_device = device;
+    m_queue = queue;
+
+    return OK();
+}
+
+WGPUAdapter WebGPUContext::request_adapter(WGPUInstance instance, const WGPURequestAdapterOptions &adapter_options) {
+    struct AdapterRequest {
+        WGPUAdapter adapter = nullptr;
+        bool completed = false;
+    } adapter_request;
+
+    const auto adapter_cb = [](WGPURequestAdapterStatus s, WGPUAdapterImpl *a, WGPUStringView, void *data, void *) {
+        auto *request = (AdapterRequest *)data;
+
+        if (s == WGPURequestAdapterStatus_Success) {
+            request->adapter = a;
+        }
+
+        request->completed = true;
+    };
+
+    WGPURequestAdapterCallbackInfo cb = {
+        .nextInChain = nullptr,
+        .mode = WGPUCallbackMode_WaitAnyOnly,
+        .callback = adapter_cb,
+        .userdata1 = &adapter_request,
+        .userdata2 = nullptr,
+    };
+
+    // Request an adapter using a lambda for the callback
+    wgpuInstanceRequestAdapter(instance, &adapter_options, cb);
+
+    assert(adapter_request.completed);
+
+    return adapter_request.adapter;
+}
+
+WGPUDevice WebGPUContext::request_device(WGPUAdapter adapter, const WGPUDeviceDescriptor &device_desc) {
+    struct Request {
+        WGPUDevice device = nullptr;
+        bool completed = false;
+    } request;
+    
+    WGPURequestDeviceCallbackInfo device_cb = {
+        .nextInChain = nullptr,
+        .mode = WGPUCallbackMode_WaitAnyOnly,
+        .callback = [](
+            WGPURequestDeviceStatus s, WGPUDevice d, WGPUStringView, void *data, void *
+        ) -> void {
+            auto *request = (Request *)data;
+
+            if (s == WGPURequestDeviceStatus_Success) {
+                request->device = d;
+            }
+
+            request->completed = true;
+        },
+        .userdata1 = &request,
+        .userdata2 = nullptr,
+    };
+
+    wgpuAdapterRequestDevice(adapter, &device_desc, device_cb);
+
+    assert(request.completed);
+
+    return request.device;
+}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <reimu/core/result.h>
+
+#include <memory>
+
+#include "webgpu.h"
+
+namespace reimu::graphics {
+
+/**
+ * @brief WebGPU instance, adapter, device and queue shared by every window
+ *
+ * Renderers only create their surface and swap chain, so opening another
+ * window doesn't create a device, and GPU resources can be shared between
+ * windows. The context lives while any renderer is using it.
+ */
+class WebGPUContext {
+public:
+    /**
+     * @brief Get the process' context, creating the instance if there isn't one
+     *
+     * @return The context, or null if no instance could be created
+     */
+    static std::shared_ptr<WebGPUContext> get();
+
+    ~WebGPUContext();
+
+    /**
+     * @brief Create the adapter and device if they haven't been, with an adapter that can present to 'surface'
+     */
+    Result<void, ReimuError> create_device(WGPUSurface surface);
+
+    inline WGPUInstance instance() const {
+        return m_instance;
+    }
+
+    inline WGPUAdapter adapter() const {
+        return m_adapter;
+    }
+
+    inline WGPUDevice device() const {
+        return m_device;
+    }
+
+    inline WGPUQueue queue() const {
+        return m_queue;
+    }
+
+private:
+    WebGPUContext() = default;
+
+    static WGPUAdapter request_adapter(WGPUInstance instance,
+            const WGPURequestAdapterOptions &adapter_options);
+    static WGPUDevice request_device(WGPUAdapter adapter, const WGPUDeviceDescriptor &device_desc);
+
+    WGPUInstance m_instance = nullptr;
+    WGPUAdapter m_adapter = nullptr;
+    WGPUDevice m_device = nullptr;
+    WGPUQueue m_queue = nullptr;
+};
+
+}
@@ -0,0 +1,290 @@
+#include "pipeline_cache.h"
+
+#include <reimu/core/hash.h>
+#include <reimu/core/logger.h>
+
+#include <assert.h>
+#include <string.h>
+
+namespace reimu::graphics {
+
+std::shared_ptr<WebGPUPipelineCache> WebGPUPipelineCache::for_device(WGPUDevice device) {
+    static std::map<WGPUDevice, std::weak_ptr<WebGPUPipelineCache>> caches;
+
+    auto &entry = caches[device];
+    if (auto cache = entry.lock()) {
+        return cache;
+    }
+
+    auto cache = std::make_shared<WebGPUPipelineCache>(device);
+    entry = cache;
+
+    // Forget caches of devices which are gone, so a new device at the same address gets a new cache
+    std::erase_if(caches, [](const auto &cached) {
+        return cached.second.expired();
+    });
+
+    return cache;
+}
+
+WebGPUPipelineCache::WebGPUPipelineCache(WGPUDevice device) : m_device(device) {
+    wgpuDeviceAddRef(m_device);
+}
+
+WebGPUPipelineCache::~WebGPUPipelineCache() {
+    for (auto &[key, pipeline] : m_pipelines) {
+        wgpuRenderPipelineRelease(pipeline.pipeline);
+
+        if (pipeline.bind_layout) {
+            wgpuBindGroupLayoutRelease(pipeline.bind_layout);
+        }
+    }
+
+    for (auto &[name, shader] : m_shaders) {
+        wgpuShaderModuleRelease(shader.module);
+    }
+
+    wgpuDeviceRelease(m_device);
+}
+
+Result<void, ReimuError> WebGPUPipelineCache::load_shader(const std::string &name, const char *code) {
+    uint64_t code_hash = data_hash(code, strlen(code));
+
+    auto it = m_shaders.find(name);
+    if (it != m_shaders.end() && it->second.code_hash == code_hash) {
+        return OK();
+    }
+
+    WGPUShaderSourceWGSL wgsl_desc = {};
+    wgsl_desc.chain = {
+        .next = nullptr,
+        .sType = WGPUSType_ShaderSourceWGSL,
+    };
+
+    wgsl_desc.code = {code, strlen(code)};
+
+    WGPUShaderModuleDescriptor shader_desc = {};
+    shader_desc.nextInChain = &wgsl_desc.chain;
+
+    WGPUShaderModule module = wgpuDeviceCreateShaderModule(m_device, &shader_desc);
+    if (!module) {
+        logger::warn("Failed to create shader module: {}", name);
+
+        return ERR(ReimuError::RendererShaderCompilationFailed);
+    }
+
+    m_shaders_compiled++;
+
+    // Pipelines handed out using the old module keep it alive until they are released
+    if (it != m_shaders.end()) {
+        evict_pipelines(name);
+        wgpuShaderModuleRelease(it->second.module);
+    }
+
+    m_shaders[name] = Shader {
+        .module = module,
+        .code_hash = code_hash,
+    };
+
+    return OK();
+}
+
+Result<WebGPUPipelineCache::Pipeline, ReimuError> WebGPUPipelineCache::get_pipeline(const std::string &shader,
+        const BindingDefinition *bindings, size_t num_bindings, AlphaMode alpha_mode, WGPUTextureFormat format) {
+    auto shader_it = m_shaders.find(shader);
+    if (shader_it == m_shaders.end()) {
+        logger::warn("Shader '{}' is not loaded", shader);
+
+        return ERR(ReimuError::RendererError);
+    }
+
+    auto module = shader_it->second.module;
+
+    PipelineKey key = {
+        .shader = shader,
+        .code_hash = shader_it->second.code_hash,
+        .bindings = {},
+        .alpha_mode = alpha_mode,
+        .format = format,
+    };
+
+    for (size_t i = 0; i < num_bindings; i++) {
+        const auto &binding = bindings[i];
+        size_t size = binding.type == BindingType::Texture ? 0 : binding.uniform_buffer.size;
+
+        key.bindings.push_back((uint64_t)binding.type << 56 | (uint64_t)binding.visibility << 48
+            | (uint64_t)binding.index << 32 | size);
+    }
+
+    auto it = m_pipelines.find(key);
+    if (it == m_pipelines.end()) {
+        auto pipeline = TRY(create_pipeline(module, bindings, num_bindings, alpha_mode, format));
+
+        it = m_pipelines.emplace(std::move(key), pipeline).first;
+    }
+
+    // The caller gets its own references, the cache keeps its
+    wgpuRenderPipelineAddRef(it->second.pipeline);
+    if (it->second.bind_layout) {
+        wgpuBindGroupLayoutAddRef(it->second.bind_layout);
+    }
+
+    return OK(it->second);
+}
+
+void WebGPUPipelineCache::evict_pipelines(const std::string &shader) {
+    std::erase_if(m_pipelines, [&](const auto &cached) {
+        const auto &[key, pipeline] = cached;
+        if (key.shader != shader) {
+            return false;
+        }
+
+        wgpuRenderPipelineRelease(pipeline.pipeline);
+        if (pipeline.bind_layout) {
+            wgpuBindGroupLayoutRelease(pipeline.bind_layout);
+        }
+
+        return true;
+    });
+}
+
+Result<WebGPUPipelineCache::Pipeline, ReimuError> WebGPUPipelineCache::create_pipeline(WGPUShaderModule shader_module,
+        const BindingDefinition *bindings, size_t num_bindings, AlphaMode alpha_mode, WGPUTextureFormat format) {
+    WGPUBindGroupLayout bind_group_layout = nullptr;
+    if (num_bindings > 0) {
+        // Construct the bind group layout
+        std::vector<WGPUBindGroupLayoutEntry> bind_group_layout_entries;
+        for (size_t i = 0; i < num_bindings; i++) {
+            auto entry = convert_binding_definition(bindings[i]);
+
+            bind_group_layout_entries.push_back(entry);
+        }
+
+        WGPUBindGroupLayoutDescriptor bind_group_layout_desc = {};
+        bind_group_layout_desc.entryCount = bind_group_layout_entries.size();
+        bind_group_layout_desc.entries = bind_group_layout_entries.data();
+
+        bind_group_layout = wgpuDeviceCreateBindGroupLayout(m_device, &bind_group_layout_desc);
+        if (!bind_group_layout) {
+            logger::warn("Failed to create bind group layout");
+
+            return ERR(ReimuError::RendererError);
+        }
+    }
+
+    WGPUPipelineLayoutDescriptor layout_desc = {};
+    layout_desc.bindGroupLayoutCount = bind_group_layout ? 1 : 0;
+    layout_desc.bindGroupLayouts = &bind_group_layout;
+
+    auto pipeline_layout = wgpuDeviceCreatePipelineLayout(m_device, &layout_desc);
+    assert(pipeline_layout);
+
+    // Create the pipeline
+    WGPURenderPipelineDescriptor pipeline_desc = {};
+    pipeline_desc.label = webgpu::to_sv("render pipeline");
+
+    pipeline_desc.vertex = {
+        .nextInChain = nullptr,
+        .module = shader_module,
+        .entryPoint = webgpu::to_sv("vertex_main"),
+        .constantCount = 0,
+        .constants = nullptr,
+        .bufferCount = 0,
+        .buffers = nullptr,
+    };
+
+    pipeline_desc.primitive = {
+        .nextInChain = nullptr,
+        .topology = WGPUPrimitiveTopology_TriangleStrip,
+        .stripIndexFormat = WGPUIndexFormat_Undefined,
+        .frontFace = WGPUFrontFace_CCW,
+        .cullMode = WGPUCullMode_None,
+    };
+
+    // Premultiplied source over needs no multiply by the source alpha
+    WGPUBlendState blend_state = {};
+    blend_state.color.srcFactor = alpha_mode == AlphaMode::Premultiplied
+        ? WGPUBlendFactor_One : WGPUBlendFactor_SrcAlpha;
+    blend_state.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    blend_state.color.operation = WGPUBlendOperation_Add;
+
+    blend_state.alpha.srcFactor = WGPUBlendFactor_One;
+    blend_state.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    blend_state.alpha.operation = WGPUBlendOperation_Add;
+
+    WGPUColorTargetState color_target = {};
+    color_target.format = format;
+    color_target.blend = &blend_state;
+    color_target.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment_state = {};
+    fragment_state.module = shader_module;
+    fragment_state.entryPoint = webgpu::to_sv("fragment_main");
+    fragment_state.constantCount = 0;
+    fragment_state.constants = nullptr;
+
+    fragment_state.targetCount = 1;
+    fragment_state.targets = &color_target;
+
+    pipeline_desc.fragment = &fragment_state;
+
+    pipeline_desc.depthStencil = nullptr;
+
+    pipeline_desc.multisample.count = 1;
+    pipeline_desc.multisample.mask = 0xffffffff;
+
+    pipeline_desc.layout = pipeline_layout;
+
+    auto pipeline = wgpuDeviceCreateRenderPipeline(m_device, &pipeline_desc);
+
+    wgpuPipelineLayoutRelease(pipeline_layout);
+
+    if (!pipeline) {
+        logger::warn("Failed to create render pipeline");
+
+        if (bind_group_layout) {
+            wgpuBindGroupLayoutRelease(bind_group_layout);
+        }
+
+        return ERR(ReimuError::RendererError);
+    }
+
+    m_pipelines_created++;
+
+    return OK(Pipeline {
+        .pipeline = pipeline,
+        .bind_layout = bind_group_layout,
+    });
+}
+
+WGPUBindGroupLayoutEntry WebGPUPipelineCache::convert_binding_definition(const BindingDefinition &binding) {
+    WGPUBindGroupLayoutEntry entry = {};
+    entry.binding = binding.index;
+    entry.visibility = webgpu::convert_shader_stage(binding.visibility);
+
+    switch (binding.type) {
+    case BindingType::UniformBuffer:
+        // Render passes put the buffers of every draw in one buffer, picked by offset
+        entry.buffer.type = WGPUBufferBindingType_Uniform;
+        entry.buffer.hasDynamicOffset = true;
+        entry.buffer.minBindingSize = binding.uniform_buffer.size;
+        break;
+    case BindingType::StorageBuffer:
+        entry.buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+        entry.buffer.hasDynamicOffset = true;
+        break;
+    case BindingType::Texture:
+        // For now we force texture samples to be floats
+        entry.texture.nextInChain = nullptr;
+        entry.texture.sampleType = WGPUTextureSampleType_Float;
+        entry.texture.viewDimension = WGPUTextureViewDimension_2D;
+        entry.texture.multisampled = false;
+        break;
+    default:
+        logger::fatal("Unsupported binding type");
+    }
+
+    return entry;
+}
+
+}
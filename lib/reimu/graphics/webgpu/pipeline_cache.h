@@ -0,0 +1,96 @@
+#pragma once
+
+#include <reimu/core/result.h>
+#include <reimu/graphics/render_pass.h>
+#include <reimu/graphics/texture.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "webgpu.h"
+
+namespace reimu::graphics {
+
+/**
+ * @brief Shader modules and render pipelines of a device, shared by every renderer using it
+ *
+ * Shaders are compiled once per name and code, and pipelines once per shader,
+ * binding layout and color target, so opening another window or dialog
+ * compiles nothing. Backend pipeline caches aren't exposed by webgpu.h, so
+ * nothing is kept on disk.
+ */
+class WebGPUPipelineCache {
+public:
+    struct Pipeline {
+        WGPURenderPipeline pipeline;
+        // Null when the pipeline has no bindings
+        WGPUBindGroupLayout bind_layout;
+    };
+
+    /**
+     * @brief Get the cache of 'device', creating it if no renderer is using one
+     */
+    static std::shared_ptr<WebGPUPipelineCache> for_device(WGPUDevice device);
+
+    WebGPUPipelineCache(WGPUDevice device);
+    ~WebGPUPipelineCache();
+
+    /**
+     * @brief Compile a shader, unless it was already compiled from the same code
+     */
+    Result<void, ReimuError> load_shader(const std::string &name, const char *code);
+
+    /**
+     * @brief Get a pipeline, creating it on first use
+     *
+     * The pipeline and bind group layout are referenced for the caller, who releases them.
+     */
+    Result<Pipeline, ReimuError> get_pipeline(const std::string &shader, const BindingDefinition *bindings,
+        size_t num_bindings, AlphaMode alpha_mode, WGPUTextureFormat format);
+
+    inline size_t shaders_compiled() const {
+        return m_shaders_compiled;
+    }
+
+    inline size_t pipelines_created() const {
+        return m_pipelines_created;
+    }
+
+private:
+    struct Shader {
+        WGPUShaderModule module;
+        uint64_t code_hash;
+    };
+
+    struct PipelineKey {
+        // Name and code of the shader, as a module's address can be reused once it is released
+        std::string shader;
+        uint64_t code_hash;
+        // Type, visibility, index and size of each binding
+        std::vector<uint64_t> bindings;
+        AlphaMode alpha_mode;
+        WGPUTextureFormat format;
+
+        auto operator<=>(const PipelineKey &) const = default;
+    };
+
+    static WGPUBindGroupLayoutEntry convert_binding_definition(const BindingDefinition &binding);
+
+    // Release the pipelines made from a shader which was replaced
+    void evict_pipelines(const std::string &shader);
+
+    Result<Pipeline, ReimuError> create_pipeline(WGPUShaderModule shader, const BindingDefinition *bindings,
+        size_t num_bindings, AlphaMode alpha_mode, WGPUTextureFormat format);
+
+    WGPUDevice m_device;
+
+    std::map<std::string, Shader> m_shaders;
+    std::map<PipelineKey, Pipeline> m_pipelines;
+
+    size_t m_shaders_compiled = 0;
+    size_t m_pipelines_created = 0;
+};
+
+}
@@ -2,11 +2,22 @@
 
 #include <assert.h>
 
+#include <algorithm>
+
+#include <reimu/core/hash.h>
+
 #include "renderer.h"
 #include "texture.h"
 
 namespace reimu::graphics {
 
+// Smallest buffer, enough for a few hundred draws
+static constexpr size_t min_buffer_capacity = 64 * 1024;
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
 WebGPURenderPass::WebGPURenderPass(WebGPURenderer &renderer, WGPURenderPipeline pipeline,
         WGPUBindGroupLayout bind_layout, const BindingDefinition *bindings, size_t num_bindings)
         : pipeline(pipeline), bind_layout(bind_layout), m_renderer(renderer) {
@@ -18,40 +29,45 @@ WebGPURenderPass::WebGPURenderPass(WebGPURenderer &renderer, WGPURenderPipeline
 
         m_bind_entries[i].binding = i;
 
-        // If the binding is a uniform buffer, create a buffer object for it
-        if (type == BindingType::UniformBuffer) {
-            WGPUBufferDescriptor buffer_desc = {};
-            buffer_desc.usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
-            buffer_desc.size = bindings[i].uniform_buffer.size;
-            buffer_desc.mappedAtCreation = false;
+        // Uniform and storage buffers are all parts of one buffer, chosen by dynamic offsets
+        if (type == BindingType::UniformBuffer || type == BindingType::StorageBuffer) {
+            size_t size = type == BindingType::UniformBuffer
+                ? bindings[i].uniform_buffer.size : bindings[i].storage_buffer.size;
 
-            m_bind_entries[i].size = buffer_desc.size;
+            m_bind_entries[i].size = size;
 
             m_bindings.push_back(Binding {
-                .uniform_buffer = {
-                    .size = buffer_desc.size
+                .buffer = {
+                    .size = size,
+                    .slot = m_buffer_bindings.size(),
                 },
                 .type = type
             });
+
+            m_buffer_bindings.push_back(i);
+
+            if (type == BindingType::StorageBuffer) {
+                m_max_storage_size = std::max(m_max_storage_size, size);
+            }
         } else {
             m_bindings.push_back(Binding {
+                .texture = nullptr,
                 .type = type
             });
         }
     }
+
+    m_buffer_offsets.resize(m_buffer_bindings.size());
+    m_buffer_sizes.resize(m_buffer_bindings.size());
 }
     
 WebGPURenderPass::~WebGPURenderPass() {
-    if (m_bind_group) {
-        wgpuBindGroupRelease(m_bind_group);
-    }
+    m_renderer.on_destroy_render_pass(this);
 
-    for (auto &group : m_old_bind_groups) {
-        wgpuBindGroupRelease(group);
-    }
+    clear_bind_groups();
 
-    for (auto &buffer : m_old_buffers) {
-        wgpuBufferRelease(buffer);
+    if (m_buffer) {
+        wgpuBufferRelease(m_buffer);
     }
 
     wgpuRenderPipelineRelease(pipeline);
@@ -61,30 +77,10 @@ WebGPURenderPass::~WebGPURenderPass() {
     }
 }
 
-void WebGPURenderPass::update_bindings() {
-    WGPUBindGroupDescriptor desc = {};
-    desc.layout = bind_layout;
-    desc.entryCount = m_bind_entries.size();
-    desc.entries = m_bind_entries.data();
-
-    if (m_bind_group) {
-        m_old_bind_groups.push_back(m_bind_group);
-    }
-
-    m_bind_group = m_renderer.create_bind_group(desc);
-    assert(m_bind_group);
-
-    m_bindings_changed = false;
-
-    if (m_pass_encoder) {
-        wgpuRenderPassEncoderSetBindGroup(m_pass_encoder, 0, m_bind_group, 0, nullptr);
-    }
-}
-
-void WebGPURenderPass::render(WGPUTextureView output, WGPUCommandEncoder encoder) {
+void WebGPURenderPass::render(WGPUTextureView output, WGPUCommandEncoder encoder, WGPULoadOp load_op) {
     WGPURenderPassColorAttachment color_attachment = {};
     color_attachment.view = output;
-    color_attachment.loadOp = WGPULoadOp_Clear;
+    color_attachment.loadOp = load_op;
     color_attachment.storeOp = WGPUStoreOp_Store;
     color_attachment.clearValue = {0.0f, 0.0f, 0.0f, 1.0f};
 
@@ -97,71 +93,220 @@ void WebGPURenderPass::render(WGPUTextureView output, WGPUCommandEncoder encoder
 
     wgpuRenderPassEncoderSetPipeline(m_pass_encoder, pipeline);
 
+    // Buffers stay bound between frames, so carry their last data over
+    std::swap(m_buffer_data, m_previous_buffer_data);
+    m_buffer_data.clear();
+
+    for (size_t slot = 0; slot < m_buffer_bindings.size(); slot++) {
+        append_buffer_data(slot, m_previous_buffer_data.data() + m_buffer_offsets[slot], m_buffer_sizes[slot]);
+    }
+
+    m_draws.clear();
+    m_draw_offsets.clear();
+    m_texture_states.clear();
+    m_bindings_changed = true;
+
     if (strategy) {
         strategy->draw(m_renderer, *this);
     }
 
+    encode_draws();
+
     wgpuRenderPassEncoderEnd(m_pass_encoder);
     wgpuRenderPassEncoderRelease(m_pass_encoder);
 
-    for (auto &group : m_old_bind_groups) {
-        wgpuBindGroupRelease(group);
-    }
-    m_old_bind_groups.clear();
-    
-    for (auto &buffer : m_old_buffers) {
-        wgpuBufferRelease(buffer);
-    }
-    m_old_buffers.clear();
-
     m_pass_encoder = nullptr;
 }
 
 void WebGPURenderPass::draw(int num_vertices) {
+    draw_instanced(num_vertices, 1, 0);
+}
+
+void WebGPURenderPass::draw_instanced(int num_vertices, int num_instances, int first_instance) {
+    // Keep the textures bound for the draws using them
     if (m_bindings_changed) {
-        update_bindings();
+        for (const auto &entry : m_bind_entries) {
+            m_texture_states.push_back(entry.textureView);
+        }
+
+        m_bindings_changed = false;
     }
 
-    wgpuRenderPassEncoderDraw(m_pass_encoder, num_vertices, 1, 0, 0);
+    m_draws.push_back(Draw {
+        .texture_state = (uint32_t)(m_texture_states.size() - m_bind_entries.size()),
+        .first_offset = (uint32_t)m_draw_offsets.size(),
+        .num_vertices = num_vertices,
+        .num_instances = num_instances,
+        .first_instance = first_instance,
+    });
+
+    m_draw_offsets.insert(m_draw_offsets.end(), m_buffer_offsets.begin(), m_buffer_offsets.end());
 }
 
 void WebGPURenderPass::bind_texture(int index, Texture *tex) {
     assert(index < m_bind_entries.size());
 
-    auto *texture = (WebGPUTexture *)tex;
+    // Textures in an atlas are drawn from the atlas texture
+    auto *texture = tex ? (WebGPUTexture *)&tex->backing_texture() : nullptr;
 
     auto &entry = m_bind_entries[index];
     entry.binding = index;
 
     // If tex is null, make the binding null
-    if (tex) {
+    if (texture) {
         entry.textureView = texture->view();
     } else {
         entry.textureView = nullptr;
     }
 
-    m_bindings[index].texture = tex;
+    m_bindings[index].texture = texture;
 
     m_bindings_changed = true;
 }
 
 void WebGPURenderPass::bind_uniform_buffer(int index, const void *data, size_t size) {
+    assert(m_bindings[index].type == BindingType::UniformBuffer);
+
+    bind_buffer(index, data, size);
+}
+
+void WebGPURenderPass::bind_storage_buffer(int index, const void *data, size_t size) {
+    assert(m_bindings[index].type == BindingType::StorageBuffer);
+
+    bind_buffer(index, data, size);
+}
+
+void WebGPURenderPass::bind_buffer(int index, const void *data, size_t size) {
     auto &binding = m_bindings[index];
+    assert(size <= binding.buffer.size);
+
+    // Each draw's data is a part of the frame's buffer, so binding is only a copy
+    append_buffer_data(binding.buffer.slot, data, size);
+}
+
+void WebGPURenderPass::append_buffer_data(size_t slot, const void *data, size_t size) {
+    auto &binding = m_bindings[m_buffer_bindings[slot]];
+
+    // Uniforms are read whole, storage buffers only up to what the draws use
+    size_t reserved = binding.type == BindingType::UniformBuffer ? binding.buffer.size : size;
+
+    size_t offset = m_buffer_data.size();
+    m_buffer_data.resize(offset + align_up(std::max<size_t>(reserved, 1), buffer_alignment));
+    if (size > 0) {
+        memcpy(m_buffer_data.data() + offset, data, size);
+    }
+
+    m_buffer_offsets[slot] = offset;
+    m_buffer_sizes[slot] = size;
+}
+
+void WebGPURenderPass::encode_draws() {
+    if (m_draws.empty()) {
+        return;
+    }
+
+    reserve_buffer(m_buffer_data.size() + m_max_storage_size);
+    m_renderer.write_buffer(m_buffer, 0, m_buffer_data.data(), m_buffer_data.size());
+
+    // Bind groups only change with the textures, buffers are selected by their offsets
+    WGPUBindGroup bind_group = nullptr;
+    uint32_t bound_state = UINT32_MAX;
+
+    for (const auto &draw : m_draws) {
+        if (bind_layout && draw.texture_state != bound_state) {
+            bind_group = get_bind_group(draw.texture_state);
+            bound_state = draw.texture_state;
+        }
+
+        if (bind_group) {
+            wgpuRenderPassEncoderSetBindGroup(m_pass_encoder, 0, bind_group, m_buffer_bindings.size(),
+                m_draw_offsets.data() + draw.first_offset);
+        }
+
+        wgpuRenderPassEncoderDraw(m_pass_encoder, draw.num_vertices, draw.num_instances, 0, draw.first_instance);
+    }
+}
+
+void WebGPURenderPass::reserve_buffer(size_t size) {
+    if (size <= m_buffer_capacity) {
+        return;
+    }
+
+    // Released buffers live until the GPU is done with them,
+    // but bind groups using the old buffer can't be used again
+    if (m_buffer) {
+        clear_bind_groups();
+        wgpuBufferRelease(m_buffer);
+    }
+
+    m_buffer_capacity = std::max({ size, m_buffer_capacity * 2, min_buffer_capacity });
 
     WGPUBufferDescriptor buffer_desc = {};
-    buffer_desc.usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
-    buffer_desc.size = binding.uniform_buffer.size;
+    buffer_desc.usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform | WGPUBufferUsage_Storage;
+    buffer_desc.size = m_buffer_capacity;
     buffer_desc.mappedAtCreation = false;
 
-    auto buffer = m_renderer.create_buffer(buffer_desc);
-    assert(buffer);
+    m_buffer = m_renderer.create_buffer(buffer_desc);
+    assert(m_buffer);
+}
 
-    m_renderer.write_buffer(buffer, 0, data, size);
+WGPUBindGroup WebGPURenderPass::get_bind_group(uint32_t texture_state) {
+    m_bind_group_key.assign(m_texture_states.begin() + texture_state,
+        m_texture_states.begin() + texture_state + m_bind_entries.size());
 
-    m_bind_entries[index].buffer = buffer;
-    m_bindings_changed = true;
+    if (auto it = m_bind_groups.find(m_bind_group_key); it != m_bind_groups.end()) {
+        return it->second;
+    }
+
+    auto bind_group = create_bind_group(texture_state);
+    m_bind_groups.emplace(m_bind_group_key, bind_group);
+
+    return bind_group;
+}
+
+WGPUBindGroup WebGPURenderPass::create_bind_group(uint32_t texture_state) {
+    auto entries = m_bind_entries;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (m_bindings[i].type == BindingType::Texture) {
+            entries[i].textureView = m_texture_states[texture_state + i];
+        } else {
+            entries[i].buffer = m_buffer;
+            entries[i].offset = 0;
+        }
+    }
+
+    WGPUBindGroupDescriptor desc = {};
+    desc.layout = bind_layout;
+    desc.entryCount = entries.size();
+    desc.entries = entries.data();
+
+    auto bind_group = m_renderer.create_bind_group(desc);
+    assert(bind_group);
+
+    return bind_group;
+}
+
+void WebGPURenderPass::invalidate_texture_view(WGPUTextureView view) {
+    std::erase_if(m_bind_groups, [view](const auto &entry) {
+        if (std::find(entry.first.begin(), entry.first.end(), view) == entry.first.end()) {
+            return false;
+        }
+
+        wgpuBindGroupRelease(entry.second);
+        return true;
+    });
+}
+
+void WebGPURenderPass::clear_bind_groups() {
+    for (auto &[key, group] : m_bind_groups) {
+        wgpuBindGroupRelease(group);
+    }
+
+    m_bind_groups.clear();
+}
 
-    m_old_buffers.push_back(buffer);
+size_t WebGPURenderPass::TextureViewsHash::operator()(const std::vector<WGPUTextureView> &views) const {
+    return data_hash(views.data(), views.size() * sizeof(WGPUTextureView));
 }
 
 }
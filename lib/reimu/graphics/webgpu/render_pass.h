@@ -3,6 +3,7 @@
 #include <reimu/graphics/render_pass.h>
 
 #include <string.h>
+#include <unordered_map>
 #include <vector>
 
 #include "webgpu.h"
@@ -12,6 +13,15 @@ namespace reimu::graphics {
 class WebGPURenderer;
 class Texture;
 
+/**
+ * @brief Pipeline and bindings drawn by a RenderStrategy each frame
+ *
+ * Draws are recorded while the strategy runs, then encoded once the frame's
+ * buffer data is known. Uniform and storage data for every draw goes into one
+ * buffer kept between frames, with each draw selecting its data by dynamic
+ * offsets, so bind groups only depend on the textures bound. Bind groups are
+ * cached by those textures across frames, until one of them is destroyed.
+ */
 class WebGPURenderPass : public RenderPass {
 public:
     WebGPURenderPass(WebGPURenderer &renderer, WGPURenderPipeline pipeline,
@@ -19,12 +29,23 @@ public:
 
     ~WebGPURenderPass() override;
 
-    void render(WGPUTextureView output, WGPUCommandEncoder encoder);
-    void update_bindings();
+    /**
+     * @brief Record the pass into 'encoder'
+     *
+     * @param load_op Whether to clear 'output' or draw over what earlier passes drew
+     */
+    void render(WGPUTextureView output, WGPUCommandEncoder encoder, WGPULoadOp load_op);
 
     void draw(int num_vertices) override;
+    void draw_instanced(int num_vertices, int num_instances, int first_instance) override;
     void bind_texture(int index, Texture *texture) override;
     void bind_uniform_buffer(int index, const void *data, size_t size) override;
+    void bind_storage_buffer(int index, const void *data, size_t size) override;
+
+    /**
+     * @brief Release cached bind groups using 'view', before it is destroyed
+     */
+    void invalidate_texture_view(WGPUTextureView view);
 
     inline void set_strategy(RenderStrategy *strategy) override {
         this->strategy = strategy;
@@ -36,11 +57,27 @@ public:
     RenderStrategy *strategy = nullptr;
 
 private:
+    // Offsets of buffer data must be multiples of this, the WebGPU default limit
+    static constexpr size_t buffer_alignment = 256;
+
+    struct Draw {
+        // Index into m_texture_states of the textures bound
+        uint32_t texture_state;
+        // Index into m_draw_offsets of the first dynamic offset, one per buffer binding
+        uint32_t first_offset;
+        int num_vertices;
+        int num_instances;
+        int first_instance;
+    };
+
     struct Binding {
         union {
             struct {
+                // Size of the binding, the most bytes bound for storage buffers
                 size_t size;
-            } uniform_buffer;
+                // Index of the binding's dynamic offset
+                size_t slot;
+            } buffer;
             class Texture *texture;
         };
         BindingType type;
@@ -48,17 +85,51 @@ private:
 
     WebGPURenderer &m_renderer;
 
+    void append_buffer_data(size_t slot, const void *data, size_t size);
+    void bind_buffer(int index, const void *data, size_t size);
+
+    void encode_draws();
+    void reserve_buffer(size_t size);
+    WGPUBindGroup get_bind_group(uint32_t texture_state);
+    WGPUBindGroup create_bind_group(uint32_t texture_state);
+    void clear_bind_groups();
+
     WGPURenderPassEncoder m_pass_encoder = nullptr;
 
-    bool m_bindings_changed = false;
-    WGPUBindGroup m_bind_group = nullptr;
+    bool m_bindings_changed = true;
 
+    // Template for bind groups, buffer entries point at m_buffer
     std::vector<WGPUBindGroupEntry> m_bind_entries;
     std::vector<Binding> m_bindings;
+    std::vector<size_t> m_buffer_bindings;
+
+    // Draws recorded this frame, and the texture views bound for each
+    std::vector<Draw> m_draws;
+    std::vector<uint32_t> m_draw_offsets;
+    std::vector<WGPUTextureView> m_texture_states;
+
+    // Current offset into m_buffer_data and size of the data bound to each buffer binding
+    std::vector<uint32_t> m_buffer_offsets;
+    std::vector<uint32_t> m_buffer_sizes;
+
+    // Buffer data for the frame, written to m_buffer in one go
+    std::vector<uint8_t> m_buffer_data;
+    std::vector<uint8_t> m_previous_buffer_data;
+    WGPUBuffer m_buffer = nullptr;
+    size_t m_buffer_capacity = 0;
+
+    // Storage bindings read past the data bound, up to their size, so the buffer is padded by this
+    size_t m_max_storage_size = 0;
+
+    struct TextureViewsHash {
+        size_t operator()(const std::vector<WGPUTextureView> &views) const;
+    };
 
-    // TODO: allocate one big buffer for UBOs and use dynamic offsets
-    std::vector<WGPUBindGroup> m_old_bind_groups;
-    std::vector<WGPUBuffer> m_old_buffers;
+    // Bind groups by the texture view of each binding, null for buffers. Buffer
+    // offsets are dynamic and the buffer only changes when it grows, which
+    // clears the cache, so the views are enough to find a bind group.
+    std::unordered_map<std::vector<WGPUTextureView>, WGPUBindGroup, TextureViewsHash> m_bind_groups;
+    std::vector<WGPUTextureView> m_bind_group_key;
 };
 
 }
@@ -6,6 +6,7 @@
 #include <vector>
 #include <webgpu.h>
 
+#include "context.h"
 #include "texture.h"
 #include "webgpu.h"
 
@@ -14,24 +15,20 @@
 namespace reimu::graphics {
 
 WebGPURenderer *WebGPURenderer::create(video::Window *window) {
-    WGPUInstanceDescriptor desc = {};
-    desc.nextInChain = nullptr;
+    // Every window renders with the same device, only the surface is its own
+    auto context = WebGPUContext::get();
+    if (!context) {
+        return nullptr;
+    }
 
     auto *renderer = new WebGPURenderer;
 
     renderer->m_viewport_size = window->get_size();
-
-    auto instance = wgpuCreateInstance(&desc);
-    if (!instance) {
-        logger::warn("Failed to create WebGPU instance");
-
-        delete renderer;
-        return nullptr;
-    }
-    renderer->m_instance = instance;
+    renderer->m_context = context;
+    renderer->m_instance = context->instance();
 
     // Create a WebGPU surface using the window
-    auto surface_result = create_bind_window_surface(instance, window);
+    auto surface_result = create_bind_window_surface(renderer->m_instance, window);
     if (surface_result.is_err()) {
         logger::warn("Failed to create WebGPU surface: {}", surface_result.move_err());
         
@@ -49,74 +46,18 @@ WebGPURenderer *WebGPURenderer::create(video::Window *window) {
 
     renderer->m_surface = surface;
 
-    // Use our new surface to request an adapter
-    WGPURequestAdapterOptions adapter_options = {};
-    adapter_options.compatibleSurface = renderer->m_surface;
-
-    auto adapter = create_adapter(instance, adapter_options);
-    if (!adapter) {
-        logger::warn("Failed to create WebGPU adapter");
-
-        delete renderer;
-        return nullptr;
-    }
-    renderer->m_adapter = adapter;
-
-    WGPUSupportedFeatures adapter_features;
-
-    wgpuAdapterGetFeatures(adapter, &adapter_features);
-
-    for (size_t i = 0; i < adapter_features.featureCount; i++) {
-        logger::debug("Adapter feature: {:x}", (uint64_t)adapter_features.features[i]);
-    }
-
-    wgpuSupportedFeaturesFreeMembers(adapter_features);
-
-    WGPUDeviceDescriptor device_desc = {};
-    device_desc.label = webgpu::to_sv("reimu");
-    // Required features or limits can go here
-    device_desc.defaultQueue.label = webgpu::to_sv("queue");
-
-    WGPUDevice device = create_device(adapter, device_desc);
-    if (!device) {
-        logger::warn("Failed to create WebGPU device");
-
-        delete renderer;
-        return nullptr;
-    }
-    renderer->m_device = device;
-
-    renderer->m_error_callback = [](
-        WGPUDevice const *, WGPUErrorType type, WGPUStringView message, void *, void *
-    ) {
-        std::string_view sv = {message.data, message.length};
-        logger::fatal("WebGPU device error ({:x}): {}", (uint64_t)type, sv);
-    };
-    
-    //wgpuDeviceSetUncapturedErrorCallback(device, renderer->m_error_callback, nullptr);
-
-    auto queue = wgpuDeviceGetQueue(device);
-    if (!queue) {
-        logger::warn("Failed to get WebGPU queue");
-
+    if (context->create_device(surface).is_err()) {
         delete renderer;
         return nullptr;
     }
 
-    renderer->m_cmd_queue = queue;
+    renderer->m_adapter = context->adapter();
+    renderer->m_device = context->device();
+    renderer->m_cmd_queue = context->queue();
 
-    renderer->m_queue_callback = [](WGPUQueueWorkDoneStatus status, void*, void*) -> void {
-        logger::debug("Queue work done, status: {:x}", (uint32_t)status);
-    };
-
-    WGPUQueueWorkDoneCallbackInfo info = {
-        .nextInChain = nullptr,
-        .mode = WGPUCallbackMode_WaitAnyOnly,
-        .callback = renderer->m_queue_callback,
-        .userdata1 = NULL,
-        .userdata2 = NULL
-    };
-    wgpuQueueOnSubmittedWorkDone(queue, info);
+    // Shaders and pipelines are shared with other renderers on the device
+    renderer->m_pipelines = WebGPUPipelineCache::for_device(renderer->m_device);
+    renderer->m_uploads = std::make_unique<WebGPUUploadManager>(*renderer);
 
     // Create a swap chain
     if(renderer->create_swap_chain().is_err()) {
@@ -128,22 +69,33 @@ WebGPURenderer *WebGPURenderer::create(video::Window *window) {
 
     // TODO: remove
     renderer->load_shader("default", R"(
-        struct Uniform {
+        struct View {
             view_transform: mat4x4f,
+        };
+
+        struct Instance {
             source_region: vec4f,
             target_region: vec4f,
+            opacity: f32,
         };
 
-        @group(0) @binding(0) var<uniform> data: Uniform; 
-        @group(0) @binding(1) var tex: texture_2d<f32>;
+        @group(0) @binding(0) var<uniform> view: View;
+        @group(0) @binding(1) var<storage, read> instances: array<Instance>;
+        @group(0) @binding(2) var tex: texture_2d<f32>;
 
         struct VertexOutput {
             @builtin(position) position: vec4f,
-            @location(0) uv : vec2f
+            @location(0) uv: vec2f,
+            @location(1) opacity: f32,
         };
 
         @vertex
-        fn vertex_main(@builtin(vertex_index) in_vertex_index: u32) -> VertexOutput {
+        fn vertex_main(
+            @builtin(vertex_index) in_vertex_index: u32,
+            @builtin(instance_index) in_instance_index: u32
+        ) -> VertexOutput {
+            let data = instances[in_instance_index];
+
             var p = vec2f(0.0, 0.0);
             var uv = vec2f(0.0, 0.0);
             if (in_vertex_index == 0u) {
@@ -161,14 +113,16 @@ WebGPURenderer *WebGPURenderer::create(video::Window *window) {
             }
 
             return VertexOutput(
-                data.view_transform * vec4f(p, 0.0, 1.0),
-                uv
+                view.view_transform * vec4f(p, 0.0, 1.0),
+                uv,
+                data.opacity
             );
         }
 
         @fragment
         fn fragment_main(in: VertexOutput) -> @location(0) vec4f {
-            return textureLoad(tex, vec2i(in.uv), 0).rgba;
+            // Premultiplied, so every channel is scaled by the opacity
+            return textureLoad(tex, vec2i(in.uv), 0).rgba * in.opacity;
         })").ensure();
 
     window->set_renderer(renderer);
@@ -177,36 +131,41 @@ WebGPURenderer *WebGPURenderer::create(video::Window *window) {
 }
 
 WebGPURenderer::~WebGPURenderer() {
-    if (m_cmd_queue) {
-        wgpuQueueRelease(m_cmd_queue);
-    }
+    m_uploads = nullptr;
+    m_pipelines = nullptr;
 
-    for (auto shader : m_shaders) {
-        wgpuShaderModuleRelease(shader.second);
-    }
-
-    if (m_device) {
-        wgpuDeviceRelease(m_device);
-    }
-
-    if (m_adapter) {
-        wgpuAdapterRelease(m_adapter);
-    }
-    
     if (m_surface) {
         wgpuSurfaceRelease(m_surface);
     }
 
-    if (m_instance) {
-        wgpuInstanceRelease(m_instance);
-    }
+    // The context releases the device once no renderer uses it
 }
 
-void WebGPURenderer::render() {
+bool WebGPURenderer::render() {
+    m_frame_stats = {};
+
+    // Runs the callbacks of staging buffers the GPU has finished with
+    wgpuInstanceProcessEvents(m_instance);
+
     // Draw the frame
     WGPUSurfaceTexture surface_texture;
 
     wgpuSurfaceGetCurrentTexture(m_surface, &surface_texture);
+    if (surface_texture.status != WGPUSurfaceGetCurrentTextureStatus_SuccessOptimal
+            && surface_texture.status != WGPUSurfaceGetCurrentTextureStatus_SuccessSuboptimal) {
+        logger::warn("Failed to get current surface texture ({})", (int)surface_texture.status);
+
+        if (surface_texture.texture) {
+            wgpuTextureRelease(surface_texture.texture);
+        }
+
+        // The surface may be outdated or lost, so the next frame gets a new one
+        if (create_swap_chain().is_err()) {
+            logger::warn("Failed to recreate WebGPU swap chain");
+        }
+
+        return false;
+    }
 
     WGPUTextureViewDescriptor viewDescriptor;
     viewDescriptor.nextInChain = nullptr;
@@ -223,57 +182,53 @@ void WebGPURenderer::render() {
     auto texture_view = wgpuTextureCreateView(surface_texture.texture, &viewDescriptor);
     if (!texture_view) {
         logger::warn("Failed to get current texture view");
-        return;
+
+        wgpuTextureRelease(surface_texture.texture);
+        return false;
     }
 
-    for (auto &pass : m_render_passes) {
-        WGPUCommandEncoderDescriptor encoder_desc = {};
-        encoder_desc.label = webgpu::to_sv("command encoder");
+    // Every pass of the frame is recorded into one encoder and submitted once, along
+    // with the texture uploads made while painting
+    WGPUCommandEncoderDescriptor encoder_desc = {};
+    encoder_desc.label = webgpu::to_sv("frame command encoder");
 
-        WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(m_device, &encoder_desc);
-        assert(encoder);
+    WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(m_device, &encoder_desc);
+    assert(encoder);
 
-        pass->render(texture_view, encoder);
+    // Textures are uploaded before the passes drawing them
+    m_frame_stats.texture_uploads = m_uploads->record(encoder);
 
-        WGPUCommandBufferDescriptor cmd_buffer_desc{};
-        cmd_buffer_desc.label = webgpu::to_sv("command buffer");
+    // Passes draw over each other in the order they were created, so only the first clears
+    bool is_first_pass = true;
+    for (auto *pass : m_render_passes) {
+        pass->render(texture_view, encoder, is_first_pass ? WGPULoadOp_Clear : WGPULoadOp_Load);
 
-        WGPUCommandBuffer cmd_buffer = wgpuCommandEncoderFinish(encoder, &cmd_buffer_desc);
-        assert(cmd_buffer);
+        is_first_pass = false;
+    }
 
-        wgpuCommandEncoderRelease(encoder);
+    WGPUCommandBufferDescriptor cmd_buffer_desc{};
+    cmd_buffer_desc.label = webgpu::to_sv("frame command buffer");
 
-        wgpuQueueSubmit(m_cmd_queue, 1, &cmd_buffer);
+    WGPUCommandBuffer cmd_buffer = wgpuCommandEncoderFinish(encoder, &cmd_buffer_desc);
+    assert(cmd_buffer);
 
-        wgpuCommandBufferRelease(cmd_buffer);
-    }
+    wgpuCommandEncoderRelease(encoder);
 
-    wgpuTextureViewRelease(texture_view);
-    wgpuSurfacePresent(m_surface);
-}
+    wgpuQueueSubmit(m_cmd_queue, 1, &cmd_buffer);
+    m_frame_stats.queue_submits++;
 
-Result<void, ReimuError> WebGPURenderer::load_shader(const std::string &name, const char *data) {
-    WGPUShaderSourceWGSL wgsl_desc = {};
-    wgsl_desc.chain = {
-        .next = nullptr,
-        .sType = WGPUSType_ShaderSourceWGSL,
-    };
+    wgpuCommandBufferRelease(cmd_buffer);
 
-    wgsl_desc.code = {data, strlen(data)};
-    
-    WGPUShaderModuleDescriptor shader_desc = {};
-    shader_desc.nextInChain = &wgsl_desc.chain;
+    m_uploads->on_submitted();
 
-    WGPUShaderModule shader = wgpuDeviceCreateShaderModule(m_device, &shader_desc);
-    if (!shader) {
-        logger::warn("Failed to create shader module: {}", name);
-        
-        return ERR(ReimuError::RendererShaderCompilationFailed);
-    }
+    wgpuTextureViewRelease(texture_view);
+    wgpuSurfacePresent(m_surface);
 
-    m_shaders.insert({name, shader});
+    return true;
+}
 
-    return OK();
+Result<void, ReimuError> WebGPURenderer::load_shader(const std::string &name, const char *data) {
+    return m_pipelines->load_shader(name, data);
 }
 
 Result<Texture *, ReimuError> WebGPURenderer::create_texture(const Vector2i &size, ColorFormat format) {
@@ -316,104 +271,31 @@ Result<Texture *, ReimuError> WebGPURenderer::create_texture(const Vector2i &siz
 }
 
 Result<RenderPass *, ReimuError> WebGPURenderer::create_render_pass(const BindingDefinition *bindings,
-        size_t num_bindings) {
-    auto shader_module = m_shaders.at("default");
-    assert(shader_module);
-
-    WGPUBindGroupLayout bind_group_layout = nullptr;
-    if (num_bindings > 0) {
-        // Construct the bind group layout
-        std::vector<WGPUBindGroupLayoutEntry> bind_group_layout_entries;
-        for (int i = 0; i < num_bindings; i++) {
-            auto entry = convert_binding_definition(bindings[i]);
-
-            bind_group_layout_entries.push_back(entry);
-        }
+        size_t num_bindings, AlphaMode alpha_mode, const std::string &shader) {
+    auto pipeline = TRY(m_pipelines->get_pipeline(shader, bindings, num_bindings, alpha_mode, SWAP_CHAIN_FORMAT));
 
-        WGPUBindGroupLayoutDescriptor bind_group_layout_desc = {};
-        bind_group_layout_desc.entryCount = bind_group_layout_entries.size();
-        bind_group_layout_desc.entries = bind_group_layout_entries.data();
+    auto render_pass = new WebGPURenderPass{*this, pipeline.pipeline, pipeline.bind_layout, bindings, num_bindings};
 
-        bind_group_layout = wgpuDeviceCreateBindGroupLayout(m_device, &bind_group_layout_desc);
-        assert(bind_group_layout);
-    }
-
-    WGPUPipelineLayoutDescriptor layout_desc = {};
-    layout_desc.bindGroupLayoutCount = bind_group_layout ? 1 : 0;
-    layout_desc.bindGroupLayouts = &bind_group_layout;
-
-    logger::debug("wgpu pipeline bind group layouts: {}, layout: {:x}",
-        layout_desc.bindGroupLayoutCount, (uintptr_t)layout_desc.bindGroupLayouts[0]);
-
-    auto pipeline_layout = wgpuDeviceCreatePipelineLayout(m_device, &layout_desc);
-    assert(pipeline_layout);
-      
-    // Create the pipeline
-    WGPURenderPipelineDescriptor pipeline_desc = {};
-    pipeline_desc.label = webgpu::to_sv("render pipeline");
-    
-    pipeline_desc.vertex = {
-        .nextInChain = nullptr,
-        .module = shader_module,
-        .entryPoint = webgpu::to_sv("vertex_main"),
-        .constantCount = 0,
-        .constants = nullptr,
-        .bufferCount = 0,
-        .buffers = nullptr,
-    };
-
-    pipeline_desc.primitive = {
-        .nextInChain = nullptr,
-        .topology = WGPUPrimitiveTopology_TriangleStrip,
-        .stripIndexFormat = WGPUIndexFormat_Undefined,
-        .frontFace = WGPUFrontFace_CCW,
-        .cullMode = WGPUCullMode_None,
-    };
-
-    WGPUBlendState blend_state = {};
-    blend_state.color.srcFactor = WGPUBlendFactor_SrcAlpha;
-    blend_state.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
-    blend_state.color.operation = WGPUBlendOperation_Add;
-
-    blend_state.alpha.srcFactor = WGPUBlendFactor_One;
-    blend_state.alpha.dstFactor = WGPUBlendFactor_One;
-    blend_state.alpha.operation = WGPUBlendOperation_Add;
-
-    WGPUColorTargetState color_target = {};
-    color_target.format = SWAP_CHAIN_FORMAT;
-    color_target.blend = &blend_state;
-    color_target.writeMask = WGPUColorWriteMask_All;
-
-    WGPUFragmentState fragment_state = {};
-    fragment_state.module = shader_module;
-    fragment_state.entryPoint = webgpu::to_sv("fragment_main");
-    fragment_state.constantCount = 0;
-    fragment_state.constants = nullptr;
-
-    fragment_state.targetCount = 1;
-    fragment_state.targets = &color_target;
-
-    pipeline_desc.fragment = &fragment_state;
-
-    pipeline_desc.depthStencil = nullptr;
-
-    pipeline_desc.multisample.count = 1;
-    pipeline_desc.multisample.mask = 0xffffffff;
-
-    pipeline_desc.layout = pipeline_layout;
-
-    auto pipeline = wgpuDeviceCreateRenderPipeline(m_device, &pipeline_desc);
-    assert(pipeline);
+    m_render_passes.push_back(render_pass);
 
-    wgpuPipelineLayoutRelease(pipeline_layout);
+    return OK(render_pass);
+}
 
-    auto render_pass = new WebGPURenderPass{*this, pipeline, bind_group_layout, bindings, num_bindings};
+void WebGPURenderer::on_destroy_render_pass(RenderPass *render_pass) {
+    std::erase(m_render_passes, (WebGPURenderPass *)render_pass);
+}
 
-    render_pass->pipeline = pipeline;
+void WebGPURenderer::on_destroy_texture(WGPUTexture texture, WGPUTextureView view) {
+    m_uploads->cancel(texture);
 
-    m_render_passes.emplace(render_pass);
+    for (auto *pass : m_render_passes) {
+        pass->invalidate_texture_view(view);
+    }
+}
 
-    return OK(render_pass);
+void WebGPURenderer::upload_texture(WGPUTexture texture, const void *data, size_t stride,
+        const Recti &region, size_t bytes_per_pixel) {
+    m_uploads->upload(texture, data, stride, region, bytes_per_pixel);
 }
 
 void WebGPURenderer::resize_viewport(const Vector2i &size) {
@@ -422,13 +304,18 @@ void WebGPURenderer::resize_viewport(const Vector2i &size) {
     create_swap_chain().ensure();
 }
 
-ColorFormat WebGPURenderer::display_surface_color_format() const {
-    return ColorFormat::RGBA8;
+void WebGPURenderer::set_present_mode(PresentMode mode) {
+    if (mode == m_present_mode) {
+        return;
+    }
+
+    m_present_mode = mode;
+
+    create_swap_chain().ensure();
 }
 
-void WebGPURenderer::write_texture(const WGPUTexelCopyTextureInfo &destination, void const *data,
-        size_t dataSize, const WGPUTexelCopyBufferLayout &dataLayout, const WGPUExtent3D &writeSize) {
-    wgpuQueueWriteTexture(m_cmd_queue, &destination, data, dataSize, &dataLayout, &writeSize);
+ColorFormat WebGPURenderer::display_surface_color_format() const {
+    return ColorFormat::RGBA8;
 }
 
 WGPUTexture WebGPURenderer::create_texture_obj(const WGPUTextureDescriptor &desc) {
@@ -436,6 +323,8 @@ WGPUTexture WebGPURenderer::create_texture_obj(const WGPUTextureDescriptor &desc
 }
 
 WGPUBindGroup WebGPURenderer::create_bind_group(const WGPUBindGroupDescriptor &desc) {
+    m_frame_stats.bind_groups_created++;
+
     return wgpuDeviceCreateBindGroup(m_device, &desc);
 }
 
@@ -458,34 +347,30 @@ Result<void, ReimuError> WebGPURenderer::create_swap_chain() {
     surface_config.format = SWAP_CHAIN_FORMAT;
     surface_config.presentMode = WGPUPresentMode_Fifo;
 
-    surface_config.device = m_device;
+    // Fifo is the only mode every surface has to support
+    auto present_mode = webgpu::convert_present_mode(m_present_mode);
+    if (present_mode != WGPUPresentMode_Fifo) {
+        WGPUSurfaceCapabilities capabilities = {};
+        wgpuSurfaceGetCapabilities(m_surface, m_adapter, &capabilities);
 
-    wgpuSurfaceConfigure(m_surface, &surface_config);
+        for (size_t i = 0; i < capabilities.presentModeCount; i++) {
+            if (capabilities.presentModes[i] == present_mode) {
+                surface_config.presentMode = present_mode;
+            }
+        }
 
-    return OK();
-}
+        wgpuSurfaceCapabilitiesFreeMembers(capabilities);
 
-WGPUBindGroupLayoutEntry WebGPURenderer::convert_binding_definition(const BindingDefinition &binding) {
-    WGPUBindGroupLayoutEntry entry = {};
-    entry.binding = binding.index;
-    entry.visibility = webgpu::convert_shader_stage(binding.visibility);
-
-    switch (binding.type) {
-    case BindingType::UniformBuffer:
-        entry.buffer.type = WGPUBufferBindingType_Uniform;
-        break;
-    case BindingType::Texture:
-        // For now we force texture samples to be floats
-        entry.texture.nextInChain = nullptr;
-        entry.texture.sampleType = WGPUTextureSampleType_Float;
-        entry.texture.viewDimension = WGPUTextureViewDimension_2D;
-        entry.texture.multisampled = false;
-        break;
-    default:
-        logger::fatal("Unsupported binding type");
+        if (surface_config.presentMode != present_mode) {
+            logger::warn("Present mode {:x} is not supported, using fifo", (uint32_t)present_mode);
+        }
     }
 
-    return entry;
+    surface_config.device = m_device;
+
+    wgpuSurfaceConfigure(m_surface, &surface_config);
+
+    return OK();
 }
 
 Result<WGPUSurface, ReimuError> WebGPURenderer::create_bind_window_surface(WGPUInstance instance, video::Window *window) {
@@ -525,67 +410,4 @@ Result<WGPUSurface, ReimuError> WebGPURenderer::create_bind_window_surface(WGPUI
     return ERR(ReimuError::RendererUnsupportedWindowBackend);
 }
 
-WGPUAdapter WebGPURenderer::create_adapter(WGPUInstance instance, const WGPURequestAdapterOptions &adapter_options) {
-    struct AdapterRequest {
-        WGPUAdapter adapter = nullptr;
-        bool completed = false;
-    } adapter_request;
-
-    const auto adapter_cb = [](WGPURequestAdapterStatus s, WGPUAdapterImpl *a, WGPUStringView, void *data, void *) {
-        auto *request = (AdapterRequest *)data;
-
-        if (s == WGPURequestAdapterStatus_Success) {
-            request->adapter = a;
-        }
-
-        request->completed = true;
-    };
-
-    WGPURequestAdapterCallbackInfo cb = {
-        .nextInChain = nullptr,
-        .mode = WGPUCallbackMode_WaitAnyOnly,
-        .callback = adapter_cb,
-        .userdata1 = &adapter_request,
-        .userdata2 = nullptr,
-    };
-
-    // Request an adapter using a lambda for the callback
-    wgpuInstanceRequestAdapter(instance, &adapter_options, cb);
-
-    assert(adapter_request.completed);
-
-    return adapter_request.adapter;
-}
-
-WGPUDevice WebGPURenderer::create_device(WGPUAdapter adapter, const WGPUDeviceDescriptor &device_desc) {
-    struct Request {
-        WGPUDevice device = nullptr;
-        bool completed = false;
-    } request;
-    
-    WGPURequestDeviceCallbackInfo device_cb = {
-        .nextInChain = nullptr,
-        .mode = WGPUCallbackMode_WaitAnyOnly,
-        .callback = [](
-            WGPURequestDeviceStatus s, WGPUDevice d, WGPUStringView, void *data, void *
-        ) -> void {
-            auto *request = (Request *)data;
-
-            if (s == WGPURequestDeviceStatus_Success) {
-                request->device = d;
-            }
-
-            request->completed = true;
-        },
-        .userdata1 = &request,
-        .userdata2 = nullptr,
-    };
-
-    wgpuAdapterRequestDevice(adapter, &device_desc, device_cb);
-
-    assert(request.completed);
-
-    return request.device;
-}
-
 }
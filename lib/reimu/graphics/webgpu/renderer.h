@@ -3,11 +3,13 @@
 #include <reimu/graphics/renderer.h>
 #include <reimu/video/window.h>
 
-#include <map>
-#include <set>
+#include <vector>
 #include <webgpu.h>
 
+#include "context.h"
+#include "pipeline_cache.h"
 #include "render_pass.h"
+#include "upload_manager.h"
 #include "webgpu.h"
 
 namespace reimu::graphics {
@@ -18,19 +20,28 @@ public:
 
     ~WebGPURenderer() override;
 
-    void render() override;
+    bool render() override;
     Result<void, ReimuError> load_shader(const std::string &name, const char *data) override;
     Result<RenderPass *, ReimuError> create_render_pass(const BindingDefinition *bindings,
-        size_t num_bindings) override;
+        size_t num_bindings, AlphaMode alpha_mode, const std::string &shader) override;
     Result<Texture *, ReimuError> create_texture(const Vector2i &size, ColorFormat color_format)
         override;
 
     void resize_viewport(const Vector2i &size) override;
+    void set_present_mode(PresentMode mode) override;
     ColorFormat display_surface_color_format() const override;
     
     void on_destroy_render_pass(RenderPass *render_pass);
-    void write_texture(const WGPUTexelCopyTextureInfo &destination, void const *data, size_t dataSize,
-        const WGPUTexelCopyBufferLayout &dataLayout, const WGPUExtent3D &writeSize);
+    // Called before a texture and its view are released, so nothing uses them afterwards
+    void on_destroy_texture(WGPUTexture texture, WGPUTextureView view);
+
+    /**
+     * @brief Upload 'region' of 'texture' with the next frame
+     *
+     * @param data Pixels for the top left of the region, rows 'stride' bytes apart
+     */
+    void upload_texture(WGPUTexture texture, const void *data, size_t stride, const Recti &region,
+        size_t bytes_per_pixel);
 
     WGPUTexture create_texture_obj(const WGPUTextureDescriptor &desc);
     WGPUBindGroup create_bind_group(const WGPUBindGroupDescriptor &desc);
@@ -42,16 +53,15 @@ private:
 
     Result<void, ReimuError> create_swap_chain();
 
-    static WGPUBindGroupLayoutEntry convert_binding_definition(const BindingDefinition &binding);
-
     static Result<WGPUSurface, ReimuError> create_bind_window_surface(WGPUInstance instance,
             video::Window *window);
-    static WGPUAdapter create_adapter(WGPUInstance instance,
-            const WGPURequestAdapterOptions &adapter_options);
-    static WGPUDevice create_device(WGPUAdapter adapter, const WGPUDeviceDescriptor &device_desc);
 
-    std::map<std::string, WGPUShaderModule> m_shaders;
-    std::set<WebGPURenderPass *> m_render_passes;
+    std::shared_ptr<WebGPUPipelineCache> m_pipelines;
+    // In the order they are drawn
+    std::vector<WebGPURenderPass *> m_render_passes;
+
+    // Owns the instance, adapter, device and queue
+    std::shared_ptr<WebGPUContext> m_context;
 
     WGPUInstance m_instance = nullptr;
     WGPUSurface m_surface = nullptr;
@@ -60,8 +70,9 @@ private:
 
     WGPUQueue m_cmd_queue = nullptr;
 
-    WGPUUncapturedErrorCallback m_error_callback;
-    WGPUQueueWorkDoneCallback m_queue_callback;
+    PresentMode m_present_mode = PresentMode::Fifo;
+
+    std::unique_ptr<WebGPUUploadManager> m_uploads;
 };
 
 } 
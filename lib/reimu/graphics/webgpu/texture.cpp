@@ -7,6 +7,7 @@ namespace reimu::graphics {
 
 WebGPUTexture::~WebGPUTexture() {
     logger::debug("Destroying texture!");
+    m_renderer.on_destroy_texture(m_texture, m_view);
     wgpuTextureViewRelease(m_view);
 
     wgpuTextureDestroy(m_texture);
@@ -17,6 +18,7 @@ void WebGPUTexture::replace(ColorFormat fmt, const Vector2i &size) {
     m_format = fmt;
     m_size = size;
 
+    m_renderer.on_destroy_texture(m_texture, m_view);
     wgpuTextureViewRelease(m_view);
     wgpuTextureDestroy(m_texture);
     wgpuTextureRelease(m_texture);
@@ -54,24 +56,24 @@ void WebGPUTexture::replace(ColorFormat fmt, const Vector2i &size) {
 }
 
 void WebGPUTexture::update(const void *data, size_t size) {
-    WGPUTexelCopyTextureInfo image_copy_texture = {};
-    image_copy_texture.texture = m_texture;
-    image_copy_texture.mipLevel = 0;
-    // Offset in the texture
-    image_copy_texture.origin = {0, 0, 0};
-    image_copy_texture.aspect = WGPUTextureAspect_All;
-
-    auto stride = get_color_format_info(m_format).bytes_per_pixel * m_size.x;
-
-    WGPUTexelCopyBufferLayout source_layout = {};
-    source_layout.offset = 0;
-    source_layout.bytesPerRow = stride;
-    source_layout.rowsPerImage = m_size.y;
-
-    m_renderer.write_texture(image_copy_texture, data, size, source_layout,
-        WGPUExtent3D{
-            (uint32_t)m_size.x, (uint32_t)m_size.y, 1
-        });
+    size_t stride = get_color_format_info(m_format).bytes_per_pixel * m_size.x;
+    if (size < stride * m_size.y) {
+        logger::fatal("Texture update of {} bytes is smaller than the texture", size);
+    }
+
+    write_region(data, stride, Recti::from_size({0, 0}, m_size));
+}
+
+void WebGPUTexture::update_region(const void *data, size_t stride, const Recti &region) {
+    auto bytes_per_pixel = get_color_format_info(m_format).bytes_per_pixel;
+
+    // Only the rows and columns of the region are copied, so start the data at its top left
+    write_region((const uint8_t *)data + region.y * stride + region.x * bytes_per_pixel, stride, region);
+}
+
+void WebGPUTexture::write_region(const void *data, size_t stride, const Recti &region) {
+    // Copied to staging memory now, and to the texture with the next frame
+    m_renderer.upload_texture(m_texture, data, stride, region, get_color_format_info(m_format).bytes_per_pixel);
 }
 
 }
@@ -18,6 +18,8 @@ public:
 
     void replace(ColorFormat fmt, const Vector2i &size) override;
     void update(const void *data, size_t size) override;
+    void update_region(const void *data, size_t stride, const Recti &region) override;
+    void write_region(const void *data, size_t stride, const Recti &region) override;
 
     inline WGPUTextureView view() {
         return m_view;
@@ -0,0 +1,176 @@
+#include "upload_manager.h"
+
+#include <reimu/core/logger.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "renderer.h"
+
+namespace reimu::graphics {
+
+// Size of the buffers kept in the ring, larger uploads get a buffer of their own
+static constexpr size_t staging_buffer_size = 4 * 1024 * 1024;
+
+// Copies from buffers need rows and offsets aligned to this
+static constexpr size_t copy_row_alignment = 256;
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+WebGPUUploadManager::WebGPUUploadManager(WebGPURenderer &renderer) : m_renderer(renderer) {}
+
+WebGPUUploadManager::~WebGPUUploadManager() {
+    // Pending maps are cancelled, their callbacks keep the StagingBuffer alive
+    for (auto &buffer : m_buffers) {
+        wgpuBufferRelease(buffer->buffer);
+    }
+}
+
+void WebGPUUploadManager::upload(WGPUTexture texture, const void *data, size_t stride,
+        const Recti &region, size_t bytes_per_pixel) {
+    if (region.is_empty()) {
+        return;
+    }
+
+    size_t row_size = region.width() * bytes_per_pixel;
+    size_t bytes_per_row = align_up(row_size, copy_row_alignment);
+
+    uint64_t offset;
+    auto buffer = allocate(bytes_per_row * region.height(), offset);
+
+    uint8_t *dest = buffer->mapped + offset;
+    const uint8_t *src = (const uint8_t *)data;
+    for (int y = 0; y < region.height(); y++) {
+        memcpy(dest, src, row_size);
+
+        dest += bytes_per_row;
+        src += stride;
+    }
+
+    m_copies.push_back(Copy {
+        .texture = texture,
+        .buffer = std::move(buffer),
+        .offset = offset,
+        .bytes_per_row = (uint32_t)bytes_per_row,
+        .region = region,
+    });
+}
+
+void WebGPUUploadManager::cancel(WGPUTexture texture) {
+    std::erase_if(m_copies, [texture](const Copy &copy) {
+        return copy.texture == texture;
+    });
+}
+
+size_t WebGPUUploadManager::record(WGPUCommandEncoder encoder) {
+    for (const auto &copy : m_copies) {
+        WGPUTexelCopyBufferInfo source = {};
+        source.buffer = copy.buffer->buffer;
+        source.layout.offset = copy.offset;
+        source.layout.bytesPerRow = copy.bytes_per_row;
+        source.layout.rowsPerImage = copy.region.height();
+
+        WGPUTexelCopyTextureInfo destination = {};
+        destination.texture = copy.texture;
+        destination.mipLevel = 0;
+        destination.origin = {(uint32_t)copy.region.x, (uint32_t)copy.region.y, 0};
+        destination.aspect = WGPUTextureAspect_All;
+
+        WGPUExtent3D size = {(uint32_t)copy.region.width(), (uint32_t)copy.region.height(), 1};
+
+        wgpuCommandEncoderCopyBufferToTexture(encoder, &source, &destination, &size);
+    }
+
+    size_t num_copies = m_copies.size();
+    m_copies.clear();
+
+    // Buffers must be unmapped before the GPU uses them
+    for (auto &buffer : m_buffers) {
+        if (buffer->mapped && buffer->used > 0) {
+            wgpuBufferUnmap(buffer->buffer);
+            buffer->mapped = nullptr;
+
+            m_submitted.push_back(buffer);
+        }
+    }
+
+    return num_copies;
+}
+
+void WebGPUUploadManager::on_submitted() {
+    for (auto &buffer : m_submitted) {
+        // Buffers for one large upload aren't kept
+        if (buffer->size > staging_buffer_size) {
+            wgpuBufferRelease(buffer->buffer);
+            std::erase(m_buffers, buffer);
+
+            continue;
+        }
+
+        // Mapping completes once the GPU has finished the copies from the buffer
+        WGPUBufferMapCallbackInfo info = {
+            .nextInChain = nullptr,
+            .mode = WGPUCallbackMode_AllowProcessEvents,
+            .callback = [](WGPUMapAsyncStatus status, WGPUStringView, void *data, void *) {
+                std::unique_ptr<std::shared_ptr<StagingBuffer>> owner{(std::shared_ptr<StagingBuffer> *)data};
+                auto &buffer = **owner;
+
+                if (status != WGPUMapAsyncStatus_Success) {
+                    return;
+                }
+
+                buffer.mapped = (uint8_t *)wgpuBufferGetMappedRange(buffer.buffer, 0, buffer.size);
+                buffer.used = 0;
+            },
+            .userdata1 = new std::shared_ptr<StagingBuffer>(buffer),
+            .userdata2 = nullptr,
+        };
+
+        wgpuBufferMapAsync(buffer->buffer, WGPUMapMode_Write, 0, buffer->size, info);
+    }
+
+    m_submitted.clear();
+}
+
+std::shared_ptr<WebGPUUploadManager::StagingBuffer> WebGPUUploadManager::allocate(size_t size, uint64_t &offset) {
+    for (auto &buffer : m_buffers) {
+        size_t start = align_up(buffer->used, copy_row_alignment);
+
+        if (buffer->mapped && start + size <= buffer->size) {
+            buffer->used = start + size;
+            offset = start;
+
+            return buffer;
+        }
+    }
+
+    // Every buffer is full or in use by the GPU, so grow the ring
+    auto buffer = std::make_shared<StagingBuffer>();
+    buffer->size = std::max(staging_buffer_size, align_up(size, copy_row_alignment));
+
+    WGPUBufferDescriptor buffer_desc = {};
+    buffer_desc.label = webgpu::to_sv("staging buffer");
+    buffer_desc.usage = WGPUBufferUsage_MapWrite | WGPUBufferUsage_CopySrc;
+    buffer_desc.size = buffer->size;
+    buffer_desc.mappedAtCreation = true;
+
+    buffer->buffer = m_renderer.create_buffer(buffer_desc);
+    if (!buffer->buffer) {
+        logger::fatal("Failed to create staging buffer");
+    }
+
+    buffer->mapped = (uint8_t *)wgpuBufferGetMappedRange(buffer->buffer, 0, buffer->size);
+    assert(buffer->mapped);
+
+    buffer->used = size;
+    offset = 0;
+
+    m_buffers.push_back(buffer);
+    return buffer;
+}
+
+}
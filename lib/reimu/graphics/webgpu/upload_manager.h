@@ -0,0 +1,82 @@
+#pragma once
+
+#include <reimu/graphics/rect.h>
+
+#include <memory>
+#include <vector>
+
+#include "webgpu.h"
+
+namespace reimu::graphics {
+
+class WebGPURenderer;
+
+/**
+ * @brief Uploads texture data through a ring of mapped staging buffers
+ *
+ * Uploads are copied into mapped memory straight away, and the copies to the
+ * textures are recorded into the frame's command encoder, so many small
+ * uploads cost one submit. Buffers are mapped again once the GPU is done
+ * with them and reused by later frames.
+ */
+class WebGPUUploadManager {
+public:
+    WebGPUUploadManager(WebGPURenderer &renderer);
+    ~WebGPUUploadManager();
+
+    /**
+     * @brief Queue an upload of 'region' of 'texture'
+     *
+     * @param data Pixels for the top left of the region, rows 'stride' bytes apart
+     */
+    void upload(WGPUTexture texture, const void *data, size_t stride, const Recti &region,
+        size_t bytes_per_pixel);
+
+    /**
+     * @brief Drop queued uploads to 'texture', before it is destroyed
+     */
+    void cancel(WGPUTexture texture);
+
+    /**
+     * @brief Record the queued uploads into 'encoder' and unmap their buffers
+     *
+     * @return Number of uploads recorded
+     */
+    size_t record(WGPUCommandEncoder encoder);
+
+    /**
+     * @brief Map the buffers used by the submitted frame again, ready once the GPU is done
+     */
+    void on_submitted();
+
+private:
+    struct StagingBuffer {
+        WGPUBuffer buffer = nullptr;
+        size_t size = 0;
+
+        // Mapped memory while the buffer can be written, null while the GPU uses it
+        uint8_t *mapped = nullptr;
+        size_t used = 0;
+    };
+
+    struct Copy {
+        WGPUTexture texture;
+        std::shared_ptr<StagingBuffer> buffer;
+        uint64_t offset;
+        uint32_t bytes_per_row;
+        Recti region;
+    };
+
+    std::shared_ptr<StagingBuffer> allocate(size_t size, uint64_t &offset);
+
+    WebGPURenderer &m_renderer;
+
+    std::vector<std::shared_ptr<StagingBuffer>> m_buffers;
+
+    // Buffers with copies recorded for the frame being submitted
+    std::vector<std::shared_ptr<StagingBuffer>> m_submitted;
+
+    std::vector<Copy> m_copies;
+};
+
+}
@@ -24,4 +24,17 @@ WGPUShaderStage convert_shader_stage(ShaderStage stage) {
     logger::fatal("Unsupported shader stage");
 }
 
+WGPUPresentMode convert_present_mode(PresentMode mode) {
+    switch (mode) {
+    case PresentMode::Fifo:
+        return WGPUPresentMode_Fifo;
+    case PresentMode::Mailbox:
+        return WGPUPresentMode_Mailbox;
+    case PresentMode::Immediate:
+        return WGPUPresentMode_Immediate;
+    }
+
+    logger::fatal("Unsupported present mode");
+}
+
 }
@@ -1,7 +1,8 @@
 #pragma once
 
-#include <reimu/graphics/texture.h>
 #include <reimu/graphics/render_pass.h>
+#include <reimu/graphics/renderer.h>
+#include <reimu/graphics/texture.h>
 
 #include <webgpu/webgpu.h>
 
@@ -9,6 +10,7 @@ namespace reimu::graphics::webgpu {
 
 WGPUTextureFormat convert_color_format(ColorFormat fmt);
 WGPUShaderStage convert_shader_stage(ShaderStage stage);
+WGPUPresentMode convert_present_mode(PresentMode mode);
 
 consteval WGPUStringView to_sv(const char *string) {
     return {string, std::string_view(string).size()};
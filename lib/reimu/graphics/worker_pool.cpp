@@ -0,0 +1,106 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+namespace reimu::graphics {
+
+WorkerPool &WorkerPool::get() {
+    static WorkerPool pool;
+    return pool;
+}
+
+WorkerPool::WorkerPool() {
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (unsigned i = 0; i < cores - 1; i++) {
+        m_workers.emplace_back([this, i]() { worker_main(i); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock{m_lock};
+        m_stopping = true;
+    }
+
+    m_wake.notify_all();
+
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+}
+
+void WorkerPool::run(size_t count, unsigned thread_count, const std::function<void(size_t)> &fn) {
+    if (thread_count == 0) {
+        thread_count = this->thread_count();
+    }
+
+    size_t helpers = std::min<size_t>({ thread_count - 1, m_workers.size(), count > 0 ? count - 1 : 0 });
+    if (helpers == 0) {
+        for (size_t i = 0; i < count; i++) {
+            fn(i);
+        }
+
+        return;
+    }
+
+    std::lock_guard run_lock{m_run_lock};
+
+    {
+        std::lock_guard lock{m_lock};
+
+        m_fn = &fn;
+        m_count = count;
+        m_next = 0;
+
+        m_helpers = helpers;
+        m_active = helpers;
+        m_generation++;
+    }
+
+    m_wake.notify_all();
+
+    do_work();
+
+    // Workers may still be finishing the last indices
+    std::unique_lock lock{m_lock};
+    m_done.wait(lock, [this]() { return m_active == 0; });
+
+    m_fn = nullptr;
+}
+
+void WorkerPool::worker_main(unsigned id) {
+    uint64_t generation = 0;
+
+    std::unique_lock lock{m_lock};
+    while (true) {
+        m_wake.wait(lock, [&]() { return m_stopping || m_generation != generation; });
+        if (m_stopping) {
+            return;
+        }
+
+        generation = m_generation;
+
+        // Not needed for this job
+        if (id >= m_helpers) {
+            continue;
+        }
+
+        lock.unlock();
+        do_work();
+        lock.lock();
+
+        if (--m_active == 0) {
+            m_done.notify_one();
+        }
+    }
+}
+
+void WorkerPool::do_work() {
+    size_t i;
+    while ((i = m_next.fetch_add(1, std::memory_order_relaxed)) < m_count) {
+        (*m_fn)(i);
+    }
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reimu::graphics {
+
+/**
+ * @brief Threads for splitting rasterization across cores
+ *
+ * Threads are started on first use, one fewer than the number of cores
+ * as the thread calling run does work too.
+ */
+class WorkerPool {
+public:
+    static WorkerPool &get();
+
+    ~WorkerPool();
+
+    // Threads available to run, including the caller
+    unsigned thread_count() const {
+        return m_workers.size() + 1;
+    }
+
+    /**
+     * @brief Call 'fn' for each index in [0, count), returning once all calls have finished
+     *
+     * @param thread_count Most threads to use including the caller, 0 for all of them
+     */
+    void run(size_t count, unsigned thread_count, const std::function<void(size_t)> &fn);
+
+private:
+    WorkerPool();
+
+    void worker_main(unsigned id);
+    void do_work();
+
+    std::vector<std::thread> m_workers;
+
+    // Held for the duration of run, so only one job is in flight
+    std::mutex m_run_lock;
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    // Current job, changed under m_lock
+    uint64_t m_generation = 0;
+    unsigned m_helpers = 0;
+    unsigned m_active = 0;
+    bool m_stopping = false;
+
+    const std::function<void(size_t)> *m_fn = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next = 0;
+};
+
+}
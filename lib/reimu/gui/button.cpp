@@ -27,7 +27,7 @@ Button::Button() {
 void Button::repaint(UIPainter &painter) {
     Widget::repaint(painter);
 
-    graphics::Painter p{ *m_surface };
+    graphics::Painter p{ *m_surface, m_display_list };
 
     painter.begin(p);
 
@@ -1,7 +1,40 @@
 #include "compositor.h"
 
+#include <algorithm>
+#include <stdint.h>
+
 namespace reimu::gui {
 
+// Clips split into more pieces than this are drawn whole, as the draws would cost more than the overdraw
+static constexpr size_t max_pieces_per_clip = 8;
+
+static Recti offset_rect(const Recti &rect, const Vector2i &offset) {
+    return Recti::from_size(rect.top_left() + offset, rect.size());
+}
+
+// Add the parts of 'rect' outside of 'hole' to 'out'
+static void subtract_rect(const Recti &rect, const Recti &hole, std::vector<Recti> &out) {
+    Recti overlap = rect.intersect(hole);
+    if (overlap.is_empty()) {
+        out.push_back(rect);
+        return;
+    }
+
+    // Full width above and below the hole, then either side of it
+    Recti parts[] = {
+        { rect.x, rect.y, rect.z, overlap.y },
+        { rect.x, overlap.w, rect.z, rect.w },
+        { rect.x, overlap.y, overlap.x, overlap.w },
+        { overlap.z, overlap.y, rect.z, overlap.w },
+    };
+
+    for (const auto &part : parts) {
+        if (!part.is_empty()) {
+            out.push_back(part);
+        }
+    }
+}
+
 Compositor::Compositor(graphics::Renderer *renderer) {
     reimu::graphics::BindingDefinition bindings[] = {
         {
@@ -12,19 +45,117 @@ Compositor::Compositor(graphics::Renderer *renderer) {
             .type = reimu::graphics::BindingType::UniformBuffer,
             .index = 0,
         },
+        {
+            .storage_buffer = {
+                .size = sizeof(Instance) * max_instances
+            },
+            .visibility = reimu::graphics::ShaderStage::Vertex,
+            .type = reimu::graphics::BindingType::StorageBuffer,
+            .index = 1,
+        },
         {
             .visibility = reimu::graphics::ShaderStage::Fragment,
             .type = reimu::graphics::BindingType::Texture,
-            .index = 1,
+            .index = 2,
         }
     };
     
-    auto render_pass = renderer->create_render_pass(bindings, 2).ensure();
+    // Widget surfaces are painted with premultiplied alpha
+    auto render_pass = renderer->create_render_pass(bindings, 3, graphics::AlphaMode::Premultiplied).ensure();
 
     m_render_pass = std::unique_ptr<graphics::RenderPass>(render_pass);
     m_render_pass->set_strategy(this);
 }
 
+void Compositor::cull_clips(const Vector2i &viewport_size) {
+    Recti viewport = Recti::from_size({0, 0}, viewport_size);
+
+    m_pieces.clear();
+    m_occluders.clear();
+
+    // Front to back, so each clip is only drawn where no opaque clip above it hides it
+    for (auto it = m_clips.rbegin(); it != m_clips.rend(); it++) {
+        const auto &clip = *it;
+        auto &texture = clip.surface->texture();
+
+        Vector2i offset = clip.dest - clip.source.top_left();
+        Recti target = offset_rect(clip.source, offset).intersect(viewport);
+        if (target.is_empty()) {
+            continue;
+        }
+
+        m_visible.clear();
+        m_visible.push_back(target);
+
+        for (const auto &occluder : m_occluders) {
+            m_split.clear();
+            for (const auto &rect : m_visible) {
+                subtract_rect(rect, occluder, m_split);
+            }
+
+            std::swap(m_visible, m_split);
+            if (m_visible.empty()) {
+                break;
+            }
+        }
+
+        if (m_visible.size() > max_pieces_per_clip) {
+            Recti bounds = m_visible.front();
+            for (const auto &rect : m_visible) {
+                bounds = bounds.union_with(rect);
+            }
+
+            m_visible.clear();
+            m_visible.push_back(bounds);
+        }
+
+        // Textures in an atlas are drawn from the atlas, so neighbouring clips share a texture
+        auto *tex = &texture.backing_texture();
+        Vector2i source_offset = texture.backing_origin() - offset;
+
+        for (const auto &rect : m_visible) {
+            m_pieces.push_back(Piece {
+                .tex = tex,
+                .source = offset_rect(rect, source_offset),
+                .target = rect,
+            });
+        }
+
+        Recti opaque = offset_rect(clip.surface->opaque_rect().intersect(clip.source), offset).intersect(target);
+        if (!opaque.is_empty()) {
+            m_occluders.push_back(opaque);
+        }
+    }
+
+    std::reverse(m_pieces.begin(), m_pieces.end());
+
+    // Pieces next to each other in both the texture and the window are drawn as one,
+    // only merging neighbours in the list keeps the drawing order
+    size_t count = 0;
+    for (const auto &piece : m_pieces) {
+        if (count > 0) {
+            auto &last = m_pieces[count - 1];
+
+            bool same_offset = last.tex == piece.tex
+                && last.target.top_left() - last.source.top_left() == piece.target.top_left() - piece.source.top_left();
+            bool is_beside = last.target.y == piece.target.y && last.target.w == piece.target.w
+                && (last.target.z == piece.target.x || piece.target.z == last.target.x);
+            bool is_below = last.target.x == piece.target.x && last.target.z == piece.target.z
+                && (last.target.w == piece.target.y || piece.target.w == last.target.y);
+
+            if (same_offset && (is_beside || is_below)) {
+                last.source = last.source.union_with(piece.source);
+                last.target = last.target.union_with(piece.target);
+                continue;
+            }
+        }
+
+        m_pieces[count++] = piece;
+    }
+
+    m_pieces.resize(count);
+}
+
 void Compositor::draw(graphics::Renderer &renderer, graphics::RenderPass &pass) {
     auto viewport_size = renderer.get_viewport_size();
     auto view_transform = reimu::Matrix4();
@@ -35,17 +166,48 @@ void Compositor::draw(graphics::Renderer &renderer, graphics::RenderPass &pass)
     UBO ubo;
     ubo.view = view_transform;
 
-    for (const auto &clip : m_clips) {
-        Vector4i source = clip.source;
-        Vector2i dest = clip.dest;
+    pass.bind_uniform_buffer(0, &ubo, sizeof(ubo));
 
-        ubo.source = vector_static_cast<float>(source);
-        ubo.target = vector_static_cast<float>(Recti{dest.x, dest.y, source.z - source.x + dest.x, source.w - source.y + dest.y});
+    // Opacity changes with repaints, so what is hidden is found every frame
+    cull_clips(viewport_size);
+
+    m_instances.clear();
+    m_batches.clear();
+
+    for (const auto &piece : m_pieces) {
+        // Batches don't cross the instances bound at once
+        if (m_batches.empty() || m_batches.back().tex != piece.tex || m_instances.size() % max_instances == 0) {
+            m_batches.push_back(Batch {
+                .tex = piece.tex,
+                .first = m_instances.size(),
+                .count = 0,
+            });
+        }
 
-        pass.bind_uniform_buffer(0, &ubo, sizeof(ubo));
-        pass.bind_texture(1, clip.tex);
+        m_instances.push_back(Instance {
+            .source = vector_static_cast<float>(piece.source),
+            .target = vector_static_cast<float>(piece.target),
+            .opacity = 1.0f,
+            .padding = {},
+        });
+
+        m_batches.back().count++;
+    }
+
+    // Every piece is drawn by one instanced draw per texture run
+    size_t bound_first = SIZE_MAX;
+    for (const auto &batch : m_batches) {
+        size_t first = batch.first / max_instances * max_instances;
+
+        if (first != bound_first) {
+            size_t count = std::min(max_instances, m_instances.size() - first);
+            pass.bind_storage_buffer(1, m_instances.data() + first, count * sizeof(Instance));
+
+            bound_first = first;
+        }
 
-        pass.draw(4);
+        pass.bind_texture(2, batch.tex);
+        pass.draw_instanced(4, batch.count, batch.first - first);
     }
 }
 
@@ -5,25 +5,36 @@
 #include <reimu/graphics/rect.h>
 #include <reimu/gui/widget.h>
 
-#include <list>
+#include <vector>
 
 namespace reimu::gui {
 
 class Compositor : public graphics::RenderStrategy {
 public:
+    // Widget surface drawn to the window, in the order they were added
     struct Clip {
         Recti source;
         Vector2i dest;
 
-        graphics::Texture *tex;
+        // Read when drawing, as its texture and opaque rect change with repaints
+        graphics::Surface *surface;
     };
 
     struct UBO {
         reimu::Matrix4 view;
+    };
+
+    // Per clip data read by the shader, laid out as a WGSL struct
+    struct Instance {
         reimu::Vector4f source;
         reimu::Vector4f target;
+        float opacity;
+        float padding[3];
     };
 
+    // Most instances bound at once, more are drawn in several batches
+    static constexpr size_t max_instances = 1024;
+
     Compositor(graphics::Renderer *renderer);
 
     void draw(graphics::Renderer &renderer, graphics::RenderPass &pass) override;
@@ -37,15 +48,45 @@ public:
     }
 
 private:
-    AddClipFn m_add_clip_fn = [this](Recti src, Vector2i dest, graphics::Texture *tex) {
+    AddClipFn m_add_clip_fn = [this](Recti src, Vector2i dest, graphics::Surface *surface) {
         m_clips.push_back(Clip {
             .source = src,
             .dest = dest,
-            .tex = tex
+            .surface = surface
         });
     };
 
-    std::list<Clip> m_clips;
+    // Part of a clip not hidden by opaque clips above it
+    struct Piece {
+        graphics::Texture *tex;
+        // In the backing texture
+        Recti source;
+        Recti target;
+    };
+
+    /**
+     * @brief Find the visible pieces of every clip, back to front
+     */
+    void cull_clips(const Vector2i &viewport_size);
+
+    // Run of instances drawn from the same texture
+    struct Batch {
+        graphics::Texture *tex;
+        size_t first;
+        size_t count;
+    };
+
+    std::vector<Clip> m_clips;
+
+    std::vector<Piece> m_pieces;
+    // Opaque parts of the clips above the one being culled
+    std::vector<Recti> m_occluders;
+    std::vector<Recti> m_visible;
+    std::vector<Recti> m_split;
+
+    std::vector<Instance> m_instances;
+    std::vector<Batch> m_batches;
+
     std::unique_ptr<graphics::RenderPass> m_render_pass;
 };
 
@@ -1,25 +1,32 @@
 #include <reimu/gui/widget.h>
 
+#include <reimu/core/unicode.h>
+
 namespace reimu::gui {
 
 void Label::repaint(UIPainter &painter) {
     Widget::repaint(painter);
     
-    graphics::Painter p{ *m_surface };
+    graphics::Painter p{ *m_surface, m_display_list };
 
     painter.begin(p);
 
+    // Clear the old text, only the changed regions are drawn
+    painter.draw_background();
     painter.draw_label(m_text);
 
     painter.end();
 }
 
 void Label::set_text(const std::string &text) {
-    m_text = text;
-
-    if (m_parent) {
-        m_parent->dispatch_event("ui_repaint"_hashid);
+    std::u32string utf32;
+    if (to_utf32(text, utf32).is_err()) {
+        logger::warn("Label text is not valid UTF-8");
     }
+
+    m_text.set_text(utf32);
+
+    dispatch_event("ui_repaint"_hashid);
 }
 
 }
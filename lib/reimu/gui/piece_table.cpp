@@ -0,0 +1,349 @@
+#include "piece_table.h"
+
+#include <algorithm>
+
+namespace reimu::gui {
+
+namespace {
+
+void index_newlines(std::string_view text, size_t offset, std::vector<size_t> &newlines) {
+    for (size_t pos = text.find('\n'); pos != std::string_view::npos; pos = text.find('\n', pos + 1)) {
+        newlines.push_back(offset + pos);
+    }
+}
+
+}
+
+PieceTable::PieceTable() {}
+
+PieceTable::PieceTable(std::string text) : m_original(std::move(text)) {
+    index_newlines(m_original, 0, m_original_newlines);
+
+    if (!m_original.empty()) {
+        m_root = new_node(Buffer::Original, 0, m_original.size());
+    }
+}
+
+void PieceTable::insert(size_t pos, std::string_view text) {
+    if (text.empty()) {
+        return;
+    }
+
+    pos = std::min(pos, size());
+
+    size_t add_start = m_add.size();
+    size_t newline_count = m_add_newlines.size();
+
+    m_add += text;
+    index_newlines(text, add_start, m_add_newlines);
+
+    int32_t left, right;
+    split(m_root, pos, left, right);
+
+    // Typing appends to the same piece rather than making a new one each time
+    if (!extend_last(left, add_start, text.size(), m_add_newlines.size() - newline_count)) {
+        left = merge(left, new_node(Buffer::Add, add_start, text.size()));
+    }
+
+    m_root = merge(left, right);
+}
+
+void PieceTable::erase(size_t pos, size_t len) {
+    pos = std::min(pos, size());
+    len = std::min(len, size() - pos);
+
+    if (len == 0) {
+        return;
+    }
+
+    int32_t left, middle, right;
+    split(m_root, pos, left, right);
+    split(right, len, middle, right);
+
+    free_tree(middle);
+
+    m_root = merge(left, right);
+}
+
+std::string PieceTable::text(size_t pos, size_t len) const {
+    std::string out;
+
+    pos = std::min(pos, size());
+    len = std::min(len, size() - pos);
+    out.reserve(len);
+
+    // Walk only the subtrees which overlap the range
+    auto collect = [this, &out](auto &self, int32_t node, size_t pos, size_t len) -> void {
+        if (node < 0 || len == 0) {
+            return;
+        }
+
+        const Node &n = m_nodes[node];
+        size_t left_length = subtree_length(n.left);
+
+        if (pos < left_length) {
+            size_t count = std::min(len, left_length - pos);
+            self(self, n.left, pos, count);
+
+            pos += count;
+            len -= count;
+        }
+
+        pos -= left_length;
+        if (len > 0 && pos < n.length) {
+            size_t count = std::min(len, n.length - pos);
+            out.append(buffer_text(n.buffer), n.start + pos, count);
+
+            pos += count;
+            len -= count;
+        }
+
+        self(self, n.right, pos - n.length, len);
+    };
+
+    collect(collect, m_root, pos, len);
+
+    return out;
+}
+
+size_t PieceTable::size() const {
+    return subtree_length(m_root);
+}
+
+size_t PieceTable::line_count() const {
+    return subtree_newlines(m_root) + 1;
+}
+
+size_t PieceTable::line_start(size_t line) const {
+    if (line == 0) {
+        return 0;
+    }
+
+    // Find the end of the line'th newline
+    size_t n = line;
+    size_t offset = 0;
+
+    int32_t node = m_root;
+    while (node >= 0) {
+        const Node &nd = m_nodes[node];
+
+        size_t left_newlines = subtree_newlines(nd.left);
+        if (n <= left_newlines) {
+            node = nd.left;
+            continue;
+        }
+
+        n -= left_newlines;
+        offset += subtree_length(nd.left);
+
+        if (n <= nd.newlines) {
+            return offset + nth_newline(nd.buffer, nd.start, n - 1) - nd.start + 1;
+        }
+
+        n -= nd.newlines;
+        offset += nd.length;
+
+        node = nd.right;
+    }
+
+    return size();
+}
+
+size_t PieceTable::line_end(size_t line) const {
+    if (line + 1 >= line_count()) {
+        return size();
+    }
+
+    return line_start(line + 1) - 1;
+}
+
+size_t PieceTable::line_at(size_t pos) const {
+    size_t line = 0;
+
+    int32_t node = m_root;
+    while (node >= 0) {
+        const Node &nd = m_nodes[node];
+
+        size_t left_length = subtree_length(nd.left);
+        if (pos < left_length) {
+            node = nd.left;
+            continue;
+        }
+
+        pos -= left_length;
+        line += subtree_newlines(nd.left);
+
+        if (pos < nd.length) {
+            return line + count_newlines(nd.buffer, nd.start, pos);
+        }
+
+        pos -= nd.length;
+        line += nd.newlines;
+
+        node = nd.right;
+    }
+
+    return line;
+}
+
+int32_t PieceTable::new_node(Buffer buffer, size_t start, size_t length) {
+    int32_t index;
+    if (!m_free_nodes.empty()) {
+        index = m_free_nodes.back();
+        m_free_nodes.pop_back();
+    } else {
+        index = m_nodes.size();
+        m_nodes.emplace_back();
+    }
+
+    // xorshift32
+    m_rng_state ^= m_rng_state << 13;
+    m_rng_state ^= m_rng_state >> 17;
+    m_rng_state ^= m_rng_state << 5;
+
+    Node &n = m_nodes[index];
+    n = {
+        .priority = m_rng_state,
+        .buffer = buffer,
+        .start = start,
+        .length = length,
+        .newlines = count_newlines(buffer, start, length),
+    };
+
+    update(index);
+
+    return index;
+}
+
+void PieceTable::free_tree(int32_t node) {
+    if (node < 0) {
+        return;
+    }
+
+    free_tree(m_nodes[node].left);
+    free_tree(m_nodes[node].right);
+
+    m_free_nodes.push_back(node);
+}
+
+void PieceTable::update(int32_t node) {
+    Node &n = m_nodes[node];
+
+    n.subtree_length = subtree_length(n.left) + n.length + subtree_length(n.right);
+    n.subtree_newlines = subtree_newlines(n.left) + n.newlines + subtree_newlines(n.right);
+}
+
+void PieceTable::split(int32_t node, size_t pos, int32_t &left, int32_t &right) {
+    if (node < 0) {
+        left = right = -1;
+        return;
+    }
+
+    size_t left_length = subtree_length(m_nodes[node].left);
+    size_t node_length = m_nodes[node].length;
+
+    // Splitting a piece can grow m_nodes, so don't hold references across recursion
+    if (pos <= left_length) {
+        int32_t child;
+        split(m_nodes[node].left, pos, left, child);
+
+        m_nodes[node].left = child;
+        update(node);
+
+        right = node;
+    } else if (pos >= left_length + node_length) {
+        int32_t child;
+        split(m_nodes[node].right, pos - left_length - node_length, child, right);
+
+        m_nodes[node].right = child;
+        update(node);
+
+        left = node;
+    } else {
+        // Split the piece itself, the tail takes the right subtree
+        size_t offset = pos - left_length;
+
+        int32_t tail = new_node(m_nodes[node].buffer, m_nodes[node].start + offset,
+            node_length - offset);
+
+        // Children of the node have a lower priority, so the tail can take its place
+        m_nodes[tail].priority = m_nodes[node].priority;
+        m_nodes[tail].right = m_nodes[node].right;
+        update(tail);
+
+        Node &n = m_nodes[node];
+        n.right = -1;
+        n.length = offset;
+        n.newlines -= m_nodes[tail].newlines;
+        update(node);
+
+        left = node;
+        right = tail;
+    }
+}
+
+int32_t PieceTable::merge(int32_t left, int32_t right) {
+    if (left < 0) {
+        return right;
+    } else if (right < 0) {
+        return left;
+    }
+
+    if (m_nodes[left].priority > m_nodes[right].priority) {
+        int32_t merged = merge(m_nodes[left].right, right);
+        m_nodes[left].right = merged;
+        update(left);
+
+        return left;
+    } else {
+        int32_t merged = merge(left, m_nodes[right].left);
+        m_nodes[right].left = merged;
+        update(right);
+
+        return right;
+    }
+}
+
+bool PieceTable::extend_last(int32_t node, size_t add_start, size_t length, size_t newlines) {
+    if (node < 0) {
+        return false;
+    }
+
+    Node &n = m_nodes[node];
+    if (n.right >= 0) {
+        if (!extend_last(n.right, add_start, length, newlines)) {
+            return false;
+        }
+    } else {
+        if (n.buffer != Buffer::Add || n.start + n.length != add_start) {
+            return false;
+        }
+
+        n.length += length;
+        n.newlines += newlines;
+    }
+
+    n.subtree_length += length;
+    n.subtree_newlines += newlines;
+
+    return true;
+}
+
+size_t PieceTable::count_newlines(Buffer buffer, size_t start, size_t length) const {
+    const auto &newlines = buffer_newlines(buffer);
+
+    auto begin = std::lower_bound(newlines.begin(), newlines.end(), start);
+    auto end = std::lower_bound(begin, newlines.end(), start + length);
+
+    return end - begin;
+}
+
+size_t PieceTable::nth_newline(Buffer buffer, size_t start, size_t n) const {
+    const auto &newlines = buffer_newlines(buffer);
+
+    auto it = std::lower_bound(newlines.begin(), newlines.end(), start);
+
+    return *(it + n);
+}
+
+}
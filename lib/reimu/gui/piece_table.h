@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace reimu::gui {
+
+/**
+ * @brief UTF-8 text buffer for editing
+ *
+ * Text is stored as pieces of two append-only buffers, the original text
+ * and everything inserted since. Pieces are kept in an implicit treap ordered
+ * by position, where each node stores the byte and newline counts of its subtree,
+ * so inserts, erases and line lookups are O(log n) in the number of pieces.
+ *
+ * Each buffer keeps the offsets of its newlines, so newlines within
+ * a piece are found by binary search rather than scanning its text.
+ */
+class PieceTable {
+public:
+    PieceTable();
+    PieceTable(std::string text);
+
+    void insert(size_t pos, std::string_view text);
+    void erase(size_t pos, size_t len);
+
+    std::string text(size_t pos, size_t len) const;
+    std::string text() const { return text(0, size()); }
+
+    size_t size() const;
+    size_t line_count() const;
+
+    // Byte offset of the start of 'line'
+    size_t line_start(size_t line) const;
+    // Byte offset of the end of 'line', excluding the newline
+    size_t line_end(size_t line) const;
+
+    // Line containing byte offset 'pos'
+    size_t line_at(size_t pos) const;
+
+private:
+    enum class Buffer : uint8_t {
+        Original,
+        Add,
+    };
+
+    struct Node {
+        uint32_t priority;
+
+        int32_t left = -1;
+        int32_t right = -1;
+
+        Buffer buffer;
+        size_t start;
+        size_t length;
+        size_t newlines;
+
+        // Totals for the subtree rooted at this node
+        size_t subtree_length = 0;
+        size_t subtree_newlines = 0;
+    };
+
+    int32_t new_node(Buffer buffer, size_t start, size_t length);
+    void free_tree(int32_t node);
+
+    void update(int32_t node);
+
+    void split(int32_t node, size_t pos, int32_t &left, int32_t &right);
+    int32_t merge(int32_t left, int32_t right);
+
+    // Grow the last piece of the tree by 'length' bytes if it ends at the end of the add buffer
+    bool extend_last(int32_t node, size_t add_start, size_t length, size_t newlines);
+
+    size_t count_newlines(Buffer buffer, size_t start, size_t length) const;
+    size_t nth_newline(Buffer buffer, size_t start, size_t n) const;
+
+    const std::string &buffer_text(Buffer buffer) const {
+        return buffer == Buffer::Original ? m_original : m_add;
+    }
+
+    const std::vector<size_t> &buffer_newlines(Buffer buffer) const {
+        return buffer == Buffer::Original ? m_original_newlines : m_add_newlines;
+    }
+
+    size_t subtree_length(int32_t node) const {
+        return node < 0 ? 0 : m_nodes[node].subtree_length;
+    }
+
+    size_t subtree_newlines(int32_t node) const {
+        return node < 0 ? 0 : m_nodes[node].subtree_newlines;
+    }
+
+    std::string m_original;
+    std::string m_add;
+
+    std::vector<size_t> m_original_newlines;
+    std::vector<size_t> m_add_newlines;
+
+    std::vector<Node> m_nodes;
+    std::vector<int32_t> m_free_nodes;
+    int32_t m_root = -1;
+
+    uint32_t m_rng_state = 0x9e3779b9;
+};
+
+}
@@ -11,6 +11,11 @@ RootContainer::RootContainer(Window *win, const Vector2f &viewport_size, bool de
     create_window_controls();
 
     bind_event_callback("ui_repaint"_hashid, [this]() {
+        m_needs_repaint = true;
+        m_repaint = true;
+    });
+
+    bind_event_callback("ui_child_repaint"_hashid, [this]() {
         m_repaint = true;
     });
 
@@ -23,28 +28,35 @@ RootContainer::RootContainer(Window *win, const Vector2f &viewport_size, bool de
     });
 }
 
-void RootContainer::repaint(UIPainter &painter) {
+void RootContainer::paint(UIPainter &painter) {
     m_repaint = false;
 
-    Box::repaint(painter);
+    // The window controls are children, so are painted with the rest
+    Box::paint(painter);
+}
 
-    if (m_decorate) {
-        graphics::Painter p{ *m_surface };
+void RootContainer::repaint(UIPainter &painter) {
+    Widget::repaint(painter);
 
-        painter.begin(p);
-        painter.draw_frame(window_title, true);
-        painter.end();
+    // The frame is painted over the background with the same Painter,
+    // so both are kept in one display list
+    graphics::Painter p{ *m_surface, m_display_list };
 
-        for (auto &control : m_window_controls) {
-            control->repaint(painter);
-        }
+    painter.begin(p);
+    painter.draw_background();
+    if (m_decorate) {
+        painter.draw_frame(window_title, true);
     }
+    painter.end();
 }
 
 void RootContainer::update_layout(const Vector2f &viewport_size) {
     m_recalculate_layout = false;
     m_repaint = true;
 
+    // The frame depends on the layout, the retained display list keeps this cheap
+    m_needs_repaint = true;
+
     calculated_layout.font_size = 16;
     calculated_layout.root_font_size = 16;
     calculated_layout.left_padding = 0;
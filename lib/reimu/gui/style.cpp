@@ -2,11 +2,48 @@
 
 #include <reimu/core/unicode.h>
 #include <reimu/graphics/font.h>
+#include <reimu/os/fs.h>
 
 #include <assert.h>
 
+#include <unordered_map>
+#include <vector>
+
 namespace reimu::gui {
 
+struct DefaultUIPainter::Theme {
+    UIStyle style;
+    std::shared_ptr<graphics::Font> font;
+
+    // Chrome rendered once for the style, then copied to each widget
+    std::unique_ptr<graphics::NineSlice> frame_border;
+    std::unique_ptr<graphics::NineSlice> button_up;
+    std::unique_ptr<graphics::NineSlice> button_down;
+    std::unique_ptr<graphics::NineSlice> textbox;
+    std::unique_ptr<graphics::NineSlice> textbox_focused;
+
+    // Text is only laid out again when it changes
+    std::unordered_map<std::string, graphics::Text> title_texts;
+    std::unordered_map<std::string, graphics::Text> button_texts;
+
+    void render();
+
+    // Get the laid out text for a label from 'texts', laying it out in 'color' the first time
+    graphics::Text &text(std::unordered_map<std::string, graphics::Text> &texts,
+        const std::string &label, const Color &color);
+};
+
+static bool is_same_style(const UIStyle &a, const UIStyle &b) {
+    return a.background_color.value == b.background_color.value
+        && a.text_color.value == b.text_color.value
+        && a.highlight_color.value == b.highlight_color.value
+        && a.shadow_color.value == b.shadow_color.value
+        && a.input_background_color.value == b.input_background_color.value
+        && a.selection_color.value == b.selection_color.value
+        && a.win_border_thickness == b.win_border_thickness
+        && a.win_titlebar_height == b.win_titlebar_height;
+}
+
 UIPainter::UIPainter() {}
  
 void UIPainter::begin(graphics::Painter &painter) {
@@ -17,6 +54,11 @@ void UIPainter::end() {
     m_current_painter = nullptr;
 }
 
+void UIPainter::set_style(const UIStyle &style) {
+    m_style = style;
+    style_changed();
+}
+
 graphics::Painter &UIPainter::get_painter() {
     assert(m_current_painter);
     return *m_current_painter;
@@ -25,22 +67,30 @@ graphics::Painter &UIPainter::get_painter() {
 DefaultUIPainter::DefaultUIPainter(ResourceManager &rm) : m_res_mgr(rm) {
     auto fon = m_res_mgr.get("font_default"_hashid);
     if (fon.has_some()) {
-        m_text.set_font(Resource::as<graphics::Font>(fon.ensure()).ensure());
+        m_font = Resource::as<graphics::Font>(fon.ensure()).ensure();
     } else {
-        auto fon = m_res_mgr.load_from_file<graphics::Font>("font.ttf", "font_default"_hashid).ensure();
+        m_font = m_res_mgr.load_from_file<graphics::Font>("font.ttf", "font_default"_hashid).ensure();
 
-        m_text.set_font(std::move(fon));
+        if (auto cache_path = os::cache_path(); !cache_path.is_err()) {
+            m_font->enable_disk_cache(cache_path.ensure() + "/glyphs");
+        }
     }
 
+    m_text.set_font(m_font);
+
     m_style.background_color = Color(200, 200, 190);
     m_style.text_color = Color(0, 0, 0);
     m_style.highlight_color = Color(255, 255, 255);
     m_style.shadow_color = Color(0, 0, 0);
+    m_style.input_background_color = Color(255, 255, 255);
+    m_style.selection_color = Color(160, 200, 255);
     m_style.win_border_thickness = 2;
     m_style.win_titlebar_height = 24;
 }
 
 void DefaultUIPainter::draw_frame(const std::string &title, bool is_active) {
+    update_theme();
+
     auto &painter = get_painter();
     auto &style = get_style();
 
@@ -48,22 +98,9 @@ void DefaultUIPainter::draw_frame(const std::string &title, bool is_active) {
 
     auto titlebar_rect = Rectf{1, 1, size.x - 1, (float)style.win_titlebar_height + 1};
 
-    if (m_style.win_border_thickness > 0) {
+    if (m_theme->frame_border) {
         float thickness = style.win_border_thickness;
-        painter
-            // Highlight
-            .draw_rect({0, 0, size.x - 1, 1}, style.highlight_color)
-            .draw_rect({0, 0, 1, size.y - 1}, style.highlight_color)
-            // Shadow
-            .draw_rect({size.x - 1, 0, size.x, size.y}, style.shadow_color)
-            .draw_rect({0, size.y - 1, size.x, size.y}, style.shadow_color)
-            // Border
-            .draw_rect({1, 1, size.x - 1, 1 + thickness}, style.background_color)
-            .draw_rect({1, 1, 1 + thickness, size.y - 1}, style.background_color)
-            .draw_rect({size.x - thickness - 1, 1, size.x - 1, size.y - 1},
-                style.background_color)
-            .draw_rect({1, size.y - thickness - 1, size.x - 1, size.y - 1},
-                style.background_color)
+        painter.draw_nine_slice({0, 0, size.x, size.y}, *m_theme->frame_border)
             .draw_rect({thickness, thickness + 1 + style.win_titlebar_height, size.x - 1,
                 thickness + 1 + style.win_titlebar_height + 1}, style.background_color);
 
@@ -75,15 +112,26 @@ void DefaultUIPainter::draw_frame(const std::string &title, bool is_active) {
     }
 
     // Window titlebar gradient
-    Color c1 = Color(192, 0, 100, 255);
-    Color c2 = Color(64, 32, 128, 255);
+    Vector2i titlebar_size = { (int)titlebar_rect.width(), (int)titlebar_rect.height() };
+    if (titlebar_size.x > 0 && titlebar_size.y > 0) {
+        if (!m_titlebar || m_titlebar->size() != titlebar_size) {
+            Color c1 = Color(192, 0, 100, 255);
+            Color c2 = Color(64, 32, 128, 255);
+
+            // Gradient points are relative to the window, so move them to the titlebar
+            m_titlebar = std::make_shared<graphics::Surface>(titlebar_size);
+            graphics::Painter{*m_titlebar}.draw_rect_gradient(
+                {0, 0, (float)titlebar_size.x, (float)titlebar_size.y}, c1, c2,
+                {-titlebar_rect.x, -titlebar_rect.y},
+                {titlebar_rect.width() - titlebar_rect.x, 500.f - titlebar_rect.y});
+        }
+
+        painter.draw_image(titlebar_rect, m_titlebar, Recti::from_size({0, 0}, titlebar_size));
+    }
 
-    painter.draw_rect_gradient(titlebar_rect, c1, c2, {0.f, 0.f}, {titlebar_rect.width(), 500.f});
+    auto &title_text = m_theme->text(m_theme->title_texts, title, Color(255, 255, 255));
 
-    m_text.set_text(to_utf32(title).ensure());
-    m_text.set_font_size_px(16);
-    m_text.set_color(Color(255, 255, 255));
-    m_text.render(painter.surface(), {
+    painter.draw_text(title_text, {
         titlebar_rect.x + 2,
         titlebar_rect.y,
         titlebar_rect.z,
@@ -92,52 +140,41 @@ void DefaultUIPainter::draw_frame(const std::string &title, bool is_active) {
 }
 
 void DefaultUIPainter::draw_button(const std::string &label, bool is_pressed) {
+    update_theme();
+
     auto &painter = get_painter();
-    auto &style = get_style();
 
     auto size = vector_static_cast<float>(painter.surface_size());
 
-    auto button_rect = Rectf{0, 0, size.x, size.y};
+    painter.draw_nine_slice({0, 0, size.x, size.y}, is_pressed ? *m_theme->button_down : *m_theme->button_up);
 
-    if (is_pressed) {
-        painter.draw_rect(button_rect, style.background_color)
-            .draw_rect({0, 0, size.x, 1}, style.shadow_color)
-            .draw_rect({0, 0, 1, size.y}, style.shadow_color)
-            .draw_rect({size.x - 1, 0, size.x, size.y}, style.shadow_color)
-            .draw_rect({0, size.y - 1, size.x, size.y}, style.shadow_color);
-    } else {
-        painter.draw_rect(button_rect, style.background_color)
-            .draw_rect({0, 0, size.x, 1}, style.highlight_color)
-            .draw_rect({0, 0, 1, size.y}, style.highlight_color)
-            .draw_rect({size.x - 2, 0, size.x, size.y}, style.shadow_color)
-            .draw_rect({0, size.y - 2, size.x, size.y}, style.shadow_color);
-    }
-
-    m_text.set_text(to_utf32(label).ensure());
-    m_text.set_font_size_px(16);
-    m_text.set_color(Color(0, 0, 0));
+    auto &text = m_theme->text(m_theme->button_texts, label, Color(0, 0, 0));
+    auto text_size = text.text_geometry();
 
-    auto text_size = m_text.text_geometry();
-
-    m_text.render(painter.surface(), {(size.x - text_size.x) / 2, (size.y - text_size.y) / 2, size.x, size.y});
+    painter.draw_text(text, {(size.x - text_size.x) / 2, (size.y - text_size.y) / 2, size.x, size.y});
 }
 
-void DefaultUIPainter::draw_label(const std::string &label) {
+void DefaultUIPainter::draw_label(graphics::Text &label) {
     auto &painter = get_painter();
+    auto &style = get_style();
+
     auto size = vector_static_cast<float>(painter.surface_size());
 
-    draw_text(label, {2, 2, size.x, size.y});
+    style_text(label);
+    label.set_wrap_width(size.x - 4);
+
+    painter.draw_text(label, {2, 2, size.x, size.y});
 }
 
 void DefaultUIPainter::draw_text(const std::string &text, const Rectf &bounds) {
     auto &painter = get_painter();
     auto &style = get_style();
 
-    m_text.set_text(to_utf32(text).ensure());
+    set_text_utf8(text);
     m_text.set_font_size_px(16);
     m_text.set_color(Color(0, 0, 0));
     
-    m_text.render(painter.surface(), bounds);
+    painter.draw_text(m_text, bounds);
 }
 
 void DefaultUIPainter::draw_background() {
@@ -149,4 +186,186 @@ void DefaultUIPainter::draw_background() {
     painter.draw_rect({0, 0, size.x, size.y}, style.background_color);
 }
 
+void DefaultUIPainter::style_changed() {
+    m_is_theme_stale = true;
+}
+
+// Chrome is painted at its smallest size, with one pixel for each edge and the center
+template<typename PaintFn>
+static std::unique_ptr<graphics::NineSlice> render_nine_slice(int left, int top, int right, int bottom,
+        bool draws_center, PaintFn paint) {
+    auto slice = std::make_unique<graphics::NineSlice>(Vector2i{ left + right + 1, top + bottom + 1 },
+        Recti{ left, top, left + 1, top + 1 }, draws_center);
+
+    {
+        graphics::Painter painter{slice->surface()};
+        paint(painter, vector_static_cast<float>(painter.surface_size()));
+    }
+
+    return slice;
+}
+
+void DefaultUIPainter::Theme::render() {
+    if (style.win_border_thickness > 0) {
+        int t = style.win_border_thickness;
+
+        // The middle is left for the titlebar and widgets
+        frame_border = render_nine_slice(t + 1, t + 1, t + 1, t + 1, false,
+                [&](graphics::Painter &painter, Vector2f size) {
+            painter
+                // Highlight
+                .draw_rect({0, 0, size.x - 1, 1}, style.highlight_color)
+                .draw_rect({0, 1, 1, size.y - 1}, style.highlight_color)
+                // Shadow
+                .draw_rect({size.x - 1, 0, size.x, size.y}, style.shadow_color)
+                .draw_rect({0, size.y - 1, size.x - 1, size.y}, style.shadow_color)
+                // Border
+                .draw_rect_outline({1, 1, size.x - 1, size.y - 1}, style.background_color, t);
+        });
+    }
+
+    // The background only fills inside the edges, so nothing is drawn twice
+    button_up = render_nine_slice(1, 1, 2, 2, true, [&](graphics::Painter &painter, Vector2f size) {
+        painter.draw_rect({1, 1, size.x - 2, size.y - 2}, style.background_color)
+            .draw_rect({0, 0, size.x - 2, 1}, style.highlight_color)
+            .draw_rect({0, 1, 1, size.y - 2}, style.highlight_color)
+            .draw_rect({size.x - 2, 0, size.x, size.y}, style.shadow_color)
+            .draw_rect({0, size.y - 2, size.x - 2, size.y}, style.shadow_color);
+    });
+
+    button_down = render_nine_slice(1, 1, 1, 1, true, [&](graphics::Painter &painter, Vector2f size) {
+        painter.draw_rect_outline({0, 0, size.x, size.y}, style.shadow_color, 1)
+            .draw_rect({1, 1, size.x - 1, size.y - 1}, style.background_color);
+    });
+
+    // Sunken frame, darker when focused
+    for (bool is_focused : { false, true }) {
+        Color border_color = is_focused ? style.shadow_color : style.background_color;
+
+        auto slice = render_nine_slice(2, 2, 1, 1, true, [&](graphics::Painter &painter, Vector2f size) {
+            painter.draw_rect({2, 2, size.x - 1, size.y - 1}, style.input_background_color)
+                .draw_rect({0, 0, size.x - 1, 1}, style.shadow_color)
+                .draw_rect({0, 1, 1, size.y - 1}, style.shadow_color)
+                .draw_rect({size.x - 1, 0, size.x, size.y}, style.highlight_color)
+                .draw_rect({0, size.y - 1, size.x - 1, size.y}, style.highlight_color)
+                .draw_rect({1, 1, size.x - 1, 2}, border_color)
+                .draw_rect({1, 2, 2, size.y - 1}, border_color);
+        });
+
+        (is_focused ? textbox_focused : textbox) = std::move(slice);
+    }
+}
+
+void DefaultUIPainter::update_theme() {
+    if (!m_is_theme_stale) {
+        return;
+    }
+
+    m_is_theme_stale = false;
+
+    // Themes in use by any painter, so windows with the same style render it once
+    static std::vector<std::weak_ptr<Theme>> themes;
+
+    m_theme = nullptr;
+    std::erase_if(themes, [](const auto &theme) { return theme.expired(); });
+
+    for (const auto &weak_theme : themes) {
+        auto theme = weak_theme.lock();
+        if (theme->font == m_font && is_same_style(theme->style, get_style())) {
+            m_theme = std::move(theme);
+            break;
+        }
+    }
+
+    if (!m_theme) {
+        m_theme = std::make_shared<Theme>();
+        m_theme->style = get_style();
+        m_theme->font = m_font;
+        m_theme->render();
+
+        themes.push_back(m_theme);
+    }
+
+    m_titlebar = nullptr;
+}
+
+graphics::Text &DefaultUIPainter::Theme::text(std::unordered_map<std::string, graphics::Text> &texts,
+        const std::string &label, const Color &color) {
+    // Enough for the buttons and titles of a few windows, past that start again
+    static constexpr size_t max_texts = 256;
+
+    auto it = texts.find(label);
+    if (it != texts.end()) {
+        return it->second;
+    }
+
+    if (texts.size() >= max_texts) {
+        texts.clear();
+    }
+
+    std::u32string utf32;
+    if (to_utf32(label, utf32).is_err()) {
+        logger::warn("UI text is not valid UTF-8");
+    }
+
+    auto &text = texts[label];
+    text.set_font(font);
+    text.set_font_size_px(16);
+    text.set_color(color);
+    text.set_text(utf32);
+
+    return text;
+}
+
+void DefaultUIPainter::set_text_utf8(std::string_view text) {
+    if (to_utf32(text, m_utf32_buffer).is_err()) {
+        logger::warn("UI text is not valid UTF-8");
+    }
+
+    m_text.set_text(m_utf32_buffer);
+}
+
+void DefaultUIPainter::style_text(graphics::Text &text) {
+    text.set_font(m_font);
+    text.set_font_size_px(16);
+    text.set_color(get_style().text_color);
+}
+
+void DefaultUIPainter::draw_textbox(bool is_focused) {
+    update_theme();
+
+    auto &painter = get_painter();
+
+    auto size = vector_static_cast<float>(painter.surface_size());
+
+    painter.draw_nine_slice({0, 0, size.x, size.y}, is_focused ? *m_theme->textbox_focused : *m_theme->textbox);
+}
+
+void DefaultUIPainter::draw_textbox_line(graphics::Text &line, const Rectf &bounds,
+        size_t selection_start, size_t selection_end, Optional<size_t> cursor) {
+    auto &painter = get_painter();
+    auto &style = get_style();
+
+    style_text(line);
+    line.set_wrap_width(0);
+
+    painter.draw_rect(bounds, style.input_background_color);
+
+    if (selection_end > selection_start) {
+        float start_x = bounds.x + line.position_of(selection_start).x;
+        float end_x = bounds.x + line.position_of(selection_end).x;
+
+        painter.draw_rect({start_x, bounds.y, std::min(end_x, bounds.z), bounds.w},
+            style.selection_color);
+    }
+
+    painter.draw_text(line, bounds);
+
+    if (cursor.has_some()) {
+        float x = bounds.x + line.position_of(cursor.ensure()).x;
+
+        painter.draw_rect({x, bounds.y, x + 1, bounds.w}, style.text_color);
+    }
+}
+
 }
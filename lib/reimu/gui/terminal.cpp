@@ -11,6 +11,9 @@ extern uint32_t term_256_colors[];
 
 struct TerminalPrivateData {
     term::Grid grid{80, 25};
+
+    // Reused between calls to put_line_utf8
+    std::u32string utf32_buffer;
 };
 
 TerminalWidget::TerminalWidget(std::shared_ptr<graphics::Font> font) : m_font(std::move(font)) {
@@ -32,9 +35,22 @@ void TerminalWidget::put_char(uint32_t c) {
 }
 
 void TerminalWidget::put_line_utf8(std::string_view line) {
-    auto utf32 = to_utf32(line).ensure();
-    for (auto c : utf32) {
-        put_char(c);
+    auto &utf32 = m_data->utf32_buffer;
+    if (!to_utf32(line, utf32).is_err()) {
+        for (auto c : utf32) {
+            put_char(c);
+        }
+
+        return;
+    }
+
+    // Invalid sequences are shown as U+FFFD one byte at a time
+    for (size_t i = 0; i < line.size();) {
+        size_t consumed = 1;
+        auto c = single_utf8_to_utf32(line.data() + i, line.size() - i, consumed);
+
+        put_char(c.has_some() ? c.ensure() : 0xfffd);
+        i += c.has_some() ? consumed : 1;
     }
 }
 
@@ -121,11 +137,13 @@ void TerminalWidget::repaint(UIPainter &painter) {
 
     m_has_requested_repaint = false;
 
-    graphics::Painter gfx_painter{ *m_surface };
+    // Only cells which changed are drawn, split across threads as the grid covers the whole widget
+    graphics::Painter gfx_painter{ *m_surface, m_display_list, graphics::PaintMode::Tiled };
 
     // TODO: WOW this is inefficient and really bad
     auto text_obj = graphics::Text{};
     text_obj.set_font(m_font);
+    text_obj.set_fallback_fonts(m_fallback_fonts);
     text_obj.set_font_size_px(16);
 
     auto draw_cell = [&](uint32_t ch, int row, int col, uint32_t fg_color, uint32_t bg_color) {
@@ -143,7 +161,7 @@ void TerminalWidget::repaint(UIPainter &painter) {
         text_obj.set_text(text);
 
         text_obj.set_color(fg_color);
-        text_obj.render(*m_surface, cell_rect);
+        gfx_painter.draw_text(text_obj, cell_rect);
     };
 
     m_data->grid.paint(draw_cell);
@@ -178,6 +196,10 @@ void TerminalWidget::line_break() {
     m_data->grid.next_row();
 }
 
+void TerminalWidget::set_fallback_fonts(std::vector<std::shared_ptr<graphics::Font>> fonts) {
+    m_fallback_fonts = std::move(fonts);
+}
+
 // Array of the default 256 color palette in form RGBA (0xAABBGGRR)
 uint32_t term_256_colors[] = {
     0xFF000000, 0xFF0000AA, 0xFF00AA00, 0xFF00AAAA, 0xFFAA0000, 0xFFAA00AA, 0xFFAA5500, 0xFFAAAAAA,
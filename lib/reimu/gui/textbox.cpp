@@ -1,25 +1,531 @@
 #include <reimu/gui/widget.h>
 
+#include <reimu/core/unicode.h>
+#include <reimu/gui/window.h>
+
+#include "piece_table.h"
+
+#include <algorithm>
+
 namespace reimu::gui {
 
-TextBox::TextBox() {
-    bind_event_callback("on_key_press", [this]() {
-        
+namespace {
+
+// Space between the frame and the text
+constexpr int text_padding = 3;
+
+// Longest grapheme cluster looked at when moving the cursor
+constexpr size_t max_cluster_bytes = 64;
+
+// Decode one codepoint at 'i', invalid sequences decode to U+FFFD one byte at a time
+size_t decode_step(std::string_view text, size_t i, uint32_t &codepoint) {
+    size_t consumed;
+    auto r = single_utf8_to_utf32(text.data() + i, text.size() - i, consumed);
+    if (!r.has_some()) {
+        codepoint = 0xfffd;
+        return 1;
+    }
+
+    codepoint = r.ensure();
+    return consumed;
+}
+
+std::u32string decode_line(std::string_view text) {
+    std::u32string line;
+    if (!to_utf32(text, line).is_err()) {
+        return line;
+    }
+
+    // Fall back to decoding one codepoint at a time
+    line.clear();
+    line.reserve(text.size());
+
+    for (size_t i = 0; i < text.size();) {
+        uint32_t codepoint;
+        i += decode_step(text, i, codepoint);
+
+        line.push_back(codepoint);
+    }
+
+    return line;
+}
+
+size_t byte_to_codepoint(std::string_view text, size_t offset) {
+    size_t count = 0;
+    for (size_t i = 0; i < offset && i < text.size(); count++) {
+        uint32_t codepoint;
+        i += decode_step(text, i, codepoint);
+    }
+
+    return count;
+}
+
+size_t codepoint_to_byte(std::string_view text, size_t index) {
+    size_t i = 0;
+    while (index-- > 0 && i < text.size()) {
+        uint32_t codepoint;
+        i += decode_step(text, i, codepoint);
+    }
+
+    return i;
+}
+
+}
+
+TextBox::TextBox() : m_buffer(std::make_unique<PieceTable>()) {
+    bind_event_callback("on_key_down"_hashid, [this]() {
+        if (m_window) {
+            handle_key(m_window->get_last_input_event().key);
+        }
+    });
+
+    bind_event_callback("on_mouse_down"_hashid, [this]() {
+        if (m_window) {
+            set_cursor(offset_at_point(m_window->pointer() - bounds.top_left()));
+            m_is_selecting = true;
+        }
+    });
+
+    bind_event_callback("on_mouse_move"_hashid, [this]() {
+        if (m_window && m_is_selecting) {
+            set_cursor(offset_at_point(m_window->pointer() - bounds.top_left()), true);
+        }
+    });
+
+    bind_event_callback("on_mouse_up"_hashid, [this]() {
+        m_is_selecting = false;
+    });
+
+    bind_event_callback("on_mouse_leave"_hashid, [this]() {
+        m_is_selecting = false;
+    });
+
+    bind_event_callback("on_focus_gained"_hashid, [this]() {
+        m_is_focused = true;
+        m_needs_full_repaint = true;
+
+        dispatch_event("ui_repaint"_hashid);
+    });
+
+    bind_event_callback("on_focus_lost"_hashid, [this]() {
+        m_is_focused = false;
+        m_needs_full_repaint = true;
+
+        dispatch_event("ui_repaint"_hashid);
     });
 }
 
+TextBox::~TextBox() {}
+
 void TextBox::repaint(UIPainter &painter) {
-    
+    auto old_size = m_surface->size();
+
+    Widget::repaint(painter);
+
+    if (m_surface->size() != old_size) {
+        m_needs_full_repaint = true;
+    }
+
+    // Work out how many lines fit using the style's font
+    painter.style_text(m_line_text);
+    m_line_text.set_text(U"");
+    m_line_height = std::max((int)m_line_text.text_geometry().y, 1);
+
+    size_t visible_lines = std::max((int)(bounds.height() - text_padding * 2) / m_line_height, 1);
+    if (visible_lines != m_visible_lines) {
+        m_visible_lines = visible_lines;
+        m_needs_full_repaint = true;
+
+        scroll_to_cursor();
+    }
+
+    size_t first_line = m_scroll_line;
+    size_t last_line = m_scroll_line + m_visible_lines;
+
+    graphics::Painter p{ *m_surface };
+    painter.begin(p);
+
+    if (m_needs_full_repaint) {
+        painter.draw_textbox(m_is_focused);
+    } else {
+        first_line = std::max(first_line, m_damage_first);
+        last_line = std::min(last_line, m_damage_last + 1);
+    }
+
+    size_t line_count = m_buffer->line_count();
+    size_t selection_start = std::min(m_cursor, m_anchor);
+    size_t selection_end = std::max(m_cursor, m_anchor);
+    size_t cursor_line = m_buffer->line_at(m_cursor);
+
+    float width = bounds.width();
+
+    for (size_t line = first_line; line < last_line; line++) {
+        float y = text_padding + (line - m_scroll_line) * m_line_height;
+        Rectf line_rect = { text_padding, y, width - text_padding, y + m_line_height };
+
+        // Lines past the end are still drawn to clear them
+        if (line >= line_count) {
+            m_line_text.set_text(U"");
+            painter.draw_textbox_line(m_line_text, line_rect, 0, 0, OPT_NONE);
+            continue;
+        }
+
+        size_t start = m_buffer->line_start(line);
+        size_t end = m_buffer->line_end(line);
+
+        std::string text = m_buffer->text(start, end - start);
+        m_line_text.set_text(decode_line(text));
+
+        // Selections spanning the newline select to the end of the line
+        size_t line_selection_start = 0;
+        size_t line_selection_end = 0;
+        if (selection_start < selection_end && selection_start <= end && selection_end > start) {
+            line_selection_start = byte_to_codepoint(text, std::max(selection_start, start) - start);
+            line_selection_end = selection_end > end ? m_line_text.length() + 1
+                : byte_to_codepoint(text, selection_end - start);
+        }
+
+        Optional<size_t> cursor = OPT_NONE;
+        if (m_is_focused && line == cursor_line) {
+            cursor = OPT_SOME(byte_to_codepoint(text, m_cursor - start));
+        }
+
+        painter.draw_textbox_line(m_line_text, line_rect, line_selection_start, line_selection_end,
+            std::move(cursor));
+    }
+
+    painter.end();
+
+    m_needs_full_repaint = false;
+    m_damage_first = SIZE_MAX;
+    m_damage_last = 0;
 }
 
 void TextBox::set_text(std::string text) {
-    m_text = std::move(text);
+    m_buffer = std::make_unique<PieceTable>(std::move(text));
+
+    m_cursor = m_anchor = 0;
+    m_scroll_line = 0;
+    m_preferred_x = -1;
+    m_needs_full_repaint = true;
 
     dispatch_event("on_text_input"_hashid);
+    dispatch_event("ui_repaint"_hashid);
+}
+
+std::string TextBox::get_text() const {
+    return m_buffer->text();
 }
 
-std::string_view TextBox::get_text() const {
-    return std::string_view{ m_text };
+void TextBox::insert(std::string_view text) {
+    if (m_cursor != m_anchor) {
+        size_t start = std::min(m_cursor, m_anchor);
+        erase(start, std::max(m_cursor, m_anchor) - start);
+    }
+
+    size_t line = m_buffer->line_at(m_cursor);
+
+    m_buffer->insert(m_cursor, text);
+
+    // New lines move everything below
+    if (text.find('\n') != std::string_view::npos) {
+        damage_from(line);
+    } else {
+        damage_lines(line, line);
+    }
+
+    m_cursor = m_anchor = m_cursor + text.size();
+    m_preferred_x = -1;
+
+    scroll_to_cursor();
+
+    dispatch_event("on_text_input"_hashid);
+    dispatch_event("ui_repaint"_hashid);
+}
+
+void TextBox::erase(size_t pos, size_t len) {
+    if (len == 0) {
+        return;
+    }
+
+    size_t first_line = m_buffer->line_at(pos);
+    size_t last_line = m_buffer->line_at(pos + len);
+
+    m_buffer->erase(pos, len);
+
+    if (first_line != last_line) {
+        damage_from(first_line);
+    } else {
+        damage_lines(first_line, first_line);
+    }
+
+    m_cursor = m_anchor = pos;
+    m_preferred_x = -1;
+
+    scroll_to_cursor();
+
+    dispatch_event("on_text_input"_hashid);
+    dispatch_event("ui_repaint"_hashid);
+}
+
+void TextBox::set_cursor(size_t pos, bool extend_selection) {
+    pos = std::min(pos, m_buffer->size());
+
+    size_t old_start = std::min(m_cursor, m_anchor);
+    size_t old_end = std::max(m_cursor, m_anchor);
+
+    m_cursor = pos;
+    if (!extend_selection) {
+        m_anchor = pos;
+    }
+
+    // Redraw the lines covered by either the old or new cursor and selection
+    size_t first = std::min({ old_start, m_cursor, m_anchor });
+    size_t last = std::max({ old_end, m_cursor, m_anchor });
+    damage_lines(m_buffer->line_at(first), m_buffer->line_at(last));
+
+    scroll_to_cursor();
+
+    dispatch_event("ui_repaint"_hashid);
+}
+
+void TextBox::select_all() {
+    m_anchor = 0;
+    set_cursor(m_buffer->size(), true);
+}
+
+std::string TextBox::get_selected_text() const {
+    size_t start = std::min(m_cursor, m_anchor);
+
+    return m_buffer->text(start, std::max(m_cursor, m_anchor) - start);
+}
+
+void TextBox::handle_key(const video::KeyboardEvent &key) {
+    bool shift = key.is_shift;
+    bool has_selection = m_cursor != m_anchor;
+
+    switch (key.key) {
+    case video::Key::Left:
+        m_preferred_x = -1;
+
+        // Collapse the selection to its start
+        if (has_selection && !shift) {
+            set_cursor(std::min(m_cursor, m_anchor));
+        } else {
+            set_cursor(prev_grapheme(m_cursor), shift);
+        }
+        break;
+    case video::Key::Right:
+        m_preferred_x = -1;
+
+        if (has_selection && !shift) {
+            set_cursor(std::max(m_cursor, m_anchor));
+        } else {
+            set_cursor(next_grapheme(m_cursor), shift);
+        }
+        break;
+    case video::Key::Up:
+        move_vertical(-1, shift);
+        break;
+    case video::Key::Down:
+        move_vertical(1, shift);
+        break;
+    case video::Key::PageUp:
+        move_vertical(-(int)m_visible_lines, shift);
+        break;
+    case video::Key::PageDown:
+        move_vertical(m_visible_lines, shift);
+        break;
+    case video::Key::Home:
+        m_preferred_x = -1;
+        set_cursor(m_buffer->line_start(m_buffer->line_at(m_cursor)), shift);
+        break;
+    case video::Key::End:
+        m_preferred_x = -1;
+        set_cursor(m_buffer->line_end(m_buffer->line_at(m_cursor)), shift);
+        break;
+    case video::Key::Backspace:
+        if (has_selection) {
+            insert("");
+        } else {
+            size_t start = prev_grapheme(m_cursor);
+            erase(start, m_cursor - start);
+        }
+        break;
+    case video::Key::Delete:
+        if (has_selection) {
+            insert("");
+        } else {
+            erase(m_cursor, next_grapheme(m_cursor) - m_cursor);
+        }
+        break;
+    case video::Key::Return:
+        insert("\n");
+        break;
+    case video::Key::Tab:
+        insert("\t");
+        break;
+    case 'a':
+    case 'A':
+        if (key.is_ctrl) {
+            select_all();
+            break;
+        }
+        [[fallthrough]];
+    default:
+        // Skip C0 and C1 control characters, which keys like Escape type
+        if (!key.is_ctrl && key.codepoint >= 0x20 && (key.codepoint < 0x7f || key.codepoint >= 0xa0)) {
+            char utf8[4];
+            size_t len = utf32_to_utf8(key.codepoint, utf8);
+
+            insert({ utf8, len });
+        }
+        break;
+    }
+}
+
+void TextBox::move_vertical(int lines, bool extend_selection) {
+    size_t line = m_buffer->line_at(m_cursor);
+    size_t start = m_buffer->line_start(line);
+
+    size_t target;
+    if (lines < 0) {
+        target = line >= (size_t)-lines ? line + lines : 0;
+    } else {
+        target = std::min(line + lines, m_buffer->line_count() - 1);
+    }
+
+    if (target == line) {
+        return;
+    }
+
+    // Keep the same horizontal position over repeated moves
+    if (m_preferred_x < 0) {
+        std::string text = m_buffer->text(start, m_cursor - start);
+        m_line_text.set_text(decode_line(text));
+        m_preferred_x = m_line_text.position_of(m_line_text.length()).x;
+    }
+
+    size_t target_start = m_buffer->line_start(target);
+    std::string text = m_buffer->text(target_start, m_buffer->line_end(target) - target_start);
+
+    m_line_text.set_text(decode_line(text));
+    size_t index = m_line_text.offset_at({ m_preferred_x, 0 });
+
+    float preferred_x = m_preferred_x;
+    set_cursor(target_start + codepoint_to_byte(text, index), extend_selection);
+    m_preferred_x = preferred_x;
+}
+
+size_t TextBox::next_grapheme(size_t pos) const {
+    if (pos >= m_buffer->size()) {
+        return m_buffer->size();
+    }
+
+    std::string text = m_buffer->text(pos, max_cluster_bytes);
+
+    uint32_t codepoint;
+    size_t i = decode_step(text, 0, codepoint);
+
+    if (codepoint == '\r' && i < text.size() && text[i] == '\n') {
+        return pos + i + 1;
+    }
+
+    // Take any extending codepoints, and whatever follows a ZWJ
+    bool after_zwj = codepoint == 0x200d;
+    while (i < text.size()) {
+        size_t consumed = decode_step(text, i, codepoint);
+        if (!after_zwj && !is_grapheme_extend(codepoint)) {
+            break;
+        }
+
+        after_zwj = codepoint == 0x200d;
+        i += consumed;
+    }
+
+    return pos + i;
+}
+
+size_t TextBox::prev_grapheme(size_t pos) const {
+    if (pos == 0) {
+        return 0;
+    }
+
+    size_t start = pos > max_cluster_bytes ? pos - max_cluster_bytes : 0;
+    std::string text = m_buffer->text(start, pos - start);
+
+    // Step back to the start of the previous codepoint
+    auto step_back = [&text](size_t &i) {
+        do {
+            i--;
+        } while (i > 0 && ((uint8_t)text[i] & 0xc0) == 0x80);
+
+        uint32_t codepoint;
+        decode_step(text, i, codepoint);
+
+        return codepoint;
+    };
+
+    size_t i = text.size();
+    uint32_t codepoint = step_back(i);
+
+    if (codepoint == '\n' && i > 0 && text[i - 1] == '\r') {
+        return start + i - 1;
+    }
+
+    // Extending codepoints belong to what is before them, as does anything after a ZWJ
+    while (i > 0) {
+        size_t prev_i = i;
+        uint32_t prev = step_back(prev_i);
+
+        if (!is_grapheme_extend(codepoint) && prev != 0x200d) {
+            break;
+        }
+
+        i = prev_i;
+        codepoint = prev;
+    }
+
+    return start + i;
+}
+
+size_t TextBox::offset_at_point(const Vector2f &point) {
+    int row = std::max((int)(point.y - text_padding), 0) / m_line_height;
+    size_t line = std::min(m_scroll_line + row, m_buffer->line_count() - 1);
+
+    size_t start = m_buffer->line_start(line);
+    std::string text = m_buffer->text(start, m_buffer->line_end(line) - start);
+
+    m_line_text.set_text(decode_line(text));
+    size_t index = m_line_text.offset_at({ point.x - text_padding, 0 });
+
+    return start + codepoint_to_byte(text, index);
+}
+
+void TextBox::damage_lines(size_t first, size_t last) {
+    m_damage_first = std::min(m_damage_first, first);
+    m_damage_last = std::max(m_damage_last, last);
+}
+
+void TextBox::damage_from(size_t line) {
+    damage_lines(line, SIZE_MAX - 1);
+}
+
+void TextBox::scroll_to_cursor() {
+    size_t line = m_buffer->line_at(m_cursor);
+
+    size_t scroll_line = m_scroll_line;
+    if (line < m_scroll_line) {
+        scroll_line = line;
+    } else if (line >= m_scroll_line + m_visible_lines) {
+        scroll_line = line - m_visible_lines + 1;
+    }
+
+    // Scrolling moves every line
+    if (scroll_line != m_scroll_line) {
+        m_scroll_line = scroll_line;
+        m_needs_full_repaint = true;
+    }
 }
 
 }
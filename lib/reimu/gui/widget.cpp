@@ -8,8 +8,17 @@ namespace reimu::gui {
 
 Widget::Widget() {
     bind_event_callback("ui_repaint"_hashid, [this]() {
+        m_needs_repaint = true;
+
         if (m_parent) {
-            m_parent->dispatch_event("ui_repaint"_hashid);
+            m_parent->dispatch_event("ui_child_repaint"_hashid);
+        }
+    });
+
+    // Let the root know something needs painting, without repainting the parents
+    bind_event_callback("ui_child_repaint"_hashid, [this]() {
+        if (m_parent) {
+            m_parent->dispatch_event("ui_child_repaint"_hashid);
         }
     });
 }
@@ -42,28 +51,49 @@ void Widget::update_layout() {
 
 }
 
+void Widget::paint(UIPainter &painter) {
+    if (!m_needs_repaint && !(m_surface && m_surface->size() != wanted_surface_size())) {
+        return;
+    }
+
+    m_needs_repaint = false;
+    repaint(painter);
+}
+
 void Widget::repaint(UIPainter &painter) {
     // Default is to draw nothing, but resize the texture if needed
     if (m_surface) {
-        auto wanted_size = vector_static_cast<int>(bounds.size());
+        auto wanted_size = wanted_surface_size();
 
         if (m_surface->size() != wanted_size) {
-            if (wanted_size.x <= 0 || wanted_size.y <= 0) {
-                wanted_size = { 1, 1 };
-            }
-
             m_surface->resize(wanted_size);
+
+            // Nothing painted before the resize is kept
+            m_display_list.clear();
         }
     }
 }
 
+void Widget::invalidate_paint() {
+    m_needs_repaint = true;
+}
+
+Vector2i Widget::wanted_surface_size() const {
+    auto size = vector_static_cast<int>(bounds.size());
+    if (size.x <= 0 || size.y <= 0) {
+        return { 1, 1 };
+    }
+
+    return size;
+}
+
 void Widget::add_clips(AddClipFn add_clip) {
     // If there is a texture, add a clip
     if (m_surface) {
         auto tex_size = m_surface->size();
         Recti source_rect = { 0, 0, tex_size.x, tex_size.y };
 
-        add_clip(source_rect, vector_static_cast<int>(bounds.top_left()), &m_surface->texture());
+        add_clip(source_rect, vector_static_cast<int>(bounds.top_left()), m_surface.get());
     }
 }
 
@@ -73,14 +103,9 @@ void Widget::signal_layout_changed() {
     }
 }
 
-void Widget::create_texture_if_needed(CreateTextureFn fn) {
+void Widget::create_surface_if_needed(CreateSurfaceFn fn) {
     if (!m_surface) {
-        auto tex_size = vector_static_cast<int>(bounds.size());
-        if (tex_size.x <= 0 || tex_size.y <= 0) {
-            tex_size = { 1, 1 };
-        }
-
-        m_surface = std::make_unique<graphics::Surface>(fn(tex_size));
+        m_surface = fn(wanted_surface_size());
     }
 }
 
@@ -100,27 +125,39 @@ Widget *Box::get_widget_at(const Vector2f &pos) {
     return this;
 }
 
+void Box::paint(UIPainter &painter) {
+    Widget::paint(painter);
+
+    // Children have their own surfaces, so only the ones which changed are painted
+    for (Widget *child : m_children) {
+        child->paint(painter);
+    }
+}
+
 void Box::repaint(UIPainter &painter) {
     Widget::repaint(painter);
 
-    graphics::Painter p(*m_surface);
+    graphics::Painter p(*m_surface, m_display_list);
     painter.begin(p);
     painter.draw_background();
     painter.end();
+}
+
+void Box::invalidate_paint() {
+    Widget::invalidate_paint();
 
-    // Draw the children
     for (Widget *child : m_children) {
-        child->repaint(painter);
+        child->invalidate_paint();
     }
 }
 
-void Box::create_texture_if_needed(CreateTextureFn fn) {
-    m_create_texture_fn = fn;
+void Box::create_surface_if_needed(CreateSurfaceFn fn) {
+    m_create_surface_fn = fn;
 
-    Widget::create_texture_if_needed(fn);
+    Widget::create_surface_if_needed(fn);
 
     for (Widget *child : m_children) {
-        child->create_texture_if_needed(fn);
+        child->create_surface_if_needed(fn);
     }
 }
 
@@ -131,8 +168,8 @@ void Box::add_child(Widget *child) {
 
     child->set_parent(this);
 
-    if (m_create_texture_fn) {
-        child->create_texture_if_needed(m_create_texture_fn);
+    if (m_create_surface_fn) {
+        child->create_surface_if_needed(m_create_surface_fn);
     }
 }
 
@@ -1,12 +1,32 @@
 #include <reimu/gui/window.h>
 
+#include <reimu/os/fs.h>
 #include <reimu/video/driver.h>
 #include <reimu/video/video.h>
 
+#include <assert.h>
+
 #include "compositor.h"
 
 namespace reimu::gui {
 
+static std::shared_ptr<ResourceManager> shared_resource_manager() {
+    static std::weak_ptr<ResourceManager> shared;
+
+    auto res_mgr = shared.lock();
+    if (!res_mgr) {
+        res_mgr = std::make_shared<ResourceManager>();
+        shared = res_mgr;
+
+        // Images are decoded once, then mapped from the cache
+        if (auto cache_path = os::cache_path(); !cache_path.is_err()) {
+            res_mgr->set_cache_dir(cache_path.ensure() + "/images");
+        }
+    }
+
+    return res_mgr;
+}
+
 Result<Window *, ReimuError> Window::create(const Vector2i &size) {
     auto window = TRY(video::Window::create(size));
     auto renderer = TRY(graphics::create_attach_renderer(window));
@@ -20,10 +40,20 @@ Window::~Window() {
 
 Window::Window(video::Window *window, graphics::Renderer *renderer)
         : m_raw_window(window), m_renderer(renderer) {
-    // Set up callback so Widgets can create textures
-    m_create_texture_fn = [this](const Vector2i &size) -> graphics::Texture * {
-        return m_renderer->create_texture(size, m_renderer->display_surface_color_format())
-            .ensure();
+    m_texture_atlas = std::make_unique<graphics::TextureAtlas>(
+        [this](const Vector2i &size, graphics::ColorFormat format) -> graphics::Texture * {
+            return m_renderer->create_texture(size, format).ensure();
+        });
+
+    m_surface_pool = std::make_unique<graphics::SurfacePool>(
+        [this](const Vector2i &size, graphics::ColorFormat format) -> graphics::Texture * {
+            return m_texture_atlas->create_texture(size, format);
+        });
+
+    // Set up callback so Widgets can create surfaces, sharing storage through the pool
+    m_create_surface_fn = [this](const Vector2i &size) {
+        return std::make_unique<graphics::Surface>(*m_surface_pool, size,
+            m_renderer->display_surface_color_format());
     };
 
     m_raw_window->bind_event_callback("wm_close"_hashid, [this]() {
@@ -32,35 +62,68 @@ Window::Window(video::Window *window, graphics::Renderer *renderer)
 
     m_raw_window->bind_event_callback("wm_input"_hashid, [this]() {
         process_input();
-        render();
+        request_render();
+    });
+
+    m_raw_window->bind_event_callback("wm_resize"_hashid, [this]() {
+        m_needs_present = true;
+        request_render();
+    });
+
+    // Sent at most once per display refresh
+    m_raw_window->bind_event_callback("wm_frame"_hashid, [this]() {
+        if (has_damage()) {
+            render();
+        }
     });
 
     m_compositor = std::make_unique<Compositor>(renderer);
 
     m_root = std::make_unique<RootContainer>(this,
         vector_static_cast<float>(renderer->get_viewport_size()));
-    m_root->create_texture_if_needed(m_create_texture_fn);
+    m_root->create_surface_if_needed(m_create_surface_fn);
 
-    m_res_mgr = std::make_shared<ResourceManager>();
+    m_res_mgr = shared_resource_manager();
+    m_ui_painter = std::make_unique<DefaultUIPainter>(*m_res_mgr);
 }
 
 void Window::render() {
-    DefaultUIPainter painter{*m_res_mgr};
+    auto &painter = *m_ui_painter;
 
     if (m_root->needs_layout_update()) {
         m_root->update_layout(vector_static_cast<float>(m_renderer->get_viewport_size()));
         
-        m_root->repaint(painter);
+        // Widgets whose size changed are repainted too
+        m_root->paint(painter);
 
         m_compositor->clear_clips();
         m_root->add_clips(m_compositor->get_add_clip_fn());
     } else if(m_root->needs_repaint()) {
-        m_root->repaint(painter);
+        m_root->paint(painter);
     }
 
+    m_needs_present = false;
     m_raw_window->render();
 }
 
+void Window::request_render() {
+    m_raw_window->request_frame();
+}
+
+bool Window::has_damage() const {
+    return m_needs_present || m_root->needs_layout_update() || m_root->needs_repaint();
+}
+
+void Window::set_ui_painter(std::unique_ptr<UIPainter> painter) {
+    // Every render paints through it
+    assert(painter);
+
+    m_ui_painter = std::move(painter);
+
+    m_root->invalidate_paint();
+    m_root->dispatch_event("ui_repaint"_hashid);
+}
+
 void Window::set_size(const Vector2i &size) {
     m_raw_window->set_size(size);
 }
@@ -67,6 +67,7 @@ struct ReimuError {
         AccessError = 0x3,
         WindowCreationFailed = 0x1000,
         FailedToLoadFont = 0x1001,
+        FailedToLoadImage = 0x1002,
         NoSuitableRenderer = 0x2000,
         RendererError = 0x2001,
         RendererUnsupportedWindowBackend = 0x2002,
@@ -2,6 +2,7 @@
 
 #include <reimu/core/result.h>
 
+#include <string>
 #include <vector>
 
 namespace reimu {
@@ -13,6 +14,8 @@ enum class FileMode {
 
 class File {
 public:
+    virtual ~File() = default;
+
     virtual Result<std::vector<uint8_t>, ReimuError> read(size_t up_to) = 0;
     virtual Result<size_t, ReimuError> write(const void *buffer, size_t size) = 0;
 
@@ -21,6 +24,12 @@ public:
 
     virtual size_t offset() = 0;
     virtual size_t file_size() = 0;
+
+    // Path the file was opened with
+    virtual const std::string &path() const = 0;
+
+    // Last modification time in nanoseconds since the epoch, or 0 if unknown
+    virtual uint64_t modified_time() = 0;
 };
 
 }
@@ -37,5 +37,15 @@ consteval inline uint64_t string_hash<uint64_t>(const char *str, size_t len) {
 
 static_assert(string_hash<uint64_t>("hello", 5) == 0xa430d84680aabd0b);
 
+// Runtime FNV-1a over arbitrary data, 'hash' can be used to continue a previous hash
+inline uint64_t data_hash(const void *data, size_t len, uint64_t hash = detail::fnv_offset_64) {
+    auto *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * detail::fnv_prime_64;
+    }
+
+    return hash;
+}
+
 }
 
@@ -3,6 +3,7 @@
 #include <reimu/core/string_id.h>
 #include <reimu/core/resource.h>
 
+#include <string>
 #include <unordered_map>
 
 namespace reimu {
@@ -13,7 +14,15 @@ public:
     Result<std::shared_ptr<T>, ReimuError> load_from_file(const std::string &filepath, StringID id) {
         auto file = TRY(open_resource_file(filepath));
 
-        auto resource = std::shared_ptr<Resource>{ TRY(T::create(*file)) };
+        // Resources which can cache decoded data are given the cache directory
+        T *created;
+        if constexpr (requires { T::create(*file, m_cache_dir); }) {
+            created = TRY(T::create(*file, m_cache_dir));
+        } else {
+            created = TRY(T::create(*file));
+        }
+
+        auto resource = std::shared_ptr<Resource>{ created };
         m_resources[id] = resource;
 
         return OK(static_pointer_cast<T>(resource));
@@ -21,10 +30,20 @@ public:
 
     Optional<std::shared_ptr<Resource>> get(StringID id);
 
+    /**
+     * @brief Set where resources may cache decoded data, so later loads skip decoding
+     */
+    void set_cache_dir(std::string cache_dir) {
+        m_cache_dir = std::move(cache_dir);
+    }
+
 private:
     Result<std::unique_ptr<File>, ReimuError> open_resource_file(const std::string &filepath);
 
     std::unordered_map<StringID, std::shared_ptr<Resource>, StringIDHash> m_resources{};
+
+    // Empty when resources shouldn't be cached
+    std::string m_cache_dir;
 };
 
 }
@@ -6,13 +6,35 @@
 
 #include <stddef.h>
 
+#include <string>
 #include <string_view>
 
 namespace reimu {
 
 DEF_SIMPLE_ERROR(InvalidUTF8Sequence, "Invalid UTF-8 sequence");
 
+// Number of codepoints 'utf8' decodes to when it is valid.
+// Counts bytes which are not continuation bytes, so this is an upper bound for invalid input
+size_t utf32_length(std::string_view utf8);
+
+// Decodes 'utf8' into 'utf32', which must have space for utf32_length(utf8) codepoints.
+// Overlong encodings, surrogates and codepoints above U+10FFFF are rejected.
+// Returns the number of codepoints written
+Result<size_t, InvalidUTF8Sequence> to_utf32(std::string_view utf8, char32_t *utf32);
+
+// Decodes 'utf8' into 'utf32', reusing its storage
+Result<void, InvalidUTF8Sequence> to_utf32(std::string_view utf8, std::u32string &utf32);
+
 Result<std::u32string, InvalidUTF8Sequence> to_utf32(std::string_view utf8);
 Optional<uint32_t> single_utf8_to_utf32(const char *utf8, size_t n, size_t &consumed);
 
+// Encodes 'codepoint' into 'utf8', which must have space for 4 bytes.
+// Returns the number of bytes written
+size_t utf32_to_utf8(uint32_t codepoint, char *utf8);
+
+// Whether 'codepoint' extends the previous grapheme cluster.
+// Covers combining marks, variation selectors, emoji modifiers and ZWJ
+// rather than the full set of Unicode grapheme break rules
+bool is_grapheme_extend(uint32_t codepoint);
+
 }
@@ -28,6 +28,25 @@ union ColorRGBA8 final {
 		return { r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f };
 	}
 
+	/**
+	 * @brief Get the color with each channel multiplied by the alpha
+	 */
+	inline constexpr ColorRGBA8 premultiplied() const {
+		auto mul = [](uint32_t c, uint32_t a) -> uint8_t {
+			uint32_t x = c * a + 128;
+			return (x + (x >> 8)) >> 8;
+		};
+
+		return { mul(r, a), mul(g, a), mul(b, a), a };
+	}
+
+	/**
+	 * @brief Blend 'other' over this color by the alpha of 'other'
+	 *
+	 * Works on straight alpha and the alpha channel is blended like the others,
+	 * so this is only right for opaque colors. Painters composite
+	 * premultiplied surfaces with Porter-Duff operators instead.
+	 */
 	inline constexpr ColorRGBA8 operator*(const ColorRGBA8 &other) const {
 		// Upcast to uint16_t
 		uint16_t alpha = other.a;
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <reimu/graphics/color.h>
+#include <reimu/graphics/rect.h>
+#include <reimu/graphics/texture.h>
+#include <reimu/graphics/vector.h>
+
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace reimu::graphics {
+
+struct Glyph;
+class Image;
+class Surface;
+
+/**
+ * @brief Porter-Duff operators for compositing a color onto a Surface
+ */
+enum class BlendMode {
+    // Color over the surface by its alpha
+    SourceOver,
+    // Replace the surface with the color
+    Source,
+    // Multiply the surface by the color
+    Multiply,
+    // Make the surface transparent
+    Clear,
+};
+
+struct PositionedGlyph {
+    const Glyph *glyph;
+
+    // Top left of the glyph bitmap
+    Vector2i pos;
+};
+
+/**
+ * @brief Recorded draw commands for a Surface
+ *
+ * Commands can be drawn in order on the calling thread, or binned into
+ * tiles which are drawn in parallel. Every pixel only depends on the commands
+ * covering it, so both give identical results.
+ *
+ * Rects must already be clipped to the Surface they are drawn to,
+ * and glyphs must stay alive until the list is drawn. Colors are recorded
+ * with straight alpha, and premultiplied when drawn to a premultiplied Surface.
+ *
+ * A list can be kept after drawing and compared with the next one recorded
+ * for the same Surface, so only the regions which changed are drawn again.
+ */
+class DisplayList {
+public:
+    void fill_rect(const Recti &rect, const Color &color);
+    void blend_rect(const Recti &rect, const Color &color, BlendMode mode = BlendMode::SourceOver);
+
+    /**
+     * @brief Fill 'rect' with a gradient from 'c1' at 'p1' to 'c2' at 'p2'
+     */
+    void gradient_rect(const Recti &rect, const Color &c1, const Color &c2,
+        const Vector2f &p1, const Vector2f &p2);
+
+    /**
+     * @brief Draw glyph coverage bitmaps in 'color', clipped to 'clip'
+     */
+    void draw_glyphs(std::span<const PositionedGlyph> glyphs, const Color &color, const Recti &clip);
+
+    /**
+     * @brief Draw a line from 'begin' to 'end', clipped to 'clip'
+     *
+     * Lines up to one pixel wide are aliased, with the pixels picked by Bresenham's algorithm.
+     * Wider lines are antialiased with round caps.
+     *
+     * @param include_end Whether to draw the last pixel of thin lines, left out so
+     * joined lines don't draw their joints twice
+     */
+    void draw_line(const Vector2f &begin, const Vector2f &end, const Color &color, float width,
+        const Recti &clip, bool include_end = true);
+
+    /**
+     * @brief Fill 'rect' by repeating 'source' of 'image', clipped to 'clip'
+     *
+     * Pixels are copied rather than blended, converting to the alpha mode of the Surface
+     * drawn to. The list keeps 'image' alive, which must not be changed while it is used.
+     */
+    void copy_image(const Recti &rect, std::shared_ptr<const Surface> image, const Recti &source,
+        const Recti &clip);
+    void copy_image(const Recti &rect, std::shared_ptr<const Image> image, const Recti &source,
+        const Recti &clip);
+
+    void clear();
+
+    inline bool is_empty() const {
+        return m_commands.empty();
+    }
+
+    /**
+     * @brief Get a rect which is fully opaque once the commands are drawn
+     *
+     * The rect is conservative, and empty when the list covers nothing opaquely.
+     * Anything under it is hidden, so a compositor can skip drawing it.
+     *
+     * @param alpha_mode Alpha mode of the Surface drawn to, as blending onto straight
+     * alpha pixels can make them translucent
+     * @param opaque Rect which was opaque before drawing
+     */
+    Recti opaque_rect(AlphaMode alpha_mode, const Recti &opaque = {}) const;
+
+    /**
+     * @brief Draw the commands in order and add them to the surface damage
+     */
+    void rasterize(Surface &surface) const;
+
+    /**
+     * @brief Draw the commands split into tiles across threads
+     *
+     * @param thread_count Most threads to use, 0 for one per core
+     */
+    void rasterize_tiled(Surface &surface, unsigned thread_count = 0);
+
+    /**
+     * @brief Draw only the parts of the commands within 'clip_rects'
+     *
+     * Commands outside every clip rect are skipped. The clip rects must not overlap,
+     * and are added to the surface damage.
+     */
+    void rasterize(Surface &surface, std::span<const Recti> clip_rects) const;
+    void rasterize_tiled(Surface &surface, std::span<const Recti> clip_rects, unsigned thread_count = 0);
+
+    /**
+     * @brief Find where drawing this list gives different pixels to drawing 'previous'
+     *
+     * Commands are compared in order, and the rects of any which differ are added
+     * to 'damage'. The rects added do not overlap.
+     */
+    void diff(const DisplayList &previous, std::vector<Recti> &damage) const;
+
+private:
+    enum class CommandType {
+        Fill,
+        Blend,
+        Gradient,
+        Glyphs,
+        Line,
+        Image,
+    };
+
+    struct Command {
+        CommandType type;
+
+        // Area covered by the command
+        Recti rect;
+
+        Color color;
+        Color color2 = {};
+
+        BlendMode blend_mode = BlendMode::SourceOver;
+
+        // Gradient factor is (x - origin.x) * dx + (y - origin.y) * dy
+        Vector2f origin = {};
+        float dx = 0;
+        float dy = 0;
+
+        uint32_t first_glyph = 0;
+        uint32_t glyph_count = 0;
+
+        // Lines run from origin to end
+        Vector2f end = {};
+        float width = 0;
+        bool include_end = true;
+
+        // Images repeat 'source' from 'image_origin'
+        uint32_t image = 0;
+        Recti source = {};
+        Vector2i image_origin = {};
+    };
+
+    bool same_command(const Command &command, const DisplayList &other, const Command &other_command) const;
+
+    void draw_tiles(Surface &surface, std::span<const Recti> clip_rects, unsigned thread_count);
+    void draw_command(uint8_t *buffer, size_t stride, AlphaMode alpha_mode, const Command &command,
+        const Recti &clip) const;
+    static void blend_span(uint32_t *dest, size_t count, const Color &color, BlendMode mode,
+        bool is_premultiplied);
+    // Pixels of a Surface or Image, kept alive by 'owner'
+    struct ImageRef {
+        std::shared_ptr<const void> owner;
+        const uint8_t *pixels;
+        size_t stride;
+        AlphaMode alpha_mode;
+    };
+
+    void add_image(const Recti &rect, ImageRef image, const Recti &source, const Recti &clip);
+
+    // Copy 'count' pixels repeating 'src', starting 'offset' pixels into it
+    static void copy_tiled(uint32_t *dest, size_t count, const uint32_t *src, size_t src_count, size_t offset);
+    static void draw_thin_line(uint8_t *buffer, size_t stride, const Command &command, const Color &color,
+        bool is_premultiplied, const Recti &clip);
+    static void draw_wide_line(uint8_t *buffer, size_t stride, const Command &command, const Color &color,
+        bool is_premultiplied, const Recti &clip);
+
+    std::vector<Command> m_commands;
+    std::vector<PositionedGlyph> m_glyphs;
+    std::vector<ImageRef> m_images;
+
+    // Commands touching each tile, kept to reuse the storage
+    std::vector<std::vector<uint32_t>> m_tile_commands;
+};
+
+}
@@ -5,6 +5,7 @@
 #include <reimu/core/resource.h>
 #include <memory>
 #include <mutex>
+#include <string>
 
 namespace reimu::graphics {
 
@@ -12,6 +13,33 @@ namespace detail {
     struct FontData;
 }
 
+/**
+ * @brief A rasterized glyph, owned by the glyph cache of a Font
+ */
+struct Glyph {
+    // Glyph index within the font face, used for kerning
+    uint32_t index;
+
+    // 8-bit coverage, one byte per pixel
+    const uint8_t *bitmap;
+    int width;
+    int rows;
+
+    // Offset of the bitmap from the pen position and baseline
+    int left;
+    int top;
+
+    // Horizontal advance in pixels
+    int advance;
+};
+
+struct FontMetrics {
+    int ascender;
+    int line_height;
+
+    bool has_kerning;
+};
+
 class Font : public Resource
 {
 public:
@@ -20,15 +48,57 @@ public:
     static Result<Font *, ReimuError> create(File &file);
 
     StringID obj_type_id() const override;
-    
+
     static consteval StringID type_id() {
         return "font"_hashid;
     }
 
     void *get_handle();
 
+    /**
+     * @brief Check whether the font has a glyph for a codepoint
+     *
+     * Looks up a coverage table built when the font is loaded,
+     * so does not need to touch FreeType.
+     */
+    bool has_codepoint(uint32_t codepoint) const;
+
+    /**
+     * @brief Get the rasterized glyph for a codepoint
+     *
+     * Glyphs are rasterized once per pixel size and render mode, then cached
+     * for the lifetime of the Font. The returned pointer stays valid for as long
+     * as the Font does. Glyphs which fail to rasterize are returned empty.
+     */
+    const Glyph *get_glyph(uint32_t codepoint, int pixel_size, bool smoothing);
+
+    FontMetrics get_metrics(int pixel_size);
+
+    /**
+     * @brief Get the kerning between two glyph indices in pixels
+     */
+    int get_kerning(uint32_t left, uint32_t right, int pixel_size);
+
+    /**
+     * @brief Back the glyph cache with files in 'cache_dir'
+     *
+     * The first time glyphs of a pixel size and render mode are requested,
+     * they are mapped from the cache file for that size and mode if there is
+     * a valid one. Cache files are keyed by a hash of the font data, so files
+     * made from a different font are ignored.
+     *
+     * Newly rasterized glyphs are written back by store_disk_cache, which
+     * is also called when the Font is destroyed.
+     */
+    void enable_disk_cache(std::string cache_dir);
+
+    /**
+     * @brief Write any glyphs rasterized since the cache was loaded to disk
+     */
+    void store_disk_cache();
+
     std::mutex m_lock;
-    
+
 private:
     Font();
 
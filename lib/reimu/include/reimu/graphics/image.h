@@ -0,0 +1,87 @@
+#pragma once
+
+#include <reimu/core/file.h>
+#include <reimu/core/result.h>
+#include <reimu/core/resource.h>
+#include <reimu/graphics/rect.h>
+#include <reimu/graphics/texture.h>
+#include <reimu/graphics/vector.h>
+
+#include <memory>
+#include <string>
+
+namespace reimu::graphics {
+
+/**
+ * @brief Immutable RGBA8 pixels with premultiplied alpha, loaded from a file
+ *
+ * PPM (P5 and P6), QOI and decoded image cache files are supported. With a cache
+ * directory, decoded pixels are written to a cache file keyed by the path, size
+ * and modification time of the source file, and later loads map that file without
+ * reading the source or decoding again.
+ *
+ * Pixels can be drawn with Painter::draw_image or uploaded to a texture straight
+ * from the image, which may point into a mapped cache file.
+ */
+class Image : public Resource {
+public:
+    static Result<Image *, ReimuError> create(File &file);
+
+    /**
+     * @brief Load an image, using the decoded cache in 'cache_dir' if there is a valid one
+     *
+     * Images which aren't cached yet are decoded and cached. An empty 'cache_dir' disables the cache.
+     */
+    static Result<Image *, ReimuError> create(File &file, const std::string &cache_dir);
+
+    StringID obj_type_id() const override;
+
+    static consteval StringID type_id() {
+        return "image"_hashid;
+    }
+
+    /**
+     * @brief Get part of the image, such as an icon in an atlas, sharing its pixels
+     *
+     * 'region' is clipped to the image.
+     */
+    std::shared_ptr<Image> sub_image(const Recti &region) const;
+
+    inline const Vector2i &size() const {
+        return m_size;
+    }
+
+    /**
+     * @brief Get the top left pixel, rows are 'stride' bytes apart
+     */
+    inline const uint8_t *pixels() const {
+        return m_pixels;
+    }
+
+    inline size_t stride() const {
+        return m_stride;
+    }
+
+    inline AlphaMode alpha_mode() const {
+        return AlphaMode::Premultiplied;
+    }
+
+    // Whether the pixels were mapped from a cache file rather than decoded
+    inline bool is_mapped() const {
+        return m_is_mapped;
+    }
+
+private:
+    Image() = default;
+
+    // Keeps the pixels alive, either decoded pixels or a mapped file
+    std::shared_ptr<const void> m_storage;
+
+    const uint8_t *m_pixels = nullptr;
+    size_t m_stride = 0;
+    Vector2i m_size = {0, 0};
+
+    bool m_is_mapped = false;
+};
+
+}
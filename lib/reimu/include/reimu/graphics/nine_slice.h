@@ -0,0 +1,51 @@
+#pragma once
+
+#include <reimu/graphics/rect.h>
+#include <reimu/graphics/surface.h>
+#include <reimu/graphics/vector.h>
+
+#include <memory>
+
+namespace reimu::graphics {
+
+/**
+ * @brief Image which can be drawn at any size, for borders and bevels
+ *
+ * The image is split into nine parts by 'center'. Corners are copied as they are,
+ * the edges between them are repeated along each side and the center is repeated
+ * to fill the middle, so drawing is only copying pixels.
+ */
+class NineSlice {
+public:
+    /**
+     * @param draws_center Whether to fill the middle, or leave it for something else to draw
+     */
+    NineSlice(const Vector2i &size, const Recti &center, bool draws_center = true)
+        : m_surface(std::make_shared<Surface>(size)), m_center(center), m_draws_center(draws_center) {}
+
+    /**
+     * @brief Get the Surface to paint the image to, which must not change once drawn
+     */
+    inline Surface &surface() {
+        return *m_surface;
+    }
+
+    inline const std::shared_ptr<Surface> &shared_surface() const {
+        return m_surface;
+    }
+
+    inline const Recti &center() const {
+        return m_center;
+    }
+
+    inline bool draws_center() const {
+        return m_draws_center;
+    }
+
+private:
+    std::shared_ptr<Surface> m_surface;
+    Recti m_center;
+    bool m_draws_center;
+};
+
+}
@@ -1,20 +1,45 @@
 #pragma once
 
 #include <reimu/graphics/color.h>
+#include <reimu/graphics/display_list.h>
+#include <reimu/graphics/image.h>
+#include <reimu/graphics/nine_slice.h>
 #include <reimu/graphics/rect.h>
 #include <reimu/graphics/surface.h>
 
+#include <memory>
+#include <span>
 #include <string>
 
 namespace reimu::graphics {
 
+class Text;
+
+enum class PaintMode {
+    // Draw each command as it is made
+    Immediate,
+    // Record commands and draw them split into tiles across threads when flushed,
+    // giving the same pixels as Immediate
+    Tiled,
+};
+
 class Painter {
 public:
-    Painter(Surface &surface);
+    Painter(Surface &surface, PaintMode mode = PaintMode::Immediate);
 
-    ~Painter() {
-        m_surface.update();
-    }
+    /**
+     * @brief Paint a Surface which was last painted with 'retained'
+     *
+     * Commands are recorded and compared with 'retained' when the Painter is destroyed.
+     * Only the regions where they differ are drawn, using 'mode', then the new commands
+     * are kept in 'retained' for the next time.
+     */
+    Painter(Surface &surface, DisplayList &retained, PaintMode mode = PaintMode::Immediate);
+
+    /**
+     * @brief Flush any recorded commands and upload the damaged parts of the Surface
+     */
+    ~Painter();
 
     inline Vector2i surface_size() const {
         return m_surface.size();
@@ -22,6 +47,13 @@ public:
 
     Painter &draw_rect(const Rectf &rect, const Color &color);
 
+    /**
+     * @brief Composite a rectangle of 'color' onto the Surface with 'mode'
+     *
+     * Colors have straight alpha and are premultiplied for premultiplied surfaces.
+     */
+    Painter &blend_rect(const Rectf &rect, const Color &color, BlendMode mode = BlendMode::SourceOver);
+
     /**
      * @brief Draw a rectangle with a gradient
      * 
@@ -34,15 +66,72 @@ public:
      */
     Painter &draw_rect_gradient(const Rectf &rect, const Color &c1, const Color &c2, const Vector2f &p1, const Vector2f &p2);
 
+    /**
+     * @brief Draw text within 'bounds'
+     */
+    Painter &draw_text(Text &text, const Rectf &bounds);
+
+    /**
+     * @brief Draw a border 'thickness' pixels wide inside 'rect'
+     */
     Painter &draw_rect_outline(const Rectf &rect, const Color &color, int thickness);
+
+    /**
+     * @brief Draw a line, aliased when 'thickness' is 1 and antialiased when wider
+     */
     Painter &draw_line(const Vector2f &begin, const Vector2f &end, const Color &color, int thickness);
 
+    /**
+     * @brief Draw lines joining each point to the next
+     */
+    Painter &draw_lines(std::span<const Vector2f> points, const Color &color, int thickness);
+
+    /**
+     * @brief Copy 'source' of 'image' into 'rect', repeating it to fill 'rect'
+     *
+     * 'image' is kept until the commands are drawn and must not change after.
+     */
+    Painter &draw_image(const Rectf &rect, std::shared_ptr<const Surface> image, const Recti &source);
+    Painter &draw_image(const Rectf &rect, std::shared_ptr<const Image> image, const Recti &source);
+
+    /**
+     * @brief Copy all of 'image' with its top left at 'pos'
+     */
+    Painter &draw_image(const Vector2f &pos, std::shared_ptr<const Image> image);
+
+    /**
+     * @brief Draw 'image' resized to 'rect'
+     *
+     * Corners are shrunk from the inside edges when 'rect' is smaller than them.
+     */
+    Painter &draw_nine_slice(const Rectf &rect, const NineSlice &image);
+
+    /**
+     * @brief Draw any recorded commands to the Surface
+     *
+     * Does nothing for retained painters, which need every command to compare.
+     */
+    void flush();
+
     Surface &surface() {
         return m_surface;
     }
 
 private:
+    // Largest opaque rect drawn straight into the surface by draw_rect in immediate mode
+    static constexpr int max_direct_fill_area = 32 * 32;
+
+    // Fill 'rect', which is within the surface, without going through the display list
+    void fill_direct(const Recti &rect, const Color &color);
+
+    Painter &command_added();
+    void draw_retained();
+
     Surface &m_surface;
+    PaintMode m_mode;
+
+    DisplayList m_list;
+    DisplayList *m_retained = nullptr;
 };
 
 }
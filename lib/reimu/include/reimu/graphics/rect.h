@@ -2,6 +2,8 @@
 
 #include <reimu/graphics/vector.h>
 
+#include <algorithm>
+
 namespace reimu {
 
 template <typename T>
@@ -38,6 +40,24 @@ struct Rect : public Vector4<T> {
         return { width(), height() };
     }
 
+    inline T area() const {
+        return width() * height();
+    }
+
+    inline bool is_empty() const {
+        return width() <= 0 || height() <= 0;
+    }
+
+    /**
+     * @brief Get the smallest rect containing both rects
+     */
+    inline Rect<T> union_with(const Rect<T> &other) const {
+        return {
+            std::min(this->x, other.x), std::min(this->y, other.y),
+            std::max(this->z, other.z), std::max(this->w, other.w)
+        };
+    }
+
     inline Rect<T> intersect(const Rect<T> &other) const {
         T x1 = std::max(this->x, other.x);
         T y1 = std::max(this->y, other.y);
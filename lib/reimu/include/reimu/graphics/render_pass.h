@@ -11,6 +11,8 @@ class Renderer;
 
 enum class BindingType {
     UniformBuffer,
+    // Read only array, such as per instance data
+    StorageBuffer,
     Texture,
 };
 
@@ -24,6 +26,10 @@ struct BindingDefinition {
         struct {
             size_t size;
         } uniform_buffer;
+        struct {
+            // Most bytes bound at once
+            size_t size;
+        } storage_buffer;
     };
 
     ShaderStage visibility;
@@ -39,8 +45,14 @@ public:
 
     virtual void bind_texture(int index, Texture *texture) = 0;
     virtual void bind_uniform_buffer(int index, const void *data, size_t size) = 0;
+    virtual void bind_storage_buffer(int index, const void *data, size_t size) = 0;
     virtual void draw(int num_vertices) = 0;
 
+    /**
+     * @brief Draw 'num_instances' instances, numbered from 'first_instance'
+     */
+    virtual void draw_instanced(int num_vertices, int num_instances, int first_instance = 0) = 0;
+
     virtual void set_strategy(RenderStrategy *strategy) = 0;
 };
 
@@ -5,6 +5,8 @@
 #include <reimu/graphics/texture.h>
 #include <reimu/graphics/vector.h>
 
+#include <string>
+
 namespace reimu::video {
 
 class Window;
@@ -13,14 +15,40 @@ class Window;
 
 namespace reimu::graphics {
 
+/**
+ * @brief Counts of work done to render a frame, for finding per frame overhead
+ */
+struct FrameStats {
+    // GPU bind groups created, which should be none once nothing changes
+    uint32_t bind_groups_created = 0;
+    // Command buffers submitted to the GPU
+    uint32_t queue_submits = 0;
+    // Copies from staging memory to textures
+    uint32_t texture_uploads = 0;
+};
+
+/**
+ * @brief How finished frames are queued for the display
+ */
+enum class PresentMode {
+    // Wait for the display to refresh, never tears
+    Fifo,
+    // Replace a queued frame with a newer one, so rendering never waits
+    Mailbox,
+    // Show frames as soon as they are done, which may tear
+    Immediate,
+};
+
 class Renderer {
 public:
     virtual ~Renderer() = default;
 
     /**
      * @brief Dispatch render queue and swap buffers
+     *
+     * @return Whether a frame was presented to the window
      */
-    virtual void render() = 0;
+    virtual bool render() = 0;
 
     /**
      * @brief Load shader from provided data
@@ -33,9 +61,13 @@ public:
     /**
      * @brief Create a new render pass
      * 
+     * @param alpha_mode How the alpha of textures drawn by the pass is stored,
+     * which picks the blend factors
+     * @param shader Name of a loaded shader
      * @return Result<RenderPass *, ReimuError>
      */
-    virtual Result<RenderPass *, ReimuError> create_render_pass(const BindingDefinition *bindings, size_t num_bindings) = 0;
+    virtual Result<RenderPass *, ReimuError> create_render_pass(const BindingDefinition *bindings, size_t num_bindings,
+        AlphaMode alpha_mode = AlphaMode::Premultiplied, const std::string &shader = "default") = 0;
 
     /**
      * @brief Create a new texture
@@ -53,6 +85,13 @@ public:
     */
     virtual void resize_viewport(const Vector2i& size) = 0;
 
+    /**
+     * @brief Set how frames are presented, Fifo is used if the display doesn't support 'mode'
+     *
+     * Mailbox and Immediate give lower latency than the default of Fifo.
+     */
+    virtual void set_present_mode(PresentMode mode) = 0;
+
     /**
      * @brief Get the color format used by the display surface
      * 
@@ -60,6 +99,15 @@ public:
      */
     virtual ColorFormat display_surface_color_format() const = 0;
 
+    /**
+     * @brief Whether frames are kept in memory rather than presented to the window
+     *
+     * Headless renderers never wait for the display, so windows can render them at any time.
+     */
+    virtual bool is_headless() const {
+        return false;
+    }
+
     /**
      * @brief Get the current viewport size in pixels
      * 
@@ -69,8 +117,16 @@ public:
         return m_viewport_size;
     }
 
+    /**
+     * @brief Get the stats of the last frame rendered
+     */
+    inline const FrameStats &frame_stats() const {
+        return m_frame_stats;
+    }
+
 protected:
     Vector2i m_viewport_size;
+    FrameStats m_frame_stats;
 };
 
 Result<Renderer *, ReimuError> create_attach_renderer(video::Window *window);
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <reimu/graphics/renderer.h>
+
+#include <string>
+#include <vector>
+
+namespace reimu::graphics {
+
+class SoftwareRenderPass;
+
+/**
+ * @brief Renderer compositing into a framebuffer in memory, for running without a GPU
+ *
+ * Passes can only make instanced draws with the default shader, which is all the
+ * compositor uses. Nothing is shown in the window, and frames are the same on every
+ * machine, so they can be compared with golden images or written out as they are rendered.
+ */
+class SoftwareRenderer final : public Renderer {
+public:
+    SoftwareRenderer(const Vector2i &viewport_size);
+    ~SoftwareRenderer() override;
+
+    /**
+     * @brief Create a renderer for 'window'
+     *
+     * Frames are written to the directory in REIMU_FRAME_DUMP_DIR, if it is set.
+     */
+    static SoftwareRenderer *create(video::Window *window);
+
+    bool render() override;
+    Result<void, ReimuError> load_shader(const std::string &name, const char *data) override;
+    Result<RenderPass *, ReimuError> create_render_pass(const BindingDefinition *bindings,
+        size_t num_bindings, AlphaMode alpha_mode, const std::string &shader) override;
+    Result<Texture *, ReimuError> create_texture(const Vector2i &size, ColorFormat color_format)
+        override;
+
+    void resize_viewport(const Vector2i &size) override;
+    void set_present_mode(PresentMode mode) override;
+    ColorFormat display_surface_color_format() const override;
+
+    bool is_headless() const override {
+        return true;
+    }
+
+    /**
+     * @brief Write every frame rendered from now on to 'dir', as frame_00000.ppm and so on
+     *
+     * @param dir Directory to write to, or empty to stop writing frames
+     */
+    void set_frame_dump_dir(std::string dir);
+
+    /**
+     * @brief Write the last frame to 'path' as a binary PPM image
+     */
+    Result<void, ReimuError> write_ppm(const std::string &path) const;
+
+    /**
+     * @brief Get the last frame, premultiplied RGBA8 pixels in rows of the viewport width
+     */
+    inline const std::vector<uint32_t> &framebuffer() const {
+        return m_framebuffer;
+    }
+
+    void on_destroy_render_pass(RenderPass *render_pass);
+
+private:
+    std::vector<uint32_t> m_framebuffer;
+
+    // In the order they are drawn
+    std::vector<SoftwareRenderPass *> m_render_passes;
+
+    std::string m_frame_dump_dir;
+    uint32_t m_frame_index = 0;
+};
+
+}
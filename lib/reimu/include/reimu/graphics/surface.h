@@ -1,5 +1,7 @@
 #pragma once
 
+#include <reimu/graphics/rect.h>
+#include <reimu/graphics/surface_pool.h>
 #include <reimu/graphics/texture.h>
 #include <reimu/graphics/vector.h>
 
@@ -11,10 +13,25 @@ namespace reimu::graphics {
 class Surface {
 public:
     Surface(Texture *tex);
+
+    /**
+     * @brief Create a surface with only a software buffer, for drawing to and copying from
+     */
+    Surface(const Vector2i &size, ColorFormat format = ColorFormat::RGBA8);
+
+    /**
+     * @brief Create a surface using storage from 'pool', which must outlive it
+     *
+     * The storage may be larger than the surface, only the top left is used.
+     */
+    Surface(SurfacePool &pool, const Vector2i &size, ColorFormat format);
+
     ~Surface();
 
     /**
      * @brief Resize the surface including any underlying texture
+     *
+     * Pooled surfaces keep their storage while the size stays in the same size class.
     */
     void resize(const Vector2i &size);
 
@@ -25,15 +42,31 @@ public:
         return m_buffer.data();
     }
 
+    inline const uint8_t *buffer() const {
+        return m_buffer.data();
+    }
+
     /**
-     * @brief Get the Texture for this surface
+     * @brief Get the Texture for this surface, which software only surfaces don't have
     */
     inline class Texture &texture() {
         return *m_texture;
     }
 
     /**
-     * @brief Sync the Texture object with the software buffer
+     * @brief Mark part of the software buffer as changed since the last update
+     *
+     * Overlapping rects are merged when that doesn't grow the area to upload,
+     * and the rects are kept to a small number.
+    */
+    void add_damage(const Recti &rect);
+
+    inline const std::vector<Recti> &damage() const {
+        return m_damage;
+    }
+
+    /**
+     * @brief Upload the damaged parts of the software buffer to the Texture
     */
     void update();
 
@@ -41,22 +74,57 @@ public:
         return m_size;
     }
 
+    /**
+     * @brief Get how pixels are stored, Painters premultiply colors for premultiplied surfaces
+    */
+    inline AlphaMode alpha_mode() const {
+        return m_alpha_mode;
+    }
+
+    inline void set_alpha_mode(AlphaMode mode) {
+        m_alpha_mode = mode;
+    }
+
+    /**
+     * @brief Get a rect of the surface known to be fully opaque, empty if there is none
+     *
+     * Painters keep it up to date, anything else writing to the buffer must reset it.
+    */
+    inline const Recti &opaque_rect() const {
+        return m_opaque_rect;
+    }
+
+    inline void set_opaque_rect(const Recti &rect) {
+        m_opaque_rect = rect;
+    }
+
     inline uint32_t bytes_per_pixel() const {
         return get_color_format_info(m_color_format).bytes_per_pixel;
     }
 
+    /**
+     * @brief Get the bytes per row of the software buffer, which may be wider than the surface
+    */
     inline uint32_t stride() const {
-        return bytes_per_pixel() * m_size.x;
+        return bytes_per_pixel() * m_capacity.x;
     }
 
 private:
     void make_buffer();
 
     ColorFormat m_color_format;
+    AlphaMode m_alpha_mode = AlphaMode::Premultiplied;
 
     Vector2i m_size;
+    // Size of the texture and buffer
+    Vector2i m_capacity;
     std::vector<uint8_t> m_buffer;
 
+    SurfacePool *m_pool = nullptr;
+
+    std::vector<Recti> m_damage;
+    Recti m_opaque_rect = {};
+
     std::unique_ptr<Texture> m_texture;
 };
 
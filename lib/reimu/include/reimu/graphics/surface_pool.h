@@ -0,0 +1,64 @@
+#pragma once
+
+#include <reimu/graphics/texture.h>
+#include <reimu/graphics/vector.h>
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace reimu::graphics {
+
+/**
+ * @brief Reuses the textures and software buffers of Surfaces
+ *
+ * Storage is allocated in size classes, so a Surface can be resized within
+ * its class without allocating, and storage released by one Surface is
+ * taken by the next one needing the same class.
+ */
+class SurfacePool {
+public:
+    using CreateTextureFn = std::function<Texture *(const Vector2i &size, ColorFormat format)>;
+
+    struct Storage {
+        std::unique_ptr<Texture> texture;
+        std::vector<uint8_t> buffer;
+    };
+
+    /**
+     * @param create_texture Creates textures for new storage
+     * @param max_free_bytes Most bytes of software buffers to keep for reuse
+     */
+    SurfacePool(CreateTextureFn create_texture, size_t max_free_bytes = 64 * 1024 * 1024);
+
+    /**
+     * @brief Get the size of storage used for a Surface of 'size'
+     */
+    static Vector2i size_class(const Vector2i &size);
+
+    /**
+     * @brief Take storage for a Surface of 'size', reusing released storage if there is any
+     */
+    Storage acquire(const Vector2i &size, ColorFormat format);
+
+    /**
+     * @brief Keep storage for reuse, or free it if the pool is full
+     */
+    void release(Storage storage);
+
+    inline size_t free_bytes() const {
+        return m_free_bytes;
+    }
+
+private:
+    static uint64_t key(const Vector2i &size_class, ColorFormat format);
+
+    CreateTextureFn m_create_texture;
+
+    std::unordered_map<uint64_t, std::vector<Storage>> m_free;
+    size_t m_free_bytes = 0;
+    size_t m_max_free_bytes;
+};
+
+}
@@ -1,42 +1,189 @@
 #pragma once
 
 #include <reimu/graphics/color.h>
+#include <reimu/graphics/display_list.h>
 #include <reimu/graphics/rect.h>
 #include <reimu/graphics/surface.h>
 #include <reimu/graphics/vector.h>
 #include <reimu/graphics/font.h>
 
+#include <cstddef>
+#include <map>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace reimu::graphics {
 
+/**
+ * @brief Laid out block of text
+ *
+ * Text is stored as paragraphs separated by '\n', each caching where
+ * its lines wrap. Edits and changes to the wrap width only lay out
+ * the paragraphs they affect again, and layout happens lazily on
+ * the next render or text_geometry call.
+ */
 class Text final {
 public:
     Text();
     Text(std::u32string text);
 
-    void set_text(std::u32string text);
+    /**
+     * @brief Set the text
+     *
+     * Only paragraphs which differ from the current text are laid out again,
+     * so appending to or changing part of a long text is cheap.
+     */
+    void set_text(std::u32string_view text);
+
+    /**
+     * @brief Replace 'len' codepoints at 'pos' with 'text'
+     */
+    void replace(size_t pos, size_t len, std::u32string_view text);
+    void append(std::u32string_view text);
+
+    std::u32string get_text() const;
+
+    // Length of the text in codepoints
+    size_t length() const { return m_length; }
     
     void set_font(std::shared_ptr<Font> font);
+
+    /**
+     * @brief Set the fonts used for codepoints missing from the main font
+     *
+     * Fonts are tried in order, codepoints not covered by any font
+     * are drawn with the main font's missing glyph.
+     */
+    void set_fallback_fonts(std::vector<std::shared_ptr<Font>> fonts);
     void set_font_size_px(int size_px);
 
+    /**
+     * @brief Wrap lines at word boundaries to fit within 'width' pixels
+     *
+     * Words longer than the width are broken between characters.
+     * A width of 0 disables wrapping.
+     */
+    void set_wrap_width(int width);
+
     void set_color(const Color& colour);
 
     void render(Surface &dest, const Rectf &bounds);
 
+    /**
+     * @brief Record the glyphs within 'bounds' and 'clip' into a display list
+     *
+     * Glyphs are owned by the fonts, so the list must be drawn while they are alive.
+     */
+    void render(DisplayList &list, const Rectf &bounds, const Recti &clip);
+
     Vector2f text_geometry();
 
+    /**
+     * @brief Get the position of the codepoint at 'pos', relative to the top left of the text
+     */
+    Vector2f position_of(size_t pos);
+
+    /**
+     * @brief Get the index of the codepoint nearest to 'point', relative to the top left of the text
+     */
+    size_t offset_at(const Vector2f &point);
+
 private:
+    struct Paragraph {
+        std::u32string text;
+
+        // Index into text of the start of each wrapped line after the first
+        std::vector<uint32_t> line_breaks;
+        // Width of the widest line
+        int width = 0;
+
+        bool stale = true;
+
+        int line_count() const {
+            return line_breaks.size() + 1;
+        }
+    };
+
+    // Fenwick tree over per-paragraph counts, for finding paragraphs by offset or line
+    class PrefixSums {
+    public:
+        void build(const std::vector<size_t> &values);
+        void add(size_t index, ptrdiff_t delta);
+
+        // Sum of the first 'count' values
+        size_t prefix(size_t count) const;
+        // Index of the first value whose inclusive prefix sum is above 'value', or size() if none is
+        size_t find(size_t value) const;
+
+        size_t size() const { return m_tree.size(); }
+
+    private:
+        std::vector<size_t> m_tree;
+    };
+
+    // Glyph and the font it came from, after falling back for missing codepoints
+    struct ResolvedGlyph {
+        const Glyph *glyph;
+        Font *font;
+    };
+
+    // Previous glyph when laying out a line, for kerning
+    struct PenState {
+        const Glyph *prev_glyph = nullptr;
+        Font *prev_font = nullptr;
+    };
+
+    template<typename GlyphFn>
+    int layout_line(std::u32string_view line, int x, int baseline, GlyphFn glyph_fn);
+
+    const Glyph *next_glyph(uint32_t codepoint, PenState &pen, int &kerning);
+    const Glyph *resolve_glyph(uint32_t codepoint, Font *&font);
+
+    void layout_paragraph(size_t index);
+    void invalidate_paragraph(size_t index);
+    void invalidate_layout();
+    void update_layout();
+
+    void mark_stale(size_t begin, size_t end);
+    void ensure_index();
+
+    void replace_paragraphs(size_t index, size_t count, std::vector<std::u32string> paragraphs);
+
     std::shared_ptr<Font> m_font = nullptr;
+    std::vector<std::shared_ptr<Font>> m_fallback_fonts;
 
     Color m_color = Color(0, 0, 0);
-    std::u32string m_text; // Text to render
-    Rectf m_bounds;       // Bounds of the text
     int m_pixel_size = 16;
+    int m_wrap_width = 0;
+
+    // Glyphs resolved for each codepoint, cleared when the fonts or size change
+    std::unordered_map<uint32_t, ResolvedGlyph> m_resolved_glyphs;
+
+    std::vector<Paragraph> m_paragraphs;
+    size_t m_length = 0;
+
+    // Metrics of the laid out paragraphs
+    FontMetrics m_metrics = {};
+    size_t m_line_count = 0;
+    // Count of paragraphs with each width, the last key is the text width
+    std::map<int, size_t> m_paragraph_widths;
+
+    // Codepoints in each paragraph including its newline, and lines in each laid out paragraph
+    PrefixSums m_offset_index;
+    PrefixSums m_line_index;
+    // Set when paragraphs were inserted or removed, the indices are rebuilt before the next lookup
+    bool m_index_stale = true;
+
+    // Range of paragraphs which may need laying out
+    size_t m_stale_begin = 0;
+    size_t m_stale_end = 0;
 
-    Vector2f m_text_size;
-    bool m_stale_geometry = true;
+    // Reused by render
+    DisplayList m_render_list;
+    std::vector<PositionedGlyph> m_line_glyphs;
 };
 
 } // namespace Arclight
@@ -2,6 +2,7 @@
 
 #include <stddef.h>
 
+#include <reimu/graphics/rect.h>
 #include <reimu/graphics/vector.h>
 
 namespace reimu::graphics {
@@ -16,6 +17,13 @@ enum class ColorFormat {
 
 ColorFormatInfo get_color_format_info(ColorFormat format);
 
+enum class AlphaMode {
+    // Color channels are independent of alpha
+    Straight,
+    // Color channels are already multiplied by alpha
+    Premultiplied,
+};
+
 class Texture {
 public:
     virtual ~Texture() = default;
@@ -27,6 +35,41 @@ public:
 
     virtual void update(const void *data, size_t size) = 0;
 
+    /**
+     * @brief Upload part of the texture
+     *
+     * @param data Pixel data for the whole texture
+     * @param stride Bytes per row of data
+     * @param region Region of the texture to upload
+     */
+    virtual void update_region(const void *data, size_t stride, const Recti &region) {
+        (void)region;
+
+        update(data, stride * m_size.y);
+    }
+
+    /**
+     * @brief Upload pixels to a region of the texture
+     *
+     * @param data Pixels for the top left of the region
+     * @param stride Bytes per row of data
+     */
+    virtual void write_region(const void *data, size_t stride, const Recti &region) = 0;
+
+    /**
+     * @brief Get the texture holding the pixels, which is another texture for regions of an atlas
+     */
+    virtual Texture &backing_texture() {
+        return *this;
+    }
+
+    /**
+     * @brief Get where the pixels are in the backing texture
+     */
+    virtual Vector2i backing_origin() const {
+        return {0, 0};
+    }
+
     inline ColorFormat color_format() const { return m_format; }
     const Vector2i &size() const { return m_size; }
 
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <reimu/core/optional.h>
+#include <reimu/graphics/rect.h>
+#include <reimu/graphics/texture.h>
+#include <reimu/graphics/vector.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace reimu::graphics {
+
+/**
+ * @brief Packs rects into rows (shelves) of rects with the same rounded up height
+ *
+ * Freed space is reused by rects of the same height, and empty shelves by any rect
+ * that fits in them.
+ */
+class ShelfPacker {
+public:
+    ShelfPacker(const Vector2i &size);
+
+    /**
+     * @brief Find space for a rect of 'size', or none if there isn't any
+     */
+    Optional<Recti> allocate(const Vector2i &size);
+
+    /**
+     * @brief Free a rect returned by allocate
+     */
+    void free(const Recti &rect);
+
+    /**
+     * @brief Get the area of the allocated rects, including rounding
+     */
+    inline int64_t used_area() const {
+        return m_used_area;
+    }
+
+    inline const Vector2i &size() const {
+        return m_size;
+    }
+
+private:
+    struct Span {
+        int x;
+        int width;
+    };
+
+    struct Shelf {
+        int y;
+        int height;
+
+        // Sorted by x and never touching, merged when freed
+        std::vector<Span> free_spans;
+    };
+
+    static int shelf_height(int height);
+
+    Optional<Recti> allocate_in(Shelf &shelf, const Vector2i &size);
+
+    Vector2i m_size;
+
+    // Sorted by y
+    std::vector<Shelf> m_shelves;
+    int m_next_y = 0;
+
+    int64_t m_used_area = 0;
+};
+
+/**
+ * @brief Creates small textures as regions of one large texture
+ *
+ * Regions can be drawn together in one draw, binding only the atlas texture.
+ * Textures which are too large or don't fit get a texture of their own, so
+ * backing_texture() and backing_origin() say where any texture's pixels are.
+ * The atlas must outlive the textures it creates.
+ */
+class TextureAtlas {
+public:
+    using CreateTextureFn = std::function<Texture *(const Vector2i &size, ColorFormat format)>;
+
+    // Format of the atlas texture, textures of other formats aren't put in it
+    static constexpr ColorFormat format = ColorFormat::RGBA8;
+
+    /**
+     * @param create_texture Creates the atlas texture, and textures which aren't in the atlas
+     * @param max_region_size Largest width or height put in the atlas
+     */
+    TextureAtlas(CreateTextureFn create_texture, const Vector2i &size = {2048, 2048},
+        int max_region_size = 512);
+
+    /**
+     * @brief Create a texture, as a region of the atlas if there is space for it
+     */
+    Texture *create_texture(const Vector2i &size, ColorFormat format);
+
+    /**
+     * @brief Get the atlas texture, creating it on first use
+     */
+    Texture &texture();
+
+    inline const ShelfPacker &packer() const {
+        return m_packer;
+    }
+
+private:
+    friend class AtlasTexture;
+
+    CreateTextureFn m_create_texture;
+
+    ShelfPacker m_packer;
+    int m_max_region_size;
+
+    std::unique_ptr<Texture> m_texture;
+};
+
+}
@@ -1,12 +1,15 @@
 #pragma once
 
+#include <reimu/core/optional.h>
 #include <reimu/core/resource_manager.h>
 
 #include <reimu/graphics/color.h>
+#include <reimu/graphics/nine_slice.h>
 #include <reimu/graphics/texture.h>
 #include <reimu/graphics/text.h>
 #include <reimu/graphics/painter.h>
 
+#include <memory>
 #include <string>
 
 namespace reimu::gui {
@@ -18,6 +21,9 @@ struct UIStyle {
     Color highlight_color;
     Color shadow_color;
 
+    Color input_background_color;
+    Color selection_color;
+
     int win_border_thickness;
     int win_titlebar_height;
 };
@@ -32,17 +38,48 @@ public:
 
     const UIStyle &get_style() const { return m_style; }
 
+    /**
+     * @brief Change the style, letting the painter rebuild anything drawn with the old one
+     */
+    void set_style(const UIStyle &style);
+
     virtual void draw_frame(const std::string &title, bool is_active) = 0;
     virtual void draw_button(const std::string &label, bool is_pressed) = 0;
-    virtual void draw_label(const std::string &label) = 0;
+    /**
+     * @brief Draw a label, applying the style to its text
+     *
+     * The label keeps its layout between repaints, so only
+     * changes to the style or size lay it out again.
+     */
+    virtual void draw_label(graphics::Text &label) = 0;
     virtual void draw_text(const std::string &text, const Rectf &bounds) = 0;
     virtual void draw_background() = 0;
 
-    /*virtual void draw_textbox(std::string text, int cur_pos, bool is_pressed) = 0;*/
+    /**
+     * @brief Apply the font, size and color used for body text
+     */
+    virtual void style_text(graphics::Text &text) = 0;
+
+    /**
+     * @brief Draw the frame and background of a text box
+     */
+    virtual void draw_textbox(bool is_focused) = 0;
+
+    /**
+     * @brief Draw a single line of a text box, clearing what was there before
+     *
+     * 'selection_start' and 'selection_end' are the codepoints of the line
+     * which are selected, 'cursor' is the codepoint the cursor is before.
+     */
+    virtual void draw_textbox_line(graphics::Text &line, const Rectf &bounds,
+        size_t selection_start, size_t selection_end, Optional<size_t> cursor) = 0;
 
 protected:
     graphics::Painter &get_painter();
 
+    // Called after the style changes
+    virtual void style_changed() {}
+
     UIStyle m_style;
     graphics::Painter *m_current_painter;
 };
@@ -53,12 +90,38 @@ public:
 
     void draw_frame(const std::string &title, bool is_active) override;
     void draw_button(const std::string &label, bool is_pressed) override;
-    void draw_label(const std::string &label) override;
+    void draw_label(graphics::Text &label) override;
     void draw_text(const std::string &text, const Rectf &bounds) override;
     void draw_background() override;
 
+    void style_text(graphics::Text &text) override;
+    void draw_textbox(bool is_focused) override;
+    void draw_textbox_line(graphics::Text &line, const Rectf &bounds,
+        size_t selection_start, size_t selection_end, Optional<size_t> cursor) override;
+
+protected:
+    void style_changed() override;
+
 private:
+    // Chrome and text rendered for a style and font, shared by every painter using them
+    struct Theme;
+
+    void set_text_utf8(std::string_view text);
+
+    // Find the theme for the style if it changed since it was last found
+    void update_theme();
+
     graphics::Text m_text;
+    std::shared_ptr<graphics::Font> m_font;
+
+    // Decoded text, kept to reuse its storage
+    std::u32string m_utf32_buffer;
+
+    bool m_is_theme_stale = true;
+    std::shared_ptr<Theme> m_theme;
+
+    // The titlebar gradient depends on its width, so is rendered again when that changes
+    std::shared_ptr<graphics::Surface> m_titlebar;
 
     ResourceManager &m_res_mgr;
 };
@@ -55,11 +55,17 @@ public:
 
     void line_break();
 
+    /**
+     * @brief Set the fonts to try, in order, for codepoints missing from the terminal font
+     */
+    void set_fallback_fonts(std::vector<std::shared_ptr<graphics::Font>> fonts);
+
 private:
     std::list<std::vector<uint32_t>> m_lines;
     TerminalPrivateData *m_data;
 
     std::shared_ptr<graphics::Font> m_font;
+    std::vector<std::shared_ptr<graphics::Font>> m_fallback_fonts;
 
     Color m_fg_color = Color::white();
     Color m_bg_color = Color::black();
@@ -1,19 +1,23 @@
 #pragma once
 
 #include <reimu/core/event.h>
+#include <reimu/graphics/display_list.h>
 #include <reimu/graphics/renderer.h>
 #include <reimu/graphics/surface.h>
 #include <reimu/graphics/vector.h>
 #include <reimu/gui/layout.h>
 #include <reimu/gui/style.h>
+#include <reimu/video/input.h>
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <string_view>
 
 namespace reimu::gui {
 
-using CreateTextureFn = std::function<graphics::Texture *(const Vector2i &)>;
-using AddClipFn = std::function<void(const Recti &, const Vector2i &, graphics::Texture *)>;
+using CreateSurfaceFn = std::function<std::unique_ptr<graphics::Surface>(const Vector2i &)>;
+using AddClipFn = std::function<void(const Recti &, const Vector2i &, graphics::Surface *)>;
 
 class Widget : public EventDispatcher {
 public:
@@ -33,13 +37,26 @@ public:
     virtual Widget *get_widget_at(const Vector2f &pos);
 
     virtual void update_layout();
+
+    /**
+     * @brief Repaint the widget if it changed since it was last painted
+     *
+     * Widgets are marked to repaint by dispatching 'ui_repaint' to them,
+     * or by their surface needing a resize.
+     */
+    virtual void paint(UIPainter &painter);
     virtual void repaint(UIPainter &painter);
 
+    /**
+     * @brief Mark the widget and its children to repaint, as when the painter changes
+     */
+    virtual void invalidate_paint();
+
     /**
      * Add clips to the render queue.
      * 
      * @param add_clip Function to add a clip to the render queue.
-     * add_clip takes in a source rectangle, a destination position and a texture.
+     * add_clip takes in a source rectangle, a destination position and a surface.
     */
     virtual void add_clips(AddClipFn add_clip);
 
@@ -48,7 +65,7 @@ public:
      */
     virtual void signal_layout_changed();
 
-    virtual void create_texture_if_needed(CreateTextureFn fn);
+    virtual void create_surface_if_needed(CreateSurfaceFn fn);
 
     Rectf bounds;
 
@@ -58,10 +75,16 @@ public:
 protected:
     virtual void remove_child(Widget *child);
 
+    Vector2i wanted_surface_size() const;
+
     Widget *m_parent = nullptr;
     class Window *m_window = nullptr;
 
     std::unique_ptr<graphics::Surface> m_surface = nullptr;
+
+    // Commands last painted to the surface, for painting with a retained Painter
+    graphics::DisplayList m_display_list;
+    bool m_needs_repaint = true;
 };
 
 class Box : public Widget {
@@ -70,10 +93,12 @@ public:
 
     Widget *get_widget_at(const Vector2f &pos) override;
 
+    void paint(UIPainter &painter) override;
     virtual void repaint(UIPainter &painter) override;
+    void invalidate_paint() override;
 
     void add_clips(AddClipFn add_clip) override;
-    void create_texture_if_needed(CreateTextureFn fn) override;
+    void create_surface_if_needed(CreateSurfaceFn fn) override;
 
 protected:
     virtual void add_child(Widget *child);
@@ -81,7 +106,7 @@ protected:
 
     virtual Rectf inner_bounds() const;
 
-    CreateTextureFn m_create_texture_fn;
+    CreateSurfaceFn m_create_surface_fn;
     std::list<Widget *> m_children;
 };
 
@@ -130,6 +155,7 @@ public:
     RootContainer(class Window *win, const Vector2f &viewport_size,
         bool decorate = true);
 
+    void paint(UIPainter &painter) override;
     void repaint(UIPainter &painter) override;
     void update_layout(const Vector2f &viewport_size);
 
@@ -139,6 +165,7 @@ public:
         return m_recalculate_layout;
     }
 
+    // Whether any widget in the window needs to be repainted
     inline bool needs_repaint() const {
         return m_repaint;
     }
@@ -175,19 +202,90 @@ public:
     void set_text(const std::string &text);
 
 private:
-    std::string m_text;
+    graphics::Text m_text;
 };
 
+class PieceTable;
+
+/**
+ * @brief Editable multi-line text
+ *
+ * Text is kept in a piece table so edits anywhere in a large buffer
+ * are O(log n). Only the visible lines are laid out and drawn, and
+ * a repaint only redraws the lines changed since the last one.
+ */
 class TextBox : public Widget {
 public:
     TextBox();
+    ~TextBox() override;
+
     void repaint(UIPainter &painter) override;
 
     void set_text(std::string text);
-    std::string_view get_text() const;
+    std::string get_text() const;
+
+    /**
+     * @brief Insert text at the cursor, replacing any selection
+     */
+    void insert(std::string_view text);
+
+    /**
+     * @brief Move the cursor to byte offset 'pos'
+     *
+     * If 'extend_selection' is set the selection is extended to 'pos',
+     * otherwise the selection is cleared.
+     */
+    void set_cursor(size_t pos, bool extend_selection = false);
+    size_t get_cursor() const { return m_cursor; }
+
+    void select_all();
+    std::string get_selected_text() const;
+
+    /**
+     * @brief Edit the text or move the cursor as a key press would
+     *
+     * Cursor movement and deletion step over whole grapheme clusters.
+     */
+    void handle_key(const video::KeyboardEvent &key);
 
 private:
-    std::string m_text;
+
+    void erase(size_t pos, size_t len);
+    void move_vertical(int lines, bool extend_selection);
+
+    size_t next_grapheme(size_t pos) const;
+    size_t prev_grapheme(size_t pos) const;
+
+    // Byte offset of the character nearest to a point relative to the widget
+    size_t offset_at_point(const Vector2f &point);
+
+    void damage_lines(size_t first, size_t last);
+    void damage_from(size_t line);
+    void scroll_to_cursor();
+
+    std::unique_ptr<PieceTable> m_buffer;
+
+    // Byte offsets, the selection is between the anchor and the cursor
+    size_t m_cursor = 0;
+    size_t m_anchor = 0;
+
+    // Horizontal position to keep when moving between lines
+    float m_preferred_x = -1;
+
+    size_t m_scroll_line = 0;
+    size_t m_visible_lines = 1;
+    int m_line_height = 16;
+
+    // Lines to redraw on the next repaint
+    size_t m_damage_first = SIZE_MAX;
+    size_t m_damage_last = 0;
+    bool m_needs_full_repaint = true;
+
+    bool m_is_focused = false;
+    bool m_is_selecting = false;
+
+    // Reused to lay out each visible line
+    graphics::Text m_line_text;
 };
 
 }
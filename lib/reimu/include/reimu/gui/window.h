@@ -2,6 +2,8 @@
 
 #include <reimu/core/error.h>
 #include <reimu/core/resource_manager.h>
+#include <reimu/graphics/surface_pool.h>
+#include <reimu/graphics/texture_atlas.h>
 #include <reimu/gui/widget.h>
 #include <reimu/video/window.h>
 #include <reimu/video/input.h>
@@ -31,8 +33,26 @@ public:
      */
     void set_title(const std::string &title);
 
+    /**
+     * @brief Render a frame now, waiting for the display if it is busy
+     *
+     * Used for the first frame, anything else should use request_render.
+     */
     void render();
 
+    /**
+     * @brief Render with the next frame of the display, if anything changed
+     *
+     * Any number of calls between two frames render once, and frames with nothing
+     * to repaint are skipped, so an idle window does no GPU work.
+     */
+    void request_render();
+
+    /**
+     * @brief Set how the window's frames are presented
+     */
+    void set_present_mode(graphics::PresentMode mode) { m_renderer->set_present_mode(mode); }
+
     /**
      * @brief Get the root widget
      * 
@@ -67,32 +87,66 @@ public:
         return m_last_input_event;
     }
 
+    /**
+     * @brief Get the resource manager shared by every window in the process
+     *
+     * Windows share one ResourceManager for as long as any of them is open, so
+     * resources loaded through it, such as fonts, are visible to every window.
+     */
     std::shared_ptr<ResourceManager> resource_manager() {
         return m_res_mgr;
     }
 
+    /**
+     * @brief Replace the painter used for every widget, repainting all of them
+     *
+     * The painter is kept between renders, so it can cache anything it draws.
+     * It must not be null.
+     */
+    void set_ui_painter(std::unique_ptr<UIPainter> painter);
+
+    UIPainter &ui_painter() { return *m_ui_painter; }
+
 private:
     Window(video::Window *window, graphics::Renderer *renderer);
 
     void process_input();
 
+    // Whether the next frame would differ from the last
+    bool has_damage() const;
+
     void set_mouse_widget(Widget *widget);
 
     bool m_is_open = true;
 
-    CreateTextureFn m_create_texture_fn;
+    // The window was resized, so the frame has to be presented even if no widget changed
+    bool m_needs_present = false;
+
+    CreateSurfaceFn m_create_surface_fn;
 
     Widget *m_mouse_widget = nullptr;
     Widget *m_focused_widget = nullptr;
 
-    std::unique_ptr<RootContainer> m_root;
+    // Before anything with textures, so the renderer outlives them
     std::unique_ptr<video::Window> m_raw_window;
     std::unique_ptr<graphics::Renderer> m_renderer;
 
+    // Small surface textures are regions of the atlas, so the compositor can draw them together
+    std::unique_ptr<graphics::TextureAtlas> m_texture_atlas;
+
+    // Declared before the widgets, as their surfaces return storage to it
+    std::unique_ptr<graphics::SurfacePool> m_surface_pool;
+
+    std::unique_ptr<RootContainer> m_root;
+
     std::unique_ptr<Compositor> m_compositor;
 
+    // Shared by every window, so fonts and their glyphs are only loaded once
     std::shared_ptr<ResourceManager> m_res_mgr;
 
+    // After the resource manager, as it uses the fonts
+    std::unique_ptr<UIPainter> m_ui_painter;
+
     Vector2f m_pointer = {0, 0};
 
     video::InputEvent m_last_input_event;
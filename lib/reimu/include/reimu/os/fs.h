@@ -5,19 +5,38 @@
 #include <reimu/core/file.h>
 #include <reimu/core/result.h>
 
+#include <memory>
 #include <string>
 
 namespace reimu::os {
 
+// Read only mapping of an entire file, unmapped on destruction
+class MappedFile {
+public:
+    virtual ~MappedFile() = default;
+
+    virtual const uint8_t *data() const = 0;
+    virtual size_t size() const = 0;
+};
+
 // Ensures the path specified in 'path' exists.
 // Creates any path components with mode 'mode'
 Result<void, OSError> make_path(const std::string &path, int mode);
 
 Result<std::string, OSError> default_shell_path();
 
+// Per-user directory for cached data, may not exist yet
+Result<std::string, OSError> cache_path();
+
 Result<size_t, OSError> write(os_handle_t handle, const void *buffer, size_t size);
 Result<void, reimu::OSError> close(os_handle_t handle);
 
 Result<std::unique_ptr<File>, reimu::OSError> open(const std::string &path, FileMode mode);
 
+Result<std::unique_ptr<MappedFile>, reimu::OSError> map_file(const std::string &path);
+
+// Writes 'data' to a temporary file then renames it over 'path',
+// so readers never see a partially written file
+Result<void, reimu::OSError> replace_file(const std::string &path, const void *data, size_t size);
+
 }
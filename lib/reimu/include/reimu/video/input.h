@@ -2,6 +2,8 @@
 
 #include <reimu/graphics/vector.h>
 
+#include <stdint.h>
+
 namespace reimu::video {
 
 enum class MouseButton {
@@ -77,6 +79,8 @@ struct KeyboardEvent {
     bool is_win = false;
 
     int key;
+    // Unicode codepoint the key types with the current layout and modifiers, 0 if it types none
+    uint32_t codepoint = 0;
 };
 
 struct InputEvent {
@@ -122,6 +122,15 @@ public:
 
     virtual void render() = 0;
 
+    /**
+     * @brief Ask for a 'wm_frame' event once the display is ready for a new frame
+     *
+     * Requests made before the event are merged, so at most one frame is waiting
+     * to be shown. Windows which can't tell when the display is ready send the
+     * event straight away.
+     */
+    virtual void request_frame();
+
     virtual void show_window() = 0;
     virtual void hide_window() = 0;
     virtual void sync_window() = 0;
@@ -2,12 +2,16 @@
 #include <reimu/core/file.h>
 
 #include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace reimu::os {
 
 class UNIXFile : public File {
 public:
-    UNIXFile(int fd, FileMode mode) : m_fd{fd}, m_mode{mode} {
+    UNIXFile(int fd, FileMode mode, std::string path) : m_fd{fd}, m_mode{mode}, m_path{std::move(path)} {
         
     }
 
@@ -81,10 +85,24 @@ public:
 
         return sz;
     }
+
+    const std::string &path() const override {
+        return m_path;
+    }
+
+    uint64_t modified_time() override {
+        struct stat st;
+        if (fstat(m_fd, &st) < 0) {
+            return 0;
+        }
+
+        return (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
     
 private:
     int m_fd;
     FileMode m_mode;
+    std::string m_path;
 
     size_t m_off = 0;
 };
@@ -108,9 +126,102 @@ Result<std::unique_ptr<File>, reimu::OSError> open(const std::string &path, File
         return ERR(errno);
     }
 
-    auto file = std::make_unique<UNIXFile>(fd, mode);
+    auto file = std::make_unique<UNIXFile>(fd, mode, path);
 
     return OK(std::move(file));
 }
 
-}
\ No newline at end of file
+class UNIXMappedFile : public MappedFile {
+public:
+    UNIXMappedFile(void *base, size_t size) : m_base{base}, m_size{size} {}
+
+    ~UNIXMappedFile() override {
+        munmap(m_base, m_size);
+    }
+
+    const uint8_t *data() const override {
+        return (const uint8_t *)m_base;
+    }
+
+    size_t size() const override {
+        return m_size;
+    }
+
+private:
+    void *m_base;
+    size_t m_size;
+};
+
+Result<std::unique_ptr<MappedFile>, reimu::OSError> map_file(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return ERR(errno);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int e = errno;
+        ::close(fd);
+        return ERR(e);
+    }
+
+    // Cannot map an empty file
+    if (st.st_size == 0) {
+        ::close(fd);
+        return ERR(EINVAL);
+    }
+
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping holds its own reference to the file
+    ::close(fd);
+
+    if (base == MAP_FAILED) {
+        return ERR(errno);
+    }
+
+    return OK(std::make_unique<UNIXMappedFile>(base, st.st_size));
+}
+
+Result<void, reimu::OSError> replace_file(const std::string &path, const void *data, size_t size) {
+    // A unique name, so writers of the same path don't share one temporary file
+    std::string temp_path = path + ".XXXXXX";
+
+    int fd = mkstemp(temp_path.data());
+    if (fd < 0) {
+        return ERR(errno);
+    }
+
+    // mkstemp creates the file readable only by its owner
+    fchmod(fd, 0644);
+
+    auto *p = (const uint8_t *)data;
+    while (size > 0) {
+        auto written = ::write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            int e = errno;
+            ::close(fd);
+            unlink(temp_path.c_str());
+            return ERR(e);
+        }
+
+        p += written;
+        size -= written;
+    }
+
+    ::close(fd);
+
+    if (rename(temp_path.c_str(), path.c_str()) < 0) {
+        int e = errno;
+        unlink(temp_path.c_str());
+        return ERR(e);
+    }
+
+    return OK();
+}
+
+}
@@ -31,7 +31,10 @@ Result<void, OSError> make_path(const std::string &path, int mode) {
 
             parent = parent.substr(0, sep_pos);
 
-            return make_path(std::string{parent}, mode);
+            TRY(make_path(std::string{parent}, mode));
+
+            // Parent exists now so try again
+            return make_path(path, mode);
         }
 
         return ERR(errno);
@@ -49,6 +52,19 @@ Result<std::string, OSError> default_shell_path() {
     return OK(std::string{path});
 }
 
+Result<std::string, OSError> cache_path() {
+    if (auto path = getenv("XDG_CACHE_HOME"); path && *path) {
+        return OK(std::string{path} + "/reimu");
+    }
+
+    auto home = getenv("HOME");
+    if (home == nullptr) {
+        return ERR(OSError{ENOENT});
+    }
+
+    return OK(std::string{home} + "/.cache/reimu");
+}
+
 reimu::Result<size_t, reimu::OSError> write(os_handle_t handle, const void *buffer, size_t size) {
     auto ret = ::write(handle, buffer, size);
     if (ret < 0) {
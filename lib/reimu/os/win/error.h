@@ -0,0 +1,51 @@
+#pragma once
+
+#include <reimu/os/error.h>
+
+#include <errno.h>
+
+#include <windows.h>
+
+namespace reimu::os {
+
+// OSError holds an errno value, so Win32 error codes are mapped to the nearest one
+inline int win32_error_to_errno(DWORD error) {
+    switch (error) {
+    case ERROR_FILE_NOT_FOUND:
+    case ERROR_PATH_NOT_FOUND:
+    case ERROR_INVALID_DRIVE:
+        return ENOENT;
+    case ERROR_ACCESS_DENIED:
+    case ERROR_SHARING_VIOLATION:
+    case ERROR_LOCK_VIOLATION:
+        return EACCES;
+    case ERROR_FILE_EXISTS:
+    case ERROR_ALREADY_EXISTS:
+        return EEXIST;
+    case ERROR_NOT_ENOUGH_MEMORY:
+    case ERROR_OUTOFMEMORY:
+        return ENOMEM;
+    case ERROR_DISK_FULL:
+    case ERROR_HANDLE_DISK_FULL:
+        return ENOSPC;
+    case ERROR_TOO_MANY_OPEN_FILES:
+        return EMFILE;
+    case ERROR_INVALID_HANDLE:
+        return EBADF;
+    case ERROR_INVALID_PARAMETER:
+    case ERROR_FILE_INVALID:
+        return EINVAL;
+    case ERROR_NOT_SUPPORTED:
+    case ERROR_CALL_NOT_IMPLEMENTED:
+        return ENOSYS;
+    default:
+        return EIO;
+    }
+}
+
+// Error of the last failed Win32 call on this thread
+inline OSError last_win32_error() {
+    return OSError{ win32_error_to_errno(GetLastError()) };
+}
+
+}
@@ -3,12 +3,19 @@
 #include <reimu/core/file.h>
 
 #include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+#include "error.h"
 
 namespace reimu::os {
 
 class Win32File : public File {
 public:
-    Win32File(FILE *fd, FileMode mode) : m_fd{fd}, m_mode{mode} {
+    Win32File(FILE *fd, FileMode mode, std::string path) : m_fd{fd}, m_mode{mode}, m_path{std::move(path)} {
         
     }
 
@@ -89,10 +96,24 @@ public:
 
         return sz;
     }
+
+    const std::string &path() const override {
+        return m_path;
+    }
+
+    uint64_t modified_time() override {
+        struct _stat64 st;
+        if (_fstat64(_fileno(m_fd), &st) < 0) {
+            return 0;
+        }
+
+        return (uint64_t)st.st_mtime * 1000000000;
+    }
     
 private:
     FILE *m_fd;
     FileMode m_mode;
+    std::string m_path;
 
     size_t m_off = 0;
 };
@@ -116,9 +137,113 @@ Result<std::unique_ptr<File>, reimu::OSError> open(const std::string &path, File
         return ERR(errno);
     }
 
-    auto file = std::make_unique<Win32File>(fd, mode);
+    auto file = std::make_unique<Win32File>(fd, mode, path);
 
     return OK(std::move(file));
 }
 
-}
\ No newline at end of file
+class Win32MappedFile : public MappedFile {
+public:
+    Win32MappedFile(HANDLE mapping, const void *base, size_t size)
+        : m_mapping{mapping}, m_base{base}, m_size{size} {}
+
+    ~Win32MappedFile() override {
+        UnmapViewOfFile(m_base);
+        CloseHandle(m_mapping);
+    }
+
+    const uint8_t *data() const override {
+        return (const uint8_t *)m_base;
+    }
+
+    size_t size() const override {
+        return m_size;
+    }
+
+private:
+    HANDLE m_mapping;
+    const void *m_base;
+    size_t m_size;
+};
+
+Result<std::unique_ptr<MappedFile>, reimu::OSError> map_file(const std::string &path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return ERR(last_win32_error());
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        auto error = last_win32_error();
+        CloseHandle(file);
+        return ERR(error);
+    }
+
+    // Cannot map an empty file
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return ERR(EINVAL);
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        auto error = last_win32_error();
+        CloseHandle(file);
+        return ERR(error);
+    }
+
+    // The mapping holds its own reference to the file
+    CloseHandle(file);
+
+    const void *base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (base == nullptr) {
+        auto error = last_win32_error();
+        CloseHandle(mapping);
+        return ERR(error);
+    }
+
+    return OK(std::make_unique<Win32MappedFile>(mapping, base, (size_t)size.QuadPart));
+}
+
+Result<void, reimu::OSError> replace_file(const std::string &path, const void *data, size_t size) {
+    static std::atomic<uint32_t> counter = 0;
+
+    // A unique name, so writers of the same path don't share one temporary file
+    std::string temp_path;
+    HANDLE file;
+    do {
+        temp_path = path + "." + std::to_string(GetCurrentProcessId()) + "." + std::to_string(counter++) + ".tmp";
+        file = CreateFileA(temp_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+    } while (file == INVALID_HANDLE_VALUE && GetLastError() == ERROR_FILE_EXISTS);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return ERR(last_win32_error());
+    }
+
+    auto *p = (const uint8_t *)data;
+    while (size > 0) {
+        DWORD written;
+        if (!WriteFile(file, p, (DWORD)std::min<size_t>(size, 1 << 30), &written, nullptr)) {
+            auto error = last_win32_error();
+            CloseHandle(file);
+            DeleteFileA(temp_path.c_str());
+            return ERR(error);
+        }
+
+        p += written;
+        size -= written;
+    }
+
+    CloseHandle(file);
+
+    if (!MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        auto error = last_win32_error();
+        DeleteFileA(temp_path.c_str());
+        return ERR(error);
+    }
+
+    return OK();
+}
+
+}
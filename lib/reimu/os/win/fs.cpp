@@ -5,6 +5,8 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 
+#include "error.h"
+
 namespace reimu::os {
 
 Result<void, OSError> make_path(const std::string &path, int mode) {
@@ -15,10 +17,19 @@ reimu::Result<std::string, reimu::OSError> default_shell_path() {
     return {"C:\\Windows\\System32\\cmd.exe"};
 }
 
+reimu::Result<std::string, reimu::OSError> cache_path() {
+    auto path = getenv("LOCALAPPDATA");
+    if (path == nullptr) {
+        return ERR(reimu::OSError{ENOENT});
+    }
+
+    return OK(std::string{path} + "\\reimu");
+}
+
 reimu::Result<size_t, reimu::OSError> write(os_handle_t handle, const void *buffer, size_t size) {
     DWORD written;
     if (!WriteFile(handle, buffer, size, &written, nullptr)) {
-        return ERR(reimu::OSError{GetLastError()});
+        return ERR(last_win32_error());
     }
 
     return OK(written);
@@ -26,7 +37,7 @@ reimu::Result<size_t, reimu::OSError> write(os_handle_t handle, const void *buff
 
 reimu::Result<void, reimu::OSError> close(os_handle_t handle) {
     if (!CloseHandle(handle)) {
-        return ERR(reimu::OSError{GetLastError()});
+        return ERR(last_win32_error());
     }
 
     return OK();
@@ -0,0 +1,286 @@
+#include <reimu/graphics/software_renderer.h>
+#include <reimu/graphics/surface.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <memory>
+#include <vector>
+
+#include "../gui/compositor.h"
+#include "null_texture.h"
+
+// Checks which pieces of each clip the compositor draws: clips hidden by opaque
+// clips above them are skipped or split, clips split too far are drawn whole,
+// and neighbouring pieces of the same texture are drawn as one
+
+using namespace reimu;
+using namespace reimu::graphics;
+using namespace reimu::gui;
+
+static const Vector2i viewport_size = {100, 100};
+
+static Recti to_rect(const Vector4f &v) {
+    return { (int)v.x, (int)v.y, (int)v.z, (int)v.w };
+}
+
+struct DrawnPiece {
+    Texture *tex;
+    Recti source;
+    Recti target;
+};
+
+// Records the instances drawn, in order
+class RecordingPass final : public RenderPass {
+public:
+    void bind_texture(int, Texture *texture) override {
+        m_texture = texture;
+    }
+
+    void bind_uniform_buffer(int, const void *, size_t) override {}
+
+    void bind_storage_buffer(int, const void *data, size_t) override {
+        m_instances = (const Compositor::Instance *)data;
+    }
+
+    void draw(int) override {}
+
+    void draw_instanced(int, int num_instances, int first_instance) override {
+        for (int i = first_instance; i < first_instance + num_instances; i++) {
+            const auto &instance = m_instances[i];
+
+            pieces.push_back(DrawnPiece {
+                .tex = m_texture,
+                .source = to_rect(instance.source),
+                .target = to_rect(instance.target),
+            });
+        }
+    }
+
+    void set_strategy(RenderStrategy *) override {}
+
+    std::vector<DrawnPiece> pieces;
+
+private:
+    Texture *m_texture = nullptr;
+    const Compositor::Instance *m_instances = nullptr;
+};
+
+class Scene {
+public:
+    Scene() : m_renderer(viewport_size), m_compositor(&m_renderer) {}
+
+    // Surface which is opaque within 'opaque'
+    Surface *create(const Vector2i &size, const Recti &opaque) {
+        auto &surface = m_surfaces.emplace_back(std::make_unique<Surface>(new NullTexture(size)));
+        surface->set_opaque_rect(opaque);
+
+        return surface.get();
+    }
+
+    // Add the whole of a new surface at 'dest'
+    Surface *add(const Recti &dest, const Recti &opaque) {
+        Surface *surface = create(dest.size(), opaque);
+        add_clip(surface, Recti::from_size({0, 0}, dest.size()), dest.top_left());
+
+        return surface;
+    }
+
+    void add_clip(Surface *surface, const Recti &source, const Vector2i &dest) {
+        m_compositor.get_add_clip_fn()(source, dest, surface);
+    }
+
+    std::vector<DrawnPiece> draw() {
+        RecordingPass pass;
+        m_compositor.draw(m_renderer, pass);
+
+        return pass.pieces;
+    }
+
+private:
+    SoftwareRenderer m_renderer;
+    Compositor m_compositor;
+
+    std::vector<std::unique_ptr<Surface>> m_surfaces;
+};
+
+static bool same_rect(const Recti &a, const Recti &b) {
+    return a.top_left() == b.top_left() && a.size() == b.size();
+}
+
+static bool overlaps(const Recti &a, const Recti &b) {
+    return !a.intersect(b).is_empty();
+}
+
+// Pieces of a clip must not overlap each other or 'hidden', and must cover the rest of 'target'
+static void check_covers(const std::vector<DrawnPiece> &pieces, const Recti &target, const Recti &hidden) {
+    int area = 0;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        assert(same_rect(pieces[i].target.intersect(target), pieces[i].target));
+        assert(!overlaps(pieces[i].target, hidden));
+
+        for (size_t j = i + 1; j < pieces.size(); j++) {
+            assert(!overlaps(pieces[i].target, pieces[j].target));
+        }
+
+        area += pieces[i].target.area();
+    }
+
+    assert(area == target.area() - target.intersect(hidden).area());
+}
+
+static std::vector<DrawnPiece> pieces_of(const std::vector<DrawnPiece> &pieces, Surface *surface) {
+    std::vector<DrawnPiece> found;
+    for (const auto &piece : pieces) {
+        if (piece.tex == &surface->texture()) {
+            found.push_back(piece);
+        }
+    }
+
+    return found;
+}
+
+static void test_full_occlusion() {
+    Scene scene;
+    Surface *below = scene.add({10, 10, 50, 50}, {0, 0, 40, 40});
+    Surface *above = scene.add({0, 0, 60, 60}, {0, 0, 60, 60});
+
+    auto pieces = scene.draw();
+    assert(pieces.size() == 1);
+    assert(pieces[0].tex == &above->texture());
+    assert(pieces_of(pieces, below).empty());
+
+    // Translucent clips hide nothing
+    Scene translucent;
+    translucent.add({10, 10, 50, 50}, {});
+    translucent.add({0, 0, 60, 60}, {});
+    assert(translucent.draw().size() == 2);
+}
+
+static void test_partial_occlusion() {
+    // A hole in the middle leaves the full width above and below it, then either side
+    Scene scene;
+    Recti target = {0, 0, 40, 40};
+    Recti hole = {10, 10, 20, 20};
+
+    Surface *below = scene.add(target, {0, 0, 40, 40});
+    Surface *above = scene.add(hole, {0, 0, 10, 10});
+
+    auto pieces = scene.draw();
+    auto below_pieces = pieces_of(pieces, below);
+
+    assert(below_pieces.size() == 4);
+    check_covers(below_pieces, target, hole);
+
+    size_t full_width = 0;
+    for (const auto &piece : below_pieces) {
+        full_width += piece.target.width() == target.width();
+    }
+    assert(full_width == 2);
+
+    // Drawn back to front, with pieces drawn from where they are in the surface
+    assert(pieces.back().tex == &above->texture());
+    for (const auto &piece : below_pieces) {
+        assert(same_rect(piece.source, piece.target));
+    }
+
+    // A hole across the full width only leaves the parts above and below it
+    Scene across;
+    below = across.add(target, {});
+    across.add({0, 10, 40, 20}, {0, 0, 40, 10});
+
+    below_pieces = pieces_of(across.draw(), below);
+    assert(below_pieces.size() == 2);
+    check_covers(below_pieces, target, {0, 10, 40, 20});
+
+    // Only the opaque part of a clip hides what is below
+    Scene partly_opaque;
+    below = partly_opaque.add(target, {});
+    partly_opaque.add({10, 0, 50, 40}, {10, 0, 40, 40});
+
+    below_pieces = pieces_of(partly_opaque.draw(), below);
+    assert(below_pieces.size() == 1);
+    assert(same_rect(below_pieces[0].target, {0, 0, 20, 40}));
+}
+
+static void test_split_bound() {
+    Scene scene;
+    Recti target = {0, 0, 90, 90};
+    Surface *below = scene.add(target, {});
+
+    // Two holes split the clip into up to 8 pieces
+    scene.add({10, 10, 20, 20}, {0, 0, 10, 10});
+    scene.add({50, 50, 60, 60}, {0, 0, 10, 10});
+
+    auto below_pieces = pieces_of(scene.draw(), below);
+    assert(below_pieces.size() > 1 && below_pieces.size() <= 8);
+
+    int area = 0;
+    for (const auto &piece : below_pieces) {
+        assert(!overlaps(piece.target, {10, 10, 20, 20}));
+        assert(!overlaps(piece.target, {50, 50, 60, 60}));
+
+        area += piece.target.area();
+    }
+    assert(area == target.area() - 200);
+
+    // A third hole would split it further, so it is drawn whole
+    scene.add({70, 20, 80, 30}, {0, 0, 10, 10});
+
+    below_pieces = pieces_of(scene.draw(), below);
+    assert(below_pieces.size() == 1);
+    assert(same_rect(below_pieces[0].target, target));
+    assert(same_rect(below_pieces[0].source, target));
+}
+
+static void test_merging() {
+    // Parts of one surface drawn where they are in it become one piece
+    Scene scene;
+    Surface *surface = scene.create({40, 60}, {});
+    scene.add_clip(surface, {0, 0, 40, 40}, {0, 0});
+    scene.add_clip(surface, {0, 40, 40, 60}, {0, 40});
+
+    auto pieces = scene.draw();
+    assert(pieces.size() == 1);
+    assert(same_rect(pieces[0].target, {0, 0, 40, 60}));
+    assert(same_rect(pieces[0].source, {0, 0, 40, 60}));
+
+    // Parts moved relative to each other are drawn separately
+    Scene moved;
+    surface = moved.add({0, 0, 40, 40}, {});
+    moved.add_clip(surface, {0, 0, 40, 20}, {0, 40});
+
+    pieces = moved.draw();
+    assert(pieces.size() == 2);
+
+    // Pieces of a clip split around a hole join up again beside it
+    Scene split;
+    Surface *below = split.add({0, 0, 40, 40}, {});
+    split.add({30, 10, 40, 20}, {0, 0, 10, 10});
+
+    auto below_pieces = pieces_of(split.draw(), below);
+    assert(below_pieces.size() == 3);
+    check_covers(below_pieces, {0, 0, 40, 40}, {30, 10, 40, 20});
+
+    // Neighbours in the list are only merged when nothing is drawn between them
+    Scene between;
+    surface = between.create({60, 40}, {});
+    between.add_clip(surface, {0, 0, 40, 40}, {0, 0});
+    Surface *other = between.add({60, 0, 80, 20}, {});
+    between.add_clip(surface, {40, 0, 60, 40}, {40, 0});
+
+    pieces = between.draw();
+    assert(pieces.size() == 3);
+    assert(pieces[1].tex == &other->texture());
+}
+
+int main() {
+    test_full_occlusion();
+    test_partial_occlusion();
+    test_split_bound();
+    test_merging();
+
+    printf("compositor: ok\n");
+
+    return 0;
+}
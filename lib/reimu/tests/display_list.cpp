@@ -0,0 +1,338 @@
+#include <reimu/graphics/display_list.h>
+#include <reimu/graphics/font.h>
+#include <reimu/graphics/surface.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "null_texture.h"
+
+// Checks tiled rasterization matches drawing in order, that glyphs are composited
+// onto premultiplied surfaces correctly, that redrawing only
+// the regions which changed matches drawing everything, that opaque rects
+// are opaque once drawn, and measures
+// how full window repaints scale with the number of threads
+// usage: display_list [max threads]
+
+using namespace reimu;
+using namespace reimu::graphics;
+
+static std::vector<uint8_t> glyph_bitmap;
+static Glyph glyphs[16];
+
+static void make_glyphs(std::mt19937 &rng) {
+    glyph_bitmap.resize(24 * 24 * 16);
+    for (auto &b : glyph_bitmap) {
+        // Mix of empty, partial and full coverage
+        int r = rng() % 4;
+        b = r == 0 ? 0 : r == 1 ? 0xff : rng();
+    }
+
+    for (int i = 0; i < 16; i++) {
+        glyphs[i] = { (uint32_t)i, glyph_bitmap.data() + i * 24 * 24, 6 + i, 24, 0, 0, 8 };
+    }
+}
+
+// A window's worth of widgets: background gradient, panels, translucent overlays, lines and text.
+// Panel 'changed_panel' gets a different color, as if one widget changed.
+static void record_window(DisplayList &list, const Vector2i &size, std::mt19937 &rng, int changed_panel = -1) {
+    Recti bounds = Recti::from_size({0, 0}, size);
+
+    list.gradient_rect(bounds, Color(192, 0, 100), Color(64, 32, 128), {0, 0}, {(float)size.x, 500});
+
+    for (int i = 0; i < 200; i++) {
+        Vector2i pos = { (int)(rng() % size.x), (int)(rng() % size.y) };
+        Recti rect = Recti::from_size(pos, { (int)(rng() % 600) + 1, (int)(rng() % 300) + 1 }).intersect(bounds);
+
+        switch (i % 4) {
+        case 0:
+        case 1: {
+            Color color(rng());
+            if (i == changed_panel) {
+                color.value = ~color.value;
+            }
+
+            list.fill_rect(rect, color);
+            break;
+        }
+        case 2:
+            list.blend_rect(rect, Color(rng()));
+            break;
+        case 3:
+            list.gradient_rect(rect, Color(rng()), Color(rng()), vector_static_cast<float>(pos),
+                { (float)(pos.x + rng() % 400), (float)(pos.y + rng() % 400) });
+            break;
+        }
+    }
+
+    // Thin and wide lines crossing tile edges
+    for (int i = 0; i < 40; i++) {
+        Vector2f a = { (float)(rng() % (size.x + 100)) - 50, (float)(rng() % (size.y + 100)) - 50 };
+        Vector2f b = { (float)(rng() % (size.x + 100)) - 50, (float)(rng() % (size.y + 100)) - 50 };
+
+        list.draw_line(a, b, Color(rng()), i % 2 ? 1.f : (float)(rng() % 8 + 2), bounds);
+    }
+
+    // Tiled images crossing tile edges
+    static auto image = [&]() {
+        auto surface = std::make_shared<Surface>(Vector2i{ 37, 23 });
+        for (int y = 0; y < 23; y++) {
+            for (int x = 0; x < 37; x++) {
+                ((uint32_t *)(surface->buffer() + y * surface->stride()))[x] = rng();
+            }
+        }
+
+        return surface;
+    }();
+
+    for (int i = 0; i < 20; i++) {
+        Recti rect = Recti::from_size({ (int)(rng() % size.x) - 50, (int)(rng() % size.y) - 50 },
+            { (int)(rng() % 500) + 1, (int)(rng() % 300) + 1 });
+        Recti source = Recti::from_size({ (int)(rng() % 30), (int)(rng() % 20) },
+            { (int)(rng() % 7) + 1, (int)(rng() % 3) + 1 });
+
+        list.copy_image(rect, image, source, bounds);
+    }
+
+    std::vector<PositionedGlyph> line;
+    for (int y = 0; y < size.y; y += 20) {
+        line.clear();
+        for (int x = 0; x < size.x; x += 9) {
+            line.push_back({ &glyphs[rng() % 16], { x, y } });
+        }
+
+        list.draw_glyphs(line, Color(rng()), bounds);
+    }
+}
+
+static void test_identical() {
+    std::mt19937 rng(7);
+
+    for (Vector2i size : { Vector2i{ 1000, 700 }, Vector2i{ 100, 50 }, Vector2i{ 257, 65 } }) {
+        Surface serial{new NullTexture(size)};
+        Surface tiled{new NullTexture(size)};
+
+        DisplayList list;
+        record_window(list, size, rng);
+
+        list.rasterize(serial);
+
+        for (unsigned threads : { 1u, 2u, 0u }) {
+            memset(tiled.buffer(), 0, tiled.stride() * size.y);
+            list.rasterize_tiled(tiled, threads);
+
+            assert(memcmp(serial.buffer(), tiled.buffer(), serial.stride() * size.y) == 0);
+        }
+    }
+}
+
+static uint32_t div255(uint32_t x) {
+    return (x + 128 + ((x + 128) >> 8)) >> 8;
+}
+
+static void test_glyph_coverage() {
+    std::mt19937 rng(5);
+    Vector2i size = { 61, 37 };
+
+    Surface surface{new NullTexture(size)};
+    std::vector<uint32_t> expected(size.x * size.y);
+
+    for (int i = 0; i < 200; i++) {
+        // Random premultiplied pixels
+        uint32_t *pixels = (uint32_t *)surface.buffer();
+        for (int p = 0; p < size.x * size.y; p++) {
+            Color c(rng());
+            pixels[p] = c.premultiplied().value;
+        }
+
+        memcpy(expected.data(), pixels, expected.size() * 4);
+
+        Color color = i % 4 == 0 ? Color(rng() | 0xff000000) : Color(rng());
+        uint32_t src = color.premultiplied().value;
+
+        PositionedGlyph glyph = { &glyphs[rng() % 16], { (int)(rng() % 70) - 10, (int)(rng() % 40) - 10 } };
+
+        DisplayList list;
+        list.draw_glyphs({ &glyph, 1 }, color, Recti::from_size({0, 0}, size));
+        list.rasterize(surface);
+
+        for (int y = 0; y < size.y; y++) {
+            for (int x = 0; x < size.x; x++) {
+                int gx = x - glyph.pos.x;
+                int gy = y - glyph.pos.y;
+                if (gx < 0 || gy < 0 || gx >= glyph.glyph->width || gy >= glyph.glyph->rows) {
+                    continue;
+                }
+
+                uint32_t coverage = glyph.glyph->bitmap[gy * glyph.glyph->width + gx];
+                uint32_t src_alpha = div255((src >> 24) * coverage);
+
+                uint32_t &d = expected[y * size.x + x];
+                uint32_t result = 0;
+                for (int shift = 0; shift < 32; shift += 8) {
+                    uint32_t c = div255(((src >> shift) & 0xff) * coverage);
+                    result |= (c + div255(((d >> shift) & 0xff) * (255 - src_alpha))) << shift;
+                }
+
+                d = result;
+            }
+        }
+
+        assert(memcmp(expected.data(), pixels, expected.size() * 4) == 0);
+    }
+}
+
+static void test_retained() {
+    Vector2i size = { 1000, 700 };
+
+    DisplayList previous;
+    DisplayList current;
+
+    std::mt19937 rng(9);
+    record_window(previous, size, rng);
+    rng.seed(9);
+    record_window(current, size, rng, 40);
+
+    Surface expected{new NullTexture(size)};
+    current.rasterize(expected);
+
+    std::vector<Recti> damage;
+    current.diff(previous, damage);
+
+    assert(!damage.empty());
+
+    long damaged_area = 0;
+    for (size_t i = 0; i < damage.size(); i++) {
+        damaged_area += damage[i].area();
+
+        for (size_t j = i + 1; j < damage.size(); j++) {
+            assert(damage[i].intersect(damage[j]).is_empty());
+        }
+    }
+
+    assert(damaged_area < size.x * size.y);
+
+    // Redraw over what the previous list drew
+    for (bool tiled : { false, true }) {
+        Surface surface{new NullTexture(size)};
+        previous.rasterize(surface);
+
+        if (tiled) {
+            current.rasterize_tiled(surface, damage);
+        } else {
+            current.rasterize(surface, damage);
+        }
+
+        assert(memcmp(expected.buffer(), surface.buffer(), expected.stride() * size.y) == 0);
+    }
+
+    // Nothing changed, nothing to draw
+    damage.clear();
+    previous.diff(previous, damage);
+    assert(damage.empty());
+}
+
+static void test_opaque_rect() {
+    std::mt19937 rng(11);
+    Vector2i size = { 300, 200 };
+    Recti bounds = Recti::from_size({0, 0}, size);
+
+    for (auto alpha_mode : { AlphaMode::Premultiplied, AlphaMode::Straight }) {
+        // Like a widget, with an opaque background under text, lines and a translucent panel
+        DisplayList list;
+        list.fill_rect(bounds, Color(rng() | 0xff000000));
+        list.blend_rect({ 20, 20, 120, 80 }, Color(40, 40, 40, 128));
+        list.draw_line({ 10, 150 }, { 290, 190 }, Color(rng()), 3, bounds);
+
+        std::vector<PositionedGlyph> line;
+        for (int x = 0; x < size.x; x += 9) {
+            line.push_back({ &glyphs[rng() % 16], { x, 100 } });
+        }
+
+        list.draw_glyphs(line, Color(rng()), bounds);
+
+        // A transparent hole
+        list.blend_rect({ 250, 0, 300, 200 }, Color(0, 0, 0, 0), BlendMode::Clear);
+
+        Recti opaque = list.opaque_rect(alpha_mode);
+        assert(!opaque.is_empty());
+        assert(opaque.z <= 250);
+
+        if (alpha_mode == AlphaMode::Premultiplied) {
+            assert(opaque.x == 0 && opaque.y == 0 && opaque.w == size.y);
+        }
+
+        Surface surface{new NullTexture(size)};
+        surface.set_alpha_mode(alpha_mode);
+        list.rasterize(surface);
+
+        for (int y = opaque.y; y < opaque.w; y++) {
+            const uint32_t *row = (const uint32_t *)(surface.buffer() + y * surface.stride());
+
+            for (int x = opaque.x; x < opaque.z; x++) {
+                assert(Color(row[x]).a == 0xff);
+            }
+        }
+    }
+
+    // Images may be transparent, so hide what they cover
+    DisplayList list;
+    list.fill_rect(bounds, Color(0, 0, 0));
+
+    auto image = std::make_shared<Surface>(Vector2i{ 4, 4 });
+    list.copy_image({ 0, 0, 300, 50 }, image, { 0, 0, 4, 4 }, bounds);
+
+    Recti opaque = list.opaque_rect(AlphaMode::Premultiplied);
+    assert(opaque.y == 50 && opaque.w == size.y);
+}
+
+static void benchmark(const Vector2i &size, unsigned max_threads) {
+    std::mt19937 rng(11);
+
+    Surface surface{new NullTexture(size)};
+
+    DisplayList list;
+    record_window(list, size, rng);
+
+    printf("%dx%d full window repaint\n", size.x, size.y);
+
+    double single = 0;
+    for (unsigned threads = 1; threads <= max_threads; threads++) {
+        const int iterations = 20;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            list.rasterize_tiled(surface, threads);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+        if (threads == 1) {
+            single = ms;
+        }
+
+        printf("%2u threads: %7.2f ms (%.2fx)\n", threads, ms, single / ms);
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned max_threads = argc > 1 ? atoi(argv[1]) : std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::mt19937 rng(3);
+    make_glyphs(rng);
+
+    test_identical();
+    test_glyph_coverage();
+    test_retained();
+    test_opaque_rect();
+
+    benchmark({1920, 1080}, max_threads);
+    benchmark({3840, 2160}, max_threads);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <reimu/graphics/font.h>
+#include <reimu/os/fs.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Compares time to first use of a font with and without the on-disk glyph cache,
+// and checks glyphs are rasterized again when the cache files are stale or corrupt
+// usage: glyph_cache [font path] [cache dir]
+
+using namespace reimu;
+
+static const int sizes[] = { 12, 16, 24 };
+
+static std::unique_ptr<graphics::Font> load_font(const char *path) {
+    auto file = os::open(path, FileMode::ReadOnly).ensure();
+    return std::unique_ptr<graphics::Font>{ graphics::Font::create(*file).ensure() };
+}
+
+// Gets every printable Latin-1 glyph at each size, returns the time taken in microseconds
+static double warm_glyphs(graphics::Font &font, std::vector<const graphics::Glyph *> &glyphs) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (int size : sizes) {
+        for (uint32_t c = 0x20; c < 0x100; c++) {
+            if (c >= 0x7f && c < 0xa0) {
+                continue;
+            }
+
+            glyphs.push_back(font.get_glyph(c, size, false));
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// Glyphs from the cache should be identical to freshly rasterized ones
+static void check_same_glyphs(const std::vector<const graphics::Glyph *> &expected,
+        const std::vector<const graphics::Glyph *> &glyphs) {
+    assert(expected.size() == glyphs.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        auto *a = expected[i];
+        auto *b = glyphs[i];
+
+        assert(a->index == b->index && a->advance == b->advance);
+        assert(a->width == b->width && a->rows == b->rows);
+        assert(a->left == b->left && a->top == b->top);
+        assert(!a->width || !memcmp(a->bitmap, b->bitmap, a->width * a->rows));
+    }
+}
+
+// Compare glyphs loaded with the disk cache, which is written back when the font is destroyed
+static void check_cached_glyphs(const char *font_path, const std::string &cache_dir,
+        const std::vector<const graphics::Glyph *> &expected) {
+    std::vector<const graphics::Glyph *> glyphs;
+
+    auto font = load_font(font_path);
+    font->enable_disk_cache(cache_dir);
+    warm_glyphs(*font, glyphs);
+
+    check_same_glyphs(expected, glyphs);
+}
+
+// Change every cache file in 'cache_dir', then check glyphs still come out the same
+template<typename ChangeFn>
+static void check_damaged_cache(const char *font_path, const std::string &cache_dir,
+        const std::vector<const graphics::Glyph *> &expected, ChangeFn change) {
+    for (const auto &entry : std::filesystem::directory_iterator(cache_dir)) {
+        if (entry.path().extension() != ".glyphs") {
+            continue;
+        }
+
+        std::string data;
+        {
+            std::ifstream file(entry.path(), std::ios::binary);
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
+        change(data);
+
+        std::ofstream file(entry.path(), std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+    }
+
+    // The damaged files are ignored, then replaced by ones which load
+    check_cached_glyphs(font_path, cache_dir, expected);
+    check_cached_glyphs(font_path, cache_dir, expected);
+}
+
+int main(int argc, char **argv) {
+    const char *font_path = argc > 1 ? argv[1] : "font.ttf";
+    std::string cache_dir = argc > 2 ? argv[2] : "glyph_cache_bench";
+
+    std::vector<const graphics::Glyph *> cold_glyphs;
+    auto cold_font = load_font(font_path);
+    double cold_time = warm_glyphs(*cold_font, cold_glyphs);
+
+    // Populate the cache
+    {
+        std::vector<const graphics::Glyph *> glyphs;
+        auto font = load_font(font_path);
+        font->enable_disk_cache(cache_dir);
+
+        warm_glyphs(*font, glyphs);
+        font->store_disk_cache();
+    }
+
+    std::vector<const graphics::Glyph *> cached_glyphs;
+    auto cached_font = load_font(font_path);
+    cached_font->enable_disk_cache(cache_dir);
+    double cached_time = warm_glyphs(*cached_font, cached_glyphs);
+
+    check_same_glyphs(cold_glyphs, cached_glyphs);
+
+    // Written by an older version, which is stale rather than corrupt
+    check_damaged_cache(font_path, cache_dir, cold_glyphs, [](std::string &data) {
+        data[4] ^= 0xff;
+    });
+
+    // A changed bitmap byte fails the checksum
+    check_damaged_cache(font_path, cache_dir, cold_glyphs, [](std::string &data) {
+        data.back() ^= 0x55;
+    });
+
+    check_damaged_cache(font_path, cache_dir, cold_glyphs, [](std::string &data) {
+        data.resize(data.size() / 2);
+    });
+
+    check_damaged_cache(font_path, cache_dir, cold_glyphs, [](std::string &data) {
+        data.resize(16);
+    });
+
+    printf("%zu glyphs\n", cold_glyphs.size());
+    printf("rasterized: %10.1f us\n", cold_time);
+    printf("disk cache: %10.1f us (%.1fx)\n", cached_time, cold_time / cached_time);
+
+    return 0;
+}
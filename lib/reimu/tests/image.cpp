@@ -0,0 +1,279 @@
+#include <reimu/core/resource_manager.h>
+#include <reimu/graphics/image.h>
+#include <reimu/graphics/painter.h>
+#include <reimu/os/fs.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "null_texture.h"
+
+// Checks the image decoders and decoded cache, then compares decoding with mapping the cache
+
+using namespace reimu;
+using namespace reimu::graphics;
+
+// Straight alpha test image, with flat areas so QOI uses every op
+static std::vector<uint32_t> make_pixels(const Vector2i &size, std::mt19937 &rng, bool is_opaque) {
+    std::vector<uint32_t> pixels(size.x * size.y);
+
+    Color color(0, 0, 0, 255);
+    for (auto &pixel : pixels) {
+        switch (rng() % 8) {
+        case 0:
+            color.value = rng();
+            break;
+        case 1:
+            color.r += rng() % 3 - 1;
+            color.b += rng() % 3 - 1;
+            break;
+        case 2:
+            color.g += rng() % 40 - 20;
+            color.r += rng() % 10 - 5;
+            break;
+        default:
+            break;
+        }
+
+        if (is_opaque) {
+            color.a = 255;
+        }
+
+        pixel = color.value;
+    }
+
+    return pixels;
+}
+
+static void put_be32(std::vector<uint8_t> &out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(value >> shift);
+    }
+}
+
+// Reference QOI encoder, following the specification
+static std::vector<uint8_t> encode_qoi(const std::vector<uint32_t> &pixels, const Vector2i &size) {
+    std::vector<uint8_t> out = { 'q', 'o', 'i', 'f' };
+    put_be32(out, size.x);
+    put_be32(out, size.y);
+    out.push_back(4);
+    out.push_back(0);
+
+    Color index[64] = {};
+    Color prev(0, 0, 0, 255);
+    int run = 0;
+
+    for (size_t i = 0; i < pixels.size(); i++) {
+        Color px(pixels[i]);
+
+        if (px.value == prev.value) {
+            run++;
+            if (run == 62 || i + 1 == pixels.size()) {
+                out.push_back(0xc0 | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0) {
+            out.push_back(0xc0 | (run - 1));
+            run = 0;
+        }
+
+        int hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+        if (index[hash].value == px.value) {
+            out.push_back(hash);
+        } else if (px.a == prev.a) {
+            int8_t dr = px.r - prev.r;
+            int8_t dg = px.g - prev.g;
+            int8_t db = px.b - prev.b;
+            int8_t dr_dg = dr - dg;
+            int8_t db_dg = db - dg;
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                out.push_back(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+            } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                out.push_back(0x80 | (dg + 32));
+                out.push_back(((dr_dg + 8) << 4) | (db_dg + 8));
+            } else {
+                out.insert(out.end(), { 0xfe, px.r, px.g, px.b });
+            }
+        } else {
+            out.insert(out.end(), { 0xff, px.r, px.g, px.b, px.a });
+        }
+
+        index[hash] = px;
+        prev = px;
+    }
+
+    out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+    return out;
+}
+
+static std::vector<uint8_t> encode_ppm(const std::vector<uint32_t> &pixels, const Vector2i &size) {
+    std::string header = std::format("P6\n# reimu test\n{} {}\n255\n", size.x, size.y);
+
+    std::vector<uint8_t> out(header.begin(), header.end());
+    for (uint32_t pixel : pixels) {
+        Color c(pixel);
+        out.insert(out.end(), { c.r, c.g, c.b });
+    }
+
+    return out;
+}
+
+static void write_file(const std::string &path, const std::vector<uint8_t> &data) {
+    os::replace_file(path, data.data(), data.size()).ensure();
+}
+
+static std::unique_ptr<Image> load(const std::string &path, const std::string &cache_dir = "") {
+    auto file = os::open(path, FileMode::ReadOnly).ensure();
+    return std::unique_ptr<Image>{ Image::create(*file, cache_dir).ensure() };
+}
+
+static void check_pixels(const Image &image, const std::vector<uint32_t> &pixels, const Vector2i &size) {
+    assert(image.size() == size);
+
+    for (int y = 0; y < size.y; y++) {
+        auto *row = (const uint32_t *)(image.pixels() + y * image.stride());
+
+        for (int x = 0; x < size.x; x++) {
+            assert(row[x] == Color(pixels[y * size.x + x]).premultiplied().value);
+        }
+    }
+}
+
+static void test_decode(const std::string &dir) {
+    std::mt19937 rng(46);
+    Vector2i size = { 61, 37 };
+
+    auto pixels = make_pixels(size, rng, false);
+    write_file(dir + "/test.qoi", encode_qoi(pixels, size));
+    check_pixels(*load(dir + "/test.qoi"), pixels, size);
+
+    auto opaque = make_pixels(size, rng, true);
+    write_file(dir + "/test.ppm", encode_ppm(opaque, size));
+    check_pixels(*load(dir + "/test.ppm"), opaque, size);
+
+    // 16-bit grey samples are scaled down
+    std::string header = "P5 2 1 65535\n";
+    std::vector<uint8_t> grey(header.begin(), header.end());
+    grey.insert(grey.end(), { 0xff, 0xff, 0x80, 0x00 });
+    write_file(dir + "/grey.ppm", grey);
+
+    auto grey_image = load(dir + "/grey.ppm");
+    assert(((const uint32_t *)grey_image->pixels())[0] == 0xffffffff);
+    assert(((const uint32_t *)grey_image->pixels())[1] == Color(128, 128, 128).value);
+
+    // Truncated files fail rather than reading past the end
+    auto truncated = encode_ppm(opaque, size);
+    truncated.resize(truncated.size() - 1);
+    write_file(dir + "/truncated.ppm", truncated);
+
+    auto file = os::open(dir + "/truncated.ppm", FileMode::ReadOnly).ensure();
+    assert(Image::create(*file).is_err());
+
+    // Cached loads map the same pixels
+    std::string cache_dir = dir + "/cache";
+    auto decoded = load(dir + "/test.qoi", cache_dir);
+    assert(!decoded->is_mapped());
+
+    auto mapped = load(dir + "/test.qoi", cache_dir);
+    assert(mapped->is_mapped());
+    check_pixels(*mapped, pixels, size);
+
+    // Changing the source misses the cache, a different size so the key changes
+    // even where modification times are coarse
+    Vector2i changed_size = { 23, 19 };
+    auto changed = make_pixels(changed_size, rng, false);
+    write_file(dir + "/changed.qoi", encode_qoi(pixels, size));
+    assert(!load(dir + "/changed.qoi", cache_dir)->is_mapped());
+    assert(load(dir + "/changed.qoi", cache_dir)->is_mapped());
+
+    write_file(dir + "/changed.qoi", encode_qoi(changed, changed_size));
+    auto reloaded = load(dir + "/changed.qoi", cache_dir);
+    assert(!reloaded->is_mapped());
+    check_pixels(*reloaded, changed, changed_size);
+
+    // Resources loaded through a resource manager use its cache
+    ResourceManager res_mgr;
+    res_mgr.set_cache_dir(cache_dir);
+
+    auto resource = res_mgr.load_from_file<Image>(dir + "/test.qoi", "test_image"_hashid).ensure();
+    assert(resource->is_mapped());
+    assert(Resource::as<Image>(res_mgr.get("test_image"_hashid).ensure()).has_some());
+
+    // Sub-images share pixels, and draw like the same region of the whole image
+    std::shared_ptr<const Image> whole = std::move(mapped);
+    std::shared_ptr<const Image> icon = whole->sub_image(Recti::from_size({ 10, 5 }, { 16, 16 }));
+    assert(icon->size() == (Vector2i{ 16, 16 }));
+    assert(icon->pixels() == whole->pixels() + 5 * whole->stride() + 10 * 4);
+    assert(whole->sub_image({ 50, 30, 100, 100 })->size() == (Vector2i{ 11, 7 }));
+
+    Surface a{new NullTexture({ 40, 40 })};
+    Surface b{new NullTexture({ 40, 40 })};
+    memset(a.buffer(), 0, a.stride() * 40);
+    memset(b.buffer(), 0, b.stride() * 40);
+
+    Painter{a}.draw_image(Vector2f{ 3, 4 }, icon);
+    Painter{b}.draw_image({ 3, 4, 19, 20 }, whole, Recti::from_size({ 10, 5 }, { 16, 16 }));
+    assert(memcmp(a.buffer(), b.buffer(), a.stride() * 40) == 0);
+}
+
+static void benchmark(const std::string &dir) {
+    std::mt19937 rng(47);
+    Vector2i size = { 48, 48 };
+    static constexpr int icon_count = 200;
+
+    std::string cache_dir = dir + "/bench_cache";
+    for (int i = 0; i < icon_count; i++) {
+        auto pixels = make_pixels(size, rng, false);
+        write_file(std::format("{}/icon{}.qoi", dir, i), encode_qoi(pixels, size));
+    }
+
+    auto time_loads = [&](const std::string &cache) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < icon_count; i++) {
+            load(std::format("{}/icon{}.qoi", dir, i), cache);
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(end - start).count();
+    };
+
+    double decode_time = time_loads("");
+
+    // Populate the cache
+    time_loads(cache_dir);
+    double cached_time = time_loads(cache_dir);
+
+    printf("%d %dx%d icons\n", icon_count, size.x, size.y);
+    printf("decoded:      %10.1f us\n", decode_time);
+    printf("mapped cache: %10.1f us (%.1fx)\n", cached_time, decode_time / cached_time);
+}
+
+int main() {
+    // Every run starts with an empty cache, so the first load of each image decodes it
+    char temp_dir[] = "/tmp/reimu_image_XXXXXX";
+    if (!mkdtemp(temp_dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    std::string dir = temp_dir;
+
+    test_decode(dir);
+    benchmark(dir);
+
+    std::filesystem::remove_all(dir);
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <reimu/graphics/texture.h>
+
+#include <stdint.h>
+
+namespace reimu::graphics {
+
+// Texture which keeps no pixels, for tests of what is drawn and uploaded
+class NullTexture final : public Texture {
+public:
+    NullTexture(const Vector2i &size) : Texture(ColorFormat::RGBA8, size) {}
+
+    void replace(ColorFormat fmt, const Vector2i &size) override {
+        m_format = fmt;
+        m_size = size;
+    }
+
+    void update(const void *, size_t size) override {
+        uploaded_bytes += size;
+    }
+
+    void update_region(const void *data, size_t stride, const Recti &region) override {
+        write_region((const uint8_t *)data + region.y * stride + region.x * 4, stride, region);
+    }
+
+    void write_region(const void *data, size_t, const Recti &region) override {
+        uploaded_bytes += region.width() * region.height() * 4;
+
+        last_data = data;
+        last_region = region;
+    }
+
+    size_t uploaded_bytes = 0;
+
+    // Arguments of the last write_region
+    const void *last_data = nullptr;
+    Recti last_region = {0, 0, 0, 0};
+};
+
+}
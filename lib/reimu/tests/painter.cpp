@@ -0,0 +1,646 @@
+#include <reimu/graphics/painter.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "null_texture.h"
+
+// Checks the Painter fill, blend, gradient and premultiplied operator kernels against scalar versions,
+// checks only damaged regions are uploaded, checks pooled surfaces reuse storage and compares fill rate against per-pixel loops
+
+using namespace reimu;
+using namespace reimu::graphics;
+
+static uint32_t div255(uint32_t x) {
+    return (x + 128 + ((x + 128) >> 8)) >> 8;
+}
+
+static uint32_t lerp_pixel(uint32_t a, uint32_t b, uint32_t weight) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t ca = (a >> shift) & 0xff;
+        uint32_t cb = (b >> shift) & 0xff;
+
+        result |= div255(ca * (255 - weight) + cb * weight) << shift;
+    }
+
+    return result;
+}
+
+static uint32_t *pixel_at(Surface &surface, int x, int y) {
+    return (uint32_t *)(surface.buffer() + y * surface.stride()) + x;
+}
+
+static void randomize(Surface &surface, std::mt19937 &rng) {
+    for (int y = 0; y < surface.size().y; y++) {
+        for (int x = 0; x < surface.size().x; x++) {
+            *pixel_at(surface, x, y) = rng();
+        }
+    }
+}
+
+static void test_kernels() {
+    std::mt19937 rng(42);
+
+    Surface surface{new NullTexture({67, 41})};
+    Surface expected{new NullTexture({67, 41})};
+
+    // The references here are for straight alpha
+    surface.set_alpha_mode(AlphaMode::Straight);
+
+    for (int i = 0; i < 500; i++) {
+        randomize(surface, rng);
+        memcpy(expected.buffer(), surface.buffer(), surface.stride() * surface.size().y);
+
+        // Odd offsets and widths exercise the unaligned heads and scalar tails
+        Rectf rect = Rectf::from_size({ (float)(rng() % 80) - 10, (float)(rng() % 50) - 10 },
+            { (float)(rng() % 80), (float)(rng() % 50) });
+        Recti clipped = Recti::from_size({0, 0}, surface.size())
+            .intersect((Recti)vector_static_cast<int>((Vector4f)rect));
+
+        Color c1 = rng();
+        Color c2 = rng();
+
+        int op = i % 3;
+        {
+            Painter painter{surface};
+            if (op == 0) {
+                painter.draw_rect(rect, c1);
+            } else if (op == 1) {
+                painter.blend_rect(rect, c1);
+            } else {
+                painter.draw_rect_gradient(rect, c1, c2, {5, 3}, {60, 30});
+            }
+        }
+
+        float dx = 55.f / (55.f * 55.f + 27.f * 27.f);
+        float dy = 27.f / (55.f * 55.f + 27.f * 27.f);
+
+        for (int y = clipped.y; y < clipped.w; y++) {
+            float row_t = (y - 3.f) * dy - 5.f * dx;
+
+            for (int x = clipped.x; x < clipped.z; x++) {
+                uint32_t *pixel = pixel_at(expected, x, y);
+                if (op == 0) {
+                    *pixel = c1.value;
+                } else if (op == 1) {
+                    *pixel = lerp_pixel(*pixel, c1.value, c1.a);
+                } else {
+                    float t = (float)x * dx + row_t;
+                    float f = t * 255.f;
+                    f = f > 0.f ? f : 0.f;
+                    f = f < 255.f ? f : 255.f;
+
+                    *pixel = lerp_pixel(c1.value, c2.value, (uint32_t)f);
+                }
+            }
+        }
+
+        assert(memcmp(expected.buffer(), surface.buffer(), surface.stride() * surface.size().y) == 0);
+    }
+}
+
+// Small opaque fills are drawn without the display list, and should give the same surface
+static void test_direct_fill() {
+    std::mt19937 rng(44);
+
+    Surface direct{new NullTexture({67, 41})};
+    Surface listed{new NullTexture({67, 41})};
+
+    for (int i = 0; i < 300; i++) {
+        Rectf rect = Rectf::from_size({ (float)(rng() % 80) - 10, (float)(rng() % 50) - 10 },
+            { (float)(rng() % 40), (float)(rng() % 40) });
+        Recti clipped = Recti::from_size({0, 0}, direct.size())
+            .intersect((Recti)vector_static_cast<int>((Vector4f)rect));
+
+        Color color = rng() | 0xff000000;
+
+        {
+            Painter painter{direct};
+            painter.draw_rect(rect, color);
+
+            // Damaged as it is drawn, like any immediate command
+            assert(clipped.is_empty() || std::any_of(direct.damage().begin(), direct.damage().end(),
+                [&](const Recti &damage) { return damage.intersect(clipped).area() == clipped.area(); }));
+        }
+
+        Painter{listed, PaintMode::Tiled}.draw_rect(rect, color);
+
+        assert(memcmp(direct.buffer(), listed.buffer(), direct.stride() * direct.size().y) == 0);
+        assert(direct.opaque_rect().top_left() == listed.opaque_rect().top_left());
+        assert(direct.opaque_rect().size() == listed.opaque_rect().size());
+    }
+}
+
+static uint32_t premultiply(uint32_t pixel) {
+    uint32_t alpha = pixel >> 24;
+    uint32_t result = alpha << 24;
+    for (int shift = 0; shift < 24; shift += 8) {
+        result |= div255(((pixel >> shift) & 0xff) * alpha) << shift;
+    }
+
+    return result;
+}
+
+static void test_premultiplied() {
+    std::mt19937 rng(43);
+
+    Surface surface{new NullTexture({67, 41})};
+    Surface expected{new NullTexture({67, 41})};
+
+    for (int i = 0; i < 800; i++) {
+        // Operators are only defined for valid premultiplied pixels
+        for (int y = 0; y < surface.size().y; y++) {
+            for (int x = 0; x < surface.size().x; x++) {
+                *pixel_at(surface, x, y) = premultiply(rng());
+            }
+        }
+
+        memcpy(expected.buffer(), surface.buffer(), surface.stride() * surface.size().y);
+
+        Rectf rect = Rectf::from_size({ (float)(rng() % 80) - 10, (float)(rng() % 50) - 10 },
+            { (float)(rng() % 80), (float)(rng() % 50) });
+        Recti clipped = Recti::from_size({0, 0}, surface.size())
+            .intersect((Recti)vector_static_cast<int>((Vector4f)rect));
+
+        Color color = rng();
+        uint32_t src = premultiply(color.value);
+        uint32_t src_alpha = src >> 24;
+
+        BlendMode mode = (BlendMode)(i % 4);
+        {
+            Painter painter{surface};
+            painter.blend_rect(rect, color, mode);
+        }
+
+        for (int y = clipped.y; y < clipped.w; y++) {
+            for (int x = clipped.x; x < clipped.z; x++) {
+                uint32_t *pixel = pixel_at(expected, x, y);
+                uint32_t dest_alpha = *pixel >> 24;
+
+                uint32_t result = 0;
+                for (int shift = 0; shift < 32; shift += 8) {
+                    uint32_t c = (src >> shift) & 0xff;
+                    uint32_t d = (*pixel >> shift) & 0xff;
+
+                    uint32_t value = 0;
+                    switch (mode) {
+                    case BlendMode::SourceOver:
+                        value = c + div255(d * (255 - src_alpha));
+                        break;
+                    case BlendMode::Source:
+                        value = c;
+                        break;
+                    case BlendMode::Multiply:
+                        value = div255(c * d + c * (255 - dest_alpha) + d * (255 - src_alpha));
+                        break;
+                    case BlendMode::Clear:
+                        break;
+                    }
+
+                    assert(value <= 255);
+                    result |= value << shift;
+                }
+
+                *pixel = result;
+            }
+        }
+
+        assert(memcmp(expected.buffer(), surface.buffer(), surface.stride() * surface.size().y) == 0);
+    }
+
+    // Translucent over transparent keeps the color, which a straight blend darkens
+    Surface clear{new NullTexture({8, 1})};
+    memset(clear.buffer(), 0, clear.stride());
+    {
+        Painter painter{clear};
+        painter.blend_rect({0, 0, 8, 1}, Color(200, 100, 50, 128));
+    }
+
+    assert(*pixel_at(clear, 7, 0) == Color(200, 100, 50, 128).premultiplied().value);
+}
+
+static void test_lines() {
+    std::mt19937 rng(44);
+    Vector2i size = { 67, 41 };
+
+    Surface surface{new NullTexture(size)};
+    Surface expected{new NullTexture(size)};
+    Color color{10, 20, 30};
+
+    // Outlines match four fills
+    for (int i = 0; i < 100; i++) {
+        memset(surface.buffer(), 0, surface.stride() * size.y);
+        memset(expected.buffer(), 0, expected.stride() * size.y);
+
+        Rectf rect = Rectf::from_size({ (float)(rng() % 80) - 10, (float)(rng() % 50) - 10 },
+            { (float)(rng() % 60), (float)(rng() % 40) });
+        float t = 1 + rng() % 4;
+
+        Painter{surface}.draw_rect_outline(rect, color, t);
+        Painter{expected}
+            .draw_rect({ rect.x, rect.y, rect.z, std::min(rect.y + t, rect.w) }, color)
+            .draw_rect({ rect.x, std::max(rect.w - t, rect.y), rect.z, rect.w }, color)
+            .draw_rect({ rect.x, rect.y, std::min(rect.x + t, rect.z), rect.w }, color)
+            .draw_rect({ std::max(rect.z - t, rect.x), rect.y, rect.z, rect.w }, color);
+
+        assert(memcmp(expected.buffer(), surface.buffer(), surface.stride() * size.y) == 0);
+    }
+
+    // Thin lines plot round(y0 + (x - x0) * dy / dx) along the major axis, however they are clipped
+    for (int i = 0; i < 300; i++) {
+        memset(surface.buffer(), 0, surface.stride() * size.y);
+
+        Vector2i a = { (int)(rng() % 100) - 16, (int)(rng() % 70) - 15 };
+        Vector2i b = { (int)(rng() % 100) - 16, (int)(rng() % 70) - 15 };
+
+        Painter{surface}.draw_line(vector_static_cast<float>(a), vector_static_cast<float>(b), color, 1);
+
+        bool is_x_major = std::abs(b.x - a.x) >= std::abs(b.y - a.y);
+        if (!is_x_major) {
+            std::swap(a.x, a.y);
+            std::swap(b.x, b.y);
+        }
+
+        if (b.x < a.x) {
+            std::swap(a, b);
+        }
+
+        int count = 0;
+        for (int major = a.x; major <= b.x; major++) {
+            int minor = a.y;
+            if (b.x != a.x) {
+                int64_t numerator = 2 * (int64_t)(major - a.x) * (b.y - a.y) + (b.x - a.x);
+                minor += (int)std::floor((double)numerator / (2 * (b.x - a.x)));
+            }
+
+            int x = is_x_major ? major : minor;
+            int y = is_x_major ? minor : major;
+            if (x >= 0 && y >= 0 && x < size.x && y < size.y) {
+                assert(*pixel_at(surface, x, y) == color.value);
+                count++;
+            }
+        }
+
+        // Nothing else was drawn
+        int drawn = 0;
+        for (int y = 0; y < size.y; y++) {
+            for (int x = 0; x < size.x; x++) {
+                drawn += *pixel_at(surface, x, y) != 0;
+            }
+        }
+
+        assert(drawn == count);
+    }
+
+    // Joints of translucent polylines are only blended once
+    {
+        memset(surface.buffer(), 0, surface.stride() * size.y);
+
+        Vector2f points[] = { {2, 2}, {30, 2}, {30, 30} };
+        Color translucent{200, 100, 50, 128};
+
+        Painter{surface}.draw_lines(points, translucent, 1);
+
+        uint32_t once = translucent.premultiplied().value;
+        assert(*pixel_at(surface, 30, 2) == once);
+        assert(*pixel_at(surface, 30, 30) == once);
+        assert(*pixel_at(surface, 2, 2) == once);
+    }
+
+    // Wide lines are covered in the middle, fade at the edges and are symmetric
+    {
+        memset(surface.buffer(), 0, surface.stride() * size.y);
+
+        Color white = Color::white();
+        Painter{surface}.draw_line({10, 20.5f}, {50, 20.5f}, white, 4);
+
+        assert(*pixel_at(surface, 30, 20) == white.value);
+        assert(*pixel_at(surface, 30, 19) == white.value);
+        assert(*pixel_at(surface, 30, 21) == white.value);
+        assert(*pixel_at(surface, 30, 17) == 0 && *pixel_at(surface, 30, 24) == 0);
+        assert(*pixel_at(surface, 30, 18) == *pixel_at(surface, 30, 22));
+
+        uint32_t edge_alpha = *pixel_at(surface, 30, 18) >> 24;
+        assert(edge_alpha > 0 && edge_alpha < 255);
+
+        // Round caps
+        assert(*pixel_at(surface, 8, 20) >> 24 > 0);
+        assert(*pixel_at(surface, 5, 20) == 0);
+    }
+}
+
+static void test_nine_slice() {
+    std::mt19937 rng(45);
+    Vector2i size = { 67, 41 };
+
+    Surface surface{new NullTexture(size)};
+    Surface expected{new NullTexture(size)};
+
+    Color highlight{255, 255, 255};
+    Color shadow{0, 0, 0};
+    Color background{200, 200, 190};
+
+    // A bevel painted directly, and painted once at its smallest size then stretched
+    auto bevel = [&](Painter &painter, const Rectf &r) {
+        painter.draw_rect({r.x + 1, r.y + 1, r.z - 2, r.w - 2}, background)
+            .draw_rect({r.x, r.y, r.z - 2, r.y + 1}, highlight)
+            .draw_rect({r.x, r.y + 1, r.x + 1, r.w - 2}, highlight)
+            .draw_rect({r.z - 2, r.y, r.z, r.w}, shadow)
+            .draw_rect({r.x, r.w - 2, r.z - 2, r.w}, shadow);
+    };
+
+    NineSlice slice{{4, 4}, {1, 1, 2, 2}};
+    {
+        Painter painter{slice.surface()};
+        bevel(painter, {0, 0, 4, 4});
+    }
+
+    for (int i = 0; i < 200; i++) {
+        memset(surface.buffer(), 0, surface.stride() * size.y);
+        memset(expected.buffer(), 0, expected.stride() * size.y);
+
+        // Partly off the surface too
+        Rectf rect = Rectf::from_size({ (float)(rng() % 80) - 10, (float)(rng() % 50) - 10 },
+            { (float)(rng() % 60) + 3, (float)(rng() % 40) + 3 });
+
+        {
+            Painter painter{expected};
+            bevel(painter, rect);
+        }
+
+        Painter{surface}.draw_nine_slice(rect, slice);
+
+        assert(memcmp(expected.buffer(), surface.buffer(), surface.stride() * size.y) == 0);
+    }
+
+    // Larger images repeat from the top left of the rect
+    auto image = std::make_shared<Surface>(Vector2i{ 5, 3 });
+    randomize(*image, rng);
+
+    memset(surface.buffer(), 0, surface.stride() * size.y);
+    Painter{surface}.draw_image({-7, 4, 30, 20}, image, {1, 1, 4, 3});
+
+    for (int y = 4; y < 20; y++) {
+        for (int x = 0; x < 30; x++) {
+            assert(*pixel_at(surface, x, y) == *pixel_at(*image, 1 + (x + 7) % 3, 1 + (y - 4) % 2));
+        }
+    }
+
+    assert(*pixel_at(surface, 30, 4) == 0 && *pixel_at(surface, 0, 3) == 0);
+
+    // Images are converted to the alpha mode of the surface
+    Color translucent{200, 100, 50, 128};
+    *pixel_at(*image, 0, 0) = translucent.premultiplied().value;
+
+    surface.set_alpha_mode(AlphaMode::Straight);
+    Painter{surface}.draw_image({0, 0, 2, 2}, image, {0, 0, 1, 1});
+    surface.set_alpha_mode(AlphaMode::Premultiplied);
+
+    Color converted{*pixel_at(surface, 1, 1)};
+    assert(converted.a == 128 && std::abs(converted.r - 200) <= 1 && std::abs(converted.g - 100) <= 1
+        && std::abs(converted.b - 50) <= 1);
+}
+
+static void test_damage() {
+    auto *texture = new NullTexture({3840, 2160});
+    Surface surface{texture};
+
+    // A new surface uploads everything once
+    surface.update();
+    assert(texture->uploaded_bytes == 3840 * 2160 * 4);
+
+    texture->uploaded_bytes = 0;
+    surface.update();
+    assert(texture->uploaded_bytes == 0);
+
+    // Repainting a button and its outline
+    {
+        Painter painter{surface};
+        painter.draw_rect({100, 100, 220, 130}, Color(200, 200, 200))
+            .draw_rect({100, 100, 220, 101}, Color(255, 255, 255))
+            .draw_rect({100, 100, 101, 130}, Color(255, 255, 255))
+            .draw_rect({218, 100, 220, 130}, Color(64, 64, 64))
+            .draw_rect({100, 128, 220, 130}, Color(64, 64, 64));
+    }
+
+    assert(surface.damage().empty());
+    assert(texture->uploaded_bytes == 120 * 30 * 4);
+
+    // Separate rects stay separate
+    texture->uploaded_bytes = 0;
+    {
+        Painter painter{surface};
+        painter.draw_rect({0, 0, 10, 10}, Color(0, 0, 0))
+            .draw_rect({3000, 2000, 3010, 2010}, Color(0, 0, 0));
+
+        assert(surface.damage().size() == 2);
+    }
+
+    assert(texture->uploaded_bytes == 2 * 10 * 10 * 4);
+
+    // Many rects are merged down
+    {
+        Painter painter{surface};
+        for (int i = 0; i < 100; i++) {
+            painter.draw_rect({ (float)i * 30, (float)i * 20, (float)i * 30 + 5, (float)i * 20 + 5 }, Color(0, 0, 0));
+        }
+
+        assert(surface.damage().size() <= 16);
+    }
+}
+
+static void test_surface_pool() {
+    int textures_created = 0;
+    SurfacePool pool{[&](const Vector2i &size, ColorFormat) -> Texture * {
+        textures_created++;
+        return new NullTexture(size);
+    }};
+
+    {
+        Surface surface{pool, {100, 30}, ColorFormat::RGBA8};
+        assert(textures_created == 1);
+        assert(surface.size() == (Vector2i{100, 30}));
+        assert(surface.texture().size() == SurfacePool::size_class({100, 30}));
+        assert(surface.stride() == surface.texture().size().x * 4u);
+
+        // Within the size class, no allocation and the new size is damaged
+        surface.update();
+        surface.resize({110, 25});
+        assert(textures_created == 1);
+        assert(surface.damage().size() == 1 && surface.damage()[0].area() == 110 * 25);
+
+        // Growing out of the class and back reuses the first storage
+        surface.resize({400, 300});
+        assert(textures_created == 2);
+        surface.resize({100, 30});
+        assert(textures_created == 2);
+
+        // Painting uses the stride of the storage
+        {
+            Painter painter{surface};
+            painter.draw_rect({0, 0, 100, 30}, Color(1, 2, 3));
+        }
+
+        assert(*pixel_at(surface, 99, 29) == Color(1, 2, 3).value);
+        assert(*pixel_at(surface, 100, 29) == 0);
+    }
+
+    // Storage from the destroyed surface goes to the next one in its class
+    assert(pool.free_bytes() > 0);
+    Surface reused{pool, {120, 20}, ColorFormat::RGBA8};
+    assert(textures_created == 2);
+
+    // A full pool frees released storage instead
+    SurfacePool small_pool{[&](const Vector2i &size, ColorFormat) -> Texture * {
+        return new NullTexture(size);
+    }, 1024};
+
+    {
+        Surface surface{small_pool, {512, 512}, ColorFormat::RGBA8};
+    }
+
+    assert(small_pool.free_bytes() == 0);
+}
+
+// The loops Painter used before the kernels
+static void old_fill(Surface &surface, const Recti &rect, uint32_t color) {
+    uint8_t *buffer = surface.buffer() + rect.y * surface.stride() + rect.x * 4;
+
+    for (int rows = rect.height(); rows--;) {
+        for (int i = 0; i < rect.width(); i++) {
+            reinterpret_cast<uint32_t*>(buffer)[i] = color;
+        }
+
+        buffer += surface.stride();
+    }
+}
+
+static void old_blend(Surface &surface, const Recti &rect, Color color) {
+    uint8_t *buffer = surface.buffer() + rect.y * surface.stride() + rect.x * 4;
+
+    for (int rows = rect.height(); rows--;) {
+        for (int i = 0; i < rect.width(); i++) {
+            Color &pixel = reinterpret_cast<Color*>(buffer)[i];
+            pixel = pixel * color;
+        }
+
+        buffer += surface.stride();
+    }
+}
+
+static void old_gradient(Surface &surface, const Recti &rect, Color c1, Color c2, Vector2f p1, Vector2f p2) {
+    auto length = (p2 - p1).magnitude();
+    auto normalized = (p2 - p1).normalize();
+
+    float dy = normalized.y / length;
+    float dx = normalized.x / length;
+
+    uint8_t *row = surface.buffer() + surface.stride() * rect.y;
+
+    float y = rect.y / length;
+    for (int rows = rect.height(); rows--;) {
+        uint32_t *pixel = ((uint32_t*)row) + rect.x;
+
+        float blend = y + rect.x / length;
+        for (int cols = rect.width(); cols--;) {
+            uint16_t blend_factor = std::min<uint16_t>(std::max<uint16_t>(static_cast<uint16_t>(blend * 255), 0), 255);
+            uint16_t one_minus = 255 - blend_factor;
+
+            uint32_t rb = (c1.value & 0x00ff00ff) * one_minus + (c2.value & 0x00ff00ff) * blend_factor;
+            uint32_t ag = ((c1.value & 0xff00ff00) >> 8) * one_minus + ((c2.value & 0xff00ff00) >> 8) * blend_factor;
+
+            *(pixel++) = ((rb & 0xff00ff00) >> 8) | ((ag & 0xff00ff00));
+            blend += dx;
+        }
+
+        row += surface.stride();
+        y += dy;
+    }
+}
+
+template<typename F>
+static double measure_mpixels(size_t pixels, F draw) {
+    // Small rects are drawn many more times, so timing isn't dominated by the clock
+    const size_t iterations = std::max<size_t>(50, 20'000'000 / pixels);
+
+    // Best of a few rounds, as other work on the machine only slows rounds down
+    double best_seconds = 0;
+    for (int round = 0; round < 3; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            draw();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        if (round == 0 || seconds < best_seconds) {
+            best_seconds = seconds;
+        }
+    }
+
+    return pixels * iterations / best_seconds / 1e6;
+}
+
+static void print_result(const char *name, double old_rate, double new_rate) {
+    printf("%-22s old %8.1f Mpx/s, new %8.1f Mpx/s (%.1fx)\n", name, old_rate, new_rate, new_rate / old_rate);
+}
+
+static void benchmark(const Vector2i &size, const Recti &rect) {
+    Surface surface{new NullTexture(size)};
+    Painter painter{surface};
+
+    size_t pixels = rect.width() * rect.height();
+    Rectf rectf = { (float)rect.x, (float)rect.y, (float)rect.z, (float)rect.w };
+
+    Color solid{40, 80, 120, 255};
+    Color translucent{200, 100, 50, 128};
+    Color c1{192, 0, 100, 255};
+    Color c2{64, 32, 128, 255};
+
+    printf("%dx%d in %dx%d surface\n", rect.width(), rect.height(), size.x, size.y);
+
+    print_result("fill",
+        measure_mpixels(pixels, [&]() { old_fill(surface, rect, solid.value); }),
+        measure_mpixels(pixels, [&]() { painter.draw_rect(rectf, solid); }));
+
+    print_result("blend",
+        measure_mpixels(pixels, [&]() { old_blend(surface, rect, translucent); }),
+        measure_mpixels(pixels, [&]() { painter.blend_rect(rectf, translucent); }));
+
+    // Same blend through the straight alpha kernel and the premultiplied one
+    {
+        Surface straight{new NullTexture(size)};
+        straight.set_alpha_mode(AlphaMode::Straight);
+        Painter straight_painter{straight};
+
+        print_result("premultiplied over",
+            measure_mpixels(pixels, [&]() { straight_painter.blend_rect(rectf, translucent); }),
+            measure_mpixels(pixels, [&]() { painter.blend_rect(rectf, translucent); }));
+    }
+
+    print_result("gradient",
+        measure_mpixels(pixels, [&]() { old_gradient(surface, rect, c1, c2, {0, 0}, {(float)size.x, 500}); }),
+        measure_mpixels(pixels, [&]() { painter.draw_rect_gradient(rectf, c1, c2, {0, 0}, {(float)size.x, 500}); }));
+}
+
+int main() {
+    test_kernels();
+    test_direct_fill();
+    test_premultiplied();
+    test_lines();
+    test_nine_slice();
+    test_damage();
+    test_surface_pool();
+
+    benchmark({1920, 1080}, {0, 0, 1920, 1080});
+    benchmark({1920, 1080}, {13, 7, 1013, 607});
+    benchmark({800, 600}, {1, 1, 9, 17});
+
+    return 0;
+}
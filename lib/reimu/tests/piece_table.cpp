@@ -0,0 +1,101 @@
+#include <reimu/core/unicode.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <random>
+#include <string>
+
+#include "../gui/piece_table.h"
+
+// Checks random inserts and erases on a PieceTable, including multi-byte
+// characters and newlines, against a std::u32string model
+
+using namespace reimu;
+using namespace reimu::gui;
+
+static std::string to_utf8(std::u32string_view text) {
+    std::string utf8;
+    for (char32_t c : text) {
+        char buffer[4];
+        utf8.append(buffer, utf32_to_utf8(c, buffer));
+    }
+
+    return utf8;
+}
+
+// Byte offset of codepoint 'index' of 'text'
+static size_t byte_offset(std::u32string_view text, size_t index) {
+    return to_utf8(text.substr(0, index)).size();
+}
+
+static void check_lines(const PieceTable &table, std::u32string_view model) {
+    std::string utf8 = to_utf8(model);
+
+    assert(table.size() == utf8.size());
+    assert(to_utf32(table.text()).ensure() == model);
+
+    size_t line = 0;
+    size_t start = 0;
+    for (size_t pos = 0; pos <= utf8.size(); pos++) {
+        assert(table.line_at(pos) == line);
+
+        if (pos == utf8.size() || utf8[pos] == '\n') {
+            assert(table.line_start(line) == start);
+            assert(table.line_end(line) == pos);
+
+            line++;
+            start = pos + 1;
+        }
+    }
+
+    assert(table.line_count() == line);
+}
+
+static void test_random_edits(uint32_t seed, std::u32string model) {
+    std::mt19937 rng(seed);
+    const char32_t alphabet[] = U"ab\né中\U0001f600";
+
+    PieceTable table{ to_utf8(model) };
+
+    for (int step = 0; step < 2000; step++) {
+        size_t pos = rng() % (model.size() + 1);
+
+        if (rng() % 3 != 0 || model.empty()) {
+            std::u32string inserted;
+            for (size_t i = rng() % 6 + 1; i > 0; i--) {
+                inserted.push_back(alphabet[rng() % 6]);
+            }
+
+            table.insert(byte_offset(model, pos), to_utf8(inserted));
+            model.insert(pos, inserted);
+        } else {
+            size_t len = std::min<size_t>(rng() % 8 + 1, model.size() - pos);
+
+            size_t begin = byte_offset(model, pos);
+            table.erase(begin, byte_offset(model, pos + len) - begin);
+            model.erase(pos, len);
+        }
+
+        // Reading part of the text crosses pieces
+        size_t first = rng() % (model.size() + 1);
+        size_t count = rng() % (model.size() - first + 1);
+        size_t begin = byte_offset(model, first);
+        assert(table.text(begin, byte_offset(model, first + count) - begin) == to_utf8(model.substr(first, count)));
+
+        if (step % 20 == 0) {
+            check_lines(table, model);
+        }
+    }
+
+    check_lines(table, model);
+}
+
+int main() {
+    test_random_edits(1, U"");
+    test_random_edits(2, U"original\ntext é\n\n");
+
+    printf("piece_table: ok\n");
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <reimu/graphics/software_renderer.h>
+#include <reimu/graphics/render_pass.h>
+#include <reimu/graphics/texture.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <vector>
+
+// Checks instances composite over the framebuffer like the default shader would,
+// the same way every frame, and that frames can be written out as PPM images
+
+using namespace reimu;
+using namespace reimu::graphics;
+
+struct Instance {
+    Vector4f source;
+    Vector4f target;
+    float opacity;
+    float padding[3];
+};
+
+class InstanceStrategy final : public RenderStrategy {
+public:
+    void draw(Renderer &, RenderPass &pass) override {
+        pass.bind_texture(0, texture);
+        pass.bind_storage_buffer(2, instances.data(), instances.size() * sizeof(Instance));
+        pass.draw_instanced(4, instances.size(), 0);
+    }
+
+    Texture *texture = nullptr;
+    std::vector<Instance> instances;
+};
+
+static uint32_t over(uint32_t dest, uint32_t src, uint32_t opacity) {
+    uint32_t out = 0;
+    uint32_t src_alpha = ((src >> 24) * opacity + 127) / 255;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t s = (((src >> shift) & 0xff) * opacity + 127) / 255;
+        uint32_t d = (dest >> shift) & 0xff;
+
+        out |= std::min(s + (d * (255 - src_alpha) + 127) / 255, 255u) << shift;
+    }
+
+    return out;
+}
+
+static std::vector<uint32_t> random_pixels(std::mt19937 &rng, size_t count) {
+    std::vector<uint32_t> pixels(count);
+    for (auto &pixel : pixels) {
+        // Premultiplied, so no channel is above alpha
+        uint32_t alpha = rng() % 256;
+        pixel = alpha << 24;
+        for (int shift = 0; shift < 24; shift += 8) {
+            pixel |= (alpha ? rng() % (alpha + 1) : 0) << shift;
+        }
+    }
+
+    return pixels;
+}
+
+static void test_composite() {
+    std::mt19937 rng(7);
+    Vector2i size = {67, 45};
+
+    SoftwareRenderer renderer(size);
+
+    Texture *texture = renderer.create_texture({40, 30}, ColorFormat::RGBA8).ensure();
+    auto pixels = random_pixels(rng, 40 * 30);
+    texture->update(pixels.data(), pixels.size() * 4);
+
+    InstanceStrategy strategy;
+    strategy.texture = texture;
+    strategy.instances = {
+        // Widths above and between vector lengths, partly off the framebuffer
+        { {0, 0, 40, 30}, {3, 2, 43, 32}, 1.f, {} },
+        { {5, 7, 18, 20}, {30, 20, 43, 33}, 0.5f, {} },
+        { {0, 0, 37, 30}, {50, 30, 87, 60}, 1.f, {} },
+        { {1, 1, 10, 9}, {-4, -3, 5, 5}, 0.25f, {} },
+    };
+
+    RenderPass *pass = static_cast<Renderer &>(renderer).create_render_pass(nullptr, 0).ensure();
+    pass->set_strategy(&strategy);
+
+    renderer.render();
+
+    std::vector<uint32_t> expected(size.x * size.y, 0xff000000);
+    for (auto &instance : strategy.instances) {
+        uint32_t opacity = (uint32_t)(instance.opacity * 255 + 0.5f);
+        Vector2i offset = { (int)instance.source.x - (int)instance.target.x,
+            (int)instance.source.y - (int)instance.target.y };
+
+        for (int y = std::max((int)instance.target.y, 0); y < std::min((int)instance.target.w, size.y); y++) {
+            for (int x = std::max((int)instance.target.x, 0); x < std::min((int)instance.target.z, size.x); x++) {
+                uint32_t &dest = expected[y * size.x + x];
+                dest = over(dest, pixels[(y + offset.y) * 40 + x + offset.x], opacity);
+            }
+        }
+    }
+
+    assert(renderer.framebuffer() == expected);
+
+    // Frames only depend on what is drawn
+    renderer.render();
+    assert(renderer.framebuffer() == expected);
+
+    // A null texture clears the binding, and instances drawn without one are skipped
+    strategy.texture = nullptr;
+    renderer.render();
+    assert(renderer.framebuffer() == std::vector<uint32_t>(size.x * size.y, 0xff000000));
+
+    delete pass;
+    delete texture;
+}
+
+static void test_ppm() {
+    SoftwareRenderer renderer({13, 7});
+    renderer.render();
+
+    char path[] = "/tmp/reimu_frame_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    assert(!renderer.write_ppm(path).is_err());
+
+    std::ifstream file(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::string header = "P6\n13 7\n255\n";
+    assert(data.size() == header.size() + 13 * 7 * 3);
+    assert(data.compare(0, header.size(), header) == 0);
+    assert(std::all_of(data.begin() + header.size(), data.end(), [](char c) { return c == 0; }));
+
+    unlink(path);
+}
+
+int main() {
+    test_composite();
+    test_ppm();
+
+    printf("software_renderer: ok\n");
+
+    return 0;
+}
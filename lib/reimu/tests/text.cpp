@@ -0,0 +1,240 @@
+#include <reimu/graphics/font.h>
+#include <reimu/graphics/text.h>
+#include <reimu/os/fs.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+
+// Checks wrapping, position lookups and paragraph splitting and merging,
+// comparing text edited in place against text laid out from scratch
+// usage: text [font path] [fallback font path]
+
+using namespace reimu;
+using namespace reimu::graphics;
+
+static std::shared_ptr<Font> font;
+
+static Text make_text(std::u32string_view str, int wrap_width) {
+    Text text;
+    text.set_font(font);
+    text.set_wrap_width(wrap_width);
+    text.set_text(str);
+
+    return text;
+}
+
+static int line_height() {
+    return make_text(U"x", 0).text_geometry().y;
+}
+
+static int width_of(std::u32string_view str) {
+    return make_text(str, 0).text_geometry().x;
+}
+
+static void check_same_layout(Text &text, std::u32string_view expected, int wrap_width) {
+    Text fresh = make_text(expected, wrap_width);
+
+    assert(text.get_text() == expected);
+    assert(text.length() == expected.size());
+    assert(text.text_geometry() == fresh.text_geometry());
+
+    for (size_t pos = 0; pos <= expected.size(); pos++) {
+        assert(text.position_of(pos) == fresh.position_of(pos));
+    }
+
+    // Scrolled so the first lines are above the surface, against the whole text drawn from scratch
+    int scroll = line_height() * 3 / 2;
+    Vector2i size = {64, 48};
+    Surface scrolled{size};
+    Surface whole{{size.x, size.y + scroll}};
+
+    text.render(scrolled, {0, (float)-scroll, (float)size.x, (float)size.y});
+    fresh.render(whole, {0, 0, (float)size.x, (float)(size.y + scroll)});
+    assert(memcmp(scrolled.buffer(), whole.buffer() + scroll * whole.stride(), scrolled.stride() * size.y) == 0);
+}
+
+static void test_wrapping() {
+    int space = width_of(U"a b") - width_of(U"ab");
+    int word = width_of(U"aaaa");
+
+    // Two words fit a line, the third wraps
+    Text text = make_text(U"aaaa aaaa aaaa", word * 2 + space);
+    assert(text.text_geometry().y == 2 * line_height());
+    assert(text.position_of(10) == Vector2f(0, line_height()));
+
+    text.set_wrap_width(0);
+    assert(text.text_geometry().y == line_height());
+    assert(text.text_geometry().x == width_of(U"aaaa aaaa aaaa"));
+
+    // A word longer than the line is broken between characters
+    Text long_word = make_text(U"aaaaaaaa", word / 2);
+    assert(long_word.text_geometry().y == 4 * line_height());
+    assert(long_word.text_geometry().x <= word / 2);
+    assert(long_word.position_of(2) == Vector2f(0, line_height()));
+}
+
+static void test_position_round_trip(int size_px) {
+    std::u32string str = U"first paragraph which wraps a few times\n\nshort\nanother one that wraps around";
+    Text text = make_text(str, 0);
+    text.set_font_size_px(size_px);
+    text.set_wrap_width(text.position_of(10).x);
+
+    // A point 1px into a glyph is still on it, even for spaces only 3px wide.
+    // Glyphs 2px wide or less are probed before their middle instead.
+    for (size_t pos = 0; pos < str.size(); pos++) {
+        Vector2f position = text.position_of(pos);
+        Vector2f next = text.position_of(pos + 1);
+
+        float inset = next.y == position.y ? std::min(1.0f, (next.x - position.x) * 0.4f) : 1.0f;
+        if (str[pos] != U'\n') {
+            assert(text.offset_at(position + Vector2f(inset, 1)) == pos);
+        }
+    }
+
+    assert(text.position_of(str.size()) == text.position_of(str.size() + 10));
+
+    // Points past either end of the text go to its ends
+    assert(text.offset_at({-10, -10}) == 0);
+    assert(text.offset_at({1e6f, 1e6f}) == str.size());
+}
+
+static void test_paragraph_edits() {
+    int wrap_width = width_of(U"aaaaaa");
+    std::u32string expected = U"one two three\nfour\nfive six";
+    Text text = make_text(expected, wrap_width);
+
+    // Split a paragraph
+    text.replace(3, 1, U"\n\n");
+    expected.replace(3, 1, U"\n\n");
+    check_same_layout(text, expected, wrap_width);
+
+    // Merge paragraphs
+    text.replace(4, 12, U"");
+    expected.replace(4, 12, U"");
+    check_same_layout(text, expected, wrap_width);
+
+    text.append(U"\nseven");
+    expected += U"\nseven";
+    check_same_layout(text, expected, wrap_width);
+
+    // Edits through set_text only replace the paragraphs which changed
+    expected = U"one\nchanged\nfive six\nseven\neight";
+    text.set_text(expected);
+    check_same_layout(text, expected, wrap_width);
+
+    expected = U"eight";
+    text.set_text(expected);
+    check_same_layout(text, expected, wrap_width);
+}
+
+static void test_random_edits() {
+    std::mt19937 rng(11);
+    const char32_t alphabet[] = U"ab cd\n";
+
+    int wrap_width = width_of(U"abcd");
+    std::u32string expected;
+    Text text = make_text(expected, wrap_width);
+
+    for (int step = 0; step < 400; step++) {
+        size_t pos = rng() % (expected.size() + 1);
+        size_t len = std::min<size_t>(rng() % 8, expected.size() - pos);
+
+        std::u32string insert;
+        for (size_t i = rng() % 10; i > 0; i--) {
+            insert.push_back(alphabet[rng() % 6]);
+        }
+
+        if (step % 4 == 0) {
+            std::u32string changed = expected;
+            changed.replace(pos, len, insert);
+
+            text.set_text(changed);
+            expected = changed;
+        } else {
+            text.replace(pos, len, insert);
+            expected.replace(pos, len, insert);
+        }
+
+        // Change the wrapping now and then so edits meet both laid out and stale paragraphs
+        if (step % 50 == 25) {
+            wrap_width = wrap_width == 0 ? width_of(U"abcd") : 0;
+            text.set_wrap_width(wrap_width);
+        }
+
+        if (step % 3 == 0) {
+            check_same_layout(text, expected, wrap_width);
+        }
+    }
+}
+
+static std::shared_ptr<Font> load_font(const char *path) {
+    auto file = os::open(path, FileMode::ReadOnly).ensure();
+    return std::shared_ptr<Font>{ Font::create(*file).ensure() };
+}
+
+// Needs a fallback font covering codepoints the main font is missing
+static void test_fallback(std::shared_ptr<Font> fallback) {
+    const int size = 16;
+
+    // A codepoint only the fallback has, whose glyph is a different width to the missing glyph
+    uint32_t missing = 0;
+    for (uint32_t c = 0x80; c < 0x10000 && !missing; c++) {
+        if (!font->has_codepoint(c) && fallback->has_codepoint(c)
+                && fallback->get_glyph(c, size, false)->advance != font->get_glyph(c, size, false)->advance) {
+            missing = c;
+        }
+    }
+    assert(missing);
+
+    std::u32string str = { U'a', missing, U'a' };
+    int a_width = font->get_glyph(U'a', size, false)->advance;
+
+    Text text = make_text(str, 0);
+    text.set_font_size_px(size);
+    assert(text.text_geometry().x == 2 * a_width + font->get_glyph(missing, size, false)->advance);
+
+    // Fonts are tried in order, skipping those without the codepoint
+    text.set_fallback_fonts({ font, fallback });
+    assert(text.text_geometry().x == 2 * a_width + fallback->get_glyph(missing, size, false)->advance);
+    assert(text.position_of(2).x == a_width + fallback->get_glyph(missing, size, false)->advance);
+
+    // Codepoints the main font has don't fall back
+    text.set_fallback_fonts({ fallback });
+    assert(text.position_of(1).x == a_width);
+
+    // Glyphs resolved with the old fonts and size are not reused
+    text.set_font_size_px(size * 2);
+    assert(text.position_of(1).x == font->get_glyph(U'a', size * 2, false)->advance);
+
+    text.set_fallback_fonts({});
+    text.set_font_size_px(size);
+    assert(text.text_geometry().x == 2 * a_width + font->get_glyph(missing, size, false)->advance);
+
+    text.set_font(fallback);
+    assert(text.position_of(1).x == fallback->get_glyph(U'a', size, false)->advance);
+}
+
+int main(int argc, char **argv) {
+    font = load_font(argc > 1 ? argv[1] : "font.ttf");
+
+    test_wrapping();
+    for (int size_px : { 10, 12, 16 }) {
+        test_position_round_trip(size_px);
+    }
+    test_paragraph_edits();
+    test_random_edits();
+
+    if (argc > 2) {
+        test_fallback(load_font(argv[2]));
+    }
+
+    printf("text: ok\n");
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <reimu/gui/widget.h>
+#include <reimu/video/input.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <string>
+
+// Checks the cursor steps over whole grapheme clusters, combining marks,
+// ZWJ sequences and CRLF, and that typing replaces the selection
+
+using namespace reimu;
+using namespace reimu::gui;
+
+static void press(TextBox &box, int key, bool shift = false) {
+    video::KeyboardEvent event;
+    event.key = key;
+    event.is_shift = shift;
+
+    box.handle_key(event);
+}
+
+static void type(TextBox &box, uint32_t codepoint) {
+    video::KeyboardEvent event;
+    event.key = (int)codepoint;
+    event.codepoint = codepoint;
+
+    box.handle_key(event);
+}
+
+// Moving right from 'begin' lands on 'end' and moving left goes back
+static void check_cluster(const std::string &text, size_t begin, size_t end) {
+    TextBox box;
+    box.set_text(text);
+
+    box.set_cursor(begin);
+    press(box, video::Key::Right);
+    assert(box.get_cursor() == end);
+
+    press(box, video::Key::Left);
+    assert(box.get_cursor() == begin);
+
+    // Selecting and deleting take the whole cluster too
+    press(box, video::Key::Right, true);
+    assert(box.get_selected_text() == text.substr(begin, end - begin));
+
+    box.set_cursor(end);
+    press(box, video::Key::Backspace);
+    assert(box.get_text() == text.substr(0, begin) + text.substr(end));
+    assert(box.get_cursor() == begin);
+
+    box.set_text(text);
+    box.set_cursor(begin);
+    press(box, video::Key::Delete);
+    assert(box.get_text() == text.substr(0, begin) + text.substr(end));
+    assert(box.get_cursor() == begin);
+}
+
+static void test_clusters() {
+    // e with a combining acute accent
+    check_cluster("ae\u0301x", 1, 4);
+
+    // Woman, ZWJ, laptop
+    check_cluster("a\U0001f469\u200d\U0001f4bbb", 1, 12);
+
+    // CRLF is one step, but the characters on either side are not part of it
+    check_cluster("a\r\nb", 1, 3);
+    check_cluster("a\r\nb", 0, 1);
+    check_cluster("a\r\nb", 3, 4);
+
+    // The ends of the text stop the cursor
+    TextBox box;
+    box.set_text("e\u0301");
+    press(box, video::Key::Left);
+    assert(box.get_cursor() == 0);
+
+    box.set_cursor(3);
+    press(box, video::Key::Right);
+    assert(box.get_cursor() == 3);
+}
+
+static void test_typing() {
+    TextBox box;
+    box.set_text("hello world");
+
+    // Typing replaces the selection, whichever way it was made
+    box.set_cursor(5);
+    box.set_cursor(0, true);
+    type(box, U'J');
+    assert(box.get_text() == "J world");
+    assert(box.get_cursor() == 1);
+    assert(box.get_selected_text().empty());
+
+    type(box, 0xe9);
+    assert(box.get_text() == "J\u00e9 world");
+    assert(box.get_cursor() == 3);
+
+    // Control characters type nothing
+    type(box, 0x1b);
+    type(box, 0x85);
+    assert(box.get_text() == "J\u00e9 world");
+
+    // Moving without shift collapses the selection to the side moved towards
+    box.set_cursor(1);
+    box.set_cursor(6, true);
+    press(box, video::Key::Left);
+    assert(box.get_cursor() == 1);
+    assert(box.get_selected_text().empty());
+
+    box.set_cursor(6);
+    box.set_cursor(1, true);
+    press(box, video::Key::Right);
+    assert(box.get_cursor() == 6);
+
+    // Deleting a selection across lines joins them
+    box.set_text("one\ntwo\nthree");
+    box.set_cursor(2);
+    box.set_cursor(9, true);
+    assert(box.get_selected_text() == "e\ntwo\nt");
+
+    press(box, video::Key::Backspace);
+    assert(box.get_text() == "onhree");
+    assert(box.get_cursor() == 2);
+
+    // A new line typed over a selection splits the line there
+    box.select_all();
+    box.insert("a\nb");
+    assert(box.get_text() == "a\nb");
+    assert(box.get_cursor() == 3);
+
+    press(box, video::Key::Home);
+    assert(box.get_cursor() == 2);
+    press(box, video::Key::Left);
+    press(box, video::Key::Home, true);
+    assert(box.get_selected_text() == "a");
+}
+
+int main() {
+    test_clusters();
+    test_typing();
+
+    printf("textbox: ok\n");
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <reimu/graphics/texture_atlas.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <random>
+#include <vector>
+
+#include "null_texture.h"
+
+// Checks the shelf packer never overlaps rects and reuses freed space,
+// and that atlas textures upload to their region of the atlas texture
+
+using namespace reimu;
+using namespace reimu::graphics;
+
+static bool overlaps(const Recti &a, const Recti &b) {
+    return !a.intersect(b).is_empty();
+}
+
+static void test_packer() {
+    std::mt19937 rng(42);
+    ShelfPacker packer({1024, 1024});
+
+    std::vector<Recti> rects;
+    for (int i = 0; i < 2000; i++) {
+        // Free about a third of the time, so space is reused
+        if (!rects.empty() && rng() % 3 == 0) {
+            size_t index = rng() % rects.size();
+
+            packer.free(rects[index]);
+            rects.erase(rects.begin() + index);
+            continue;
+        }
+
+        Vector2i size = { (int)(rng() % 120) + 1, (int)(rng() % 120) + 1 };
+
+        auto rect = packer.allocate(size);
+        if (!rect.has_some()) {
+            continue;
+        }
+
+        Recti r = rect.ensure();
+        assert(r.size() == size);
+        assert(r.x >= 0 && r.y >= 0 && r.z <= 1024 && r.w <= 1024);
+
+        for (const auto &other : rects) {
+            assert(!overlaps(r, other));
+        }
+
+        rects.push_back(r);
+    }
+
+    for (const auto &rect : rects) {
+        packer.free(rect);
+    }
+
+    assert(packer.used_area() == 0);
+
+    // Everything was freed, so the whole atlas can be used again
+    auto whole = packer.allocate({1024, 1024});
+    assert(whole.has_some());
+    assert(!packer.allocate({1, 1}).has_some());
+}
+
+static void test_atlas() {
+    std::vector<NullTexture *> created;
+
+    TextureAtlas atlas([&](const Vector2i &size, ColorFormat) -> Texture * {
+        auto *texture = new NullTexture(size);
+        created.push_back(texture);
+
+        return texture;
+    }, {512, 512}, 128);
+
+    // Small textures share the atlas texture
+    std::unique_ptr<Texture> a{atlas.create_texture({64, 32}, ColorFormat::RGBA8)};
+    std::unique_ptr<Texture> b{atlas.create_texture({64, 32}, ColorFormat::RGBA8)};
+    assert(created.size() == 1);
+    assert(&a->backing_texture() == created[0] && &b->backing_texture() == created[0]);
+    assert(a->backing_origin() != b->backing_origin());
+
+    // Uploads go to the texture's region of the atlas, starting at the region's top left
+    uint32_t pixels[64 * 32] = {};
+    b->update_region(pixels, 64 * 4, {4, 2, 20, 10});
+
+    Vector2i origin = b->backing_origin();
+    assert(created[0]->last_data == pixels + 2 * 64 + 4);
+    assert(created[0]->last_region.top_left() == origin + Vector2i(4, 2));
+    assert(created[0]->last_region.size() == Vector2i(16, 8));
+
+    // Large textures get their own
+    std::unique_ptr<Texture> large{atlas.create_texture({256, 64}, ColorFormat::RGBA8)};
+    assert(created.size() == 2);
+    assert(&large->backing_texture() == created[1]);
+    assert(large->backing_origin() == Vector2i(0, 0));
+
+    // Replacing frees the old region
+    int64_t used = atlas.packer().used_area();
+    a->replace(ColorFormat::RGBA8, {100, 100});
+    assert(a->size() == Vector2i(100, 100));
+    assert(atlas.packer().used_area() > used);
+
+    a = nullptr;
+    b = nullptr;
+    assert(atlas.packer().used_area() == 0);
+}
+
+int main() {
+    test_packer();
+    test_atlas();
+
+    printf("texture atlas ok\n");
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include <reimu/core/unicode.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+
+// Checks UTF-8 validation and compares to_utf32 throughput against
+// a byte-at-a-time decoder with a fresh string per call
+
+using namespace reimu;
+
+static std::u32string reference_to_utf32(std::string_view utf8) {
+    std::u32string utf32;
+    utf32.reserve(utf8.size());
+
+    for (size_t i = 0; i < utf8.size();) {
+        size_t consumed;
+        uint32_t c = single_utf8_to_utf32(utf8.data() + i, utf8.size() - i, consumed).ensure();
+
+        utf32.push_back(c);
+        i += consumed;
+    }
+
+    return utf32;
+}
+
+static bool is_valid(std::string_view utf8) {
+    return !to_utf32(utf8).is_err();
+}
+
+static void test_validation() {
+    assert(is_valid(""));
+    assert(is_valid("hello"));
+    assert(is_valid("\xc2\x80"));                   // U+0080
+    assert(is_valid("\xe0\xa0\x80"));               // U+0800
+    assert(is_valid("\xed\x9f\xbf"));               // U+D7FF
+    assert(is_valid("\xee\x80\x80"));               // U+E000
+    assert(is_valid("\xf0\x90\x80\x80"));           // U+10000
+    assert(is_valid("\xf4\x8f\xbf\xbf"));           // U+10FFFF
+
+    // Overlong encodings
+    assert(!is_valid("\xc0\xaf"));
+    assert(!is_valid("\xc1\xbf"));
+    assert(!is_valid("\xe0\x9f\xbf"));
+    assert(!is_valid("\xf0\x8f\xbf\xbf"));
+
+    // Surrogates
+    assert(!is_valid("\xed\xa0\x80"));
+    assert(!is_valid("\xed\xbf\xbf"));
+
+    // Above U+10FFFF
+    assert(!is_valid("\xf4\x90\x80\x80"));
+    assert(!is_valid("\xf5\x80\x80\x80"));
+
+    // Truncated sequences and stray continuation bytes
+    assert(!is_valid("\xe2\x82"));
+    assert(!is_valid("abc\xf0\x9f\x98"));
+    assert(!is_valid("\x80"));
+    assert(!is_valid("\xe2\x28\xa1"));
+
+    // Errors past the ASCII fast path
+    std::string long_ascii(100, 'a');
+    assert(is_valid(long_ascii));
+    assert(!is_valid(long_ascii + "\xff" + long_ascii));
+
+    assert(to_utf32("a\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80z").ensure() == U"aé€\U0001F600z");
+}
+
+static std::string random_text(std::mt19937 &rng, size_t size, int ascii_percent) {
+    static const char *multibyte[] = { "\xc3\xa9", "\xd0\xb4", "\xe2\x82\xac", "\xe3\x81\x82", "\xf0\x9f\x98\x80" };
+
+    std::string text;
+    while (text.size() < size) {
+        if ((int)(rng() % 100) < ascii_percent) {
+            text.push_back(0x20 + rng() % 0x5f);
+        } else {
+            text += multibyte[rng() % 5];
+        }
+    }
+
+    return text;
+}
+
+static void test_random() {
+    std::mt19937 rng(1234);
+
+    std::u32string buffer;
+    for (int i = 0; i < 1000; i++) {
+        auto text = random_text(rng, rng() % 300, rng() % 101);
+
+        to_utf32(text, buffer).ensure();
+        assert(buffer == reference_to_utf32(text));
+        assert(utf32_length(text) == buffer.size());
+    }
+}
+
+template<typename F>
+static double measure_mbps(const std::string &text, F decode) {
+    const int iterations = 50;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        decode();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return text.size() * iterations / seconds / 1e6;
+}
+
+static void benchmark(const char *name, const std::string &text) {
+    size_t sink = 0;
+
+    double reference = measure_mbps(text, [&]() {
+        sink += reference_to_utf32(text).size();
+    });
+
+    std::u32string buffer;
+    double bulk = measure_mbps(text, [&]() {
+        to_utf32(text, buffer).ensure();
+        sink += buffer.size();
+    });
+
+    printf("%-12s reference %8.1f MB/s, to_utf32 %8.1f MB/s (%.1fx) [%zu]\n", name,
+        reference, bulk, bulk / reference, sink);
+}
+
+int main() {
+    test_validation();
+    test_random();
+
+    std::mt19937 rng(5678);
+
+    const size_t size = 4 << 20;
+    benchmark("ascii", random_text(rng, size, 100));
+    benchmark("mostly ascii", random_text(rng, size, 95));
+    benchmark("mixed", random_text(rng, size, 50));
+    benchmark("multibyte", random_text(rng, size, 0));
+
+    return 0;
+}
@@ -3,98 +3,334 @@
 #include <cstddef>
 #include <cstdint>
 
+#if defined(__x86_64__) || defined(__i386__)
+#define REIMU_UNICODE_X86
+#include <immintrin.h>
+#endif
+
 namespace reimu {
 
-Result<std::u32string, InvalidUTF8Sequence> to_utf32(std::string_view utf8) {
-    std::u32string utf32;
+namespace {
 
-    // Reserve enough space for the worst case
-    utf32.reserve(utf8.size());
+inline bool is_continuation(uint8_t byte) {
+    return (byte & 0xc0) == 0x80;
+}
 
-    uint8_t *data = (uint8_t *)utf8.data();
+// Decode a multi-byte sequence starting at 'in', rejecting overlong encodings,
+// surrogates and codepoints above U+10FFFF. Returns the number of bytes used, 0 if invalid
+inline size_t decode_multibyte(const uint8_t *in, size_t remaining, uint32_t &codepoint) {
+    uint8_t lead = in[0];
 
-    for (unsigned i = 0; i < utf8.size(); i++) {
-        uint32_t u8 = data[i];
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        if (remaining < 2 || !is_continuation(in[1])) {
+            return 0;
+        }
 
-        int codepoint_size = 1;
-        if ((u8 & 0x80) == 0) {
-            codepoint_size = 1;
-        } else if ((u8 & 0xe0) == 0xc0) {
-            codepoint_size = 2;
-        } else if ((u8 & 0xf0) == 0xe0) {
-            codepoint_size = 3;
-        } else if ((u8 & 0xf8) == 0xf0) {
-            codepoint_size = 4;
-        } else {
-            return ERR({});
+        codepoint = ((lead & 0x1f) << 6) | (in[1] & 0x3f);
+        return 2;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        if (remaining < 3 || !is_continuation(in[2])) {
+            return 0;
+        }
+
+        // E0 must be followed by A0-BF to not be overlong, ED by 80-9F to not be a surrogate
+        uint8_t min = lead == 0xe0 ? 0xa0 : 0x80;
+        uint8_t max = lead == 0xed ? 0x9f : 0xbf;
+        if (in[1] < min || in[1] > max) {
+            return 0;
+        }
+
+        codepoint = ((lead & 0xf) << 12) | ((in[1] & 0x3f) << 6) | (in[2] & 0x3f);
+        return 3;
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        if (remaining < 4 || !is_continuation(in[2]) || !is_continuation(in[3])) {
+            return 0;
+        }
+
+        // F0 must be followed by 90-BF to not be overlong, F4 by 80-8F to stay below U+110000
+        uint8_t min = lead == 0xf0 ? 0x90 : 0x80;
+        uint8_t max = lead == 0xf4 ? 0x8f : 0xbf;
+        if (in[1] < min || in[1] > max) {
+            return 0;
+        }
+
+        codepoint = ((lead & 0x7) << 18) | ((in[1] & 0x3f) << 12) | ((in[2] & 0x3f) << 6)
+            | (in[3] & 0x3f);
+        return 4;
+    }
+
+    // Continuation bytes, C0, C1 and F5-FF can never start a sequence
+    return 0;
+}
+
+// Widens the run of ASCII at the start of 'in', returns the number of bytes converted.
+// Called when in[0] is ASCII
+using ConvertASCIIFn = size_t (*)(const uint8_t *in, size_t len, char32_t *out);
+
+// Counts the bytes in 'in' which are not continuation bytes
+using CountCodepointsFn = size_t (*)(const uint8_t *in, size_t len);
+
+size_t convert_ascii_scalar(const uint8_t *in, size_t len, char32_t *out) {
+    size_t i = 0;
+    while (i < len && in[i] < 0x80) {
+        out[i] = in[i];
+        i++;
+    }
+
+    return i;
+}
+
+size_t count_codepoints_scalar(const uint8_t *in, size_t len) {
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++) {
+        count += !is_continuation(in[i]);
+    }
+
+    return count;
+}
+
+#ifdef REIMU_UNICODE_X86
+
+__attribute__((target("sse2")))
+size_t convert_ascii_sse2(const uint8_t *in, size_t len, char32_t *out) {
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    while (i + 16 <= len) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(in + i));
+
+        uint32_t mask = _mm_movemask_epi8(bytes);
+        if (mask) {
+            // Only convert up to the first non-ASCII byte
+            size_t run = __builtin_ctz(mask);
+            return i + convert_ascii_scalar(in + i, run, out + i);
+        }
+
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+
+        __m128i *dest = (__m128i *)(out + i);
+        _mm_storeu_si128(dest + 0, _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(dest + 2, _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(dest + 3, _mm_unpackhi_epi16(hi, zero));
+
+        i += 16;
+    }
+
+    return i + convert_ascii_scalar(in + i, len - i, out + i);
+}
+
+__attribute__((target("avx2")))
+size_t convert_ascii_avx2(const uint8_t *in, size_t len, char32_t *out) {
+    size_t i = 0;
+    while (i + 32 <= len) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(in + i));
+
+        uint32_t mask = _mm256_movemask_epi8(bytes);
+        if (mask) {
+            size_t run = __builtin_ctz(mask);
+            _mm256_zeroupper();
+            return i + convert_ascii_scalar(in + i, run, out + i);
+        }
+
+        __m128i lo = _mm256_castsi256_si128(bytes);
+        __m128i hi = _mm256_extracti128_si256(bytes, 1);
+
+        __m256i *dest = (__m256i *)(out + i);
+        _mm256_storeu_si256(dest + 0, _mm256_cvtepu8_epi32(lo));
+        _mm256_storeu_si256(dest + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+        _mm256_storeu_si256(dest + 2, _mm256_cvtepu8_epi32(hi));
+        _mm256_storeu_si256(dest + 3, _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+
+        i += 32;
+    }
+
+    // Leave the upper halves clean for the SSE2 tail, GCC doesn't do this before tail calls
+    _mm256_zeroupper();
+    return i + convert_ascii_sse2(in + i, len - i, out + i);
+}
+
+__attribute__((target("sse2")))
+size_t count_codepoints_sse2(const uint8_t *in, size_t len) {
+    // Continuation bytes are 0x80-0xbf, which as signed bytes are below -64
+    const __m128i threshold = _mm_set1_epi8(-64);
+
+    size_t continuations = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(in + i));
+
+        uint32_t mask = _mm_movemask_epi8(_mm_cmplt_epi8(bytes, threshold));
+        continuations += __builtin_popcount(mask);
+    }
+
+    return i - continuations + count_codepoints_scalar(in + i, len - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t count_codepoints_avx2(const uint8_t *in, size_t len) {
+    const __m256i threshold = _mm256_set1_epi8(-64);
+
+    size_t continuations = 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(in + i));
+
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(threshold, bytes));
+        continuations += __builtin_popcount(mask);
+    }
+
+    _mm256_zeroupper();
+    return i - continuations + count_codepoints_sse2(in + i, len - i);
+}
+
+ConvertASCIIFn select_convert_ascii() {
+    if (__builtin_cpu_supports("avx2")) {
+        return convert_ascii_avx2;
+    }
+
+    return convert_ascii_sse2;
+}
+
+CountCodepointsFn select_count_codepoints() {
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return count_codepoints_avx2;
+    }
+
+    return count_codepoints_sse2;
+}
+
+#else
+
+ConvertASCIIFn select_convert_ascii() {
+    return convert_ascii_scalar;
+}
+
+CountCodepointsFn select_count_codepoints() {
+    return count_codepoints_scalar;
+}
+
+#endif
+
+const ConvertASCIIFn convert_ascii = select_convert_ascii();
+const CountCodepointsFn count_codepoints = select_count_codepoints();
+
+}
+
+size_t utf32_length(std::string_view utf8) {
+    return count_codepoints((const uint8_t *)utf8.data(), utf8.size());
+}
+
+Result<size_t, InvalidUTF8Sequence> to_utf32(std::string_view utf8, char32_t *utf32) {
+    const uint8_t *in = (const uint8_t *)utf8.data();
+    const uint8_t *end = in + utf8.size();
+
+    char32_t *out = utf32;
+
+    while (in < end) {
+        if (*in < 0x80) {
+            size_t n = convert_ascii(in, end - in, out);
+            in += n;
+            out += n;
+            continue;
         }
 
-        if (i + codepoint_size > utf8.size()) {
+        uint32_t codepoint;
+        size_t n = decode_multibyte(in, end - in, codepoint);
+        if (n == 0) {
             return ERR({});
         }
 
-        switch (codepoint_size) {
-        case 1:
-            utf32.push_back(u8);
-            break;
-        case 2:
-            utf32.push_back(((u8 & 0x1f) << 6) | (data[i + 1] & 0x3f));
-            i++;
-            break;
-        case 3:
-            utf32.push_back(((u8 & 0xf) << 12) | ((data[i + 1] & 0x3f) << 6)
-                | (data[i + 2] & 0x3f));
-            i += 2;
-            break;
-        case 4:
-            utf32.push_back(((u8 & 0x7) << 18) | ((data[i + 1] & 0x3f) << 12)
-                | ((data[i + 2] & 0x3f) << 6) | (data[i + 3] & 0x3f));
-            i += 3;
-            break;
+        *(out++) = codepoint;
+        in += n;
+    }
+
+    return OK((size_t)(out - utf32));
+}
+
+Result<void, InvalidUTF8Sequence> to_utf32(std::string_view utf8, std::u32string &utf32) {
+    bool is_valid = true;
+
+    // Decoded straight into the string, which keeps its capacity between calls
+    utf32.resize_and_overwrite(utf32_length(utf8), [&](char32_t *buffer, size_t) -> size_t {
+        auto r = to_utf32(utf8, buffer);
+        if (r.is_err()) {
+            is_valid = false;
+            return 0;
         }
+
+        return r.move_val();
+    });
+
+    if (!is_valid) {
+        return ERR({});
     }
 
+    return OK();
+}
+
+Result<std::u32string, InvalidUTF8Sequence> to_utf32(std::string_view utf8) {
+    std::u32string utf32;
+    TRY(to_utf32(utf8, utf32));
+
     return OK(utf32);
 }
 
 Optional<uint32_t> single_utf8_to_utf32(const char *utf8, size_t n, size_t &consumed) {
-    uint8_t *data = (uint8_t *)utf8;
-
-    uint32_t u8 = data[0];
-
-    int codepoint_size = 1;
-    if ((u8 & 0x80) == 0) {
-        codepoint_size = 1;
-    } else if ((u8 & 0xe0) == 0xc0) {
-        codepoint_size = 2;
-    } else if ((u8 & 0xf0) == 0xe0) {
-        codepoint_size = 3;
-    } else if ((u8 & 0xf8) == 0xf0) {
-        codepoint_size = 4;
-    } else {
+    const uint8_t *data = (const uint8_t *)utf8;
+
+    if (n == 0) {
         return OPT_NONE;
     }
 
-    if (codepoint_size > n) {
+    if (data[0] < 0x80) {
+        consumed = 1;
+        return OPT_SOME((uint32_t)data[0]);
+    }
+
+    uint32_t codepoint;
+    size_t size = decode_multibyte(data, n, codepoint);
+    if (size == 0) {
         return OPT_NONE;
     }
 
-    consumed = codepoint_size;
-
-    switch (codepoint_size) {
-    case 1:
-        return OPT_SOME(u8);
-    case 2:
-        return OPT_SOME(((u8 & 0x1f) << 6) | (data[1] & 0x3f));
-    case 3:
-        return OPT_SOME(((u8 & 0xf) << 12) | ((data[1] & 0x3f) << 6)
-            | (data[2] & 0x3f));
-    case 4:
-        return OPT_SOME(((u8 & 0x7) << 18) | ((data[1] & 0x3f) << 12)
-            | ((data[2] & 0x3f) << 6) | (data[3] & 0x3f));
+    consumed = size;
+    return OPT_SOME(codepoint);
+}
+
+size_t utf32_to_utf8(uint32_t codepoint, char *utf8) {
+    if (codepoint < 0x80) {
+        utf8[0] = codepoint;
+        return 1;
+    } else if (codepoint < 0x800) {
+        utf8[0] = 0xc0 | (codepoint >> 6);
+        utf8[1] = 0x80 | (codepoint & 0x3f);
+        return 2;
+    } else if (codepoint < 0x10000) {
+        utf8[0] = 0xe0 | (codepoint >> 12);
+        utf8[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+        utf8[2] = 0x80 | (codepoint & 0x3f);
+        return 3;
     }
 
-    return OPT_NONE;
+    utf8[0] = 0xf0 | (codepoint >> 18);
+    utf8[1] = 0x80 | ((codepoint >> 12) & 0x3f);
+    utf8[2] = 0x80 | ((codepoint >> 6) & 0x3f);
+    utf8[3] = 0x80 | (codepoint & 0x3f);
+    return 4;
+}
+
+bool is_grapheme_extend(uint32_t codepoint) {
+    return (codepoint >= 0x300 && codepoint <= 0x36f)      // Combining diacritical marks
+        || (codepoint >= 0x1ab0 && codepoint <= 0x1aff)
+        || (codepoint >= 0x1dc0 && codepoint <= 0x1dff)
+        || (codepoint >= 0x20d0 && codepoint <= 0x20ff)    // Combining marks for symbols
+        || (codepoint >= 0xfe20 && codepoint <= 0xfe2f)    // Combining half marks
+        || (codepoint >= 0xfe00 && codepoint <= 0xfe0f)    // Variation selectors
+        || (codepoint >= 0xe0100 && codepoint <= 0xe01ef)
+        || (codepoint >= 0x1f3fb && codepoint <= 0x1f3ff)  // Emoji skin tone modifiers
+        || codepoint == 0x200c || codepoint == 0x200d;     // ZWNJ and ZWJ
 }
 
 }
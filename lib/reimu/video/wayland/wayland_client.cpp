@@ -64,6 +64,8 @@ static void keyboard_modifiers(void *data, struct wl_keyboard *keyboard, uint32_
 static void keyboard_repeat_info(void *data, struct wl_keyboard *keyboard, int32_t rate,
         int32_t delay);
 
+static void frame_done(void *data, struct wl_callback *callback, uint32_t time);
+
 static void output_geometry(void *data, struct wl_output *wl_output, int32_t x, int32_t y,
         int32_t physical_width, int32_t physical_height, int32_t subpixel, const char *make,
         const char *model, int32_t transform);
@@ -123,6 +125,10 @@ static const wl_keyboard_listener keyboard_listener = {
     .repeat_info = keyboard_repeat_info
 };
 
+static const wl_callback_listener frame_listener = {
+    .done = frame_done
+};
+
 static const wl_output_listener output_listener = {
     .geometry = output_geometry,
     .mode = output_mode,
@@ -173,6 +179,40 @@ reimu::video::Window *WaylandDriver::window_create(const reimu::Vector2i &size)
     return win;
 }
 
+void WaylandWindow::render() {
+    if (!m_renderer) {
+        return;
+    }
+
+    // Presenting commits the surface, which sends the request with the frame.
+    // Headless renderers never commit, so their frames are drawn as soon as they're requested
+    bool is_new_callback = !frame_callback && !m_renderer->is_headless();
+    if (is_new_callback) {
+        frame_callback = wl_surface_frame(surface);
+        wl_callback_add_listener(frame_callback, &frame_listener, this);
+    }
+
+    // Without a commit the callback is never done, and would hold back every later frame
+    if (!m_renderer->render() && is_new_callback) {
+        wl_callback_destroy(frame_callback);
+        frame_callback = nullptr;
+    }
+}
+
+void WaylandWindow::request_frame() {
+    if (frame_ready) {
+        return;
+    }
+
+    // Hidden windows get no callback, so they don't render until shown
+    if (frame_callback) {
+        frame_requested = true;
+        return;
+    }
+
+    dispatch_event("wm_frame"_hashid);
+}
+
 int WaylandDriver::get_window_client_handle() {
     return wl_display_get_fd(display);
 }
@@ -184,6 +224,12 @@ void WaylandDriver::window_client_dispatch() {
         if (win->has_event()) {
             win->dispatch_event("wm_input"_hashid);
         }
+
+        // After input, so frames requested by it are merged into this one
+        if (win->frame_ready) {
+            win->frame_ready = false;
+            win->dispatch_event("wm_frame"_hashid);
+        }
     }
 
     wl_display_flush(display);
@@ -548,6 +594,7 @@ static void keyboard_key(void *data, struct wl_keyboard *keyboard, uint32_t seri
     if (win && state == WL_KEYBOARD_KEY_STATE_PRESSED) {
         // To turn an evdev code into an xkb code, we need to add 8???
         auto xkb_key = xkb_state_key_get_one_sym(d->xkb_state, key + 8);
+        d->keyboard_event.codepoint = xkb_state_key_get_utf32(d->xkb_state, key + 8);
 
         uint32_t key = xkb_keysym_to_reimu_keycode(xkb_key);
 
@@ -581,6 +628,18 @@ static void keyboard_repeat_info(void *data, struct wl_keyboard *keyboard, int32
     auto *d = (WaylandDriver *)data;
 }
 
+static void frame_done(void *data, struct wl_callback *callback, uint32_t) {
+    auto *win = (WaylandWindow *)data;
+
+    wl_callback_destroy(callback);
+    win->frame_callback = nullptr;
+
+    if (win->frame_requested) {
+        win->frame_requested = false;
+        win->frame_ready = true;
+    }
+}
+
 static reimu::Vector2u output_size;
 
 static void output_geometry(void *data, struct wl_output *wl_output, int32_t x, int32_t y,
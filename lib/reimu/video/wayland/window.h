@@ -16,6 +16,10 @@ public:
             surface(surface), xdg_surface(xdg_surface), xdg_toplevel(xdg_toplevel), size(size) {}
 
     ~WaylandWindow() {
+        if (frame_callback) {
+            wl_callback_destroy(frame_callback);
+        }
+
         xdg_toplevel_destroy(xdg_toplevel);
         xdg_surface_destroy(xdg_surface);
         wl_surface_destroy(surface);
@@ -47,11 +51,8 @@ public:
         return size;
     }
 
-    void render() override {
-        if (m_renderer) {
-            m_renderer->render();
-        }
-    }
+    void render() override;
+    void request_frame() override;
 
     void show_window() override {
 
@@ -89,4 +90,11 @@ public:
     struct xdg_toplevel *xdg_toplevel;
 
     reimu::Vector2i size;
+
+    // Callback of the last frame, done when the compositor wants the next one
+    wl_callback *frame_callback = nullptr;
+    // A frame was requested while waiting for the callback
+    bool frame_requested = false;
+    // Send 'wm_frame' after dispatching Wayland events
+    bool frame_ready = false;
 };
@@ -190,6 +190,26 @@ LRESULT CALLBACK window_proc(HWND hwnd, UINT msg, WPARAM w_param, LPARAM l_param
 
         break;
     } case WM_CHAR: {
+        // Characters outside the BMP arrive as two UTF-16 surrogates
+        static uint32_t high_surrogate = 0;
+
+        uint32_t unit = (uint32_t)w_param;
+        if (unit >= 0xd800 && unit < 0xdc00) {
+            high_surrogate = unit;
+            break;
+        }
+
+        uint32_t codepoint = unit;
+        if (unit >= 0xdc00 && unit < 0xe000) {
+            if (!high_surrogate) {
+                break;
+            }
+
+            codepoint = 0x10000 + ((high_surrogate - 0xd800) << 10) + (unit - 0xdc00);
+        }
+
+        high_surrogate = 0;
+
         reimu::video::KeyboardEvent event;
 
         event.is_ctrl = GetAsyncKeyState(VK_CONTROL) != 0;
@@ -198,7 +218,8 @@ LRESULT CALLBACK window_proc(HWND hwnd, UINT msg, WPARAM w_param, LPARAM l_param
         event.is_win = GetAsyncKeyState(VK_LWIN) != 0;
         event.is_down = true;
 
-        event.key = (reimu::video::Key)w_param;
+        event.key = (reimu::video::Key)codepoint;
+        event.codepoint = codepoint;
 
         win->queue_input_event({
             .type = reimu::video::InputEvent::Keyboard,
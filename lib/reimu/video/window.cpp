@@ -21,6 +21,12 @@ Result<Window *, ReimuError> Window::create(const Vector2i &size) {
 void Window::set_size(const Vector2i &size) {
     if (m_renderer)
         m_renderer->resize_viewport(size);
+
+    dispatch_event("wm_resize"_hashid);
+}
+
+void Window::request_frame() {
+    dispatch_event("wm_frame"_hashid);
 }
 
 }
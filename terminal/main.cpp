@@ -237,6 +237,9 @@ public:
         auto win = gui::Window::create({96*8, 52*16}).ensure();
         win->set_title("reimu-terminal");
 
+        // Typing should show up without waiting behind frames in a queue
+        win->set_present_mode(graphics::PresentMode::Mailbox);
+
         auto res_mgr = win->resource_manager();
 
         auto font_or_err = res_mgr->load_from_file<graphics::Font>("monospace.ttf", "font_terminal"_hashid);
@@ -247,12 +250,31 @@ public:
 
         auto font = font_or_err.ensure();
 
+        // Keep rasterized glyphs between runs to speed up startup
+        std::string glyph_cache_dir;
+        if (auto cache_path = os::cache_path(); !cache_path.is_err()) {
+            glyph_cache_dir = cache_path.move_val() + "/glyphs";
+            font->enable_disk_cache(glyph_cache_dir);
+        }
+
         m_window = std::unique_ptr<gui::Window>{ win };
 
         auto *root = &m_window->root();
         root->layout.layout_direction = gui::LayoutDirection::Horizontal;
 
         auto *terminal_widget = new gui::TerminalWidget(font);
+
+        // Optional font for codepoints the terminal font does not cover
+        auto fallback_or_err = res_mgr->load_from_file<graphics::Font>("fallback.ttf", "font_fallback"_hashid);
+        if (!fallback_or_err.is_err()) {
+            auto fallback = fallback_or_err.ensure();
+            if (!glyph_cache_dir.empty()) {
+                fallback->enable_disk_cache(glyph_cache_dir);
+            }
+
+            terminal_widget->set_fallback_fonts({ std::move(fallback) });
+        }
+
         terminal_widget->layout.width = terminal_widget->layout.height = gui::Size::inherit();
 
         terminal_widget->bind_event_callback("on_key_down"_hashid, [this]() {
@@ -400,7 +422,8 @@ public:
             }
         }
 
-        m_window->render();
+        // Output often arrives in many small reads, which are drawn together
+        m_window->request_render();
     }
 
     std::vector<int> parse_params(int empty_value_default) {